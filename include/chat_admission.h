@@ -0,0 +1,78 @@
+/**
+ * @file chat_admission.h
+ * @brief Limitador de admisión de conexiones nuevas
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cubetas de tokens por IP de origen y global: cada conexión aceptada
+ * consume un token y las cubetas se rellenan a la tasa configurada hasta
+ * su ráfaga máxima. Una tormenta de reconexiones se admite al ritmo que el
+ * servidor puede absorber en lugar de saturar los handshakes.
+ *
+ * Las cubetas por IP viven en una tabla de tamaño fijo con sondeo lineal
+ * acotado; si no hay hueco se reutiliza la entrada más antigua de la
+ * ventana, que con toda probabilidad ya estaba llena.
+ * 
+ * El mismo limitador, sin cubeta global, acota con --msg-ip-rate los
+ * mensajes de todas las conexiones de una IP. Como entonces se consulta
+ * en el camino de los mensajes, la tabla se reparte en franjas con su
+ * propio mutex y dos IPs distintas rara vez compiten por el mismo.
+ */
+
+#ifndef CHAT_ADMISSION_H
+#define CHAT_ADMISSION_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DE ADMISIÓN ========== */
+
+#define ADMISSION_TABLE_SIZE    4096        /* Cubetas por IP (potencia de 2) */
+#define ADMISSION_PROBE         8           /* Entradas revisadas por búsqueda */
+#define ADMISSION_STRIPES       64          /* Franjas de la tabla con mutex propio */
+#define ADMISSION_DEFAULT_BURST 10          /* Ráfaga por IP por defecto */
+#define ADMISSION_MESSAGE_BURST 20          /* Ráfaga de mensajes por defecto */
+
+/* ========== ESTRUCTURAS DE ADMISIÓN ========== */
+
+typedef struct admission admission_t;
+
+/* ========== PROTOTIPOS DE ADMISIÓN ========== */
+
+/**
+ * @brief Rellena una cubeta e intenta consumir un token
+ * 
+ * No toma ningún lock: el llamador serializa el acceso a la cubeta.
+ * 
+ * @param bucket Cubeta (a cero se llena en el primer uso)
+ * @param rate Tokens por segundo
+ * @param burst Tokens que caben en la cubeta
+ * @param now_ms Tiempo monótono actual en milisegundos
+ * @return 1 si había token, 0 si no
+ */
+int token_bucket_take(token_bucket_t *bucket, int rate, int burst, long long now_ms);
+
+/**
+ * @brief Crea un limitador de admisión
+ * @param per_ip_rate Conexiones por segundo por IP (0 = sin límite por IP)
+ * @param per_ip_burst Conexiones seguidas que admite una IP con la cubeta llena
+ * @param global_rate Conexiones por segundo en total (0 = sin límite global)
+ * @return Limitador o NULL si no hay ningún límite o falta memoria
+ */
+admission_t *admission_create(int per_ip_rate, int per_ip_burst, int global_rate);
+
+/**
+ * @brief Consume un token para una conexión nueva
+ * @param admission Limitador (NULL admite siempre)
+ * @param addr Dirección de origen de la conexión
+ * @param now_ms Tiempo monótono actual en milisegundos
+ * @return 1 si se admite, 0 si debe rechazarse
+ */
+int admission_allow(admission_t *admission, const struct sockaddr_in *addr, long long now_ms);
+
+/**
+ * @brief Libera un limitador de admisión
+ * @param admission Limitador (NULL no hace nada)
+ */
+void admission_destroy(admission_t *admission);
+
+#endif /* CHAT_ADMISSION_H */
@@ -0,0 +1,134 @@
+/**
+ * @file chat_bench.h
+ * @brief Generador de carga y medición de latencia para el servidor de chat
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Simula miles de clientes desde un único thread con epoll. Todos hablan
+ * el protocolo real (MSG_CONNECT con negociación de formato y MSG_CHAT);
+ * los emisores escriben a una tasa fija y cada mensaje lleva su instante
+ * de envío, de modo que cada receptor mide la latencia extremo a extremo
+ * del fan-out del servidor. Con --rooms los clientes se reparten entre
+ * varias salas y cada mensaje solo llega a los miembros de la suya.
+ * Con --tls cada cliente hace el handshake TLS antes del MSG_CONNECT y
+ * reanuda la sesión del primero, como una tormenta de reconexiones.
+ * Con --batch cada emisor agrupa sus mensajes de una vuelta del bucle de
+ * envío en frames de lote, como un bot puente con --batch-ms.
+ */
+
+#ifndef CHAT_BENCH_H
+#define CHAT_BENCH_H
+
+#include "chat_common.h"
+#include "chat_frame.h"
+#include "chat_tls.h"
+
+/* ========== CONSTANTES DEL BENCHMARK ========== */
+
+#define BENCH_DEFAULT_CLIENTS   100         /* Clientes simulados */
+#define BENCH_DEFAULT_RATE      1000        /* Mensajes por segundo (total) */
+#define BENCH_DEFAULT_DURATION  10          /* Segundos medidos */
+#define BENCH_DEFAULT_WARMUP    2           /* Segundos de calentamiento sin medir */
+#define BENCH_DEFAULT_PAYLOAD   64          /* Bytes de contenido por mensaje */
+#define BENCH_RX_BUFFER_SIZE    16384       /* Buffer de recepción por cliente */
+#define BENCH_TX_LIMIT          (1024 * 1024) /* Bytes pendientes a partir de los que un emisor espera */
+#define BENCH_CONNECT_TIMEOUT   30          /* Segundos para completar todos los handshakes */
+#define BENCH_CONNECT_BATCH     8           /* Handshakes en curso a la vez (< backlog de listen) */
+#define BENCH_SETTLE_MS         500         /* Silencio tras los handshakes antes de medir */
+#define BENCH_DRAIN_MS          3000        /* Espera máxima de entregas tras el último envío */
+#define BENCH_MAX_EVENTS        256         /* Eventos por llamada a epoll_wait */
+#define BENCH_USER_PREFIX       "bench"     /* Prefijo de los usuarios simulados */
+#define BENCH_ROOM_PREFIX       "benchsala" /* Prefijo de las salas con --rooms */
+#define BENCH_BATCH_BYTES       (16 * 1024) /* Frames como máximo por lote con --batch */
+
+/* Histograma log-lineal: 8 subdivisiones por potencia de dos hasta 2^40 ns */
+#define BENCH_SUB_BITS          3
+#define BENCH_SUB_BUCKETS       (1 << BENCH_SUB_BITS)
+#define BENCH_MAX_EXPONENT      39
+#define BENCH_HIST_BUCKETS      ((BENCH_MAX_EXPONENT - BENCH_SUB_BITS + 2) * BENCH_SUB_BUCKETS)
+
+/* ========== ESTRUCTURAS DEL BENCHMARK ========== */
+
+/**
+ * @brief Parámetros de una ejecución
+ */
+typedef struct {
+    const char *host;                       /* IP del servidor */
+    int port;                               /* Puerto del servidor */
+    int clients;                            /* Clientes simulados */
+    int senders;                            /* Clientes que además envían */
+    int rate;                               /* Mensajes por segundo entre todos los emisores */
+    int duration;                           /* Segundos medidos */
+    int warmup;                             /* Segundos previos sin medir */
+    int payload;                            /* Bytes de contenido por mensaje */
+    int rooms;                              /* Salas entre las que se reparten los clientes */
+    wire_format_t format;                   /* Formato negociado */
+    int batch;                              /* Mensajes por lote de cada emisor (1 = sin lotes) */
+    tls_context_t *tls;                     /* Contexto TLS o NULL sin TLS */
+} bench_config_t;
+
+/**
+ * @brief Un cliente simulado
+ */
+typedef struct {
+    int fd;                                 /* Socket conectado */
+    int ready;                              /* Recibió la bienvenida del servidor */
+    int joined;                             /* Recibió la confirmación de su sala */
+    wire_format_t format;                   /* Formato de los mensajes tras el saludo */
+    frame_buffer_t rx;                      /* Bytes recibidos sin procesar */
+    char *tx;                               /* Bytes pendientes de enviar */
+    size_t tx_length;
+    size_t tx_capacity;
+    char *batch;                            /* Hueco de cabecera y frames del lote o NULL */
+    size_t batch_length;                    /* Bytes de frames en el lote */
+    int batch_count;                        /* Mensajes en el lote */
+} bench_conn_t;
+
+/**
+ * @brief Histograma de latencias en nanosegundos
+ */
+typedef struct {
+    unsigned long long buckets[BENCH_HIST_BUCKETS];
+    unsigned long long count;
+    unsigned long long max;
+    unsigned long long sum;
+} bench_histogram_t;
+
+/**
+ * @brief Contadores de una ejecución
+ */
+typedef struct {
+    unsigned long long sent;                /* Mensajes enviados (total) */
+    unsigned long long sent_measured;       /* Enviados dentro de la ventana medida */
+    unsigned long long throttled;           /* Envíos omitidos por socket saturado */
+    unsigned long long delivered;           /* Mensajes de chat recibidos (total) */
+    unsigned long long delivered_measured;  /* Recibidos enviados en la ventana medida */
+    unsigned long long expected_measured;   /* Entregas esperadas de los enviados en la ventana */
+    unsigned long long bytes_received;      /* Bytes leídos de todos los sockets */
+    unsigned long long notifications;       /* Otros frames recibidos */
+    int ready_clients;                      /* Handshakes completados */
+    int joined_clients;                     /* Clientes ya en su sala */
+    int closed_clients;                     /* Conexiones cerradas por el servidor */
+    int tls_resumed;                        /* Handshakes TLS que reanudaron sesión */
+    bench_histogram_t latency;              /* Latencia envío → recepción */
+} bench_stats_t;
+
+/* ========== PROTOTIPOS DEL BENCHMARK ========== */
+
+/**
+ * @brief Ejecuta el benchmark completo
+ * @param config Parámetros de la ejecución
+ * @return SUCCESS o código de error
+ */
+int run_benchmark(const bench_config_t *config);
+
+/**
+ * @brief Imprime los resultados de una ejecución
+ * @param config Parámetros de la ejecución
+ * @param stats Contadores acumulados
+ * @param elapsed_ns Duración real de la ventana medida
+ */
+void print_bench_report(const bench_config_t *config, const bench_stats_t *stats,
+                        unsigned long long elapsed_ns);
+
+#endif /* CHAT_BENCH_H */
@@ -6,21 +6,33 @@
  * 
  * Este archivo contiene las definiciones, estructuras y prototipos
  * específicos para el componente cliente del sistema de chat.
+ * 
+ * El cliente es de un solo thread: un bucle poll() espera a la vez la
+ * entrada estándar, el socket del servidor y un signalfd, sin despertares
+ * periódicos; en reposo no consume CPU.
+ * 
+ * Si el servidor confirmó la reanudación de sesiones, al perder la
+ * conexión el cliente reconecta y presenta su token, su sala y el último
+ * número de secuencia recibido: el servidor solo reenvía lo que se perdió.
  */
 
 #ifndef CHAT_CLIENT_H
 #define CHAT_CLIENT_H
 
 #include "chat_common.h"
+#include "chat_frame.h"
+#include "chat_tls.h"
 #include <termios.h>
-#include <sys/select.h>
-#include <sys/time.h>
 
 /* ========== CONSTANTES ESPECÍFICAS DEL CLIENTE ========== */
 
 #define INPUT_BUFFER_SIZE   512         /* Tamaño del buffer de entrada */
 #define RECONNECT_ATTEMPTS  3           /* Número de intentos de reconexión */
-#define RECONNECT_DELAY     5           /* Delay entre reconexiones en segundos */
+#define RECONNECT_DELAY     5           /* Espera máxima antes de cada intento en segundos */
+#define OUTPUT_BUFFER_SIZE  (64 * 1024) /* Salida al terminal acumulada por lote */
+#define DRAIN_MAX_READS     16          /* Lecturas del socket por lote antes de atender stdin */
+#define CLIENT_BATCH_SIZE   (16 * 1024) /* Frames de chat acumulados como máximo por lote */
+#define CLIENT_BATCH_MAX_MS 1000        /* Ventana máxima de --batch-ms */
 
 /* ========== ESTRUCTURAS ESPECÍFICAS DEL CLIENTE ========== */
 
@@ -28,35 +40,55 @@
  * @brief Contexto del cliente de chat
  * 
  * Mantiene el estado del cliente incluyendo información de conexión,
- * threads de comunicación y configuración del terminal.
+ * la línea de entrada a medio leer y configuración del terminal.
  */
 typedef struct {
     int server_socket;                      /* Socket de conexión al servidor */
     char username[USERNAME_SIZE];           /* Nombre de usuario del cliente */
     char server_ip[16];                     /* Dirección IP del servidor */
     int server_port;                        /* Puerto del servidor */
+    tls_context_t *tls;                     /* Contexto TLS o NULL para TCP en claro */
     
-    pthread_t receive_thread;               /* Thread para recibir mensajes */
-    pthread_t input_thread;                 /* Thread para manejar entrada */
+    int signal_fd;                          /* signalfd de SIGINT/SIGTERM o -1 */
+    char input[INPUT_BUFFER_SIZE];          /* Línea de entrada en curso */
+    size_t input_length;                    /* Bytes acumulados en input */
     
     int connected;                          /* Estado de conexión */
     int running;                            /* Estado de ejecución */
+    wire_format_t wire_format;              /* Formato de red para enviar */
+    char room[ROOM_NAME_SIZE];              /* Sala actual */
+    
+    /* Reanudación de la sesión (ver WIRE_RESUME_CAPABILITY) */
+    char session[SESSION_TOKEN_SIZE];       /* Token entregado por el servidor o "" */
+    unsigned long long last_sequence;       /* Último número de secuencia recibido en la sala */
+    int reconnect_attempts;                 /* Intentos desde la última sesión aceptada */
+    
+    /* Usuarios de la sala, mantenidos con MSG_PRESENCE */
+    int presence;                           /* El servidor confirmó la presencia */
+    int who_synced;                         /* who refleja la versión who_version */
+    unsigned long long who_version;         /* Versión de la sala en el servidor */
+    char (*who)[USERNAME_SIZE];             /* Nombres de los usuarios de la sala */
+    int who_count;                          /* Usuarios en who */
+    int who_capacity;                       /* Capacidad de who */
+    
+    /* Lote de mensajes de chat pendiente (ver WIRE_BATCH_CAPABILITY) */
+    int batch_ms;                           /* Ventana de acumulación o 0 sin lotes */
+    int batch;                              /* El servidor confirmó los lotes */
+    char batch_buffer[WIRE_BATCH_HEADER_MAX + CLIENT_BATCH_SIZE]; /* Hueco de cabecera y frames */
+    size_t batch_length;                    /* Bytes de frames acumulados */
+    int batch_count;                        /* Mensajes acumulados */
+    long long batch_deadline_ms;            /* Envío del lote (CLOCK_MONOTONIC) */
+    
+    /* Salida al terminal: un write() por lote de frames recibidos */
+    char output[OUTPUT_BUFFER_SIZE];        /* Líneas formateadas pendientes */
+    size_t output_length;                   /* Bytes pendientes en output */
+    time_t stamp_second;                    /* Segundo de la marca de tiempo en caché */
+    char stamp[16];                         /* "[HH:MM:SS]" de stamp_second o "" */
     
     struct termios original_termios;        /* Configuración original del terminal */
     int terminal_configured;                /* Flag de configuración del terminal */
-    
-    pthread_mutex_t output_mutex;           /* Mutex para salida thread-safe */
 } client_context_t;
 
-/**
- * @brief Argumentos para threads del cliente
- * 
- * Estructura para pasar el contexto del cliente a los threads.
- */
-typedef struct {
-    client_context_t *ctx;                  /* Contexto del cliente */
-} client_thread_args_t;
-
 /* ========== PROTOTIPOS DE FUNCIONES DEL CLIENTE ========== */
 
 /**
@@ -89,15 +121,47 @@ int connect_to_server(client_context_t *ctx);
  */
 void disconnect_from_server(client_context_t *ctx);
 
+/**
+ * @brief Serializa y envía un mensaje al servidor en el formato negociado
+ * @param ctx Contexto del cliente
+ * @param msg Mensaje a enviar
+ * @return 0 en éxito, -1 en error
+ */
+int send_message_to_server(client_context_t *ctx, const chat_message_t *msg);
+
 /**
  * @brief Envía mensaje de conexión inicial al servidor
+ * 
+ * Con un token de sesión pide reanudarla en la sala actual a partir del
+ * último número de secuencia recibido.
+ * 
  * @param ctx Contexto del cliente
  * @return 0 en éxito, -1 en error
  */
 int send_connect_message(client_context_t *ctx);
 
+/**
+ * @brief Vuelve a conectar tras perder la conexión y reanuda la sesión
+ * 
+ * Antes de cada intento espera un tiempo aleatorio de hasta
+ * RECONNECT_DELAY segundos, para que los clientes de un servidor caído
+ * no reconecten todos a la vez; una señal interrumpe la espera. Tras
+ * RECONNECT_ATTEMPTS intentos sin una sesión aceptada se rinde.
+ * 
+ * @param ctx Contexto del cliente (con token de sesión)
+ * @return 0 si se reconectó y envió el saludo, -1 si no
+ */
+int reconnect_to_server(client_context_t *ctx);
+
 /**
  * @brief Envía un mensaje de chat al servidor
+ * 
+ * Con ctx->batch_ms > 0 y lotes confirmados por el servidor, el mensaje
+ * se acumula y sale junto a los siguientes en un único frame de lote
+ * cuando vence la ventana (la cuenta el bucle de eventos), cuando el lote
+ * se llena o antes de cualquier otro mensaje. Un programa que use esta
+ * API sin client_event_loop() debe llamar a flush_chat_batch().
+ * 
  * @param ctx Contexto del cliente
  * @param message Contenido del mensaje
  * @return 0 en éxito, -1 en error
@@ -105,18 +169,28 @@ int send_connect_message(client_context_t *ctx);
 int send_chat_message(client_context_t *ctx, const char *message);
 
 /**
- * @brief Thread para recibir mensajes del servidor
- * @param args Argumentos del thread (client_thread_args_t*)
- * @return NULL
+ * @brief Envía ya los mensajes de chat acumulados
+ * 
+ * Varios mensajes viajan en un frame de lote; uno solo, como frame normal.
+ * 
+ * @param ctx Contexto del cliente
+ * @return 0 en éxito o sin mensajes pendientes, -1 en error
  */
-void *receive_thread_func(void *args);
+int flush_chat_batch(client_context_t *ctx);
 
 /**
- * @brief Thread para manejar entrada del usuario
- * @param args Argumentos del thread (client_thread_args_t*)
- * @return NULL
+ * @brief Bucle de eventos del cliente
+ * 
+ * Multiplexa con poll() la entrada estándar, el socket del servidor y el
+ * signalfd; solo despierta cuando hay algo que hacer. Al cerrarse la
+ * entrada estándar sigue recibiendo mensajes hasta una señal o hasta que
+ * el servidor cierre la conexión.
+ * 
+ * @param ctx Contexto del cliente ya conectado
+ * @return 0 al terminar por /quit, señal o cierre del servidor (entonces
+ *         ctx->connected queda a 0 y ctx->running a 1), -1 en error
  */
-void *input_thread_func(void *args);
+int client_event_loop(client_context_t *ctx);
 
 /**
  * @brief Procesa un mensaje recibido del servidor
@@ -126,12 +200,22 @@ void *input_thread_func(void *args);
 void process_server_message(client_context_t *ctx, const chat_message_t *msg);
 
 /**
- * @brief Muestra un mensaje en la consola de forma thread-safe
+ * @brief Muestra un mensaje en la consola
+ * 
+ * Solo lo formatea en ctx->output; flush_client_output() lo escribe
+ * junto con el resto del lote.
+ * 
  * @param ctx Contexto del cliente
  * @param msg Mensaje a mostrar
  */
 void display_message(client_context_t *ctx, const chat_message_t *msg);
 
+/**
+ * @brief Escribe en el terminal la salida acumulada con un solo write()
+ * @param ctx Contexto del cliente
+ */
+void flush_client_output(client_context_t *ctx);
+
 /**
  * @brief Configura el terminal para entrada no bloqueante
  * @param ctx Contexto del cliente
@@ -146,12 +230,16 @@ int setup_terminal(client_context_t *ctx);
 void restore_terminal(client_context_t *ctx);
 
 /**
- * @brief Lee una línea de entrada del usuario
- * @param buffer Buffer de salida
- * @param buffer_size Tamaño del buffer
- * @return Número de caracteres leídos
+ * @brief Lee la entrada disponible del usuario y procesa las líneas completas
+ * 
+ * Hace un único read() sobre la entrada estándar (que poll() indicó
+ * legible) y trata cada línea terminada como comando o mensaje. Una línea
+ * más larga que el buffer se procesa en trozos.
+ * 
+ * @param ctx Contexto del cliente
+ * @return 1 si se leyó algo, 0 si la entrada se cerró, -1 en error
  */
-int read_user_input(char *buffer, size_t buffer_size);
+int read_user_input(client_context_t *ctx);
 
 /**
  * @brief Procesa comandos especiales del cliente
@@ -162,36 +250,59 @@ int read_user_input(char *buffer, size_t buffer_size);
 int process_client_command(client_context_t *ctx, const char *input);
 
 /**
- * @brief Muestra la ayuda de comandos disponibles
+ * @brief Aplica a la lista de usuarios una lista completa o un cambio
+ * 
+ * Un cambio que no sigue a la versión conocida indica que se perdió
+ * alguno: se pide la lista completa y se ignoran los cambios hasta que
+ * llegue.
+ * 
+ * @param ctx Contexto del cliente
+ * @param msg MSG_PRESENCE recibido
  */
-void show_help(void);
+void apply_presence(client_context_t *ctx, const chat_message_t *msg);
 
 /**
- * @brief Muestra información de estado del cliente
+ * @brief Muestra los usuarios de la sala actual (/who)
+ * 
+ * Usa la lista local: no pregunta al servidor.
+ * 
  * @param ctx Contexto del cliente
  */
-void show_status(client_context_t *ctx);
+void show_who(const client_context_t *ctx);
 
 /**
- * @brief Manejador de señales para el cliente
- * @param sig Número de señal recibida
+ * @brief Muestra la ayuda de comandos disponibles
  */
-void client_signal_handler(int sig);
+void show_help(void);
 
 /**
- * @brief Configura manejadores de señales para el cliente
+ * @brief Muestra información de estado del cliente
  * @param ctx Contexto del cliente
  */
-void setup_client_signal_handlers(client_context_t *ctx);
+void show_status(client_context_t *ctx);
+
+/**
+ * @brief Configura las señales del cliente
+ * 
+ * Bloquea SIGINT y SIGTERM y las entrega por un signalfd que el bucle de
+ * eventos espera junto al resto; SIGPIPE se ignora.
+ * 
+ * @param ctx Contexto del cliente (recibe el signalfd)
+ * @return 0 en éxito, -1 en error
+ */
+int setup_client_signals(client_context_t *ctx);
 
 /**
  * @brief Función principal del cliente
  * @param username Nombre de usuario
  * @param server_ip Dirección IP del servidor
  * @param server_port Puerto del servidor
+ * @param tls Contexto TLS (ver chat_tls.h) o NULL para TCP en claro
+ * @param batch_ms Ventana de acumulación de mensajes de chat (0 = sin lotes)
  * @return 0 en éxito, código de error en fallo
  */
-int run_client(const char *username, const char *server_ip, int server_port);
+int run_client(const char *username, const char *server_ip, int server_port,
+               tls_context_t *tls, int batch_ms);
 
 /**
  * @brief Muestra mensaje de bienvenida y comandos básicos
@@ -0,0 +1,89 @@
+/**
+ * @file chat_client_table.h
+ * @brief Tabla dinámica de clientes con índices por socket y por nombre
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Sustituye al array fijo de clientes. Mantiene tres vistas de los mismos
+ * client_info_t:
+ * - Un array denso de clientes activos, recorrido por el broadcast sin
+ *   saltar huecos; las bajas se hacen intercambiando con el último.
+ * - Un índice por descriptor de socket para búsquedas en O(1).
+ * - Una tabla hash de nombres de usuario para detectar duplicados en O(1).
+ *
+ * La tabla no tiene lock propio: el llamador debe tener clients_mutex.
+ */
+
+#ifndef CHAT_CLIENT_TABLE_H
+#define CHAT_CLIENT_TABLE_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DE LA TABLA ========== */
+
+#define CLIENT_TABLE_INITIAL    64          /* Capacidad inicial de cada índice */
+
+/* ========== ESTRUCTURAS DE LA TABLA ========== */
+
+/**
+ * @brief Tabla de clientes conectados
+ */
+typedef struct client_table {
+    client_info_t **active;                 /* Clientes activos contiguos */
+    int count;                              /* Número de clientes activos */
+    int capacity;                           /* Capacidad del array denso */
+    client_info_t **by_fd;                  /* Índice por descriptor de socket */
+    int fd_capacity;                        /* Tamaño del índice por socket */
+    client_info_t **name_buckets;           /* Cubetas del hash de nombres */
+    size_t bucket_count;                    /* Número de cubetas (potencia de 2) */
+} client_table_t;
+
+/* ========== PROTOTIPOS DE LA TABLA ========== */
+
+/**
+ * @brief Crea una tabla vacía
+ * @return Tabla nueva o NULL si no hay memoria
+ */
+client_table_t *client_table_create(void);
+
+/**
+ * @brief Libera la tabla (no libera los clientes que contenga)
+ * @param table Tabla de clientes
+ */
+void client_table_destroy(client_table_t *table);
+
+/**
+ * @brief Inserta un cliente en los tres índices
+ *
+ * El socket y el nombre del cliente no deben estar ya en la tabla.
+ *
+ * @param table Tabla de clientes
+ * @param client Cliente a insertar
+ * @return SUCCESS o ERROR_MEMORY
+ */
+int client_table_insert(client_table_t *table, client_info_t *client);
+
+/**
+ * @brief Quita un cliente de los tres índices en O(1)
+ * @param table Tabla de clientes
+ * @param client Cliente a quitar
+ */
+void client_table_remove(client_table_t *table, client_info_t *client);
+
+/**
+ * @brief Busca un cliente por su socket
+ * @param table Tabla de clientes
+ * @param socket_fd Socket del cliente
+ * @return Cliente o NULL si no está
+ */
+client_info_t *client_table_find_fd(const client_table_t *table, int socket_fd);
+
+/**
+ * @brief Busca un cliente por su nombre de usuario
+ * @param table Tabla de clientes
+ * @param username Nombre de usuario
+ * @return Cliente o NULL si no está
+ */
+client_info_t *client_table_find_name(const client_table_t *table, const char *username);
+
+#endif /* CHAT_CLIENT_TABLE_H */
@@ -0,0 +1,124 @@
+/**
+ * @file chat_cluster.h
+ * @brief Modo clúster: bus de mensajes entre nodos del servidor
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Varios procesos chat_server forman un clúster en malla completa: cada
+ * nodo abre un enlace TCP persistente hacia cada par indicado con --peer
+ * y escucha en --cluster-port los enlaces de los demás. Los mensajes de
+ * chat y los avisos de presencia de una sala se reenvían a los pares; el
+ * nodo que los recibe hace su propio fan-out local y nunca los reenvía,
+ * así cada mensaje cruza cada enlace una sola vez.
+ *
+ * Cada enlace saliente tiene su thread y un buffer de pendientes: los
+ * productores solo copian el frame ya serializado bajo el lock del enlace
+ * y el thread envía de una vez todo lo acumulado mientras escribía el
+ * lote anterior, sin esperar acuses (lotes en tubería). Un único thread
+ * atiende todos los enlaces entrantes.
+ *
+ * Frame entre nodos (enteros en orden de red):
+ *
+ *   [CLUSTER_MAGIC][CLUSTER_VERSION][uint32 longitud del cuerpo]
+ *   cuerpo: uint8 longitud + nombre de sala, frame compacto del mensaje
+ *
+ * Los nodos se autentican con un secreto compartido (--cluster-secret-file).
+ * Al aceptar un enlace, el nodo que escucha envía un reto (MSG_CONNECT sin
+ * sala con un nonce aleatorio); el primer frame del que conecta es el
+ * saludo, con el identificador del nodo de origen y
+ * HMAC-SHA256(secreto, "nonce nodo"). Hasta que el saludo es válido no se
+ * entrega ningún mensaje, y un enlace sin saludar se cierra pasado
+ * CLUSTER_HANDSHAKE_MS. El identificador permite además descartar un
+ * enlace de un nodo consigo mismo.
+ *
+ * Con TLS activado (--tls-cert) los enlaces también van por TLS con kTLS:
+ * el que escucha usa el certificado del servidor y el que conecta lo
+ * verifica contra --cluster-ca (o las CAs del sistema), de modo que nadie
+ * en el camino puede leer los mensajes ni retransmitir el saludo.
+ */
+
+#ifndef CHAT_CLUSTER_H
+#define CHAT_CLUSTER_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DEL CLÚSTER ========== */
+
+#define CLUSTER_MAX_PEERS       16          /* Pares configurables con --peer */
+#define CLUSTER_MAX_INBOUND     (2 * CLUSTER_MAX_PEERS) /* Enlaces entrantes simultáneos */
+#define CLUSTER_MAGIC           0xC7        /* Primer byte de un frame entre nodos */
+#define CLUSTER_VERSION         2           /* Versión del protocolo entre nodos */
+#define CLUSTER_HEADER_SIZE     6           /* Magic, versión y longitud */
+#define CLUSTER_MAX_FRAME       (CLUSTER_HEADER_SIZE + 1 + ROOM_NAME_SIZE + WIRE_MAX_FRAME_SIZE)
+#define CLUSTER_QUEUE_BYTES     (1024 * 1024) /* Pendientes por enlace antes de descartar */
+#define CLUSTER_RECV_BUFFER     65536       /* Buffer de recepción por enlace entrante */
+#define CLUSTER_SEND_TIMEOUT_MS 5000        /* Espera máxima de connect() y de cada envío */
+#define CLUSTER_RETRY_MIN_MS    100         /* Primera espera antes de reconectar */
+#define CLUSTER_RETRY_MAX_MS    5000        /* Espera máxima entre reconexiones */
+#define CLUSTER_POLL_MS         250         /* Espera del thread de enlaces entrantes */
+#define CLUSTER_HOST_SIZE       256         /* Longitud máxima de HOST en --peer */
+#define CLUSTER_DEFAULT_ADDRESS "127.0.0.1" /* Interfaz de los enlaces entrantes por defecto */
+#define CLUSTER_HANDSHAKE_MS    5000        /* Espera máxima del reto y del saludo */
+#define CLUSTER_NONCE_SIZE      32          /* Bytes aleatorios de cada reto */
+#define CLUSTER_SECRET_MIN      16          /* Longitud mínima del secreto compartido */
+#define CLUSTER_SECRET_MAX      256         /* Longitud máxima del secreto compartido */
+
+/* ========== ESTRUCTURAS DEL CLÚSTER ========== */
+
+typedef struct cluster cluster_t;
+
+/**
+ * @brief Configuración del clúster
+ */
+typedef struct {
+    const char *address;                    /* Interfaz de los enlaces entrantes */
+    int port;                               /* Puerto de los enlaces entrantes */
+    const char *secret_file;                /* Fichero con el secreto compartido */
+    const char *ca_file;                    /* CA de los certificados de los pares (NULL = sistema) */
+    const char *const *peers;               /* Pares HOST:PORT (validados con cluster_parse_peer()) */
+    int peer_count;                         /* Número de pares (0-CLUSTER_MAX_PEERS) */
+} cluster_options_t;
+
+/* ========== PROTOTIPOS DEL CLÚSTER ========== */
+
+/**
+ * @brief Valida la forma HOST:PORT de un par
+ * @param spec Texto de --peer
+ * @return 0 si es válido, -1 si no
+ */
+int cluster_parse_peer(const char *spec);
+
+/**
+ * @brief Arranca el clúster: escucha de enlaces entrantes y un thread por par
+ *
+ * Los pares que aún no responden no impiden arrancar: sus threads
+ * reintentan la conexión con espera exponencial. Si el servidor tiene
+ * TLS (ctx->tls) los enlaces en ambos sentidos también lo usan.
+ *
+ * @param ctx Contexto del servidor que recibe el fan-out de los pares
+ * @param options Interfaz, puerto, secreto, CA y pares
+ * @return Clúster o NULL si no se pudo leer el secreto, abrir el puerto o
+ *         crear los threads
+ */
+cluster_t *cluster_create(server_context_t *ctx, const cluster_options_t *options);
+
+/**
+ * @brief Reenvía un mensaje de una sala a todos los pares conectados
+ *
+ * Serializa el frame una vez y lo copia en el buffer de cada enlace; no
+ * escribe en ningún socket. Si un enlace está caído o su buffer lleno, el
+ * mensaje se descarta para ese par y se cuenta en las métricas.
+ *
+ * @param cluster Clúster (NULL no hace nada)
+ * @param room Sala del mensaje
+ * @param msg Mensaje de chat o aviso de presencia
+ */
+void cluster_publish(cluster_t *cluster, const char *room, const chat_message_t *msg);
+
+/**
+ * @brief Cierra los enlaces y espera a sus threads
+ * @param cluster Clúster (NULL no hace nada)
+ */
+void cluster_destroy(cluster_t *cluster);
+
+#endif /* CHAT_CLUSTER_H */
@@ -22,19 +22,42 @@
 #include <signal.h>
 #include <errno.h>
 #include <time.h>
+#include <stdint.h>
+
+#include "chat_log.h"
 
 /* ========== CONSTANTES DE CONFIGURACIÓN ========== */
 
 /* Configuración de red */
 #define DEFAULT_PORT        8080        /* Puerto por defecto del servidor */
-#define MAX_CLIENTS         50          /* Límite máximo de clientes concurrentes */
+#define MAX_CLIENTS         10000       /* Límite por defecto de clientes concurrentes */
 #define BUFFER_SIZE         1024        /* Tamaño del buffer para mensajes */
 #define USERNAME_SIZE       32          /* Tamaño máximo del nombre de usuario */
 #define MESSAGE_SIZE        (BUFFER_SIZE - USERNAME_SIZE - 64) /* Tamaño del mensaje */
+#define ROOM_NAME_SIZE      32          /* Tamaño máximo del nombre de una sala */
+#define ROOM_DEFAULT_NAME   "general"   /* Sala en la que entra cada cliente al conectarse */
 
 /* Configuración de timeout y reintentos */
 #define CONNECTION_TIMEOUT  30          /* Timeout de conexión en segundos */
 #define KEEPALIVE_INTERVAL  60          /* Intervalo de keepalive en segundos */
+#define SEND_TIMEOUT_MS     2000        /* Espera máxima de escritura en sockets no bloqueantes */
+
+/* Protocolo compacto (ver serialize_message_as) */
+#define WIRE_MAGIC          0xC5        /* Primer byte de un frame compacto */
+#define WIRE_VERSION        2           /* Versión del formato compacto */
+#define WIRE_CAPABILITY     "wire=2"    /* Capacidad anunciada en MSG_CONNECT */
+#define WIRE_VERSION_DEFLATE 3          /* Frame compacto con el cuerpo comprimido */
+#define WIRE_DEFLATE_CAPABILITY "deflate=1" /* Compresión anunciada en MSG_CONNECT */
+#define WIRE_VERSION_SEQUENCE 4         /* Envoltorio con el número de secuencia de la sala */
+#define WIRE_SEQUENCE_HEADER 10         /* Magic, versión y secuencia de 64 bits */
+#define WIRE_RESUME_CAPABILITY "resume=1" /* Reanudación de sesión anunciada en MSG_CONNECT */
+#define WIRE_PRESENCE_CAPABILITY "presence=1" /* Lista de usuarios anunciada en MSG_CONNECT */
+#define WIRE_VERSION_BATCH  5           /* Envoltorio de varios frames enviados juntos */
+#define WIRE_BATCH_HEADER_MAX (2 + 5)   /* Magic, versión y varint de longitud */
+#define WIRE_MAX_BATCH_SIZE (256 * 1024) /* Bytes máximos de los frames de un lote */
+#define WIRE_BATCH_CAPABILITY "batch=1" /* Lotes de mensajes anunciados en MSG_CONNECT */
+#define SESSION_TOKEN_SIZE  33          /* Token de sesión: 128 bits en hexadecimal */
+#define WIRE_MAX_FRAME_SIZE BUFFER_SIZE /* Tamaño máximo de cualquier frame */
 
 /* Códigos de retorno */
 #define SUCCESS             0
@@ -45,18 +68,87 @@
 #define ERROR_CONNECT       -5
 #define ERROR_THREAD        -6
 #define ERROR_MEMORY        -7
+#define ERROR_FULL          -8
+#define ERROR_DUPLICATE     -9
+#define ERROR_RETRY         -10
+#define ERROR_NOT_FOUND     -11
 
 /* ========== TIPOS DE MENSAJES ========== */
 
+/*
+ * Presencia: a los clientes que anuncian WIRE_PRESENCE_CAPABILITY el
+ * servidor les envía la lista de usuarios de su sala al entrar en ella y
+ * después solo los cambios, como MSG_PRESENCE con contenido
+ * "OPVERSION SALA nombres...":
+ * 
+ *   =V sala a b c    primer trozo de la lista completa en la versión V
+ *   &V sala d e      continuación de la misma lista
+ *   +V sala x        x entró en la sala (la sala pasa a la versión V)
+ *   -V sala x        x salió de la sala
+ * 
+ * Un cambio con versión V solo se aplica sobre la versión V-1; si falta
+ * alguno, el cliente envía un MSG_PRESENCE vacío y recibe la lista otra vez.
+ */
 typedef enum {
     MSG_CONNECT,        /* Mensaje de conexión inicial */
     MSG_DISCONNECT,     /* Mensaje de desconexión */
     MSG_CHAT,          /* Mensaje de chat normal */
     MSG_NOTIFICATION,   /* Notificación del sistema */
     MSG_ERROR,         /* Mensaje de error */
-    MSG_KEEPALIVE      /* Mensaje de keepalive */
+    MSG_KEEPALIVE,     /* Mensaje de keepalive */
+    MSG_JOIN,          /* Entrar en la sala indicada en el contenido */
+    MSG_LEAVE,         /* Volver a la sala por defecto */
+    MSG_PRIVATE,       /* Mensaje directo a un usuario ("DESTINO texto" al enviarlo) */
+    MSG_PRESENCE,      /* Lista de usuarios de la sala o un cambio en ella */
+    MSG_TYPE_COUNT     /* Número de tipos (no es un tipo válido) */
 } message_type_t;
 
+/**
+ * @brief Formatos de codificación en la red
+ * 
+ * El formato legacy es la copia binaria de la estructura original de
+ * mensaje (~1 KB por mensaje). El formato compacto es un frame versionado
+ * y prefijado con su longitud que solo transporta los bytes usados:
+ * 
+ *   [WIRE_MAGIC][WIRE_VERSION][varint longitud del cuerpo]
+ *   cuerpo: varint tipo, varint flags, varint timestamp,
+ *           varint longitud + usuario, varint longitud + contenido
+ * 
+ * Los enteros se codifican como varints LEB128 sin signo. Al recibir, el
+ * formato se detecta por el primer byte, así que todos pueden convivir en
+ * una misma conexión; el formato de envío se negocia en MSG_CONNECT.
+ * 
+ * El formato deflate envía los frames compactos grandes con el cuerpo
+ * comprimido (WIRE_VERSION_DEFLATE, ver chat_compress.h) y los pequeños
+ * como frames compactos normales.
+ * 
+ * A los clientes que anuncian WIRE_RESUME_CAPABILITY los mensajes de chat
+ * de una sala les llegan envueltos con su número de secuencia:
+ * 
+ *   [WIRE_MAGIC][WIRE_VERSION_SEQUENCE][uint64 secuencia en orden de red]
+ *   frame compacto o deflate
+ * 
+ * La cabecera tiene tamaño fijo para que el servidor asigne el número
+ * sobre el frame ya serializado. Al reconectar, el cliente presenta en su
+ * MSG_CONNECT el token de sesión, la sala y el último número visto
+ * ("session=TOKEN room=SALA seq=N") y recibe solo los mensajes posteriores.
+ * 
+ * Si el servidor confirma WIRE_BATCH_CAPABILITY, el cliente puede enviar
+ * varios frames compactos o deflate juntos en un lote:
+ * 
+ *   [WIRE_MAGIC][WIRE_VERSION_BATCH][varint longitud de los frames]
+ *   frames completos, uno tras otro
+ * 
+ * El receptor los extrae de uno en uno (ver frame_buffer_next()); el
+ * lote solo delimita qué frames llegaron juntos.
+ */
+typedef enum {
+    WIRE_FORMAT_LEGACY,     /* Estructura completa copiada con memcpy */
+    WIRE_FORMAT_COMPACT,    /* Frame versionado con varints */
+    WIRE_FORMAT_DEFLATE,    /* Compacto con el cuerpo comprimido si compensa */
+    WIRE_FORMAT_COUNT       /* Número de formatos */
+} wire_format_t;
+
 /* ========== ESTRUCTURAS DE DATOS ========== */
 
 /**
@@ -70,16 +162,52 @@ typedef struct {
     char username[USERNAME_SIZE];           /* Nombre del usuario remitente */
     char content[MESSAGE_SIZE];             /* Contenido del mensaje */
     time_t timestamp;                       /* Timestamp del mensaje */
+    unsigned long long sequence;            /* Número de secuencia en la sala o 0 */
     size_t length;                          /* Longitud total del mensaje */
 } chat_message_t;
 
+/**
+ * @brief Disposición binaria del formato legacy
+ * 
+ * Congela la estructura de mensaje original, que es la que envían los
+ * clientes antiguos, para que chat_message_t pueda evolucionar sin
+ * romper la compatibilidad.
+ */
+typedef struct {
+    message_type_t type;                    /* Tipo de mensaje */
+    char username[USERNAME_SIZE];           /* Nombre del usuario remitente */
+    char content[MESSAGE_SIZE];             /* Contenido del mensaje */
+    time_t timestamp;                       /* Timestamp del mensaje */
+    size_t length;                          /* Longitud total del mensaje */
+} legacy_wire_message_t;
+
+#define LEGACY_FRAME_SIZE   sizeof(legacy_wire_message_t)   /* Tamaño de un frame legacy */
+
+struct outbound_queue;
+struct outbound_limits;
+struct client_table;
+struct room_table;
+struct chat_room;
+struct shared_frame;
+struct chat_history;
+
+/**
+ * @brief Cubeta de tokens (ver chat_admission.h)
+ * 
+ * A cero está vacía pero se llena en el primer uso.
+ */
+typedef struct {
+    long long tokens;                       /* Milésimas de token disponibles */
+    long long last_ms;                      /* Último relleno */
+} token_bucket_t;
+
 /**
  * @brief Estructura para representar un cliente conectado
  * 
  * Mantiene la información necesaria para gestionar cada cliente
  * conectado al servidor, incluyendo socket y datos de identificación.
  */
-typedef struct {
+typedef struct client_info {
     int socket_fd;                          /* File descriptor del socket */
     char username[USERNAME_SIZE];           /* Nombre de usuario */
     struct sockaddr_in address;             /* Dirección IP del cliente */
@@ -87,6 +215,37 @@ typedef struct {
     pthread_t thread_id;                    /* ID del thread del cliente */
     int active;                             /* Flag de estado activo */
     int disconnect_notified;                /* Flag para evitar notificaciones duplicadas */
+    struct outbound_queue *outbound;        /* Cola de salida (ver chat_outbound.h) */
+    
+    /* Actividad (ms monótonos, atómicos: ver check_client_liveness) */
+    long long last_activity_ms;             /* Último dato recibido */
+    long long keepalive_sent_ms;            /* Sondeo sin respuesta o 0 */
+    
+    /* Enlaces de la tabla de clientes (ver chat_client_table.h) */
+    int active_index;                       /* Posición en el array denso o -1 */
+    unsigned int name_hash;                 /* Hash del nombre de usuario */
+    struct client_info *name_next;          /* Siguiente en la cubeta del hash */
+    
+    /* Sala actual (ver chat_room.h) */
+    struct chat_room *room;                 /* Sala a la que pertenece o NULL */
+    int room_index;                         /* Posición en los miembros de la sala o -1 */
+    unsigned long long room_sequence;       /* Último mensaje de la sala ya incluido en el historial
+                                             * que recibió al entrar (ver history_snapshot) */
+    
+    /* Reanudación de la sesión al reconectar (ver WIRE_RESUME_CAPABILITY) */
+    char session[SESSION_TOKEN_SIZE];       /* Token entregado en el handshake o "" */
+    
+    /* Presencia (ver MSG_PRESENCE) */
+    int presence;                           /* Recibe la lista de usuarios de su sala */
+    unsigned long long presence_version;    /* Versión de su sala tras su última entrada */
+    
+    /* Límite de envío (solo lo usa quien procesa sus mensajes) */
+    token_bucket_t send_bucket;             /* Mensajes que puede enviar ya */
+    long long send_warned_ms;               /* Último aviso de exceso (ms monótonos) o 0 */
+    
+    /* Reinicio en caliente (ver chat_handoff.h) */
+    char *handoff_input;                    /* Bytes recibidos sin procesar o NULL */
+    size_t handoff_input_length;            /* Bytes en handoff_input */
 } client_info_t;
 
 /**
@@ -95,12 +254,34 @@ typedef struct {
  * Mantiene el estado global del servidor incluyendo la lista de clientes
  * conectados y los mecanismos de sincronización.
  */
-typedef struct {
-    client_info_t clients[MAX_CLIENTS];     /* Array de clientes conectados */
-    int client_count;                       /* Número actual de clientes */
-    pthread_mutex_t clients_mutex;          /* Mutex para acceso a lista de clientes */
+typedef struct server_context {
+    struct client_table *clients;           /* Clientes conectados (ver chat_client_table.h) */
+    struct room_table *rooms;               /* Salas y sus miembros (ver chat_room.h) */
+    struct chat_history *history;           /* Historial por sala o NULL (ver chat_history.h) */
+    struct tls_context *tls;                /* Contexto TLS o NULL sin TLS (ver chat_tls.h) */
+    struct admission *admission;            /* Limitador de conexiones o NULL (ver chat_admission.h) */
+    struct admission *message_limiter;      /* Límite de mensajes por IP o NULL */
+    int message_rate;                       /* Mensajes/s por cliente (0 = sin límite) */
+    int message_burst;                      /* Ráfaga de mensajes por cliente */
+    struct cluster *cluster;                /* Enlaces con otros nodos o NULL (ver chat_cluster.h) */
+    int max_clients;                        /* Límite de clientes concurrentes */
+    pthread_mutex_t clients_mutex;          /* Mutex para acceso a lista de clientes y salas */
     int server_socket;                      /* Socket del servidor */
-    int running;                            /* Flag de estado del servidor */
+    volatile sig_atomic_t running;          /* Flag de estado (lo baja el manejador de señales) */
+    int handing_off;                        /* Los clientes pasan a una versión nueva (ver chat_handoff.h) */
+    
+    /* Fan-out propio del motor de E/S (NULL = recorrido de los miembros bajo
+     * clients_mutex): frames ya serializados para una sala, o para todos
+     * los clientes con room_name NULL */
+    int (*broadcast_hook)(struct server_context *ctx, const char *room_name,
+                          struct shared_frame **frames, int count, int exclude_socket);
+    /* Aviso al motor de que un cliente cambió de sala, desde el thread que lo atiende */
+    void (*room_hook)(struct server_context *ctx, client_info_t *client);
+    void *engine_data;                      /* Estado privado del motor de E/S */
+    const struct outbound_limits *outbound_limits; /* Límites de las colas de salida */
+    long long keepalive_ms;                 /* Inactividad antes de sondear (0 = sin sondeos) */
+    long long timeout_ms;                   /* Espera del handshake y de la respuesta al sondeo */
+    int compression;                        /* Acepta deflate en el handshake (ver chat_compress.h) */
 } server_context_t;
 
 /* ========== PROTOTIPOS DE FUNCIONES COMUNES ========== */
@@ -116,7 +297,7 @@ void init_message(chat_message_t *msg, message_type_t type,
                   const char *username, const char *content);
 
 /**
- * @brief Serializa un mensaje para envío por red
+ * @brief Serializa un mensaje para envío por red en formato legacy
  * @param msg Mensaje a serializar
  * @param buffer Buffer de salida
  * @param buffer_size Tamaño del buffer
@@ -124,8 +305,23 @@ void init_message(chat_message_t *msg, message_type_t type,
  */
 ssize_t serialize_message(const chat_message_t *msg, char *buffer, size_t buffer_size);
 
+/**
+ * @brief Serializa un mensaje en el formato de red indicado
+ * @param msg Mensaje a serializar
+ * @param format Formato de red (legacy, compacto o deflate)
+ * @param buffer Buffer de salida
+ * @param buffer_size Tamaño del buffer
+ * @return Número de bytes serializados o -1 en error
+ */
+ssize_t serialize_message_as(const chat_message_t *msg, wire_format_t format,
+                             char *buffer, size_t buffer_size);
+
 /**
  * @brief Deserializa un mensaje recibido por red
+ * 
+ * Acepta frames legacy, compactos y comprimidos; el formato se detecta
+ * por los primeros bytes.
+ * 
  * @param buffer Buffer con datos serializados
  * @param buffer_size Tamaño de los datos
  * @param msg Estructura de mensaje de salida
@@ -133,6 +329,123 @@ ssize_t serialize_message(const chat_message_t *msg, char *buffer, size_t buffer
  */
 int deserialize_message(const char *buffer, size_t buffer_size, chat_message_t *msg);
 
+/**
+ * @brief Determina la longitud del frame que comienza en un buffer
+ * @param buffer Datos recibidos
+ * @param available Bytes disponibles en el buffer
+ * @return Longitud total del frame, 0 si faltan bytes para saberlo o
+ *         completarlo, -1 si los datos no son un frame válido
+ */
+ssize_t message_frame_length(const char *buffer, size_t available);
+
+/**
+ * @brief Indica si un MSG_CONNECT anuncia soporte del formato compacto
+ * @param msg Mensaje de conexión
+ * @return 1 si lo anuncia, 0 si no
+ */
+int message_offers_compact_wire(const chat_message_t *msg);
+
+/**
+ * @brief Indica si un MSG_CONNECT anuncia soporte de compresión deflate
+ * @param msg Mensaje de conexión (o la respuesta del servidor)
+ * @return 1 si lo anuncia, 0 si no
+ */
+int message_offers_deflate(const chat_message_t *msg);
+
+/**
+ * @brief Indica si un MSG_CONNECT anuncia la reanudación de sesiones
+ * @param msg Mensaje de conexión (o la respuesta del servidor)
+ * @return 1 si lo anuncia, 0 si no
+ */
+int message_offers_resume(const chat_message_t *msg);
+
+/**
+ * @brief Indica si un MSG_CONNECT anuncia la lista de usuarios (MSG_PRESENCE)
+ * @param msg Mensaje de conexión (o la respuesta del servidor)
+ * @return 1 si lo anuncia, 0 si no
+ */
+int message_offers_presence(const chat_message_t *msg);
+
+/**
+ * @brief Indica si un MSG_CONNECT anuncia los lotes de mensajes
+ * @param msg Mensaje de conexión (o la respuesta del servidor)
+ * @return 1 si lo anuncia, 0 si no
+ */
+int message_offers_batch(const chat_message_t *msg);
+
+/**
+ * @brief Extrae el valor de un campo "clave=valor" del contenido
+ * 
+ * Los campos van separados por espacios, como las capacidades del
+ * MSG_CONNECT.
+ * 
+ * @param msg Mensaje
+ * @param key Clave sin el '='
+ * @param value Destino (se termina en '\0')
+ * @param value_size Tamaño del destino
+ * @return 1 si el campo existe y cabe, 0 si no
+ */
+int message_get_field(const chat_message_t *msg, const char *key,
+                      char *value, size_t value_size);
+
+/**
+ * @brief Escribe la cabecera del envoltorio de secuencia
+ * @param header Destino de WIRE_SEQUENCE_HEADER bytes
+ * @param sequence Número de secuencia
+ */
+void wire_put_sequence_header(char *header, unsigned long long sequence);
+
+/**
+ * @brief Escribe la cabecera de un lote
+ * @param header Destino de al menos WIRE_BATCH_HEADER_MAX bytes
+ * @param batch_length Bytes de los frames del lote
+ * @return Longitud de la cabecera
+ */
+size_t wire_put_batch_header(char *header, size_t batch_length);
+
+/**
+ * @brief Lee la cabecera de un lote
+ * @param buffer Datos recibidos (deben empezar por WIRE_MAGIC y WIRE_VERSION_BATCH)
+ * @param available Bytes disponibles
+ * @param batch_length Destino de los bytes de los frames del lote
+ * @return Longitud de la cabecera, 0 si faltan bytes, -1 si es inválida
+ */
+int wire_parse_batch_header(const char *buffer, size_t available, size_t *batch_length);
+
+/**
+ * @brief Envía un buffer completo por un socket
+ * 
+ * Reintenta envíos parciales y, si el socket es no bloqueante, espera
+ * a que vuelva a ser escribible durante como máximo SEND_TIMEOUT_MS.
+ * 
+ * @param socket_fd Socket destino
+ * @param buffer Datos a enviar
+ * @param length Número de bytes a enviar
+ * @return Número de bytes enviados o -1 en error
+ */
+ssize_t send_all(int socket_fd, const char *buffer, size_t length);
+
+/**
+ * @brief Crea un socket de escucha TCP en una dirección concreta
+ * 
+ * Para puertos auxiliares (administración, clúster); el puerto de chat
+ * usa create_server_socket(), que además hereda sockets en los reinicios
+ * en caliente.
+ * 
+ * @param address Dirección IPv4 en notación decimal ("0.0.0.0" = todas)
+ * @param port Puerto TCP
+ * @param backlog Cola de conexiones pendientes
+ * @return Descriptor del socket o código de error
+ */
+int create_listen_socket(const char *address, int port, int backlog);
+
+/**
+ * @brief Configura un socket en modo no bloqueante
+ * @param fd Socket a configurar
+ * @return 0 en éxito, -1 en error
+ */
+int set_nonblocking(int fd);
+
 /**
  * @brief Formatea un timestamp para mostrar
  * @param timestamp Timestamp a formatear
@@ -149,19 +462,20 @@ void format_timestamp(time_t timestamp, char *buffer, size_t buffer_size);
 int validate_username(const char *username);
 
 /**
- * @brief Función de logging thread-safe
- * @param level Nivel de log
- * @param format Formato del mensaje
- * @param ... Argumentos del formato
+ * @brief Valida un nombre de sala (mismas reglas que los nombres de usuario)
+ * @param name Nombre de sala a validar
+ * @return 1 si es válido, 0 si no
  */
-void safe_log(const char *level, const char *format, ...);
+int validate_room_name(const char *name);
 
-/* ========== MACROS DE UTILIDAD ========== */
+/**
+ * @brief Hash FNV-1a de un identificador (nombre de usuario o de sala)
+ * @param name Cadena terminada en '\0'
+ * @return Hash de 32 bits
+ */
+unsigned int hash_identifier(const char *name);
 
-/* Macros para logging */
-#define LOG_INFO(...)    safe_log("INFO", __VA_ARGS__)
-#define LOG_ERROR(...)   safe_log("ERROR", __VA_ARGS__)
-#define LOG_DEBUG(...)   safe_log("DEBUG", __VA_ARGS__)
+/* ========== MACROS DE UTILIDAD ========== */
 
 /* Macro para limpieza de recursos */
 #define SAFE_CLOSE(fd) do { \
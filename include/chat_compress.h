@@ -0,0 +1,72 @@
+/**
+ * @file chat_compress.h
+ * @brief Compresión deflate de los frames compactos
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Un frame comprimido es un frame compacto cuyo cuerpo va en deflate
+ * crudo (sin cabecera zlib) con un diccionario preestablecido común a
+ * servidor y clientes:
+ *
+ *   [WIRE_MAGIC][WIRE_VERSION_DEFLATE][varint longitud comprimida]
+ *   cuerpo: deflate(cuerpo del frame compacto)
+ *
+ * Cada frame se comprime por separado, sin contexto entre mensajes: así
+ * un broadcast se comprime una vez y el mismo frame vale para todos los
+ * destinatarios que negociaron deflate. El diccionario aporta el
+ * vocabulario que una ventana vacía no tiene en mensajes cortos; cambiarlo
+ * exige subir el número de WIRE_DEFLATE_CAPABILITY.
+ *
+ * Cada thread usa sus propios streams de zlib, creados en el primer uso y
+ * liberados al terminar el thread.
+ */
+
+#ifndef CHAT_COMPRESS_H
+#define CHAT_COMPRESS_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DE COMPRESIÓN ========== */
+
+#define WIRE_DEFLATE_MIN_SIZE   128         /* Frames compactos menores van sin comprimir */
+#define WIRE_DEFLATE_LEVEL      6           /* Nivel de deflate (1-9) */
+#define WIRE_DEFLATE_WINDOW_BITS 12         /* Ventana de 4 KB: diccionario más un mensaje */
+#define WIRE_DEFLATE_MEM_LEVEL  6           /* Memoria del estado de deflate (1-9) */
+
+/* ========== PROTOTIPOS DE COMPRESIÓN ========== */
+
+/**
+ * @brief Cambia el tamaño a partir del cual se comprime
+ * @param min_size Bytes del frame compacto; los menores se envían sin comprimir
+ */
+void wire_set_deflate_threshold(size_t min_size);
+
+/**
+ * @brief Tamaño a partir del cual se comprime
+ * @return Bytes del frame compacto
+ */
+size_t wire_deflate_threshold(void);
+
+/**
+ * @brief Comprime un cuerpo de frame compacto
+ * @param in Cuerpo a comprimir
+ * @param in_length Bytes del cuerpo
+ * @param out Destino
+ * @param out_size Capacidad del destino; si el resultado no cabe, no compensa
+ * @return Bytes comprimidos o -1 si no cabe o hubo un error
+ */
+ssize_t wire_deflate(const unsigned char *in, size_t in_length,
+                     unsigned char *out, size_t out_size);
+
+/**
+ * @brief Descomprime un cuerpo de frame comprimido
+ * @param in Cuerpo comprimido
+ * @param in_length Bytes comprimidos
+ * @param out Destino
+ * @param out_size Capacidad del destino
+ * @return Bytes descomprimidos o -1 si los datos son inválidos o no caben
+ */
+ssize_t wire_inflate(const unsigned char *in, size_t in_length,
+                     unsigned char *out, size_t out_size);
+
+#endif /* CHAT_COMPRESS_H */
@@ -0,0 +1,114 @@
+/**
+ * @file chat_engine.h
+ * @brief Abstracción de los motores de E/S del servidor de chat
+ * @author Sistema de Chat Socket
+ * @date 2025
+ * 
+ * El servidor puede atender a los clientes con distintos modelos de
+ * concurrencia. Cada motor implementa el bucle de aceptación y lectura,
+ * y reutiliza la lógica común de chat_server.c (handshake, procesamiento
+ * de mensajes, broadcast y desconexión).
+ */
+
+#ifndef CHAT_ENGINE_H
+#define CHAT_ENGINE_H
+
+#include "chat_server.h"
+
+/* ========== CONSTANTES DE LOS MOTORES ========== */
+
+#define EPOLL_MAX_EVENTS        256     /* Eventos procesados por iteración */
+#define EPOLL_WAIT_TIMEOUT_MS   500     /* Timeout para revisar el estado del servidor */
+#define EPOLL_MAX_LOOPS         16      /* Límite de threads de event loop */
+#define REACTOR_MAX_SHARDS      64      /* Límite de reactores (uno por CPU) */
+#define URING_MAX_LOOPS         16      /* Límite de anillos io_uring (uno por loop) */
+#define URING_QUEUE_DEPTH       4096    /* Entradas de la cola de envío de cada anillo */
+#define URING_BUFFER_COUNT      512     /* Buffers provistos por loop (potencia de dos) */
+#define URING_BUFFER_SIZE       4096    /* Tamaño de cada buffer provisto */
+
+/* ========== ESTRUCTURAS DE LOS MOTORES ========== */
+
+/**
+ * @brief Función de entrada de un motor de E/S
+ * 
+ * Crea los sockets de escucha necesarios, atiende clientes mientras
+ * ctx->running sea verdadero y retorna cuando el servidor se detiene.
+ */
+typedef int (*engine_run_func_t)(server_context_t *ctx, const server_config_t *config);
+
+/**
+ * @brief Descriptor de un motor de E/S disponible
+ */
+typedef struct {
+    const char *name;                       /* Nombre usado en --engine= */
+    const char *description;                /* Descripción para la ayuda */
+    engine_run_func_t run;                  /* Función de entrada del motor */
+} server_engine_t;
+
+/* ========== PROTOTIPOS DE LOS MOTORES ========== */
+
+/**
+ * @brief Busca un motor de E/S por nombre
+ * @param name Nombre del motor
+ * @return Descriptor del motor o NULL si no existe
+ */
+const server_engine_t *find_server_engine(const char *name);
+
+/**
+ * @brief Muestra los motores disponibles
+ * @param stream Flujo de salida
+ */
+void print_server_engines(FILE *stream);
+
+/**
+ * @brief Motor clásico: un thread por cliente con recv() bloqueante
+ * @param ctx Contexto del servidor
+ * @param config Configuración del servidor
+ * @return 0 en éxito, código de error en fallo
+ */
+int run_threaded_engine(server_context_t *ctx, const server_config_t *config);
+
+/**
+ * @brief Motor epoll: pocos event loops edge-triggered con sockets no bloqueantes
+ * @param ctx Contexto del servidor
+ * @param config Configuración del servidor
+ * @return 0 en éxito, código de error en fallo
+ */
+int run_epoll_engine(server_context_t *ctx, const server_config_t *config);
+
+/**
+ * @brief Motor reactor: un event loop por CPU, cada uno con su propio socket
+ *        SO_REUSEPORT y su porción de clientes
+ * 
+ * Su fan-out no recorre la lista global: cada reactor indexa por sala a
+ * sus clientes, entrega a los locales y publica los frames en el inbox
+ * lock-free del resto, que entrega a sus propios miembros de la sala.
+ * 
+ * @param ctx Contexto del servidor
+ * @param config Configuración del servidor
+ * @return 0 en éxito, código de error en fallo
+ */
+int run_reactor_engine(server_context_t *ctx, const server_config_t *config);
+
+/**
+ * @brief Motor io_uring: pocos event loops, cada uno con su propio anillo
+ * 
+ * Accept y recv multishot con buffers provistos por el kernel; los envíos
+ * de todas las colas avisadas en una vuelta se entregan en la misma
+ * llamada a io_uring_enter() que espera las siguientes completions.
+ * 
+ * @param ctx Contexto del servidor
+ * @param config Configuración del servidor
+ * @return 0 en éxito, código de error en fallo
+ */
+int run_uring_engine(server_context_t *ctx, const server_config_t *config);
+
+/**
+ * @brief Calcula el número de event loops a usar
+ * @param requested Número solicitado (0 = uno por CPU en línea)
+ * @param max_loops Límite superior
+ * @return Número de loops entre 1 y max_loops
+ */
+int resolve_event_loop_count(int requested, int max_loops);
+
+#endif /* CHAT_ENGINE_H */
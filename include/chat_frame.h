@@ -0,0 +1,122 @@
+/**
+ * @file chat_frame.h
+ * @brief Capa de reensamblado de frames sobre el flujo TCP
+ * @author Sistema de Chat Socket
+ * @date 2025
+ * 
+ * TCP no conserva los límites de los mensajes: un recv() puede devolver
+ * medio frame o varios frames seguidos. Esta capa mantiene por conexión
+ * un buffer circular donde se acumulan los bytes recibidos y del que se
+ * extraen frames completos, cualquiera que sea su formato de red.
+ */
+
+#ifndef CHAT_FRAME_H
+#define CHAT_FRAME_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DE FRAMING ========== */
+
+#define FRAME_BUFFER_SIZE   (64 * 1024) /* Capacidad del anillo y tamaño de lectura */
+
+/* Resultados de frame_buffer_next() */
+#define FRAME_READY         1           /* Se extrajo un mensaje */
+#define FRAME_INCOMPLETE    0           /* Faltan bytes para el siguiente frame */
+#define FRAME_INVALID       -1          /* Frame descartado por contenido inválido */
+#define FRAME_CORRUPT       -2          /* Flujo desincronizado: cerrar la conexión */
+
+/* ========== ESTRUCTURAS DE FRAMING ========== */
+
+/**
+ * @brief Buffer circular de recepción de una conexión
+ * 
+ * head y tail son contadores monótonos; la posición real en el anillo se
+ * obtiene con la máscara de la capacidad (potencia de dos). Un frame que
+ * cruza el final del anillo se copia a scratch antes de decodificarlo.
+ */
+typedef struct {
+    char *data;                             /* Anillo de capacity bytes */
+    size_t capacity;                        /* Capacidad (potencia de dos) */
+    size_t head;                            /* Posición de lectura */
+    size_t tail;                            /* Posición de escritura */
+    size_t batch_remaining;                 /* Bytes del lote en curso sin extraer */
+    char scratch[WIRE_MAX_FRAME_SIZE];      /* Copia lineal de frames partidos */
+} frame_buffer_t;
+
+/* ========== PROTOTIPOS DE FRAMING ========== */
+
+/**
+ * @brief Inicializa un buffer de frames
+ * @param fb Buffer a inicializar
+ * @param capacity Capacidad en bytes (se redondea a potencia de dos y
+ *                 nunca es menor que WIRE_MAX_FRAME_SIZE)
+ * @return 0 en éxito, ERROR_MEMORY si no hay memoria
+ */
+int frame_buffer_init(frame_buffer_t *fb, size_t capacity);
+
+/**
+ * @brief Libera la memoria de un buffer de frames
+ * @param fb Buffer a liberar
+ */
+void frame_buffer_free(frame_buffer_t *fb);
+
+/**
+ * @brief Lee del socket todo lo que quepa en el espacio libre del anillo
+ * 
+ * Usa readv() con dos segmentos para llenar el anillo aunque el espacio
+ * libre dé la vuelta, de modo que un único syscall puede traer muchos
+ * frames.
+ * 
+ * @param fb Buffer de frames
+ * @param fd Socket del que leer
+ * @return Bytes leídos, 0 si el otro extremo cerró, -1 en error (errno)
+ */
+ssize_t frame_buffer_read(frame_buffer_t *fb, int fd);
+
+/**
+ * @brief Copia al anillo bytes ya recibidos por otro medio
+ * 
+ * Para motores en los que el kernel entrega los datos en sus propios
+ * buffers (io_uring con buffers provistos).
+ * 
+ * @param fb Buffer de frames
+ * @param data Bytes recibidos
+ * @param length Número de bytes
+ * @return 0 en éxito, -1 si no caben en el espacio libre (errno = ENOBUFS)
+ */
+int frame_buffer_append(frame_buffer_t *fb, const char *data, size_t length);
+
+/**
+ * @brief Extrae el siguiente mensaje completo del buffer
+ * 
+ * Los lotes (WIRE_VERSION_BATCH) se abren aquí: se consume su cabecera y
+ * sus frames se devuelven de uno en uno, como si hubieran llegado
+ * sueltos. Un frame que se sale del lote, o un lote dentro de otro,
+ * desincroniza el flujo.
+ * 
+ * @param fb Buffer de frames
+ * @param msg Mensaje de salida
+ * @return FRAME_READY, FRAME_INCOMPLETE, FRAME_INVALID o FRAME_CORRUPT
+ */
+int frame_buffer_next(frame_buffer_t *fb, chat_message_t *msg);
+
+/**
+ * @brief Bytes recibidos pendientes de procesar
+ * @param fb Buffer de frames
+ * @return Número de bytes en el buffer
+ */
+size_t frame_buffer_pending(const frame_buffer_t *fb);
+
+/**
+ * @brief Copia los bytes pendientes de procesar sin consumirlos
+ * 
+ * Permite entregar a otro proceso un frame recibido a medias.
+ * 
+ * @param fb Buffer de frames
+ * @param data Destino
+ * @param length Capacidad del destino
+ * @return Bytes copiados
+ */
+size_t frame_buffer_peek(const frame_buffer_t *fb, char *data, size_t length);
+
+#endif /* CHAT_FRAME_H */
@@ -0,0 +1,136 @@
+/**
+ * @file chat_handoff.h
+ * @brief Reinicio en caliente: traspaso de sockets a una versión nueva
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Con --upgrade-socket=PATH el servidor escucha en un socket Unix. Un
+ * proceso nuevo arrancado con la misma opción se conecta a él y el
+ * antiguo le entrega por SCM_RIGHTS sus sockets de escucha y los de
+ * todos los clientes registrados, con su estado (nombre, sala, formato
+ * de red, token de sesión, presencia, actividad), los bytes que no llegó a enviarles y el frame que
+ * estaba recibiendo a medias. Los clientes no notan el cambio: ni se
+ * cierra su conexión ni se avisa a las salas.
+ *
+ * Secuencia:
+ *
+ *   1. El proceso nuevo se conecta a PATH (si nadie escucha, arranca en
+ *      frío) y espera el estado.
+ *   2. El antiguo duplica sus sockets de escucha y detiene el motor sin
+ *      cerrar ni notificar a los clientes; las conexiones que llegan
+ *      mientras tanto esperan en la cola del socket de escucha, que ya
+ *      comparten ambos procesos.
+ *   3. El antiguo cierra el clúster, las métricas y el historial (que el
+ *      nuevo vuelve a cargar del disco) y envía el estado.
+ *   4. El nuevo adopta los clientes, confirma con un byte, ocupa PATH y
+ *      arranca su motor; el antiguo termina.
+ *
+ * Las conexiones que aún no completaron el handshake (TCP, TLS o
+ * MSG_CONNECT) se cierran: el cliente vuelve a conectar contra el proceso
+ * nuevo. El historial que solo vive en memoria no se traspasa.
+ *
+ * Mensajes por el socket Unix (en el orden de bytes de la máquina: ambos
+ * procesos corren en el mismo host):
+ *
+ *   handoff_header_t + sockets de escucha
+ *   por cliente: handoff_client_t + socket, salida pendiente, entrada pendiente
+ *   confirmación del proceso nuevo: un byte
+ */
+
+#ifndef CHAT_HANDOFF_H
+#define CHAT_HANDOFF_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DEL REINICIO EN CALIENTE ========== */
+
+#define HANDOFF_MAGIC           0x43484f46u /* "CHOF" */
+#define HANDOFF_VERSION         3           /* Cambia con cualquier campo de los registros */
+#define HANDOFF_MAX_LISTENERS   64          /* Sockets de escucha traspasados (uno por shard) */
+#define HANDOFF_TIMEOUT_MS      30000       /* Espera máxima de cada lectura o escritura */
+#define HANDOFF_POLL_MS         250         /* Espera del thread que atiende PATH */
+
+/* ========== ESTRUCTURAS DEL REINICIO EN CALIENTE ========== */
+
+/**
+ * @brief Cabecera del estado traspasado
+ */
+typedef struct {
+    uint32_t magic;                         /* HANDOFF_MAGIC */
+    uint32_t version;                       /* HANDOFF_VERSION */
+    int32_t listener_count;                 /* Sockets de escucha adjuntos */
+    int32_t client_count;                   /* Registros de cliente que siguen */
+} handoff_header_t;
+
+/**
+ * @brief Estado de un cliente traspasado (su socket va adjunto)
+ */
+typedef struct {
+    char username[USERNAME_SIZE];           /* Nombre de usuario */
+    char room[ROOM_NAME_SIZE];              /* Sala actual */
+    struct sockaddr_in address;             /* Dirección del cliente */
+    int64_t connect_time;                   /* Hora de conexión */
+    int64_t last_activity_ms;               /* Último dato recibido (CLOCK_MONOTONIC) */
+    int64_t keepalive_sent_ms;              /* Sondeo sin respuesta o 0 */
+    int32_t wire_format;                    /* Formato de red negociado */
+    int32_t sequenced;                      /* Recibe el envoltorio de secuencia */
+    int32_t presence;                       /* Recibe MSG_PRESENCE */
+    char session[SESSION_TOKEN_SIZE];       /* Token para reanudar la sesión */
+    uint32_t output_length;                 /* Bytes sin enviar que siguen */
+    uint32_t input_length;                  /* Bytes sin procesar que siguen */
+} handoff_client_t;
+
+typedef struct handoff handoff_t;
+
+/* ========== PROTOTIPOS DEL REINICIO EN CALIENTE ========== */
+
+/**
+ * @brief Hereda el estado de la versión anterior si hay una escuchando
+ *
+ * Debe llamarse antes de arrancar el motor: los clientes quedan en la
+ * tabla (ver server_adopt_client()) y los sockets de escucha los usará
+ * create_server_socket().
+ *
+ * @param ctx Contexto del servidor
+ * @param path Socket Unix de --upgrade-socket
+ * @return Clientes heredados, o -1 si no había versión anterior
+ */
+int handoff_receive(server_context_t *ctx, const char *path);
+
+/**
+ * @brief Escucha en PATH a la versión que vendrá a sustituir a esta
+ *
+ * Cuando se conecta, duplica los sockets de escucha de port, marca
+ * ctx->handing_off y detiene el servidor con ctx->running = 0.
+ *
+ * @param ctx Contexto del servidor
+ * @param path Socket Unix (se sustituye si ya existía)
+ * @param port Puerto de los clientes
+ * @return Estado o NULL si no se pudo escuchar
+ */
+handoff_t *handoff_listen(server_context_t *ctx, const char *path, int port);
+
+/**
+ * @brief Envía el estado a la versión nueva
+ *
+ * Se llama con el motor ya detenido. Cierra las colas de salida de los
+ * clientes enviados; sus sockets siguen en la tabla y el llamador los
+ * cierra después sin shutdown() (ver cleanup_server_context()).
+ *
+ * @param handoff Estado (debe haberse pedido el traspaso)
+ * @param ctx Contexto del servidor
+ * @return 0 si la versión nueva confirmó, -1 en error
+ */
+int handoff_send(handoff_t *handoff, server_context_t *ctx);
+
+/**
+ * @brief Deja de escuchar y libera el estado
+ *
+ * Borra PATH salvo que se haya traspasado: entonces ya es de la versión
+ * nueva.
+ *
+ * @param handoff Estado (NULL no hace nada)
+ */
+void handoff_destroy(handoff_t *handoff);
+
+#endif /* CHAT_HANDOFF_H */
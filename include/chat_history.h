@@ -0,0 +1,204 @@
+/**
+ * @file chat_history.h
+ * @brief Historial reciente por sala con persistencia en segmentos mmap
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cada sala con actividad tiene un anillo de capacidad fija con
+ * referencias a los últimos frames compartidos de chat, que se reenvían
+ * en una sola escritura a quien entra en la sala. El historial no vive
+ * dentro de chat_room_t: sobrevive a que la sala se quede vacía. El
+ * número de salas con historial está acotado y se expulsa la menos
+ * reciente; su contador de secuencia (unos 60 bytes) se conserva, así que
+ * la numeración de cada sala nunca retrocede.
+ *
+ * Si se indica un directorio, cada mensaje se añade además a un segmento
+ * de solo-añadir proyectado en memoria. El camino del broadcast solo
+ * publica el frame en una pila lock-free; un thread escritor copia los
+ * registros al segmento y pide su volcado asíncrono con msync(). Hay dos
+ * segmentos que se alternan cuando el activo se llena; al arrancar se
+ * recorren en orden de generación y se reconstruyen los anillos.
+ *
+ * Formato del segmento:
+ *   cabecera: magic, versión, generación
+ *   registro: [magic][generación][longitud][checksum][sala][frame compacto]
+ * La lectura se detiene en el primer registro que no valida, así que un
+ * registro a medio escribir tras una caída simplemente se ignora.
+ *
+ * Los anillos y los contadores tienen su propio lock, que se toma solo
+ * para numerar y añadir un mensaje o para copiar un anillo. Cada copia
+ * devuelve además el último número asignado en la sala: un mensaje con
+ * número mayor no estaba en la copia y uno con número menor o igual sí,
+ * así que quien entra en una sala descarta los repetidos aunque el
+ * reparto vaya por detrás de la numeración (ver broadcast_hook). Con
+ * clients_mutex tomado, el orden es clients_mutex y después este lock.
+ *
+ * Cada sala numera sus mensajes de chat al guardarlos (ver
+ * WIRE_VERSION_SEQUENCE); un cliente que reanuda su sesión recibe solo los
+ * posteriores al último que vio. La numeración se recupera de los
+ * segmentos y empieza de cero si la sala solo vivía en memoria.
+ */
+
+#ifndef CHAT_HISTORY_H
+#define CHAT_HISTORY_H
+
+#include "chat_outbound.h"
+#include <limits.h>
+
+/* ========== CONSTANTES DEL HISTORIAL ========== */
+
+#define HISTORY_DEFAULT_DEPTH   20                  /* Mensajes reenviados al entrar */
+#define HISTORY_MAX_DEPTH       256                 /* Límite de --history */
+#define HISTORY_MAX_ROOMS       1024                /* Salas con historial en memoria */
+#define HISTORY_BUCKETS         2048                /* Cubetas del hash (potencia de 2) */
+#define HISTORY_SEGMENT_SIZE    (4 * 1024 * 1024)   /* Bytes por segmento */
+#define HISTORY_SEGMENT_COUNT   2                   /* Segmentos que se alternan */
+#define HISTORY_FLUSH_MIN_MS    1                   /* Espera mínima del escritor */
+#define HISTORY_FLUSH_MAX_MS    50                  /* Espera máxima del escritor ocioso */
+#define HISTORY_SYNC_MS         1000                /* Intervalo de msync(MS_ASYNC) */
+
+/* ========== ESTRUCTURAS DEL HISTORIAL ========== */
+
+/**
+ * @brief Último número de secuencia asignado en una sala
+ *
+ * Vive fuera de los anillos y no se expulsa con ellos: una sala que pierde
+ * su anillo por inactividad sigue numerando desde donde iba.
+ */
+typedef struct history_sequence {
+    char name[ROOM_NAME_SIZE];              /* Nombre de la sala */
+    unsigned int name_hash;                 /* Hash del nombre */
+    struct history_sequence *hash_next;     /* Siguiente en la cubeta */
+    unsigned long long last;                /* Último número asignado */
+} history_sequence_t;
+
+/**
+ * @brief Anillo de mensajes recientes de una sala
+ */
+typedef struct history_room {
+    char name[ROOM_NAME_SIZE];              /* Nombre de la sala */
+    unsigned int name_hash;                 /* Hash del nombre */
+    struct history_room *hash_next;         /* Siguiente en la cubeta */
+    struct history_room *lru_prev;          /* Actividad más reciente */
+    struct history_room *lru_next;          /* Actividad más antigua */
+    int head;                               /* Posición del mensaje más antiguo */
+    int count;                              /* Mensajes en el anillo */
+    history_sequence_t *sequence;           /* Contador de la sala (sobrevive al anillo) */
+    shared_frame_t *frames[];               /* depth referencias */
+} history_room_t;
+
+/**
+ * @brief Mensaje pendiente de persistir
+ */
+typedef struct history_pending {
+    struct history_pending *next;           /* Siguiente nodo de la pila */
+    char room[ROOM_NAME_SIZE];              /* Sala del mensaje */
+    shared_frame_t *frame;                  /* Referencia propia al frame */
+} history_pending_t;
+
+/**
+ * @brief Segmento proyectado en memoria
+ */
+typedef struct {
+    int fd;                                 /* Fichero del segmento o -1 */
+    char *map;                              /* Proyección de todo el segmento */
+    size_t offset;                          /* Siguiente byte libre */
+    unsigned long long generation;          /* Orden del segmento (0 = vacío) */
+} history_segment_t;
+
+/**
+ * @brief Historial de todas las salas
+ */
+typedef struct chat_history {
+    int depth;                              /* Capacidad de cada anillo */
+    history_room_t *buckets[HISTORY_BUCKETS];
+    int room_count;                         /* Salas con historial */
+    history_room_t *lru_head;               /* Sala con actividad más reciente */
+    history_room_t *lru_tail;               /* Sala a expulsar */
+    history_sequence_t *sequences[HISTORY_BUCKETS]; /* Contadores de todas las salas */
+    pthread_mutex_t lock;                   /* Protege anillos, LRU y contadores */
+
+    /* Persistencia (solo con directorio) */
+    int persistent;                         /* Hay segmentos abiertos */
+    history_segment_t segments[HISTORY_SEGMENT_COUNT];
+    int active;                             /* Segmento en el que se añade */
+    history_pending_t *pending;             /* Pila MPSC lock-free de mensajes */
+    pthread_t writer;                       /* Thread escritor */
+    int writer_running;                     /* El escritor está arrancado */
+    int writer_stop;                        /* Orden de terminar (atómico) */
+    unsigned long long persisted;           /* Registros escritos */
+    unsigned long long recovered;           /* Registros leídos al arrancar */
+} chat_history_t;
+
+/* ========== PROTOTIPOS DEL HISTORIAL ========== */
+
+/**
+ * @brief Crea el historial y recupera el contenido persistido
+ * @param depth Mensajes por sala (1..HISTORY_MAX_DEPTH)
+ * @param directory Directorio de los segmentos o NULL para solo memoria
+ * @return Historial nuevo o NULL en error
+ */
+chat_history_t *history_create(int depth, const char *directory);
+
+/**
+ * @brief Arranca el thread escritor (sin efecto si no hay persistencia)
+ * @param history Historial
+ * @return SUCCESS o ERROR_THREAD
+ */
+int history_start(chat_history_t *history);
+
+/**
+ * @brief Persiste lo pendiente, detiene el escritor y libera el historial
+ * @param history Historial (puede ser NULL)
+ */
+void history_destroy(chat_history_t *history);
+
+/**
+ * @brief Añade un mensaje al anillo de una sala y lo programa para persistir
+ *
+ * Asigna al frame el siguiente número de secuencia de la sala, así que
+ * debe llamarse antes de entregarlo a ninguna cola. No hace E/S: la copia
+ * al segmento la hace el thread escritor.
+ *
+ * @param history Historial
+ * @param room Nombre de la sala
+ * @param frame Frame compartido de un MSG_CHAT (el historial toma su
+ *              propia referencia)
+ */
+void history_record(chat_history_t *history, const char *room, shared_frame_t *frame);
+
+/**
+ * @brief Copia los mensajes recientes de una sala, del más antiguo al más nuevo
+ *
+ * Cada frame copiado lleva una referencia que el llamador debe soltar.
+ *
+ * @param history Historial
+ * @param room Nombre de la sala
+ * @param frames Destino (al menos history->depth posiciones)
+ * @param last Último número asignado en la sala al copiar, 0 si nunca
+ *             hubo mensajes (puede ser NULL)
+ * @return Frames copiados
+ */
+int history_snapshot(chat_history_t *history, const char *room, shared_frame_t **frames,
+                     unsigned long long *last);
+
+/**
+ * @brief Copia los mensajes de una sala posteriores a un número de secuencia
+ *
+ * Es la parte del historial que se perdió un cliente que reanuda su
+ * sesión. Sin número previo (0) o si la sala se numeró de nuevo desde
+ * entonces, copia el anillo entero como history_snapshot().
+ *
+ * @param history Historial
+ * @param room Nombre de la sala
+ * @param after Último número de secuencia que recibió el cliente
+ * @param frames Destino (al menos history->depth posiciones)
+ * @param missed Mensajes posteriores a after que ya salieron del anillo
+ * @param last Último número asignado en la sala al copiar (puede ser NULL)
+ * @return Frames copiados
+ */
+int history_snapshot_since(chat_history_t *history, const char *room,
+                           unsigned long long after, shared_frame_t **frames,
+                           unsigned long long *missed, unsigned long long *last);
+
+#endif /* CHAT_HISTORY_H */
@@ -0,0 +1,112 @@
+/**
+ * @file chat_log.h
+ * @brief Backend de logging asíncrono sin locks
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cada thread que registra mensajes obtiene su propio anillo de entradas
+ * de tamaño fijo (un productor, un consumidor). Un thread de volcado recorre
+ * todos los anillos y escribe las líneas en lotes, de modo que los threads
+ * de red nunca esperan por un mutex ni por la escritura en stdout.
+ *
+ * El nivel mínimo se comprueba en las macros LOG_*, antes de evaluar los
+ * argumentos: un LOG_DEBUG desactivado cuesta una comparación.
+ *
+ * Mientras el volcador no está arrancado (cliente, arranque y cierre del
+ * servidor) safe_log escribe de forma síncrona, como antes.
+ */
+
+#ifndef CHAT_LOG_H
+#define CHAT_LOG_H
+
+#include <stdarg.h>
+
+/* ========== CONSTANTES DEL LOGGER ========== */
+
+#define LOG_LINE_SIZE           256         /* Bytes de texto por entrada */
+#define LOG_RING_ENTRIES        64          /* Entradas por anillo (potencia de 2) */
+#define LOG_BATCH_SIZE          65536       /* Bytes máximos por escritura del volcador */
+#define LOG_FLUSH_MIN_MS        1           /* Espera del volcador con actividad */
+#define LOG_FLUSH_MAX_MS        50          /* Espera máxima del volcador en reposo */
+
+/* ========== NIVELES DE LOG ========== */
+
+/**
+ * @brief Niveles de log, de más a menos detallado
+ */
+typedef enum {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO  = 1,
+    LOG_LEVEL_ERROR = 2,
+    LOG_LEVEL_OFF   = 3
+} log_level_t;
+
+#define DEFAULT_LOG_LEVEL       LOG_LEVEL_INFO
+
+/* Nivel mínimo activo; solo lo modifica log_set_level */
+extern int log_min_level;
+
+/* ========== PROTOTIPOS DEL LOGGER ========== */
+
+/**
+ * @brief Registra un mensaje con timestamp y nivel
+ *
+ * Con el volcador arrancado copia la línea al anillo del thread y vuelve
+ * sin bloquear; si el anillo está lleno la entrada se descarta y se cuenta.
+ *
+ * @param level Nivel del mensaje
+ * @param format Formato del mensaje
+ * @param ... Argumentos del formato
+ */
+void safe_log(log_level_t level, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Cambia el nivel mínimo de log en tiempo de ejecución
+ * @param level Nuevo nivel mínimo
+ */
+void log_set_level(log_level_t level);
+
+/**
+ * @brief Interpreta un nombre de nivel ("debug", "info", "error", "off")
+ * @param name Nombre del nivel
+ * @param level Nivel resultante
+ * @return 0 si el nombre es válido, -1 si no
+ */
+int parse_log_level(const char *name, log_level_t *level);
+
+/**
+ * @brief Nombre legible de un nivel de log
+ * @param level Nivel de log
+ * @return Cadena estática con el nombre
+ */
+const char *log_level_name(log_level_t level);
+
+/**
+ * @brief Arranca el thread de volcado asíncrono
+ * @return 0 si se arrancó (o ya estaba arrancado), -1 si no
+ */
+int log_start_async(void);
+
+/**
+ * @brief Detiene el volcador tras escribir todo lo pendiente
+ *
+ * A partir de aquí safe_log vuelve a escribir de forma síncrona.
+ */
+void log_stop_async(void);
+
+/* ========== MACROS DE LOGGING ========== */
+
+#define LOG_ENABLED(level)  ((int)(level) >= __atomic_load_n(&log_min_level, __ATOMIC_RELAXED))
+
+#define LOG_AT(level, ...) do { \
+    if (LOG_ENABLED(level)) { \
+        safe_log((level), __VA_ARGS__); \
+    } \
+} while(0)
+
+#define LOG_INFO(...)    LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_ERROR(...)   LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_DEBUG(...)   LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif /* CHAT_LOG_H */
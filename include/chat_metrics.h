@@ -0,0 +1,184 @@
+/**
+ * @file chat_metrics.h
+ * @brief Métricas del servidor: contadores, histogramas y endpoint Prometheus
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cada thread que actualiza métricas escribe en su propio shard, así que
+ * los caminos calientes (broadcast, envío) no comparten líneas de caché
+ * ni toman locks; el endpoint suma todos los shards al leer.
+ *
+ * Los histogramas son de tipo HDR: buckets logarítmicos con
+ * METRICS_SUB_BUCKETS subdivisiones lineales por potencia de dos, lo que
+ * da un error relativo acotado en todo el rango con memoria fija.
+ */
+
+#ifndef CHAT_METRICS_H
+#define CHAT_METRICS_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DE MÉTRICAS ========== */
+
+#define METRICS_SUB_BITS        2                               /* 4 subdivisiones por potencia de 2 */
+#define METRICS_SUB_BUCKETS     (1 << METRICS_SUB_BITS)
+#define METRICS_MAX_EXPONENT    39                              /* Valores hasta 2^40 ns (~18 min) */
+#define METRICS_HIST_BUCKETS    ((METRICS_MAX_EXPONENT - METRICS_SUB_BITS + 2) * METRICS_SUB_BUCKETS)
+#define METRICS_RESPONSE_SIZE   16384                           /* Tamaño inicial de la respuesta HTTP */
+#define METRICS_POLL_MS         250                             /* Espera del thread de administración */
+#define METRICS_DEFAULT_ADDRESS "127.0.0.1"                     /* Solo accesible desde la propia máquina */
+
+/* ========== TIPOS DE MÉTRICAS ========== */
+
+/**
+ * @brief Contadores monotónicos
+ */
+typedef enum {
+    METRIC_MESSAGES_IN = 0,                 /* Frames recibidos de clientes */
+    METRIC_MESSAGES_OUT,                    /* Frames escritos completos a clientes */
+    METRIC_BYTES_IN,                        /* Bytes leídos de sockets de clientes */
+    METRIC_BYTES_OUT,                       /* Bytes escritos a sockets de clientes */
+    METRIC_BROADCASTS,                      /* Broadcasts iniciados */
+    METRIC_DROPPED_SENDS,                   /* Frames descartados o agrupados por desborde */
+    METRIC_CONNECTIONS,                     /* Conexiones aceptadas */
+    METRIC_ACCEPT_ERRORS,                   /* Fallos de accept() */
+    METRIC_ACCEPT_REJECTED,                 /* Conexiones rechazadas por el limitador de admisión */
+    METRIC_TLS_HANDSHAKES,                  /* Handshakes TLS completados con kTLS */
+    METRIC_TLS_RESUMED,                     /* Handshakes TLS que reanudaron sesión */
+    METRIC_TLS_FAILURES,                    /* Handshakes TLS fallidos o sin kTLS */
+    METRIC_DEFLATE_FRAMES,                  /* Frames compartidos comprimidos con deflate */
+    METRIC_DEFLATE_SAVED_BYTES,             /* Bytes ahorrados por esos frames (una vez por frame) */
+    METRIC_CLUSTER_FRAMES_OUT,              /* Frames enviados a nodos del clúster (uno por enlace) */
+    METRIC_CLUSTER_FRAMES_IN,               /* Frames recibidos de nodos del clúster */
+    METRIC_CLUSTER_DROPPED,                 /* Frames no reenviados por enlace caído o lleno */
+    METRIC_HANDOFF_CLIENTS,                 /* Clientes heredados en reinicios en caliente */
+    METRIC_SESSION_RESUMES,                 /* Handshakes que reanudaron una sesión */
+    METRIC_RESUME_REPLAYED,                 /* Mensajes reenviados al reanudar sesiones */
+    METRIC_PRIVATE_MESSAGES,                /* Mensajes privados entregados */
+    METRIC_RATE_LIMITED_CLIENT,             /* Mensajes descartados por el límite por cliente */
+    METRIC_RATE_LIMITED_IP,                 /* Mensajes descartados por el límite por IP */
+    METRIC_PRESENCE_SNAPSHOTS,              /* Listas completas de usuarios enviadas */
+    METRIC_BATCHED_MESSAGES,                /* Mensajes de chat repartidos junto a otros */
+    METRIC_COUNTER_COUNT
+} metric_counter_t;
+
+/**
+ * @brief Histogramas de latencia (en nanosegundos)
+ */
+typedef enum {
+    METRIC_FANOUT_LATENCY = 0,              /* Inicio del broadcast hasta encolar a todos */
+    METRIC_SEND_LATENCY,                    /* Duración de cada sendmsg() */
+    METRIC_HISTOGRAM_COUNT
+} metric_histogram_t;
+
+/**
+ * @brief Gauges que suben y bajan
+ *
+ * Cada shard guarda la suma de los incrementos que hizo su thread (que
+ * puede ser negativa); el valor del gauge es la suma de todos los shards.
+ */
+typedef enum {
+    METRIC_QUEUED_BYTES = 0,                /* Bytes pendientes en todas las colas de salida */
+    METRIC_QUEUED_FRAMES,                   /* Frames pendientes en todas las colas de salida */
+    METRIC_CONGESTED_QUEUES,                /* Colas por encima de la marca alta */
+    METRIC_GAUGE_COUNT
+} metric_gauge_t;
+
+/**
+ * @brief Copia agregada de un histograma
+ */
+typedef struct {
+    unsigned long long buckets[METRICS_HIST_BUCKETS];
+    unsigned long long count;               /* Muestras registradas */
+    unsigned long long sum;                 /* Suma de las muestras en ns */
+} metrics_histogram_t;
+
+/* ========== PROTOTIPOS DE MÉTRICAS ========== */
+
+/**
+ * @brief Instante monotónico actual en nanosegundos
+ */
+unsigned long long metrics_now_ns(void);
+
+/**
+ * @brief Suma a un contador del shard del thread actual
+ * @param counter Contador
+ * @param amount Cantidad a sumar
+ */
+void metrics_add(metric_counter_t counter, unsigned long long amount);
+
+/**
+ * @brief Registra una muestra en un histograma del shard del thread actual
+ * @param histogram Histograma
+ * @param value_ns Duración en nanosegundos
+ */
+void metrics_record(metric_histogram_t histogram, unsigned long long value_ns);
+
+/**
+ * @brief Registra el tiempo transcurrido desde un instante de metrics_now_ns()
+ * @param histogram Histograma
+ * @param start_ns Instante inicial
+ */
+void metrics_record_since(metric_histogram_t histogram, unsigned long long start_ns);
+
+/**
+ * @brief Suma un contador de todos los shards
+ */
+unsigned long long metrics_counter_total(metric_counter_t counter);
+
+/**
+ * @brief Suma (o resta, con delta negativo) a un gauge en el shard del thread actual
+ * @param gauge Gauge
+ * @param delta Variación
+ */
+void metrics_gauge_add(metric_gauge_t gauge, long long delta);
+
+/**
+ * @brief Valor de un gauge sumando todos los shards
+ */
+long long metrics_gauge_total(metric_gauge_t gauge);
+
+/**
+ * @brief Agrega un histograma de todos los shards
+ * @param histogram Histograma
+ * @param out Destino de la copia agregada
+ */
+void metrics_histogram_snapshot(metric_histogram_t histogram, metrics_histogram_t *out);
+
+/**
+ * @brief Percentil aproximado de un histograma agregado
+ * @param hist Histograma agregado
+ * @param percentile Percentil entre 0 y 100
+ * @return Límite superior del bucket que contiene el percentil, en ns
+ */
+unsigned long long metrics_percentile(const metrics_histogram_t *hist, double percentile);
+
+/**
+ * @brief Genera la exposición en formato de texto de Prometheus
+ * @param ctx Contexto del servidor (para los gauges de clientes y salas)
+ * @param buffer Buffer de salida
+ * @param size Tamaño del buffer
+ * @return Bytes necesarios (si es >= size, la salida se truncó)
+ */
+size_t metrics_render(server_context_t *ctx, char *buffer, size_t size);
+
+/**
+ * @brief Registra en el log un resumen de las métricas
+ */
+void metrics_log_summary(void);
+
+/**
+ * @brief Arranca el puerto de administración con el endpoint /metrics
+ * @param ctx Contexto del servidor
+ * @param address Dirección IPv4 en la que escuchar
+ * @param port Puerto TCP
+ * @return SUCCESS o código de error
+ */
+int metrics_server_start(server_context_t *ctx, const char *address, int port);
+
+/**
+ * @brief Detiene el puerto de administración (si está arrancado)
+ */
+void metrics_server_stop(void);
+
+#endif /* CHAT_METRICS_H */
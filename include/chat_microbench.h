@@ -0,0 +1,97 @@
+/**
+ * @file chat_microbench.h
+ * @brief Microbenchmarks de las primitivas del camino de cada mensaje
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Mide en el propio proceso, sin red ni servidor, el coste por operación
+ * de la codificación (serialize_message_as() y deserialize_message() en
+ * los formatos legacy y compacto), de init_message(), de
+ * validate_username() y del fan-out: broadcast_to_room() del servidor
+ * sobre una sala con N destinatarios cuyos sockets son socketpairs.
+ *
+ * Cada prueba se calibra hasta durar --time-ms y se repite --repeat
+ * veces; se informa de la repetición más rápida. Las asignaciones son
+ * las llamadas a malloc/calloc/realloc hechas desde el código del chat
+ * (el enlazador las redirige con --wrap); las internas de libc y zlib no
+ * cuentan.
+ *
+ * La salida es una línea por prueba separada por tabuladores:
+ *
+ *   nombre  iteraciones  ns/op  relativo  asignaciones/op
+ *
+ * El tiempo relativo es el ns/op de la prueba dividido por el de la
+ * calibración, un bucle fijo que no usa código del chat y se ejecuta
+ * siempre. --save-baseline=FICHERO guarda solo tiempos relativos y
+ * asignaciones, así que la referencia sirve en otras máquinas: el cociente
+ * descuenta la frecuencia de la CPU. No descuenta la microarquitectura ni,
+ * en el fan-out, el coste de las llamadas al kernel; de ahí la tolerancia
+ * del 25% por defecto.
+ *
+ * Con --baseline=FICHERO se compara con esa referencia y el programa
+ * termina con error si alguna prueba supera su tiempo relativo en más de
+ * la tolerancia o asigna más memoria por operación.
+ */
+
+#ifndef CHAT_MICROBENCH_H
+#define CHAT_MICROBENCH_H
+
+#include "chat_common.h"
+#include "chat_server.h"
+
+/* ========== CONSTANTES DE LOS MICROBENCHMARKS ========== */
+
+#define MICROBENCH_DEFAULT_TIME_MS     300     /* Duración objetivo de cada repetición */
+#define MICROBENCH_DEFAULT_REPEAT      3       /* Repeticiones (se toma la más rápida) */
+#define MICROBENCH_DEFAULT_RECIPIENTS  100     /* Destinatarios del fan-out */
+#define MICROBENCH_MAX_RECIPIENTS      4096    /* Dos descriptores por destinatario */
+#define MICROBENCH_DEFAULT_TOLERANCE   25      /* % de tiempo relativo tolerado sobre la referencia */
+#define MICROBENCH_DEFAULT_PAYLOAD     64      /* Bytes de contenido del mensaje de prueba */
+#define MICROBENCH_DRAIN_EVERY         32      /* Fan-outs entre vaciados de los sockets */
+#define MICROBENCH_NAME_SIZE           64      /* Longitud máxima del nombre de una prueba */
+#define MICROBENCH_MAX_RESULTS         32      /* Pruebas por ejecución o por referencia */
+#define MICROBENCH_CALIBRATION_NAME    "calibracion" /* Prueba con la que se normaliza */
+#define MICROBENCH_CALIBRATION_BYTES   256     /* Bytes que recorre cada iteración de la calibración */
+
+/* ========== ESTRUCTURAS DE LOS MICROBENCHMARKS ========== */
+
+/**
+ * @brief Cuerpo de una prueba
+ *
+ * Ejecuta la operación iterations veces y devuelve los nanosegundos que
+ * no deben contar (p. ej. vaciar los sockets del otro extremo).
+ */
+typedef unsigned long long (*microbench_func_t)(void *arg, unsigned long long iterations);
+
+/**
+ * @brief Prueba registrada
+ */
+typedef struct {
+    char name[MICROBENCH_NAME_SIZE];        /* Nombre en la salida */
+    microbench_func_t run;                  /* Cuerpo */
+    void *arg;                              /* Estado de la prueba */
+} microbench_case_t;
+
+/**
+ * @brief Resultado de una prueba (o línea de la referencia)
+ */
+typedef struct {
+    char name[MICROBENCH_NAME_SIZE];        /* Nombre de la prueba */
+    unsigned long long iterations;          /* Iteraciones de la repetición informada */
+    double ns_per_op;                       /* Nanosegundos por operación */
+    double relative;                        /* ns_per_op dividido por el de la calibración */
+    double allocs_per_op;                   /* Asignaciones por operación */
+} microbench_result_t;
+
+/**
+ * @brief Estado del fan-out sobre socketpairs
+ */
+typedef struct {
+    server_context_t ctx;                   /* Clientes, sala e historial del fan-out */
+    int count;                              /* Destinatarios (sin contar al remitente) */
+    client_info_t **clients;                /* Remitente (índice 0) y destinatarios */
+    int *receivers;                         /* Extremo que lee cada cliente */
+    chat_message_t message;                 /* Mensaje difundido */
+} microbench_fanout_t;
+
+#endif /* CHAT_MICROBENCH_H */
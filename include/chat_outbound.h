@@ -0,0 +1,424 @@
+/**
+ * @file chat_outbound.h
+ * @brief Frames compartidos y colas de salida por cliente
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Un broadcast se serializa una sola vez en un frame inmutable con
+ * contador de referencias; cada destinatario recibe en su cola de salida
+ * una referencia al frame, sin copiar los datos. Las escrituras se hacen
+ * con sendmsg() no bloqueante y varios frames por syscall; si el socket
+ * no admite más datos, la cola conserva el resto hasta que el motor de
+ * E/S detecta que vuelve a ser escribible.
+ *
+ * Los motores que envían de forma asíncrona (io_uring) registran en la
+ * cola una función de aviso: en lugar de escribir, el productor avisa al
+ * dueño de la conexión, que prepara el envío con la cabeza de la cola y
+ * lo confirma cuando el kernel lo completa.
+ *
+ * Las colas están acotadas: al superar la marca alta se aplica la
+ * política de desborde configurada y el cliente se considera congestionado
+ * hasta que su cola baja de la marca baja.
+ *
+ * Con el agrupador de escrituras arrancado, las colas síncronas no
+ * escriben al encolar: se apuntan en una lista de colas sucias y un
+ * thread las vacía una vez por ventana, con todos los frames acumulados
+ * en un único sendmsg(). Se cambia algo de latencia acotada por menos
+ * syscalls y segmentos TCP en ráfagas de broadcasts.
+ */
+
+#ifndef CHAT_OUTBOUND_H
+#define CHAT_OUTBOUND_H
+
+#include "chat_common.h"
+#include "chat_pool.h"
+#include <sys/uio.h>
+
+/* ========== CONSTANTES DE SALIDA ========== */
+
+#define OUTBOUND_IOV_MAX    64          /* Frames combinados por sendmsg() */
+#define OUTBOUND_HIGH_WATERMARK (256 * 1024) /* Marca alta por defecto en bytes */
+#define OUTBOUND_LOW_DIVISOR 4          /* Marca baja = marca alta / divisor */
+#define OUTBOUND_FLUSH_WINDOW_MAX_US 1000000 /* Ventana de agrupación máxima (1 s) */
+#define FRAME_SMALL_PAYLOAD (sizeof(chat_message_t) + 256) /* Codificaciones que caben en un frame pequeño */
+#define DEFAULT_OVERFLOW_POLICY OVERFLOW_DROP
+
+/* ========== ESTRUCTURAS DE SALIDA ========== */
+
+/**
+ * @brief Qué hacer cuando la cola de un cliente supera la marca alta
+ */
+typedef enum {
+    OVERFLOW_DROP,          /* Descartar notificaciones antiguas y, si no basta, el frame nuevo */
+    OVERFLOW_COALESCE,      /* Sustituir lo pendiente por un aviso de mensajes omitidos */
+    OVERFLOW_DISCONNECT     /* Desconectar al cliente lento */
+} overflow_policy_t;
+
+/**
+ * @brief Límites de una cola de salida
+ */
+typedef struct outbound_limits {
+    size_t high_watermark;                  /* Bytes a partir de los que se aplica la política */
+    size_t low_watermark;                   /* Bytes por debajo de los que se sale de congestión */
+    overflow_policy_t policy;               /* Política de desborde */
+} outbound_limits_t;
+
+/**
+ * @brief Métricas de profundidad de una cola de salida
+ */
+typedef struct {
+    size_t queued_frames;                   /* Frames pendientes */
+    size_t queued_bytes;                    /* Bytes pendientes */
+    size_t peak_bytes;                      /* Máximo de bytes pendientes observado */
+    unsigned long dropped_frames;           /* Frames descartados por la política */
+    unsigned long coalesced_frames;         /* Frames sustituidos por avisos de omisión */
+    unsigned long overflows;                /* Veces que se superó la marca alta */
+    int congested;                          /* Entre marca alta y marca baja */
+} outbound_stats_t;
+
+/**
+ * @brief Mensaje serializado, inmutable y compartido entre destinatarios
+ *
+ * Contiene la codificación en todos los formatos de red en un único
+ * bloque de memoria, tomado de uno de los dos pools de frames según su
+ * tamaño, que vuelve al pool al soltar la última referencia. Los mensajes
+ * de chat llevan delante de las codificaciones compacta y deflate el
+ * envoltorio con su número de secuencia (ver WIRE_VERSION_SEQUENCE).
+ */
+typedef struct shared_frame {
+    int refcount;                           /* Referencias vivas (atómico) */
+    chat_pool_t *pool;                      /* Pool del que se reservó el bloque (NULL = malloc) */
+    message_type_t type;                    /* Tipo del mensaje original */
+    unsigned long long sequence;            /* Número de secuencia en la sala o 0 */
+    size_t length[WIRE_FORMAT_COUNT];       /* Bytes por formato de red */
+    char *data[WIRE_FORMAT_COUNT];          /* Codificación por formato de red */
+} shared_frame_t;
+
+/**
+ * @brief Aviso al dueño de una cola en modo asíncrono
+ *
+ * Se llama con el lock de la cola tomado cuando pasa a tener datos
+ * pendientes; no debe volver a tomar ese lock.
+ */
+typedef void (*outbound_submit_func_t)(void *arg);
+
+/**
+ * @brief Nodo de la cola de salida: una referencia a un frame compartido
+ */
+typedef struct outbound_node {
+    struct outbound_node *next;             /* Siguiente frame pendiente */
+    shared_frame_t *frame;                  /* Frame referenciado */
+    const char *data;                       /* Codificación en el formato del cliente */
+    size_t length;                          /* Bytes de esa codificación */
+    unsigned long skipped;                  /* Mensajes que resume un aviso de omisión */
+    int pinned;                             /* Bytes restaurados: nunca se descartan */
+} outbound_node_t;
+
+/**
+ * @brief Cola de salida de un cliente
+ *
+ * Se reserva aparte de client_info_t y tiene su propio contador de
+ * referencias, así un broadcast puede seguir usándola fuera de
+ * clients_mutex aunque el cliente se desconecte mientras tanto.
+ */
+typedef struct outbound_queue {
+    int refcount;                           /* Referencias vivas (atómico) */
+    int socket_fd;                          /* Socket del cliente */
+    wire_format_t wire_format;              /* Formato de red negociado */
+    int sequenced;                          /* Envía el envoltorio de secuencia */
+    int wake_fd;                            /* eventfd del dueño o -1 */
+    pthread_mutex_t lock;                   /* Protege la cola */
+    outbound_node_t *head;                  /* Primer frame pendiente */
+    outbound_node_t *tail;                  /* Último frame pendiente */
+    size_t head_offset;                     /* Bytes ya enviados del primer frame */
+    size_t queued_frames;                   /* Frames pendientes */
+    size_t queued_bytes;                    /* Bytes pendientes */
+    int write_pending;                      /* Esperando a que el socket sea escribible */
+    outbound_submit_func_t submit;          /* Aviso en modo asíncrono o NULL */
+    void *submit_arg;                       /* Argumento del aviso */
+    int inflight;                           /* Frames de la cabeza en un envío asíncrono */
+    int flush_scheduled;                    /* Apuntada en la lista del agrupador */
+    struct outbound_queue *flush_next;      /* Siguiente cola sucia del agrupador */
+    int closed;                             /* La conexión se cerró */
+    outbound_limits_t limits;               /* Marcas y política de desborde */
+    int congested;                          /* Se superó la marca alta */
+    size_t peak_bytes;                      /* Máximo de bytes pendientes */
+    unsigned long dropped_frames;           /* Frames descartados */
+    unsigned long coalesced_frames;         /* Frames resumidos en avisos */
+    unsigned long overflows;                /* Desbordes de la marca alta */
+} outbound_queue_t;
+
+/* ========== PROTOTIPOS DE SALIDA ========== */
+
+/**
+ * @brief Inicializa unos límites con los valores por defecto
+ * @param limits Límites a inicializar
+ */
+void outbound_limits_init(outbound_limits_t *limits);
+
+/**
+ * @brief Fija la marca alta y deriva la marca baja
+ * @param limits Límites a modificar
+ * @param high_watermark Marca alta en bytes
+ */
+void outbound_limits_set_high(outbound_limits_t *limits, size_t high_watermark);
+
+/**
+ * @brief Interpreta el nombre de una política de desborde
+ * @param name "drop", "coalesce" o "disconnect"
+ * @param policy Política resultante
+ * @return 0 en éxito, -1 si el nombre no es válido
+ */
+int parse_overflow_policy(const char *name, overflow_policy_t *policy);
+
+/**
+ * @brief Nombre de una política de desborde
+ * @param policy Política
+ * @return Nombre legible
+ */
+const char *overflow_policy_name(overflow_policy_t policy);
+
+/**
+ * @brief Serializa un mensaje en todos los formatos en un frame compartido
+ * @param msg Mensaje a serializar
+ * @return Frame con una referencia o NULL en error
+ */
+shared_frame_t *shared_frame_create(const chat_message_t *msg);
+
+/**
+ * @brief Toma una referencia adicional sobre un frame
+ * @param frame Frame compartido
+ */
+void shared_frame_retain(shared_frame_t *frame);
+
+/**
+ * @brief Suelta una referencia y libera el frame si era la última
+ * @param frame Frame compartido
+ */
+void shared_frame_release(shared_frame_t *frame);
+
+/**
+ * @brief Asigna el número de secuencia de un mensaje de chat
+ *
+ * Solo para frames de MSG_CHAT creados con shared_frame_create() que aún
+ * no se hayan compartido (ver history_record()).
+ *
+ * @param frame Frame
+ * @param sequence Número de secuencia
+ */
+void shared_frame_set_sequence(shared_frame_t *frame, unsigned long long sequence);
+
+/**
+ * @brief Obtiene la codificación de un frame que recibe una cola
+ * @param frame Frame
+ * @param format Formato de red
+ * @param sequenced Con el envoltorio de secuencia si el frame tiene número
+ * @param length Bytes de la codificación
+ * @return Inicio de la codificación
+ */
+const char *shared_frame_encoding(const shared_frame_t *frame, wire_format_t format,
+                                  int sequenced, size_t *length);
+
+/**
+ * @brief Crea la cola de salida de un cliente
+ * @param socket_fd Socket del cliente
+ * @param format Formato de red inicial
+ * @param limits Límites de la cola (NULL = valores por defecto)
+ * @return Cola con una referencia o NULL si no hay memoria
+ */
+outbound_queue_t *outbound_queue_create(int socket_fd, wire_format_t format,
+                                        const outbound_limits_t *limits);
+
+/**
+ * @brief Toma una referencia adicional sobre una cola
+ * @param queue Cola de salida
+ */
+void outbound_queue_retain(outbound_queue_t *queue);
+
+/**
+ * @brief Suelta una referencia y libera la cola si era la última
+ * @param queue Cola de salida
+ */
+void outbound_queue_release(outbound_queue_t *queue);
+
+/**
+ * @brief Cambia el formato de red usado para los próximos frames
+ * @param queue Cola de salida
+ * @param format Formato de red negociado
+ */
+void outbound_queue_set_format(outbound_queue_t *queue, wire_format_t format);
+
+/**
+ * @brief Activa el envoltorio de secuencia en los próximos mensajes de chat
+ * @param queue Cola de salida
+ * @param sequenced 1 si el cliente negoció la reanudación de sesiones
+ */
+void outbound_queue_set_sequenced(outbound_queue_t *queue, int sequenced);
+
+/**
+ * @brief Registra el eventfd con el que despertar al dueño de la conexión
+ *
+ * Los motores sin aviso de escritura propio (thread por cliente) reciben
+ * una señal en este descriptor cuando la cola empieza a esperar.
+ *
+ * @param queue Cola de salida
+ * @param wake_fd eventfd del dueño o -1
+ */
+void outbound_queue_set_wake_fd(outbound_queue_t *queue, int wake_fd);
+
+/**
+ * @brief Pasa la cola a modo asíncrono (o la devuelve al síncrono con NULL)
+ *
+ * En modo asíncrono la cola nunca escribe en el socket: cuando pasa a
+ * tener datos pendientes llama a submit y el dueño envía con
+ * outbound_queue_prepare_send() y outbound_queue_complete_send(). Si ya
+ * había datos encolados, el aviso se produce de inmediato.
+ *
+ * @param queue Cola de salida
+ * @param submit Aviso al dueño o NULL
+ * @param arg Argumento del aviso
+ */
+void outbound_queue_set_submit(outbound_queue_t *queue, outbound_submit_func_t submit, void *arg);
+
+/**
+ * @brief Prepara un envío asíncrono con la cabeza de la cola
+ *
+ * Los frames apuntados por iov quedan retenidos en frames hasta que el
+ * llamador los suelte tras completar el envío, y la política de desborde
+ * no los toca mientras tanto.
+ *
+ * @param queue Cola de salida
+ * @param iov Vectores a rellenar
+ * @param frames Referencias a los frames de cada vector
+ * @param max Número máximo de vectores
+ * @return Vectores preparados, 0 si la cola quedó vacía (deja de esperar)
+ *         o -1 si está cerrada
+ */
+int outbound_queue_prepare_send(outbound_queue_t *queue, struct iovec *iov,
+                                shared_frame_t **frames, int max);
+
+/**
+ * @brief Confirma un envío asíncrono preparado con outbound_queue_prepare_send()
+ * @param queue Cola de salida
+ * @param result Bytes enviados o -errno
+ * @return 1 si quedan datos por enviar, 0 si la cola quedó vacía, -1 si la
+ *         conexión está cerrada o falló
+ */
+int outbound_queue_complete_send(outbound_queue_t *queue, ssize_t result);
+
+/**
+ * @brief Encola una referencia a un frame para el cliente
+ *
+ * Si la cola estaba ociosa intenta escribir de inmediato sin bloquear;
+ * lo que no quepa queda pendiente para el siguiente aviso de escritura.
+ * Si el frame no cabe bajo la marca alta se aplica la política de desborde.
+ *
+ * @param queue Cola de salida
+ * @param frame Frame compartido (se toma una referencia propia)
+ * @return 0 si se encoló, 1 si la política lo descartó, -1 si la conexión
+ *         está cerrada o falló
+ */
+int outbound_queue_push(outbound_queue_t *queue, shared_frame_t *frame);
+
+/**
+ * @brief Encola varios frames y los escribe con una sola pasada de sendmsg()
+ *
+ * Equivale a encolarlos de uno en uno, pero el socket se escribe una única
+ * vez con todos ellos (hasta OUTBOUND_IOV_MAX por syscall).
+ *
+ * @param queue Cola de salida
+ * @param frames Frames compartidos (se toma una referencia propia de cada uno)
+ * @param count Número de frames
+ * @return 0 si se encolaron, 1 si la política descartó alguno, -1 si la
+ *         conexión está cerrada o falló
+ */
+int outbound_queue_push_batch(outbound_queue_t *queue, shared_frame_t **frames, int count);
+
+/**
+ * @brief Arranca el agrupador de escrituras
+ *
+ * A partir de aquí los frames encolados en colas síncronas se escriben en
+ * el siguiente tick, como mucho window_us microsegundos después de que la
+ * cola pasara a tener datos, todos juntos en un único sendmsg().
+ *
+ * @param window_us Ventana de agrupación en microsegundos (> 0)
+ * @return 0 en éxito, -1 si no se pudo crear el thread
+ */
+int outbound_flusher_start(unsigned int window_us);
+
+/**
+ * @brief Detiene el agrupador tras escribir las colas apuntadas
+ *
+ * Las colas vuelven a escribir al encolar.
+ */
+void outbound_flusher_stop(void);
+
+/**
+ * @brief Escribe todo lo posible sin bloquear
+ * @param queue Cola de salida
+ * @return 0 en éxito (aunque queden datos), -1 si la conexión falló
+ */
+int outbound_queue_flush(outbound_queue_t *queue);
+
+/**
+ * @brief Indica si la cola espera a que el socket vuelva a ser escribible
+ * @param queue Cola de salida
+ * @return 1 si hay datos esperando, 0 si no
+ */
+int outbound_queue_pending(outbound_queue_t *queue);
+
+/**
+ * @brief Obtiene las métricas de profundidad de una cola
+ * @param queue Cola de salida
+ * @param stats Métricas resultantes
+ */
+void outbound_queue_stats(outbound_queue_t *queue, outbound_stats_t *stats);
+
+/**
+ * @brief Máximo de bytes pendientes que ha alcanzado cualquier cola
+ *
+ * La suma de bytes y frames pendientes y el número de colas congestionadas
+ * se publican como gauges de chat_metrics, actualizados al encolar y al
+ * escribir; así leerlos no recorre las colas.
+ */
+size_t outbound_peak_queue_bytes(void);
+
+/**
+ * @brief Cierra la cola y descarta los frames pendientes
+ *
+ * Debe llamarse antes de cerrar el socket para que ningún productor
+ * escriba en un descriptor reutilizado.
+ *
+ * @param queue Cola de salida
+ */
+void outbound_queue_close(outbound_queue_t *queue);
+
+/**
+ * @brief Cierra la cola y entrega una copia de los bytes sin enviar
+ *
+ * Para ceder la conexión a otro proceso (ver chat_handoff.h): la copia
+ * incluye el resto del frame que se estaba escribiendo, de modo que el
+ * flujo del cliente sigue siendo válido si otro la envía tal cual.
+ *
+ * @param queue Cola de salida
+ * @param data Copia reservada con malloc() o NULL si no había nada
+ * @param length Bytes de la copia
+ * @return 0 en éxito, -1 si no hubo memoria (la cola se cierra igualmente)
+ */
+int outbound_queue_detach(outbound_queue_t *queue, char **data, size_t *length);
+
+/**
+ * @brief Encola bytes ya codificados en el formato de la cola
+ *
+ * Es la otra mitad de outbound_queue_detach(): debe llamarse con la cola
+ * vacía, antes de encolar ningún frame. No pasa por la política de
+ * desborde.
+ *
+ * @param queue Cola de salida
+ * @param data Bytes a enviar tal cual
+ * @param length Número de bytes
+ * @return 0 en éxito, -1 si no hay memoria o la conexión falló
+ */
+int outbound_queue_restore(outbound_queue_t *queue, const char *data, size_t length);
+
+#endif /* CHAT_OUTBOUND_H */
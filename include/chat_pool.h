@@ -0,0 +1,115 @@
+/**
+ * @file chat_pool.h
+ * @brief Pools de objetos de tamaño fijo con caché por thread
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cada pool reparte objetos de un único tamaño que se trocean de slabs
+ * grandes; los slabs no se devuelven al sistema, de modo que tras el
+ * calentamiento el servidor deja de usar el heap general y la memoria se
+ * mantiene plana aunque haya rotación de conexiones.
+ *
+ * Cada thread guarda una pequeña caché de objetos libres por pool: la
+ * mayoría de reservas y liberaciones no toman el lock del pool. Las
+ * cachés se mueven por lotes y se devuelven al pool cuando el thread
+ * termina.
+ *
+ * Los pools se declaran estáticos con POOL_INITIALIZER y se registran
+ * solos en la primera reserva. Compilando con -DCHAT_POOL_DISABLE se
+ * usa malloc() directamente (útil con valgrind o sanitizers).
+ */
+
+#ifndef CHAT_POOL_H
+#define CHAT_POOL_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DE LOS POOLS ========== */
+
+#define POOL_MAX_POOLS      32          /* Pools registrados como máximo */
+#define POOL_CACHE_OBJECTS  64          /* Caché máxima por thread y pool por defecto */
+
+/* ========== ESTRUCTURAS DE LOS POOLS ========== */
+
+/**
+ * @brief Objeto libre dentro de un pool
+ */
+typedef struct pool_object {
+    struct pool_object *next;
+} pool_object_t;
+
+/**
+ * @brief Pool de objetos de tamaño fijo
+ *
+ * Los campos a partir de lock son internos.
+ */
+typedef struct chat_pool {
+    const char *name;                       /* Nombre en métricas y log */
+    size_t object_size;                     /* Tamaño de cada objeto */
+    size_t slab_objects;                    /* Objetos por slab */
+    int cache_limit;                        /* Objetos en la caché de cada thread (0 = sin caché) */
+    pthread_mutex_t lock;
+    pool_object_t *free_list;               /* Objetos libres globales */
+    void *slabs;                            /* Lista de slabs reservados */
+    size_t slab_count;
+    int id;                                 /* Posición en el registro + 1 (0 = sin registrar) */
+    size_t in_use;                          /* Objetos entregados (atómico) */
+    size_t high_water;                      /* Máximo de in_use (atómico) */
+} chat_pool_t;
+
+/**
+ * @brief Inicializador estático de un pool
+ */
+#define POOL_INITIALIZER(name, object_size, slab_objects, cache_limit) \
+    { (name), (object_size), (slab_objects), (cache_limit), PTHREAD_MUTEX_INITIALIZER, \
+      NULL, NULL, 0, 0, 0, 0 }
+
+/**
+ * @brief Estadísticas de un pool
+ */
+typedef struct {
+    const char *name;
+    size_t object_size;                     /* Tamaño de cada objeto */
+    size_t in_use;                          /* Objetos entregados */
+    size_t high_water;                      /* Máximo histórico de objetos entregados */
+    size_t capacity;                        /* Objetos troceados de los slabs */
+    size_t slab_bytes;                      /* Memoria reservada en slabs */
+} pool_stats_t;
+
+/* ========== PROTOTIPOS DE LOS POOLS ========== */
+
+/**
+ * @brief Reserva un objeto del pool
+ * @param pool Pool
+ * @return Objeto sin inicializar o NULL si no hay memoria
+ */
+void *pool_alloc(chat_pool_t *pool);
+
+/**
+ * @brief Reserva un objeto del pool inicializado a cero
+ * @param pool Pool
+ * @return Objeto o NULL si no hay memoria
+ */
+void *pool_calloc(chat_pool_t *pool);
+
+/**
+ * @brief Devuelve un objeto al pool (sin efecto con NULL)
+ * @param pool Pool del que se reservó
+ * @param object Objeto
+ */
+void pool_free(chat_pool_t *pool, void *object);
+
+/**
+ * @brief Obtiene las estadísticas de los pools registrados
+ * @param stats Array de salida
+ * @param max Capacidad del array
+ * @return Número de pools escritos
+ */
+int pool_stats_all(pool_stats_t *stats, int max);
+
+/**
+ * @brief Registra en el log el uso y la marca máxima de cada pool
+ */
+void pool_log_summary(void);
+
+#endif /* CHAT_POOL_H */
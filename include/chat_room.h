@@ -0,0 +1,100 @@
+/**
+ * @file chat_room.h
+ * @brief Salas de chat con lista de miembros indexada
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cada cliente pertenece a una única sala; al conectarse entra en la sala
+ * por defecto (ROOM_DEFAULT_NAME). Cada sala mantiene un array denso de
+ * sus miembros, de modo que el fan-out de un mensaje recorre solo a los
+ * suscriptores de la sala y no a todos los clientes conectados.
+ *
+ * Las salas se buscan por nombre en una tabla hash; se crean con el
+ * primer miembro y se liberan al quedar vacías, salvo la sala por defecto.
+ * Cada entrada o salida incrementa la versión de presencia de la sala,
+ * con la que se numeran los cambios enviados como MSG_PRESENCE.
+ *
+ * La tabla no tiene lock propio: el llamador debe tener clients_mutex.
+ */
+
+#ifndef CHAT_ROOM_H
+#define CHAT_ROOM_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DE LAS SALAS ========== */
+
+#define ROOM_TABLE_INITIAL      64          /* Cubetas iniciales del hash de salas */
+#define ROOM_MEMBERS_INITIAL    8           /* Capacidad inicial de miembros por sala */
+
+/* ========== ESTRUCTURAS DE LAS SALAS ========== */
+
+/**
+ * @brief Una sala y sus miembros
+ */
+typedef struct chat_room {
+    char name[ROOM_NAME_SIZE];              /* Nombre de la sala */
+    unsigned int name_hash;                 /* Hash del nombre */
+    struct chat_room *hash_next;            /* Siguiente en la cubeta del hash */
+    client_info_t **members;                /* Miembros contiguos */
+    int member_count;                       /* Número de miembros */
+    int member_capacity;                    /* Capacidad del array de miembros */
+    unsigned long long presence_version;    /* Cambia con cada entrada o salida */
+} chat_room_t;
+
+/**
+ * @brief Tabla de salas activas
+ */
+typedef struct room_table {
+    chat_room_t **buckets;                  /* Cubetas del hash de nombres */
+    size_t bucket_count;                    /* Número de cubetas (potencia de 2) */
+    int count;                              /* Salas existentes */
+    chat_room_t *lobby;                     /* Sala por defecto (nunca se libera) */
+} room_table_t;
+
+/* ========== PROTOTIPOS DE LAS SALAS ========== */
+
+/**
+ * @brief Crea una tabla con la sala por defecto
+ * @return Tabla nueva o NULL si no hay memoria
+ */
+room_table_t *room_table_create(void);
+
+/**
+ * @brief Libera la tabla y todas sus salas (no libera los clientes)
+ * @param table Tabla de salas
+ */
+void room_table_destroy(room_table_t *table);
+
+/**
+ * @brief Busca una sala por nombre
+ * @param table Tabla de salas
+ * @param name Nombre de la sala
+ * @return Sala o NULL si no existe
+ */
+chat_room_t *room_table_find(const room_table_t *table, const char *name);
+
+/**
+ * @brief Mueve un cliente a una sala, creándola si no existe
+ *
+ * El cliente sale antes de su sala actual (si tiene una). Si falta
+ * memoria el cliente conserva su sala anterior.
+ *
+ * @param table Tabla de salas
+ * @param client Cliente
+ * @param name Nombre de la sala destino
+ * @return SUCCESS o ERROR_MEMORY
+ */
+int room_table_join(room_table_t *table, client_info_t *client, const char *name);
+
+/**
+ * @brief Saca a un cliente de su sala en O(1)
+ *
+ * La sala se libera si queda vacía y no es la sala por defecto.
+ *
+ * @param table Tabla de salas
+ * @param client Cliente
+ */
+void room_table_leave(room_table_t *table, client_info_t *client);
+
+#endif /* CHAT_ROOM_H */
@@ -12,26 +12,103 @@
 #define CHAT_SERVER_H
 
 #include "chat_common.h"
+#include "chat_frame.h"
+#include "chat_outbound.h"
+#include "chat_tls.h"
+#include "chat_cluster.h"
+#include "chat_handoff.h"
 
 /* ========== CONSTANTES ESPECÍFICAS DEL SERVIDOR ========== */
 
-#define LISTEN_BACKLOG      10          /* Tamaño de la cola de conexiones pendientes */
+#define LISTEN_BACKLOG      4096        /* Cola de conexiones pendientes por defecto (--backlog=N) */
 #define CLEANUP_INTERVAL    300         /* Intervalo de limpieza en segundos */
+#define DEFAULT_ENGINE      "threads"   /* Motor de E/S por defecto */
+#define BROADCAST_STACK_RECIPIENTS 256  /* Destinatarios del broadcast sin reservar memoria */
+#define BROADCAST_BATCH_MAX 32          /* Mensajes de chat seguidos repartidos en un recorrido */
+#define ACCEPT_BACKOFF_MS   100         /* Pausa del motor threads tras EMFILE/ENFILE */
+#define RATE_LIMIT_NOTICE_MS 5000       /* Intervalo mínimo entre avisos de exceso de mensajes */
 
 /* ========== ESTRUCTURAS ESPECÍFICAS DEL SERVIDOR ========== */
 
+/**
+ * @brief Configuración de arranque del servidor
+ * 
+ * Agrupa los parámetros recibidos por línea de comandos que determinan
+ * el puerto, el motor de E/S con el que se atienden los clientes y el
+ * tratamiento de los clientes lentos.
+ */
+typedef struct {
+    int port;                               /* Puerto en el que escuchar */
+    const char *engine_name;                /* Nombre del motor de E/S */
+    int event_loops;                        /* Threads de event loop (0 = automático) */
+    int max_clients;                        /* Límite de clientes concurrentes */
+    outbound_limits_t outbound;             /* Marcas y política de las colas de salida */
+    int flush_window_us;                    /* Ventana de agrupación de escrituras (0 = desactivada) */
+    int metrics_port;                       /* Puerto de administración /metrics (0 = desactivado) */
+    const char *metrics_address;            /* Dirección del puerto de administración */
+    int history_depth;                      /* Mensajes de historial por sala (0 = desactivado) */
+    const char *history_dir;                /* Directorio de los segmentos o NULL */
+    int keepalive_interval;                 /* Segundos de inactividad antes del sondeo (0 = nunca) */
+    int connection_timeout;                 /* Segundos para el handshake y la respuesta al sondeo */
+    const char *tls_cert;                   /* Certificado PEM o NULL sin TLS */
+    const char *tls_key;                    /* Clave privada PEM o NULL sin TLS */
+    int compression;                        /* Negociar deflate con los clientes que lo anuncian */
+    int compress_min;                       /* Frames compactos menores van sin comprimir */
+    int listen_backlog;                     /* Cola de conexiones pendientes del listen() */
+    int defer_accept;                       /* Segundos de TCP_DEFER_ACCEPT (0 = desactivado) */
+    int accept_rate;                        /* Conexiones/s admitidas por IP (0 = sin límite) */
+    int accept_burst;                       /* Ráfaga de conexiones por IP */
+    int accept_global;                      /* Conexiones/s admitidas en total (0 = sin límite) */
+    int message_rate;                       /* Mensajes/s por cliente (0 = sin límite) */
+    int message_ip_rate;                    /* Mensajes/s por IP (0 = sin límite) */
+    int message_burst;                      /* Ráfaga de mensajes de ambos límites */
+    int cluster_port;                       /* Puerto de los enlaces entre nodos (0 = sin clúster) */
+    const char *cluster_address;            /* Interfaz de los enlaces entre nodos */
+    const char *cluster_secret_file;        /* Fichero con el secreto compartido por los nodos */
+    const char *cluster_ca;                 /* CA de los certificados de los pares o NULL */
+    const char *cluster_peers[CLUSTER_MAX_PEERS]; /* Otros nodos (HOST:PORT) */
+    int cluster_peer_count;                 /* Número de pares */
+    const char *upgrade_socket;             /* Socket Unix del reinicio en caliente o NULL */
+} server_config_t;
+
 /**
  * @brief Argumentos para el thread de manejo de cliente
  * 
  * Estructura que se pasa al thread que maneja cada cliente individual,
  * conteniendo toda la información necesaria para la comunicación.
  */
-typedef struct {
+typedef struct client_thread_args {
     int client_socket;                      /* Socket del cliente */
     struct sockaddr_in client_addr;         /* Dirección del cliente */
     server_context_t *server_ctx;           /* Contexto del servidor */
+    client_info_t *client;                  /* Cliente heredado ya registrado o NULL */
+    int wake_fd;                            /* eventfd para despertar al thread */
+    struct client_thread_args *prev;        /* Lista de threads vivos */
+    struct client_thread_args *next;
 } client_thread_args_t;
 
+/**
+ * @brief Petición de reanudar una sesión (campos del MSG_CONNECT)
+ * 
+ * Ver WIRE_RESUME_CAPABILITY en chat_common.h.
+ */
+typedef struct {
+    char session[SESSION_TOKEN_SIZE];       /* Token de la conexión anterior */
+    char room[ROOM_NAME_SIZE];              /* Sala en la que estaba */
+    unsigned long long sequence;            /* Último número de secuencia recibido */
+    unsigned long long missed;              /* Salida: mensajes que ya no están en el historial */
+} session_resume_t;
+
+/**
+ * @brief Primeros frames de un cliente recién registrado
+ * 
+ * add_client() la llama bajo clients_mutex, justo después de meterlo en
+ * su sala: lo que encole queda por delante de cualquier fan-out. No debe
+ * volver a tomar clients_mutex. Suelta las referencias de history.
+ */
+typedef void (*client_greet_func_t)(client_info_t *client, shared_frame_t **history,
+                                    int history_count, void *arg);
+
 /* ========== PROTOTIPOS DE FUNCIONES DEL SERVIDOR ========== */
 
 /**
@@ -47,12 +124,63 @@ int init_server_context(server_context_t *ctx);
  */
 void cleanup_server_context(server_context_t *ctx);
 
+/**
+ * @brief Fija las opciones de los sockets de escucha que se creen después
+ * @param backlog Cola de conexiones pendientes (el kernel la limita a somaxconn)
+ * @param defer_accept Segundos de TCP_DEFER_ACCEPT: accept() no devuelve la
+ *                     conexión hasta que llegan datos (0 = desactivado)
+ */
+void server_set_listen_options(int backlog, int defer_accept);
+
 /**
  * @brief Crea y configura el socket del servidor
  * @param port Puerto en el que escuchar
+ * @param reuse_port Si es distinto de 0 activa SO_REUSEPORT para que varios
+ *                   sockets compartan el puerto y el kernel reparta conexiones
  * @return File descriptor del socket o -1 en error
  */
-int create_server_socket(int port);
+int create_server_socket(int port, int reuse_port);
+
+/**
+ * @brief Entrega a create_server_socket() sockets de escucha ya abiertos
+ * 
+ * Los sockets heredados de la versión anterior (ver chat_handoff.h) se
+ * usan en lugar de crear otros en su puerto; los que ningún motor pide se
+ * cierran al crear el primer socket sin SO_REUSEPORT o con
+ * server_close_inherited_listeners().
+ * 
+ * @param fds Sockets de escucha
+ * @param count Número de sockets (hasta HANDOFF_MAX_LISTENERS)
+ */
+void server_inherit_listeners(const int *fds, int count);
+
+/**
+ * @brief Cierra los sockets heredados que no usó ningún motor
+ */
+void server_close_inherited_listeners(void);
+
+/**
+ * @brief Duplica los sockets de escucha abiertos en un puerto
+ * @param port Puerto de los clientes
+ * @param fds Destino de los duplicados
+ * @param max Capacidad de fds
+ * @return Sockets duplicados
+ */
+int server_dup_listeners(int port, int *fds, int max);
+
+/**
+ * @brief Decide si se admite una conexión recién aceptada
+ * 
+ * Consulta el limitador de admisión del contexto; si la rechaza, cierra
+ * el socket y la cuenta en las métricas. Es compartido por todos los motores.
+ * 
+ * @param ctx Contexto del servidor
+ * @param client_socket Socket aceptado
+ * @param client_addr Dirección de origen
+ * @return 0 si se admite, -1 si se rechazó (el socket ya está cerrado)
+ */
+int server_admit_connection(server_context_t *ctx, int client_socket,
+                            const struct sockaddr_in *client_addr);
 
 /**
  * @brief Agrega un cliente a la lista de clientes conectados
@@ -60,16 +188,65 @@ int create_server_socket(int port);
  * @param client_socket Socket del cliente
  * @param client_addr Dirección del cliente
  * @param username Nombre de usuario del cliente
- * @return Índice del cliente en la lista o -1 en error
+ * @param resume Sesión que se reanuda o NULL: el cliente vuelve a su sala y
+ *               recibe solo los mensajes posteriores a resume->sequence
+ * @param greet Encola el saludo y el historial de la sala, copiado en la
+ *              misma sección crítica que la entrada (o NULL)
+ * @param greet_arg Argumento de greet
+ * @return SUCCESS, ERROR_FULL si se alcanzó el límite, ERROR_DUPLICATE si el
+ *         nombre ya está en uso, ERROR_RETRY si lo ocupaba la conexión
+ *         anterior de la sesión (se cierra y el cliente debe reintentar) o
+ *         ERROR_MEMORY
  */
 int add_client(server_context_t *ctx, int client_socket, 
-               struct sockaddr_in client_addr, const char *username);
+               struct sockaddr_in client_addr, const char *username,
+               session_resume_t *resume,
+               client_greet_func_t greet, void *greet_arg);
+
+/**
+ * @brief Registra un cliente heredado de la versión anterior
+ * 
+ * Como add_client() pero sin handshake ni avisos: el cliente vuelve a su
+ * sala y su cola de salida empieza con los bytes que la versión anterior
+ * no llegó a enviar. El motor lo adopta al arrancar (todo cliente que ya
+ * esté en la tabla es heredado).
+ * 
+ * @param ctx Contexto del servidor
+ * @param client_socket Socket recibido
+ * @param state Estado traspasado
+ * @param output Bytes sin enviar (state->output_length)
+ * @param input Bytes sin procesar (state->input_length)
+ * @return SUCCESS o código de error (el llamador cierra el socket)
+ */
+int server_adopt_client(server_context_t *ctx, int client_socket,
+                        const handoff_client_t *state,
+                        const char *output, const char *input);
+
+/**
+ * @brief Guarda en el cliente los bytes recibidos sin procesar
+ * 
+ * La usan los motores al detenerse para un traspaso: lo que quede en rx
+ * es un frame a medias que la versión nueva debe completar.
+ * 
+ * @param client Cliente registrado
+ * @param rx Buffer de recepción de la conexión
+ */
+void server_stash_client_input(client_info_t *client, const frame_buffer_t *rx);
+
+/**
+ * @brief Devuelve al buffer de recepción los bytes heredados de un cliente
+ * @param client Cliente heredado
+ * @param rx Buffer de recepción de la conexión
+ * @return 0 en éxito, -1 si no caben
+ */
+int server_restore_client_input(client_info_t *client, frame_buffer_t *rx);
 
 /**
  * @brief Remueve un cliente de la lista de clientes conectados
  * @param ctx Contexto del servidor
  * @param client_socket Socket del cliente a remover
  * @return 0 en éxito, -1 en error
+ * @note Libera el client_info_t: el llamador no debe usarlo después
  */
 int remove_client(server_context_t *ctx, int client_socket);
 
@@ -81,6 +258,26 @@ int remove_client(server_context_t *ctx, int client_socket);
  */
 client_info_t *find_client(server_context_t *ctx, int client_socket);
 
+/**
+ * @brief Encola uno o varios mensajes para todos los clientes de un grupo
+ * 
+ * Camino común de los broadcasts: serializa cada mensaje una vez y, bajo
+ * clients_mutex, solo copia las colas de los destinatarios. No cuenta el
+ * broadcast en las métricas ni reenvía al clúster.
+ * 
+ * @param ctx Contexto del servidor
+ * @param member_of Cliente cuya sala recibe los mensajes, o NULL
+ * @param room_name Sala buscada por nombre si member_of es NULL; con
+ *                  ambos a NULL se recorren todos los clientes conectados
+ * @param msgs Mensajes, todos del mismo tipo
+ * @param count Número de mensajes (1-BROADCAST_BATCH_MAX)
+ * @param exclude_socket Socket a excluir (-1 para incluir a todos)
+ * @return Número de clientes que recibieron los mensajes
+ */
+int fan_out_messages(server_context_t *ctx, const client_info_t *member_of,
+                     const char *room_name, const chat_message_t *msgs, int count,
+                     int exclude_socket);
+
 /**
  * @brief Envía un mensaje a todos los clientes conectados (broadcast)
  * @param ctx Contexto del servidor
@@ -90,13 +287,114 @@ client_info_t *find_client(server_context_t *ctx, int client_socket);
  */
 int broadcast_message(server_context_t *ctx, const chat_message_t *msg, int exclude_socket);
 
+/**
+ * @brief Envía un mensaje a los miembros de la sala de un cliente
+ * 
+ * El coste es proporcional a los miembros de la sala y no al total de
+ * clientes. El llamador debe ser dueño de member_of (su thread o su loop),
+ * lo que garantiza que la sala sigue existiendo durante la llamada.
+ * En modo clúster el mensaje se reenvía además a los otros nodos.
+ * 
+ * Con un motor con fan-out propio (broadcast_hook, motor reactor) los
+ * mensajes de chat no toman clients_mutex; el resto de tipos recorre los
+ * miembros de la sala bajo ese lock en todos los motores.
+ * 
+ * @param ctx Contexto del servidor
+ * @param member_of Cliente cuya sala actual recibe el mensaje
+ * @param msg Mensaje a enviar
+ * @param exclude_socket Socket a excluir (-1 para incluir a todos los miembros)
+ * @return Número de clientes que recibieron el mensaje (con broadcast_hook,
+ *         solo los del shard que llama: el resto se entrega después)
+ */
+int broadcast_to_room(server_context_t *ctx, const client_info_t *member_of,
+                      const chat_message_t *msg, int exclude_socket);
+
+/**
+ * @brief Envía varios mensajes de chat a la sala de un cliente en un solo recorrido
+ * 
+ * Equivale a llamar a broadcast_to_room() con cada mensaje, pero recorre
+ * la sala una sola vez y cada miembro recibe todos los mensajes en una
+ * única escritura. Mismas condiciones sobre member_of que
+ * broadcast_to_room().
+ * 
+ * @param ctx Contexto del servidor
+ * @param member_of Cliente cuya sala recibe los mensajes
+ * @param msgs Mensajes de chat, en orden
+ * @param count Número de mensajes (1-BROADCAST_BATCH_MAX)
+ * @return Número de clientes que recibieron los mensajes
+ */
+int broadcast_batch_to_room(server_context_t *ctx, const client_info_t *member_of,
+                            const chat_message_t *msgs, int count);
+
+/**
+ * @brief Envía un mensaje de otro nodo a los miembros locales de una sala
+ * 
+ * Solo hace el fan-out local (y guarda los mensajes de chat en el
+ * historial de la sala aunque aquí no tenga miembros); nunca reenvía al
+ * clúster, de modo que un mensaje no vuelve a cruzar ningún enlace.
+ * 
+ * @param ctx Contexto del servidor
+ * @param room_name Nombre de la sala
+ * @param msg Mensaje a enviar
+ * @return Número de clientes que recibieron el mensaje
+ */
+int broadcast_to_room_name(server_context_t *ctx, const char *room_name,
+                           const chat_message_t *msg);
+
+/**
+ * @brief Entrega un mensaje privado a un único usuario
+ * 
+ * Busca al destinatario en el índice de nombres de la tabla de clientes
+ * (O(1)) y encola el frame solo en su cola de salida. Los mensajes
+ * privados no pasan por el historial ni por el clúster: el destinatario
+ * debe estar conectado a este nodo.
+ * 
+ * @param ctx Contexto del servidor
+ * @param sender Cliente remitente
+ * @param recipient Nombre del destinatario
+ * @param text Texto del mensaje
+ * @return SUCCESS, ERROR_NOT_FOUND si el destinatario no está conectado,
+ *         ERROR_MEMORY sin memoria o ERROR_FULL si su cola lo rechazó
+ */
+int send_private_message(server_context_t *ctx, const client_info_t *sender,
+                         const char *recipient, const char *text);
+
 /**
  * @brief Envía un mensaje a un cliente específico
  * @param client_socket Socket del cliente destinatario
+ * @param format Formato de red negociado con el cliente
  * @param msg Mensaje a enviar
  * @return 0 en éxito, -1 en error
  */
-int send_message_to_client(int client_socket, const chat_message_t *msg);
+int send_message_to_client(int client_socket, wire_format_t format, const chat_message_t *msg);
+
+/**
+ * @brief Encola un mensaje para un cliente ya registrado
+ * 
+ * Todo lo que se envía tras el handshake pasa por la cola de salida del
+ * cliente para respetar el orden con los broadcasts.
+ * 
+ * @param client Cliente destinatario
+ * @param msg Mensaje a enviar
+ * @return 0 en éxito, -1 si la conexión está cerrada o falló
+ */
+int queue_message_to_client(client_info_t *client, const chat_message_t *msg);
+
+/**
+ * @brief Completa el handshake de un cliente a partir de su MSG_CONNECT
+ * 
+ * Valida el nombre de usuario, registra al cliente, envía el mensaje de
+ * bienvenida y notifica al resto. Es compartido por todos los motores.
+ * 
+ * @param ctx Contexto del servidor
+ * @param client_socket Socket del cliente
+ * @param client_addr Dirección del cliente
+ * @param msg Mensaje inicial recibido
+ * @return Puntero al cliente registrado o NULL si el handshake falla
+ */
+client_info_t *complete_client_handshake(server_context_t *ctx, int client_socket,
+                                         struct sockaddr_in client_addr,
+                                         const chat_message_t *msg);
 
 /**
  * @brief Thread principal para manejar un cliente individual
@@ -105,6 +403,39 @@ int send_message_to_client(int client_socket, const chat_message_t *msg);
  */
 void *handle_client_thread(void *args);
 
+/**
+ * @brief Procesa los frames completos acumulados de un cliente
+ * 
+ * Extrae mensajes del buffer de recepción hasta agotarlo. Si el cliente
+ * aún no está registrado, el primer frame completa el handshake y la
+ * función retorna 1 para que el motor pueda registrar la conexión antes
+ * de seguir procesando los frames restantes con una nueva llamada.
+ * 
+ * @param ctx Contexto del servidor
+ * @param rx Buffer de recepción de la conexión
+ * @param client_socket Socket del cliente
+ * @param client_addr Dirección del cliente
+ * @param client Cliente registrado (NULL antes del handshake; se actualiza)
+ * @return 1 si se acaba de completar el handshake, 0 si el buffer quedó
+ *         sin frames completos, -1 si la conexión debe cerrarse
+ */
+int process_client_frames(server_context_t *ctx, frame_buffer_t *rx, int client_socket,
+                          struct sockaddr_in client_addr, client_info_t **client);
+
+/**
+ * @brief Avanza el handshake TLS de una conexión recién aceptada
+ * 
+ * Al terminar (bien o mal) libera la sesión, deja *session a NULL y
+ * actualiza las métricas de TLS. Una sesión NULL cuenta como fallo.
+ * 
+ * @param session Handshake en curso (de tls_session_start())
+ * @param client_socket Socket del cliente
+ * @return TLS_STEP_DONE cuando el socket ya transporta frames en claro,
+ *         TLS_STEP_WANT_READ/WRITE mientras falten datos, TLS_STEP_FAILED
+ *         si la conexión debe cerrarse
+ */
+tls_step_t server_tls_step(tls_session_t **session, int client_socket);
+
 /**
  * @brief Procesa un mensaje recibido de un cliente
  * @param ctx Contexto del servidor
@@ -115,6 +446,22 @@ void *handle_client_thread(void *args);
 int process_client_message(server_context_t *ctx, client_info_t *client, 
                           const chat_message_t *msg);
 
+/**
+ * @brief Revisa la actividad de un cliente y envía un keepalive si toca
+ * 
+ * Tras ctx->keepalive_ms sin recibir datos se envía un MSG_KEEPALIVE; si
+ * en ctx->timeout_ms no llega nada más, la conexión se considera muerta.
+ * Puede llamarse desde cualquier thread: el estado de actividad es atómico.
+ * 
+ * @param ctx Contexto del servidor
+ * @param client Cliente registrado
+ * @param now_ms Tiempo actual (timer_now_ms())
+ * @param next_check_ms Próximo instante en que revisar (0 = nunca)
+ * @return 0 si la conexión sigue viva, -1 si debe cerrarse
+ */
+int check_client_liveness(server_context_t *ctx, client_info_t *client,
+                          long long now_ms, long long *next_check_ms);
+
 /**
  * @brief Maneja la desconexión de un cliente
  * @param ctx Contexto del servidor
@@ -123,19 +470,18 @@ int process_client_message(server_context_t *ctx, client_info_t *client,
 void handle_client_disconnect(server_context_t *ctx, client_info_t *client);
 
 /**
- * @brief Envía notificación de conexión de usuario
+ * @brief Envía notificación de conexión a los miembros de la sala del usuario
  * @param ctx Contexto del servidor
- * @param username Nombre del usuario que se conectó
- * @param exclude_socket Socket a excluir de la notificación
+ * @param client Usuario que se conectó (excluido de la notificación)
  */
-void notify_user_connected(server_context_t *ctx, const char *username, int exclude_socket);
+void notify_user_connected(server_context_t *ctx, const client_info_t *client);
 
 /**
- * @brief Envía notificación de desconexión de usuario
+ * @brief Envía notificación de desconexión a los miembros de la sala del usuario
  * @param ctx Contexto del servidor
- * @param username Nombre del usuario que se desconectó
+ * @param client Usuario que se desconecta, todavía miembro de su sala
  */
-void notify_user_disconnected(server_context_t *ctx, const char *username);
+void notify_user_disconnected(server_context_t *ctx, const client_info_t *client);
 
 /**
  * @brief Manejador de señales para cierre graceful del servidor
@@ -157,9 +503,9 @@ void print_server_stats(const server_context_t *ctx);
 
 /**
  * @brief Función principal del servidor
- * @param port Puerto en el que ejecutar el servidor
+ * @param config Configuración del servidor (puerto y motor de E/S)
  * @return 0 en éxito, código de error en fallo
  */
-int run_server(int port);
+int run_server(const server_config_t *config);
 
 #endif /* CHAT_SERVER_H */
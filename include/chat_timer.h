@@ -0,0 +1,128 @@
+/**
+ * @file chat_timer.h
+ * @brief Rueda de temporizadores jerárquica
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cada nivel tiene TIMER_WHEEL_SLOTS ranuras; una ranura del nivel 0 dura
+ * un tick y cada nivel superior cubre TIMER_WHEEL_SLOTS veces el rango del
+ * anterior. Un temporizador se coloca en el nivel más bajo que abarca su
+ * vencimiento y baja de nivel cuando su ranura llega al frente, así que
+ * armar, rearmar y cancelar son O(1) y avanzar un tick solo toca las
+ * ranuras que vencen en él.
+ *
+ * Los temporizadores son nodos intrusivos de listas circulares: no se
+ * reserva memoria al armarlos. La rueda no tiene lock propio; la usa
+ * únicamente el thread que la posee (cada event loop tiene la suya).
+ */
+
+#ifndef CHAT_TIMER_H
+#define CHAT_TIMER_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DE LA RUEDA ========== */
+
+#define TIMER_TICK_MS           100         /* Resolución de la rueda */
+#define TIMER_WHEEL_BITS        6           /* log2 de las ranuras por nivel */
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS      4           /* 64^4 ticks: unos 19 días */
+
+/* ========== ESTRUCTURAS DE LA RUEDA ========== */
+
+/**
+ * @brief Función que se ejecuta al vencer un temporizador
+ *
+ * El temporizador ya está desarmado: la función puede rearmarlo o
+ * liberar la estructura que lo contiene.
+ */
+typedef void (*timer_callback_t)(void *data);
+
+/**
+ * @brief Temporizador intrusivo
+ */
+typedef struct wheel_timer {
+    struct wheel_timer *prev;               /* Lista circular de la ranura */
+    struct wheel_timer *next;
+    unsigned long long expires;             /* Tick de vencimiento */
+    timer_callback_t callback;              /* Acción al vencer */
+    void *data;                             /* Argumento de la acción */
+} wheel_timer_t;
+
+/**
+ * @brief Rueda de temporizadores
+ */
+typedef struct {
+    wheel_timer_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];  /* Centinelas */
+    unsigned long long now;                 /* Último tick procesado */
+    int count;                              /* Temporizadores armados */
+} timer_wheel_t;
+
+/* ========== PROTOTIPOS DE LA RUEDA ========== */
+
+/**
+ * @brief Milisegundos de un reloj monótono
+ * @return Tiempo actual en ms
+ */
+long long timer_now_ms(void);
+
+/**
+ * @brief Inicializa una rueda vacía
+ * @param wheel Rueda
+ * @param now_ms Tiempo actual (timer_now_ms())
+ */
+void timer_wheel_init(timer_wheel_t *wheel, long long now_ms);
+
+/**
+ * @brief Inicializa un temporizador desarmado
+ * @param timer Temporizador
+ * @param callback Acción al vencer
+ * @param data Argumento de la acción
+ */
+void timer_init(wheel_timer_t *timer, timer_callback_t callback, void *data);
+
+/**
+ * @brief Indica si un temporizador está armado
+ * @param timer Temporizador
+ * @return 1 si está armado, 0 si no
+ */
+int timer_pending(const wheel_timer_t *timer);
+
+/**
+ * @brief Arma (o rearma) un temporizador en O(1)
+ * @param wheel Rueda
+ * @param timer Temporizador
+ * @param expires_ms Instante de vencimiento (como mínimo el siguiente tick)
+ */
+void timer_wheel_arm(timer_wheel_t *wheel, wheel_timer_t *timer, long long expires_ms);
+
+/**
+ * @brief Cancela un temporizador en O(1) (sin efecto si no está armado)
+ * @param wheel Rueda
+ * @param timer Temporizador
+ */
+void timer_wheel_cancel(timer_wheel_t *wheel, wheel_timer_t *timer);
+
+/**
+ * @brief Avanza la rueda hasta now_ms y ejecuta los temporizadores vencidos
+ * @param wheel Rueda
+ * @param now_ms Tiempo actual
+ * @return Temporizadores ejecutados
+ */
+int timer_wheel_advance(timer_wheel_t *wheel, long long now_ms);
+
+/**
+ * @brief Espera máxima antes de que haya que volver a avanzar la rueda
+ *
+ * Es exacta para los vencimientos del nivel 0; si solo hay temporizadores
+ * en niveles superiores devuelve el tiempo hasta la próxima ranura que
+ * baja de nivel.
+ *
+ * @param wheel Rueda
+ * @param now_ms Tiempo actual
+ * @param max_ms Espera máxima deseada
+ * @return Milisegundos entre 0 y max_ms
+ */
+int timer_wheel_timeout_ms(const timer_wheel_t *wheel, long long now_ms, int max_ms);
+
+#endif /* CHAT_TIMER_H */
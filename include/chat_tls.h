@@ -0,0 +1,155 @@
+/**
+ * @file chat_tls.h
+ * @brief Transporte TLS con el cifrado simétrico delegado en el kernel (kTLS)
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * OpenSSL solo hace el handshake. Al terminarlo, las claves de sesión se
+ * instalan en el socket con kTLS en ambos sentidos y el objeto SSL se
+ * libera: a partir de ahí el descriptor se usa con send/recv/sendmsg
+ * normales y el kernel cifra y descifra cada registro. Así el broadcast
+ * serializado una vez, las escrituras agrupadas y el motor io_uring
+ * funcionan igual sobre TLS, sin copias extra en espacio de usuario.
+ *
+ * Se negocia TLS 1.2 con AES-GCM o ChaCha20-Poly1305: es la versión con
+ * kTLS de recepción en OpenSSL 3.0 y no tiene mensajes posteriores al
+ * handshake que el kernel no sepa tratar. Las sesiones se reanudan con
+ * tickets (y la caché del servidor), de modo que una tormenta de
+ * reconexiones no repite el intercambio de claves completo.
+ *
+ * El handshake es no bloqueante y se avanza con tls_session_step() cuando
+ * el socket está listo, para que los event loops no se detengan; los
+ * threads bloqueantes usan tls_handshake(). Compilando con
+ * -DCHAT_NO_TLS (make NO_TLS=1) el módulo no depende de OpenSSL y crear
+ * un contexto devuelve NULL.
+ */
+
+#ifndef CHAT_TLS_H
+#define CHAT_TLS_H
+
+#include "chat_common.h"
+
+/* ========== CONSTANTES DE TLS ========== */
+
+#define TLS_SESSION_CACHE_SIZE  20480       /* Sesiones en la caché del servidor */
+#define TLS_SESSION_TIMEOUT     7200        /* Segundos de validez de una sesión */
+#define TLS_HANDSHAKE_TIMEOUT_MS 10000      /* Espera máxima de tls_handshake() en el cliente */
+#define TLS_HMAC_SIZE           32          /* Bytes de un HMAC-SHA256 */
+
+/* ========== ESTRUCTURAS DE TLS ========== */
+
+/**
+ * @brief Resultado de avanzar un handshake
+ */
+typedef enum {
+    TLS_STEP_FAILED = -1,   /* Handshake o kTLS fallidos: cerrar la conexión */
+    TLS_STEP_DONE = 0,      /* kTLS instalado: el socket ya transporta texto claro */
+    TLS_STEP_WANT_READ,     /* Esperar a que el socket sea legible */
+    TLS_STEP_WANT_WRITE     /* Esperar a que el socket sea escribible */
+} tls_step_t;
+
+/**
+ * @brief Configuración TLS compartida (certificados, caché de sesiones)
+ */
+typedef struct tls_context tls_context_t;
+
+/**
+ * @brief Handshake en curso sobre un socket
+ */
+typedef struct tls_session tls_session_t;
+
+/* ========== PROTOTIPOS DE TLS ========== */
+
+/**
+ * @brief Comprueba que el kernel admite kTLS (ULP "tls")
+ * @return 1 si lo admite, 0 si no
+ */
+int tls_kernel_supported(void);
+
+/**
+ * @brief Crea el contexto del servidor
+ * @param cert_file Certificado en PEM (puede incluir la cadena)
+ * @param key_file Clave privada en PEM
+ * @return Contexto o NULL en error
+ */
+tls_context_t *tls_server_create(const char *cert_file, const char *key_file);
+
+/**
+ * @brief Crea el contexto de un cliente
+ *
+ * Guarda la última sesión negociada para reanudarla en las siguientes
+ * conexiones.
+ *
+ * @param ca_file CA con la que verificar al servidor (NULL = CAs del sistema)
+ * @param verify 0 para no verificar el certificado (pruebas y benchmark)
+ * @return Contexto o NULL en error
+ */
+tls_context_t *tls_client_create(const char *ca_file, int verify);
+
+/**
+ * @brief Libera un contexto (sin efecto con NULL)
+ * @param ctx Contexto
+ */
+void tls_context_destroy(tls_context_t *ctx);
+
+/**
+ * @brief Empieza un handshake sobre un socket conectado
+ *
+ * El socket pasa a no bloqueante hasta que el handshake termina y luego
+ * recupera sus flags.
+ *
+ * @param ctx Contexto de servidor o de cliente
+ * @param fd Socket
+ * @param peer_ip IP del servidor a verificar en el certificado (cliente) o NULL
+ * @return Sesión o NULL si no hay memoria
+ */
+tls_session_t *tls_session_start(tls_context_t *ctx, int fd, const char *peer_ip);
+
+/**
+ * @brief Avanza el handshake sin bloquear
+ * @param session Sesión
+ * @return Estado del handshake (tls_step_t)
+ */
+tls_step_t tls_session_step(tls_session_t *session);
+
+/**
+ * @brief Indica si el handshake terminado reanudó una sesión anterior
+ * @param session Sesión
+ * @return 1 si se reanudó, 0 si fue un handshake completo
+ */
+int tls_session_resumed(const tls_session_t *session);
+
+/**
+ * @brief Libera una sesión (sin efecto con NULL); no cierra el socket
+ * @param session Sesión
+ */
+void tls_session_free(tls_session_t *session);
+
+/**
+ * @brief Handshake completo esperando con poll()
+ * @param ctx Contexto
+ * @param fd Socket conectado
+ * @param peer_ip IP a verificar (cliente) o NULL
+ * @param timeout_ms Espera máxima total
+ * @param resumed Destino del indicador de sesión reanudada o NULL
+ * @return 0 con kTLS instalado, -1 en error
+ */
+int tls_handshake(tls_context_t *ctx, int fd, const char *peer_ip, int timeout_ms, int *resumed);
+
+/**
+ * @brief Calcula HMAC-SHA256
+ *
+ * Lo usa el clúster para autenticar a los nodos con su secreto compartido.
+ * Compilando con -DCHAT_NO_TLS no hay implementación y devuelve -1.
+ *
+ * @param key Clave
+ * @param key_length Bytes de la clave
+ * @param data Datos autenticados
+ * @param data_length Bytes de los datos
+ * @param mac Destino del código (TLS_HMAC_SIZE bytes)
+ * @return 0 en éxito, -1 en error
+ */
+int tls_hmac_sha256(const void *key, size_t key_length, const void *data, size_t data_length,
+                    unsigned char mac[TLS_HMAC_SIZE]);
+
+#endif /* CHAT_TLS_H */
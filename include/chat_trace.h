@@ -0,0 +1,59 @@
+/**
+ * @file chat_trace.h
+ * @brief Puntos de traza estáticos (USDT) para bpftrace, perf y SystemTap
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Si al compilar existe <sys/sdt.h> (paquete systemtap-sdt-dev), cada
+ * CHAT_TRACE deja en el binario un nop y una nota ELF con el proveedor
+ * "chat", el nombre del punto y dónde encontrar sus argumentos. Sin nadie
+ * trazando, el coste es ese nop y evaluar los argumentos, que son valores
+ * ya calculados (descriptores, punteros, longitudes); el tracer que se
+ * engancha toma la hora con su propio reloj (nsecs en bpftrace). Con
+ * make NO_USDT=1, o sin la cabecera, las macros no generan código.
+ *
+ * Puntos del servidor (ver scripts/trace/):
+ *
+ *   accept(fd, ip, puerto)                  conexión admitida (orden de red)
+ *   handshake(fd, usuario, formato, reanudada) cliente registrado
+ *   recv(fd, bytes)                         lectura del socket de un cliente
+ *   message(fd, usuario, tipo, bytes)       frame extraído del buffer
+ *   fanout_lock(sala, mensajes)             antes de tomar clients_mutex
+ *   fanout_locked(sala, mensajes)           clients_mutex tomado
+ *   fanout_done(destinatarios, entregas, inicio_ns) frames encolados a todos
+ *   enqueue(fd, frames, bytes_en_cola)      frames añadidos a una cola
+ *   sendmsg(fd, iovecs, resultado, inicio_ns) sendmsg() de una cola
+ *   sent(fd, bytes, frames)                 bytes confirmados por el kernel
+ *   disconnect(fd, usuario, hora_conexión)  cliente retirado de la tabla
+ *
+ * Los usuarios y salas son punteros a cadenas terminadas en '\0' (str()
+ * en bpftrace); fanout_lock lleva NULL como sala en el broadcast global.
+ * inicio_ns es CLOCK_MONOTONIC (ver metrics_now_ns()), el mismo reloj
+ * que nsecs.
+ */
+
+#ifndef CHAT_TRACE_H
+#define CHAT_TRACE_H
+
+#ifdef CHAT_USDT
+
+#include <sys/sdt.h>
+
+#define CHAT_TRACE1(name, a)                DTRACE_PROBE1(chat, name, a)
+#define CHAT_TRACE2(name, a, b)             DTRACE_PROBE2(chat, name, a, b)
+#define CHAT_TRACE3(name, a, b, c)          DTRACE_PROBE3(chat, name, a, b, c)
+#define CHAT_TRACE4(name, a, b, c, d)       DTRACE_PROBE4(chat, name, a, b, c, d)
+
+#else
+
+/* sizeof no evalúa sus operandos: ni código ni avisos de variables sin usar */
+#define CHAT_TRACE1(name, a)                do { (void)sizeof(a); } while (0)
+#define CHAT_TRACE2(name, a, b)             do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define CHAT_TRACE3(name, a, b, c) \
+    do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#define CHAT_TRACE4(name, a, b, c, d) \
+    do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); (void)sizeof(d); } while (0)
+
+#endif /* CHAT_USDT */
+
+#endif /* CHAT_TRACE_H */
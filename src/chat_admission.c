@@ -0,0 +1,176 @@
+/**
+ * @file chat_admission.c
+ * @brief Implementación del limitador de admisión de conexiones
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Los tokens se cuentan en milésimas para rellenar con aritmética entera:
+ * a R conexiones por segundo, cada milisegundo aporta R milésimas.
+ */
+
+#include "../include/chat_admission.h"
+
+#define TOKEN_UNIT 1000LL                   /* Milésimas de token por conexión */
+#define STRIPE_SIZE (ADMISSION_TABLE_SIZE / ADMISSION_STRIPES)
+
+/**
+ * @brief Cubeta de una IP de origen
+ */
+typedef struct {
+    uint32_t ip;                            /* Dirección en orden de red */
+    int used;                               /* Entrada ocupada */
+    token_bucket_t bucket;
+} admission_entry_t;
+
+struct admission {
+    pthread_mutex_t stripe_locks[ADMISSION_STRIPES]; /* Uno por franja de la tabla */
+    pthread_mutex_t global_lock;            /* Protege la cubeta global */
+    int per_ip_rate;                        /* Tokens por segundo por IP (0 = sin límite) */
+    int per_ip_burst;                       /* Ráfaga por IP */
+    int global_rate;                        /* Tokens por segundo en total (0 = sin límite) */
+    token_bucket_t global;
+    admission_entry_t entries[ADMISSION_TABLE_SIZE];
+};
+
+/**
+ * @brief Rellena una cubeta e intenta consumir un token
+ */
+int token_bucket_take(token_bucket_t *bucket, int rate, int burst, long long now_ms)
+{
+    long long capacity = (long long)burst * TOKEN_UNIT;
+    long long elapsed = now_ms - bucket->last_ms;
+    if (elapsed > 0) {
+        /* Limitar antes de multiplicar: tras mucho tiempo la cubeta ya está llena */
+        if (elapsed > capacity / rate + 1) {
+            bucket->tokens = capacity;
+        } else {
+            bucket->tokens += elapsed * rate;
+            if (bucket->tokens > capacity) bucket->tokens = capacity;
+        }
+        bucket->last_ms = now_ms;
+    }
+
+    if (bucket->tokens < TOKEN_UNIT) {
+        return 0;
+    }
+    bucket->tokens -= TOKEN_UNIT;
+    return 1;
+}
+
+/**
+ * @brief Posición inicial de una IP en la tabla (su franja es slot / STRIPE_SIZE)
+ */
+static unsigned int ip_slot(uint32_t ip)
+{
+    return (unsigned int)((ip * 2654435761u) >> 20) & (ADMISSION_TABLE_SIZE - 1);
+}
+
+/**
+ * @brief Busca la cubeta de una IP, reutilizando la más antigua si no hay hueco
+ *
+ * El sondeo no sale de la franja de la IP, cuyo mutex debe tener el
+ * llamador.
+ */
+static token_bucket_t *find_bucket(admission_t *admission, uint32_t ip, long long now_ms)
+{
+    unsigned int slot = ip_slot(ip);
+    unsigned int base = slot & ~(unsigned int)(STRIPE_SIZE - 1);
+    admission_entry_t *oldest = NULL;
+
+    for (int i = 0; i < ADMISSION_PROBE; i++) {
+        admission_entry_t *entry = &admission->entries[base + ((slot + (unsigned int)i) & (STRIPE_SIZE - 1))];
+
+        if (entry->used && entry->ip == ip) {
+            return &entry->bucket;
+        }
+        if (!entry->used) {
+            oldest = entry;
+            break;
+        }
+        if (!oldest || entry->bucket.last_ms < oldest->bucket.last_ms) {
+            oldest = entry;
+        }
+    }
+
+    /* IP nueva (o desalojo): empieza con la cubeta llena */
+    oldest->used = 1;
+    oldest->ip = ip;
+    oldest->bucket.tokens = (long long)admission->per_ip_burst * TOKEN_UNIT;
+    oldest->bucket.last_ms = now_ms;
+    return &oldest->bucket;
+}
+
+/**
+ * @brief Crea un limitador de admisión
+ */
+admission_t *admission_create(int per_ip_rate, int per_ip_burst, int global_rate)
+{
+    if (per_ip_rate <= 0 && global_rate <= 0) {
+        return NULL;
+    }
+
+    admission_t *admission = calloc(1, sizeof(admission_t));
+    if (!admission) {
+        return NULL;
+    }
+
+    for (int i = 0; i < ADMISSION_STRIPES; i++) {
+        pthread_mutex_init(&admission->stripe_locks[i], NULL);
+    }
+    pthread_mutex_init(&admission->global_lock, NULL);
+
+    admission->per_ip_rate = per_ip_rate > 0 ? per_ip_rate : 0;
+    admission->per_ip_burst = per_ip_burst > 0 ? per_ip_burst : 1;
+    admission->global_rate = global_rate > 0 ? global_rate : 0;
+    admission->global.tokens = (long long)(global_rate > 0 ? global_rate : 1) * TOKEN_UNIT;
+    return admission;
+}
+
+/**
+ * @brief Consume un token para una conexión nueva
+ *
+ * Primero la cubeta de la IP: una IP que abusa no gasta tokens globales
+ * que necesitan las demás.
+ */
+int admission_allow(admission_t *admission, const struct sockaddr_in *addr, long long now_ms)
+{
+    if (!admission) return 1;
+
+    int allowed = 1;
+
+    if (admission->per_ip_rate > 0 && addr) {
+        uint32_t ip = addr->sin_addr.s_addr;
+        pthread_mutex_t *lock = &admission->stripe_locks[ip_slot(ip) / STRIPE_SIZE];
+
+        pthread_mutex_lock(lock);
+        token_bucket_t *bucket = find_bucket(admission, ip, now_ms);
+        allowed = token_bucket_take(bucket, admission->per_ip_rate, admission->per_ip_burst, now_ms);
+        pthread_mutex_unlock(lock);
+    }
+
+    if (allowed && admission->global_rate > 0) {
+        pthread_mutex_lock(&admission->global_lock);
+        if (admission->global.last_ms == 0) {
+            admission->global.last_ms = now_ms;
+        }
+        allowed = token_bucket_take(&admission->global, admission->global_rate,
+                                    admission->global_rate, now_ms);
+        pthread_mutex_unlock(&admission->global_lock);
+    }
+
+    return allowed;
+}
+
+/**
+ * @brief Libera un limitador de admisión
+ */
+void admission_destroy(admission_t *admission)
+{
+    if (!admission) return;
+
+    for (int i = 0; i < ADMISSION_STRIPES; i++) {
+        pthread_mutex_destroy(&admission->stripe_locks[i]);
+    }
+    pthread_mutex_destroy(&admission->global_lock);
+    free(admission);
+}
@@ -0,0 +1,794 @@
+/**
+ * @file chat_bench.c
+ * @brief Implementación del generador de carga del sistema de chat
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Fases de una ejecución:
+ * 1. Conexión: se abren todos los clientes y se espera su bienvenida.
+ * 2. Calentamiento: se envía a la tasa objetivo sin medir.
+ * 3. Medición: solo cuentan los mensajes enviados en esta ventana.
+ * 4. Drenaje: se deja de enviar y se esperan las entregas pendientes.
+ *
+ * El contenido de cada mensaje empieza por "<instante_ns> <emisor> <seq> ",
+ * con el reloj monotónico del propio proceso, así que la latencia solo es
+ * significativa con el benchmark y el servidor en la misma máquina o con
+ * relojes sincronizados.
+ */
+
+#include "../include/chat_bench.h"
+#include <fcntl.h>
+#include <sys/epoll.h>
+
+/* Indicador de interrupción activado por el manejador de señales */
+static volatile sig_atomic_t bench_interrupted = 0;
+
+/* ========== FUNCIONES AUXILIARES ========== */
+
+/**
+ * @brief Instante monotónico actual en nanosegundos
+ */
+static unsigned long long bench_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+/**
+ * @brief Registra una latencia en el histograma
+ */
+static void histogram_record(bench_histogram_t *hist, unsigned long long value)
+{
+    int index;
+
+    if (value < BENCH_SUB_BUCKETS) {
+        index = (int)value;
+    } else {
+        unsigned long long capped = value;
+        unsigned long long max_value = (1ULL << (BENCH_MAX_EXPONENT + 1)) - 1;
+        if (capped > max_value) {
+            capped = max_value;
+        }
+        int exponent = 63 - __builtin_clzll(capped);
+        int sub = (int)(capped >> (exponent - BENCH_SUB_BITS)) & (BENCH_SUB_BUCKETS - 1);
+        index = (exponent - BENCH_SUB_BITS + 1) * BENCH_SUB_BUCKETS + sub;
+    }
+
+    hist->buckets[index]++;
+    hist->count++;
+    hist->sum += value;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+/**
+ * @brief Percentil del histograma (límite superior del bucket)
+ */
+static unsigned long long histogram_percentile(const bench_histogram_t *hist, double percentile)
+{
+    if (hist->count == 0) return 0;
+
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * (double)hist->count);
+    if (rank >= hist->count) {
+        rank = hist->count - 1;
+    }
+
+    unsigned long long seen = 0;
+    for (int i = 0; i < BENCH_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen > rank) {
+            if (i < BENCH_SUB_BUCKETS) {
+                return (unsigned long long)i + 1;
+            }
+            int exponent = i / BENCH_SUB_BUCKETS + BENCH_SUB_BITS - 1;
+            int sub = i % BENCH_SUB_BUCKETS;
+            unsigned long long upper = (unsigned long long)(BENCH_SUB_BUCKETS + sub + 1)
+                                       << (exponent - BENCH_SUB_BITS);
+            return upper < hist->max ? upper : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+/**
+ * @brief Añade bytes al buffer de envío de un cliente
+ * @return 0 en éxito, -1 si no hay memoria
+ */
+static int conn_queue(bench_conn_t *conn, const char *data, size_t length)
+{
+    if (conn->tx_length + length > conn->tx_capacity) {
+        size_t capacity = conn->tx_capacity ? conn->tx_capacity : 4096;
+        while (capacity < conn->tx_length + length) {
+            capacity *= 2;
+        }
+        char *tx = realloc(conn->tx, capacity);
+        if (!tx) {
+            return -1;
+        }
+        conn->tx = tx;
+        conn->tx_capacity = capacity;
+    }
+
+    memcpy(conn->tx + conn->tx_length, data, length);
+    conn->tx_length += length;
+    return 0;
+}
+
+/**
+ * @brief Escribe sin bloquear todo lo posible del buffer de envío
+ * @return 0 si la conexión sigue viva, -1 si falló
+ */
+static int conn_flush(bench_conn_t *conn)
+{
+    size_t offset = 0;
+
+    while (offset < conn->tx_length) {
+        ssize_t sent = send(conn->fd, conn->tx + offset, conn->tx_length - offset,
+                            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        offset += (size_t)sent;
+    }
+
+    memmove(conn->tx, conn->tx + offset, conn->tx_length - offset);
+    conn->tx_length -= offset;
+    return 0;
+}
+
+/**
+ * @brief Serializa y encola un mensaje para un cliente
+ */
+static int conn_send_message(bench_conn_t *conn, wire_format_t format, const chat_message_t *msg)
+{
+    char frame[WIRE_MAX_FRAME_SIZE];
+    ssize_t length = serialize_message_as(msg, format, frame, sizeof(frame));
+    if (length < 0) {
+        return -1;
+    }
+
+    if (conn_queue(conn, frame, (size_t)length) < 0) {
+        return -1;
+    }
+    return conn_flush(conn);
+}
+
+/**
+ * @brief Envía el lote pendiente de un emisor
+ *
+ * Un solo mensaje viaja como frame normal, sin cabecera de lote.
+ */
+static int conn_flush_batch(bench_conn_t *conn)
+{
+    if (conn->batch_count == 0) {
+        return 0;
+    }
+
+    char *start = conn->batch + WIRE_BATCH_HEADER_MAX;
+    size_t length = conn->batch_length;
+    if (conn->batch_count > 1) {
+        char header[WIRE_BATCH_HEADER_MAX];
+        size_t header_length = wire_put_batch_header(header, length);
+        start -= header_length;
+        memcpy(start, header, header_length);
+        length += header_length;
+    }
+
+    conn->batch_length = 0;
+    conn->batch_count = 0;
+    if (conn_queue(conn, start, length) < 0) {
+        return -1;
+    }
+    return conn_flush(conn);
+}
+
+/**
+ * @brief Añade un mensaje al lote de un emisor y lo envía si se llena
+ */
+static int conn_batch_message(bench_conn_t *conn, const bench_config_t *config,
+                              const chat_message_t *msg)
+{
+    char frame[WIRE_MAX_FRAME_SIZE];
+    ssize_t length = serialize_message_as(msg, config->format, frame, sizeof(frame));
+    if (length < 0) {
+        return -1;
+    }
+
+    if (!conn->batch) {
+        conn->batch = malloc(WIRE_BATCH_HEADER_MAX + BENCH_BATCH_BYTES);
+        if (!conn->batch) {
+            return -1;
+        }
+    }
+    if (conn->batch_length + (size_t)length > BENCH_BATCH_BYTES && conn_flush_batch(conn) < 0) {
+        return -1;
+    }
+
+    memcpy(conn->batch + WIRE_BATCH_HEADER_MAX + conn->batch_length, frame, (size_t)length);
+    conn->batch_length += (size_t)length;
+    conn->batch_count++;
+    return conn->batch_count >= config->batch ? conn_flush_batch(conn) : 0;
+}
+
+/**
+ * @brief Envía un mensaje de chat con su instante de envío
+ */
+static int send_chat(bench_conn_t *conn, const bench_config_t *config, int sender,
+                     unsigned long long seq, unsigned long long now)
+{
+    chat_message_t msg;
+    char username[USERNAME_SIZE];
+    char content[MESSAGE_SIZE];
+
+    snprintf(username, sizeof(username), BENCH_USER_PREFIX "%d", sender);
+
+    int length = snprintf(content, sizeof(content), "%llu %d %llu ", now, sender, seq);
+    int target = config->payload < (int)sizeof(content) - 1 ? config->payload : (int)sizeof(content) - 1;
+    if (length < target) {
+        memset(content + length, 'x', (size_t)(target - length));
+        length = target;
+    }
+    content[length] = '\0';
+
+    init_message(&msg, MSG_CHAT, username, content);
+    if (config->batch > 1) {
+        return conn_batch_message(conn, config, &msg);
+    }
+    return conn_send_message(conn, config->format, &msg);
+}
+
+/**
+ * @brief Miembros de una sala cuando los clientes se reparten por turnos
+ */
+static int bench_room_members(const bench_config_t *config, int room)
+{
+    return config->clients / config->rooms + (room < config->clients % config->rooms ? 1 : 0);
+}
+
+/**
+ * @brief Envía el MSG_JOIN de un cliente a su sala
+ */
+static int send_join(bench_conn_t *conn, const bench_config_t *config, int index)
+{
+    chat_message_t msg;
+    char username[USERNAME_SIZE];
+    char room[ROOM_NAME_SIZE];
+
+    snprintf(username, sizeof(username), BENCH_USER_PREFIX "%d", index);
+    snprintf(room, sizeof(room), BENCH_ROOM_PREFIX "%d", index % config->rooms);
+
+    init_message(&msg, MSG_JOIN, username, room);
+    return conn_send_message(conn, config->format, &msg);
+}
+
+/**
+ * @brief Procesa un frame recibido por un cliente simulado
+ */
+static void handle_frame(bench_conn_t *conn, const chat_message_t *msg, bench_stats_t *stats,
+                         unsigned long long window_start, unsigned long long window_end)
+{
+    if (msg->type == MSG_CHAT &&
+        strncmp(msg->username, BENCH_USER_PREFIX, sizeof(BENCH_USER_PREFIX) - 1) == 0) {
+        unsigned long long sent_at = strtoull(msg->content, NULL, 10);
+        unsigned long long now = bench_now_ns();
+
+        stats->delivered++;
+        if (sent_at >= window_start && sent_at < window_end) {
+            stats->delivered_measured++;
+            histogram_record(&stats->latency, now > sent_at ? now - sent_at : 0);
+        }
+        return;
+    }
+
+    if (msg->type == MSG_ERROR) {
+        fprintf(stderr, "Error del servidor: %s\n", msg->content);
+        return;
+    }
+
+    /* Contestar a los sondeos para que el servidor no cierre a los receptores */
+    if (msg->type == MSG_KEEPALIVE) {
+        chat_message_t reply;
+        init_message(&reply, MSG_KEEPALIVE, BENCH_USER_PREFIX, "");
+        conn_send_message(conn, conn->format, &reply);
+        return;
+    }
+
+    if (msg->type == MSG_JOIN && !conn->joined) {
+        conn->joined = 1;
+        stats->joined_clients++;
+    }
+
+    /* La bienvenida (o cualquier notificación) confirma el registro */
+    if (!conn->ready && msg->type == MSG_NOTIFICATION) {
+        conn->ready = 1;
+        stats->ready_clients++;
+    }
+    stats->notifications++;
+}
+
+/**
+ * @brief Lee y procesa todo lo disponible en un cliente
+ * @return 0 si la conexión sigue viva, -1 si se cerró
+ */
+static int read_conn(bench_conn_t *conn, bench_stats_t *stats,
+                     unsigned long long window_start, unsigned long long window_end)
+{
+    for (;;) {
+        ssize_t received = frame_buffer_read(&conn->rx, conn->fd);
+        if (received == 0) {
+            return -1;
+        }
+        if (received < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        stats->bytes_received += (unsigned long long)received;
+
+        chat_message_t msg;
+        int status;
+        while ((status = frame_buffer_next(&conn->rx, &msg)) != FRAME_INCOMPLETE) {
+            if (status == FRAME_CORRUPT) {
+                fprintf(stderr, "Flujo inválido recibido del servidor\n");
+                return -1;
+            }
+            if (status == FRAME_READY) {
+                handle_frame(conn, &msg, stats, window_start, window_end);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Cierra un cliente simulado
+ */
+static void close_conn(int epoll_fd, bench_conn_t *conn, bench_stats_t *stats)
+{
+    if (conn->fd < 0) return;
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    SAFE_CLOSE(conn->fd);
+    if (conn->ready) {
+        stats->ready_clients--;
+    }
+    conn->ready = 0;
+    stats->closed_clients++;
+}
+
+/**
+ * @brief Atiende los eventos de epoll durante como mucho timeout_ms
+ */
+static void pump_events(int epoll_fd, bench_conn_t *conns, bench_stats_t *stats, int timeout_ms,
+                        unsigned long long window_start, unsigned long long window_end)
+{
+    struct epoll_event events[BENCH_MAX_EVENTS];
+    int count = epoll_wait(epoll_fd, events, BENCH_MAX_EVENTS, timeout_ms);
+
+    for (int i = 0; i < count; i++) {
+        bench_conn_t *conn = &conns[events[i].data.u32];
+        if (conn->fd < 0) continue;
+
+        int failed = 0;
+        if (events[i].events & EPOLLOUT) {
+            failed = conn_flush(conn) < 0;
+        }
+        if (!failed && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+            failed = read_conn(conn, stats, window_start, window_end) < 0;
+        }
+        if (failed) {
+            close_conn(epoll_fd, conn, stats);
+        }
+    }
+}
+
+/**
+ * @brief Abre un cliente simulado y envía su MSG_CONNECT
+ * @return 0 en éxito, -1 si no se pudo conectar
+ */
+static int open_conn(int epoll_fd, bench_conn_t *conn, int index, const bench_config_t *config,
+                     const struct sockaddr_in *server_addr, bench_stats_t *stats)
+{
+    conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn->fd < 0) {
+        fprintf(stderr, "Error creando socket %d: %s\n", index, strerror(errno));
+        return -1;
+    }
+
+    if (connect(conn->fd, (const struct sockaddr*)server_addr, sizeof(*server_addr)) < 0) {
+        fprintf(stderr, "Error conectando cliente %d: %s\n", index, strerror(errno));
+        SAFE_CLOSE(conn->fd);
+        return -1;
+    }
+
+    /* El handshake TLS se completa antes de pasar al bucle de epoll */
+    int resumed = 0;
+    if (config->tls && tls_handshake(config->tls, conn->fd, NULL, TLS_HANDSHAKE_TIMEOUT_MS, &resumed) < 0) {
+        fprintf(stderr, "Error en el handshake TLS del cliente %d\n", index);
+        SAFE_CLOSE(conn->fd);
+        return -1;
+    }
+    stats->tls_resumed += resumed;
+
+    int flags = fcntl(conn->fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(conn->fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+        frame_buffer_init(&conn->rx, BENCH_RX_BUFFER_SIZE) != SUCCESS) {
+        fprintf(stderr, "Error configurando cliente %d\n", index);
+        SAFE_CLOSE(conn->fd);
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u32 = (uint32_t)index;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) < 0) {
+        fprintf(stderr, "Error registrando cliente %d en epoll: %s\n", index, strerror(errno));
+        SAFE_CLOSE(conn->fd);
+        return -1;
+    }
+
+    /* Como el cliente real: el saludo viaja en legacy y anuncia el formato
+     * compacto (y deflate si se pidió) */
+    char username[USERNAME_SIZE];
+    snprintf(username, sizeof(username), BENCH_USER_PREFIX "%d", index);
+
+    conn->format = config->format;
+
+    chat_message_t connect_msg;
+    init_message(&connect_msg, MSG_CONNECT, username,
+                 config->format == WIRE_FORMAT_DEFLATE ? WIRE_CAPABILITY " " WIRE_DEFLATE_CAPABILITY :
+                 config->format == WIRE_FORMAT_COMPACT ? WIRE_CAPABILITY : "");
+    return conn_send_message(conn, WIRE_FORMAT_LEGACY, &connect_msg);
+}
+
+/**
+ * @brief Manejador de SIGINT: termina la fase en curso y muestra resultados
+ */
+static void bench_signal_handler(int sig)
+{
+    (void)sig;
+    bench_interrupted = 1;
+}
+
+/* ========== BENCHMARK ========== */
+
+/**
+ * @brief Ejecuta el benchmark completo
+ */
+int run_benchmark(const bench_config_t *config)
+{
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(config->port);
+    if (inet_pton(AF_INET, config->host, &server_addr.sin_addr) <= 0) {
+        fprintf(stderr, "Dirección IP inválida: %s\n", config->host);
+        return ERROR_CONNECT;
+    }
+
+    bench_conn_t *conns = calloc((size_t)config->clients, sizeof(bench_conn_t));
+    bench_stats_t *stats = calloc(1, sizeof(bench_stats_t));
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (!conns || !stats || epoll_fd < 0) {
+        fprintf(stderr, "Error inicializando el benchmark\n");
+        free(conns);
+        free(stats);
+        SAFE_CLOSE(epoll_fd);
+        return ERROR_MEMORY;
+    }
+    for (int i = 0; i < config->clients; i++) {
+        conns[i].fd = -1;
+    }
+
+    int result = SUCCESS;
+
+    /* Fase 1: conexión de todos los clientes. Se limita el número de
+     * handshakes en curso para no desbordar la cola de listen del servidor,
+     * que descartaría SYNs y añadiría segundos de retransmisión */
+    printf("Conectando %d clientes a %s:%d...\n", config->clients, config->host, config->port);
+    unsigned long long deadline = bench_now_ns() + BENCH_CONNECT_TIMEOUT * 1000000000ULL;
+    for (int i = 0; i < config->clients && !bench_interrupted && result == SUCCESS; i++) {
+        while (i - stats->ready_clients - stats->closed_clients >= BENCH_CONNECT_BATCH) {
+            if (bench_now_ns() > deadline || bench_interrupted) {
+                result = ERROR_CONNECT;
+                break;
+            }
+            pump_events(epoll_fd, conns, stats, 10, 0, 0);
+        }
+        if (result == SUCCESS && open_conn(epoll_fd, &conns[i], i, config, &server_addr, stats) < 0) {
+            result = ERROR_CONNECT;
+        }
+        /* Atender bienvenidas y avisos mientras se conecta el resto */
+        pump_events(epoll_fd, conns, stats, 0, 0, 0);
+    }
+
+    while (result == SUCCESS && !bench_interrupted && stats->ready_clients < config->clients) {
+        if (bench_now_ns() > deadline || stats->closed_clients > 0) {
+            fprintf(stderr, "Solo %d de %d clientes completaron el handshake\n",
+                    stats->ready_clients, config->clients);
+            result = ERROR_CONNECT;
+            break;
+        }
+        pump_events(epoll_fd, conns, stats, 10, 0, 0);
+    }
+
+    /* Repartir los clientes entre las salas */
+    if (result == SUCCESS && config->rooms > 1) {
+        printf("Repartiendo %d clientes en %d salas...\n", config->clients, config->rooms);
+        for (int i = 0; i < config->clients; i++) {
+            if (send_join(&conns[i], config, i) < 0) {
+                close_conn(epoll_fd, &conns[i], stats);
+            }
+        }
+        while (!bench_interrupted && stats->joined_clients < config->clients) {
+            if (bench_now_ns() > deadline || stats->closed_clients > 0) {
+                fprintf(stderr, "Solo %d de %d clientes entraron en su sala\n",
+                        stats->joined_clients, config->clients);
+                result = ERROR_CONNECT;
+                break;
+            }
+            pump_events(epoll_fd, conns, stats, 10, 0, 0);
+        }
+    }
+
+    /* Esperar a que terminen de llegar los avisos de conexión */
+    unsigned long long quiet_since = bench_now_ns();
+    unsigned long long last_bytes = stats->bytes_received;
+    while (result == SUCCESS && !bench_interrupted &&
+           bench_now_ns() - quiet_since < BENCH_SETTLE_MS * 1000000ULL) {
+        pump_events(epoll_fd, conns, stats, 10, 0, 0);
+        if (stats->bytes_received != last_bytes) {
+            last_bytes = stats->bytes_received;
+            quiet_since = bench_now_ns();
+        }
+    }
+
+    unsigned long long start = bench_now_ns();
+    unsigned long long window_start = start + (unsigned long long)config->warmup * 1000000000ULL;
+    unsigned long long window_end = window_start + (unsigned long long)config->duration * 1000000000ULL;
+    unsigned long long seq = 0;
+
+    /* Fases 2 y 3: envío a tasa constante */
+    if (result == SUCCESS) {
+        printf("Enviando %d msg/s desde %d emisores (calentamiento %d s, medición %d s)...\n",
+               config->rate, config->senders, config->warmup, config->duration);
+    }
+    while (result == SUCCESS && !bench_interrupted) {
+        unsigned long long now = bench_now_ns();
+        if (now >= window_end) break;
+
+        unsigned long long due = (now - start) * (unsigned long long)config->rate / 1000000000ULL;
+        while (seq < due) {
+            int sender = (int)(seq % (unsigned long long)config->senders);
+            bench_conn_t *conn = &conns[sender];
+            seq++;
+
+            if (conn->fd < 0 || conn->tx_length > BENCH_TX_LIMIT) {
+                stats->throttled++;
+                continue;
+            }
+            if (send_chat(conn, config, sender, seq, now) < 0) {
+                close_conn(epoll_fd, conn, stats);
+                continue;
+            }
+            stats->sent++;
+            if (now >= window_start) {
+                stats->sent_measured++;
+                stats->expected_measured += (unsigned long long)
+                    bench_room_members(config, sender % config->rooms);
+            }
+        }
+
+        /* Los lotes a medias salen al final de cada vuelta */
+        for (int i = 0; config->batch > 1 && i < config->senders; i++) {
+            if (conns[i].fd >= 0 && conn_flush_batch(&conns[i]) < 0) {
+                close_conn(epoll_fd, &conns[i], stats);
+            }
+        }
+
+        pump_events(epoll_fd, conns, stats, 1, window_start, window_end);
+    }
+
+    /* Fase 4: drenaje de las entregas pendientes */
+    unsigned long long expected = stats->expected_measured;
+    unsigned long long drain_deadline = bench_now_ns() + BENCH_DRAIN_MS * 1000000ULL;
+    while (result == SUCCESS && !bench_interrupted && stats->delivered_measured < expected &&
+           bench_now_ns() < drain_deadline) {
+        pump_events(epoll_fd, conns, stats, 10, window_start, window_end);
+    }
+
+    if (result == SUCCESS || bench_interrupted) {
+        unsigned long long end = bench_now_ns();
+        unsigned long long measured_end = end < window_end ? end : window_end;
+        print_bench_report(config, stats, measured_end > window_start ? measured_end - window_start : 0);
+    }
+
+    for (int i = 0; i < config->clients; i++) {
+        SAFE_CLOSE(conns[i].fd);
+        frame_buffer_free(&conns[i].rx);
+        free(conns[i].tx);
+        free(conns[i].batch);
+    }
+    free(conns);
+    free(stats);
+    SAFE_CLOSE(epoll_fd);
+    return result;
+}
+
+/**
+ * @brief Imprime los resultados de una ejecución
+ */
+void print_bench_report(const bench_config_t *config, const bench_stats_t *stats,
+                        unsigned long long elapsed_ns)
+{
+    double seconds = (double)elapsed_ns / 1e9;
+    unsigned long long expected = stats->expected_measured;
+    double loss = expected ? 100.0 * (1.0 - (double)stats->delivered_measured / (double)expected) : 0.0;
+    const bench_histogram_t *lat = &stats->latency;
+
+    printf("\n=== RESULTADOS DEL BENCHMARK ===\n");
+    printf("Servidor: %s:%d (formato %s%s)\n", config->host, config->port,
+           config->format == WIRE_FORMAT_DEFLATE ? "compacto con deflate" :
+           config->format == WIRE_FORMAT_COMPACT ? "compacto" : "legacy", config->tls ? ", TLS" : "");
+    if (config->tls) {
+        printf("Sesiones TLS reanudadas: %d de %d handshakes\n", stats->tls_resumed, stats->ready_clients);
+    }
+    printf("Clientes: %d en %d salas (emisores %d), tasa objetivo %d msg/s, contenido %d bytes\n",
+           stats->ready_clients, config->rooms, config->senders, config->rate, config->payload);
+    if (config->batch > 1) {
+        printf("Lotes: hasta %d mensajes por frame y emisor\n", config->batch);
+    }
+    printf("Ventana medida: %.2f s\n", seconds);
+    printf("Mensajes enviados: %llu (%.1f msg/s), omitidos por saturación: %llu\n",
+           stats->sent_measured, seconds > 0 ? (double)stats->sent_measured / seconds : 0.0,
+           stats->throttled);
+    printf("Entregas: %llu de %llu esperadas (pérdida %.2f%%), %.1f entregas/s\n",
+           stats->delivered_measured, expected, loss,
+           seconds > 0 ? (double)stats->delivered_measured / seconds : 0.0);
+    printf("Bytes recibidos: %llu en total\n", stats->bytes_received);
+    if (stats->closed_clients > 0) {
+        printf("Conexiones cerradas por el servidor: %d\n", stats->closed_clients);
+    }
+
+    printf("Latencia extremo a extremo (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  "
+           "máx %.1f  media %.1f\n",
+           histogram_percentile(lat, 50.0) / 1e3, histogram_percentile(lat, 90.0) / 1e3,
+           histogram_percentile(lat, 99.0) / 1e3, histogram_percentile(lat, 99.9) / 1e3,
+           lat->max / 1e3, lat->count ? (double)lat->sum / (double)lat->count / 1e3 : 0.0);
+    printf("================================\n");
+}
+
+/**
+ * @brief Muestra el uso del generador de carga
+ */
+static void print_bench_usage(const char *program)
+{
+    fprintf(stderr, "Uso: %s [--host=IP] [--port=N] [--clients=N] [--senders=N] [--rate=N] "
+            "[--duration=S] [--warmup=S] [--size=BYTES] [--rooms=N] [--wire=compact|deflate|legacy] "
+            "[--batch=N] [--tls]\n", program);
+    fprintf(stderr, "  --clients   Clientes simulados (por defecto %d)\n", BENCH_DEFAULT_CLIENTS);
+    fprintf(stderr, "  --senders   Clientes que envían (por defecto todos)\n");
+    fprintf(stderr, "  --rate      Mensajes por segundo entre todos los emisores (por defecto %d)\n",
+            BENCH_DEFAULT_RATE);
+    fprintf(stderr, "  --duration  Segundos medidos (por defecto %d)\n", BENCH_DEFAULT_DURATION);
+    fprintf(stderr, "  --warmup    Segundos de calentamiento (por defecto %d)\n", BENCH_DEFAULT_WARMUP);
+    fprintf(stderr, "  --size      Bytes de contenido por mensaje (por defecto %d)\n", BENCH_DEFAULT_PAYLOAD);
+    fprintf(stderr, "  --rooms     Salas entre las que repartir los clientes (por defecto 1)\n");
+    fprintf(stderr, "  --wire      Formato tras el saludo: compact (por defecto), deflate o legacy\n");
+    fprintf(stderr, "  --batch     Mensajes por frame de lote de cada emisor (por defecto 1, sin lotes; "
+            "no con legacy)\n");
+    fprintf(stderr, "  --tls       Conectar con TLS (sin verificar el certificado) reanudando sesiones\n");
+}
+
+/**
+ * @brief Interpreta un entero positivo de una opción --nombre=valor
+ * @return 0 si es válido, -1 si no
+ */
+static int parse_positive(const char *arg, size_t prefix_length, int allow_zero, int *value)
+{
+    char *end = NULL;
+    long parsed = strtol(arg + prefix_length, &end, 10);
+    if (!end || *end != '\0' || parsed < (allow_zero ? 0 : 1) || parsed > 1000000000L) {
+        fprintf(stderr, "Valor inválido: %s\n", arg);
+        return -1;
+    }
+    *value = (int)parsed;
+    return 0;
+}
+
+/**
+ * @brief Función main del generador de carga
+ */
+int main(int argc, char *argv[])
+{
+    bench_config_t config;
+    config.host = "127.0.0.1";
+    config.port = DEFAULT_PORT;
+    config.clients = BENCH_DEFAULT_CLIENTS;
+    config.senders = 0;
+    config.rate = BENCH_DEFAULT_RATE;
+    config.duration = BENCH_DEFAULT_DURATION;
+    config.warmup = BENCH_DEFAULT_WARMUP;
+    config.payload = BENCH_DEFAULT_PAYLOAD;
+    config.rooms = 1;
+    config.format = WIRE_FORMAT_COMPACT;
+    config.batch = 1;
+    config.tls = NULL;
+    int use_tls = 0;
+
+    for (int i = 1; i < argc; i++) {
+        int ok = 0;
+        if (strncmp(argv[i], "--host=", 7) == 0) {
+            config.host = argv[i] + 7;
+        } else if (strncmp(argv[i], "--port=", 7) == 0) {
+            ok = parse_positive(argv[i], 7, 0, &config.port);
+            if (ok == 0 && config.port > 65535) ok = -1;
+        } else if (strncmp(argv[i], "--clients=", 10) == 0) {
+            ok = parse_positive(argv[i], 10, 0, &config.clients);
+        } else if (strncmp(argv[i], "--senders=", 10) == 0) {
+            ok = parse_positive(argv[i], 10, 0, &config.senders);
+        } else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            ok = parse_positive(argv[i], 7, 0, &config.rate);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            ok = parse_positive(argv[i], 11, 0, &config.duration);
+        } else if (strncmp(argv[i], "--warmup=", 9) == 0) {
+            ok = parse_positive(argv[i], 9, 1, &config.warmup);
+        } else if (strncmp(argv[i], "--size=", 7) == 0) {
+            ok = parse_positive(argv[i], 7, 0, &config.payload);
+        } else if (strncmp(argv[i], "--rooms=", 8) == 0) {
+            ok = parse_positive(argv[i], 8, 0, &config.rooms);
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            ok = parse_positive(argv[i], 8, 0, &config.batch);
+        } else if (strcmp(argv[i], "--wire=compact") == 0) {
+            config.format = WIRE_FORMAT_COMPACT;
+        } else if (strcmp(argv[i], "--wire=deflate") == 0) {
+            config.format = WIRE_FORMAT_DEFLATE;
+        } else if (strcmp(argv[i], "--wire=legacy") == 0) {
+            config.format = WIRE_FORMAT_LEGACY;
+        } else if (strcmp(argv[i], "--tls") == 0) {
+            use_tls = 1;
+        } else {
+            ok = -1;
+        }
+
+        if (ok < 0) {
+            print_bench_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (config.batch > 1 && config.format == WIRE_FORMAT_LEGACY) {
+        fprintf(stderr, "Los lotes requieren el formato compacto o deflate\n");
+        print_bench_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (config.senders == 0 || config.senders > config.clients) {
+        config.senders = config.clients;
+    }
+    if (config.rooms > config.clients) {
+        config.rooms = config.clients;
+    }
+
+    /* Mostrar el progreso de cada fase aunque la salida vaya a un pipe */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    signal(SIGINT, bench_signal_handler);
+    signal(SIGTERM, bench_signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (use_tls) {
+        config.tls = tls_client_create(NULL, 0);
+        if (!config.tls) {
+            fprintf(stderr, "No se pudo inicializar TLS\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    int result = run_benchmark(&config);
+    tls_context_destroy(config.tls);
+    return result == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
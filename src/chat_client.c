@@ -4,14 +4,27 @@
  * @author Sistema de Chat Socket
  * @date 2025
  * 
- * Implementa un cliente TCP que se conecta al servidor de chat,
- * con threads separados para entrada y recepción de mensajes.
+ * Implementa un cliente TCP que se conecta al servidor de chat, con un
+ * único bucle de eventos para la entrada y la recepción de mensajes.
  */
 
 #include "../include/chat_client.h"
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/signalfd.h>
 
-/* Variable global para el contexto del cliente (para signal handler) */
-static client_context_t *g_client_ctx = NULL;
+/* Descriptores del bucle de eventos */
+enum { POLL_SIGNAL, POLL_SERVER, POLL_STDIN, POLL_COUNT };
+
+/**
+ * @brief Milisegundos de CLOCK_MONOTONIC
+ */
+static long long client_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
 
 /**
  * @brief Inicializa el contexto del cliente
@@ -36,15 +49,12 @@ int init_client_context(client_context_t *ctx, const char *username,
     
     ctx->server_port = server_port;
     ctx->server_socket = -1;
+    ctx->signal_fd = -1;
     ctx->connected = 0;
     ctx->running = 1;
     ctx->terminal_configured = 0;
-    
-    /* Inicializar mutex para salida thread-safe */
-    if (pthread_mutex_init(&ctx->output_mutex, NULL) != 0) {
-        LOG_ERROR("Error al inicializar mutex de salida: %s", strerror(errno));
-        return ERROR_THREAD;
-    }
+    ctx->wire_format = WIRE_FORMAT_LEGACY;
+    strcpy(ctx->room, ROOM_DEFAULT_NAME);
     
     LOG_INFO("Contexto del cliente inicializado para usuario '%s'", username);
     return SUCCESS;
@@ -70,8 +80,9 @@ void cleanup_client_context(client_context_t *ctx)
     /* Restaurar terminal */
     restore_terminal(ctx);
     
-    /* Destruir mutex */
-    pthread_mutex_destroy(&ctx->output_mutex);
+    SAFE_CLOSE(ctx->signal_fd);
+    free(ctx->who);
+    ctx->who = NULL;
     
     LOG_INFO("Limpieza del cliente completada");
 }
@@ -114,8 +125,16 @@ int connect_to_server(client_context_t *ctx)
         return ERROR_CONNECT;
     }
     
+    /* Con TLS el socket queda con kTLS y se usa igual que en claro */
+    if (ctx->tls && tls_handshake(ctx->tls, ctx->server_socket, ctx->server_ip,
+                                  TLS_HANDSHAKE_TIMEOUT_MS, NULL) < 0) {
+        LOG_ERROR("Error estableciendo TLS con el servidor");
+        SAFE_CLOSE(ctx->server_socket);
+        return ERROR_CONNECT;
+    }
+    
     ctx->connected = 1;
-    LOG_INFO("Conexión establecida exitosamente");
+    LOG_INFO("Conexión establecida exitosamente%s", ctx->tls ? " (TLS)" : "");
     
     return SUCCESS;
 }
@@ -135,13 +154,7 @@ void disconnect_from_server(client_context_t *ctx)
     if (ctx->server_socket >= 0) {
         chat_message_t disconnect_msg;
         init_message(&disconnect_msg, MSG_DISCONNECT, ctx->username, "");
-        
-        /* Serializar y enviar mensaje de desconexión */
-        char buffer[BUFFER_SIZE];
-        ssize_t msg_size = serialize_message(&disconnect_msg, buffer, sizeof(buffer));
-        if (msg_size > 0) {
-            send(ctx->server_socket, buffer, msg_size, 0);
-        }
+        send_message_to_server(ctx, &disconnect_msg);
     }
     
     /* Cerrar socket */
@@ -152,28 +165,69 @@ void disconnect_from_server(client_context_t *ctx)
 }
 
 /**
- * @brief Envía mensaje de conexión inicial al servidor
+ * @brief Serializa y envía un mensaje al servidor
  * 
- * Envía el mensaje de handshake inicial con el nombre de usuario.
+ * Usa el formato de red negociado con el servidor.
  */
-int send_connect_message(client_context_t *ctx)
+int send_message_to_server(client_context_t *ctx, const chat_message_t *msg)
 {
-    if (!ctx || !ctx->connected) return -1;
+    if (!ctx || !msg || ctx->server_socket < 0) return -1;
     
-    chat_message_t connect_msg;
-    init_message(&connect_msg, MSG_CONNECT, ctx->username, "");
+    /* Los mensajes de chat acumulados salen antes, para conservar el orden */
+    if (ctx->batch_count > 0 && flush_chat_batch(ctx) < 0) return -1;
     
     char buffer[BUFFER_SIZE];
-    ssize_t msg_size = serialize_message(&connect_msg, buffer, sizeof(buffer));
+    ssize_t msg_size = serialize_message_as(msg, ctx->wire_format, buffer, sizeof(buffer));
     
     if (msg_size < 0) {
-        LOG_ERROR("Error serializando mensaje de conexión");
+        LOG_ERROR("Error serializando mensaje");
         return -1;
     }
     
-    ssize_t sent = send(ctx->server_socket, buffer, msg_size, 0);
+    ssize_t sent = send_all(ctx->server_socket, buffer, (size_t)msg_size);
     if (sent != msg_size) {
-        LOG_ERROR("Error enviando mensaje de conexión: %s", strerror(errno));
+        LOG_ERROR("Error enviando mensaje: %s", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Envía mensaje de conexión inicial al servidor
+ * 
+ * Envía el mensaje de handshake inicial con el nombre de usuario. Va
+ * siempre en formato legacy y anuncia el formato compacto, la compresión
+ * deflate y la reanudación de sesiones, que solo se usan si el servidor
+ * los confirma.
+ */
+int send_connect_message(client_context_t *ctx)
+{
+    if (!ctx || !ctx->connected) return -1;
+    
+    char capabilities[MESSAGE_SIZE];
+    int written = snprintf(capabilities, sizeof(capabilities), "%s",
+                           WIRE_CAPABILITY " " WIRE_DEFLATE_CAPABILITY " " WIRE_RESUME_CAPABILITY
+                           " " WIRE_PRESENCE_CAPABILITY);
+    if (ctx->session[0]) {
+        snprintf(capabilities + written, sizeof(capabilities) - (size_t)written,
+                 " session=%s room=%s seq=%llu", ctx->session, ctx->room, ctx->last_sequence);
+    }
+    
+    chat_message_t connect_msg;
+    init_message(&connect_msg, MSG_CONNECT, ctx->username, capabilities);
+    
+    /* Lo acumulado para la conexión anterior no llega a enviarse */
+    if (ctx->batch_count > 0) {
+        LOG_INFO("Se descartan %d mensajes sin enviar", ctx->batch_count);
+    }
+    ctx->batch = 0;
+    ctx->batch_length = 0;
+    ctx->batch_count = 0;
+    
+    ctx->wire_format = WIRE_FORMAT_LEGACY;
+    if (send_message_to_server(ctx, &connect_msg) < 0) {
+        LOG_ERROR("Error enviando mensaje de conexión");
         return -1;
     }
     
@@ -181,6 +235,56 @@ int send_connect_message(client_context_t *ctx)
     return 0;
 }
 
+/**
+ * @brief Vuelve a conectar tras perder la conexión y reanuda la sesión
+ * 
+ * La espera aleatoria entre 0 y RECONNECT_DELAY segundos (jitter
+ * completo) reparte en el tiempo las reconexiones de muchos clientes.
+ */
+int reconnect_to_server(client_context_t *ctx)
+{
+    if (!ctx || !ctx->session[0]) return -1;
+    
+    while (ctx->running && ctx->reconnect_attempts < RECONNECT_ATTEMPTS) {
+        ctx->reconnect_attempts++;
+        int delay_ms = (int)(random() % (RECONNECT_DELAY * 1000 + 1));
+        printf("\r\033[K[Conexión perdida: reintento %d de %d en %.1f s]\n",
+               ctx->reconnect_attempts, RECONNECT_ATTEMPTS, delay_ms / 1000.0);
+        fflush(stdout);
+        
+        /* Esperar sin dejar de atender SIGINT/SIGTERM */
+        struct pollfd pfd;
+        pfd.fd = ctx->signal_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready;
+        do {
+            ready = poll(&pfd, 1, delay_ms);
+        } while (ready < 0 && errno == EINTR);
+        if (ready > 0) {
+            struct signalfd_siginfo info;
+            if (read(ctx->signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+                LOG_INFO("Señal %u recibida, cerrando cliente...", info.ssi_signo);
+            }
+            ctx->running = 0;
+            return -1;
+        }
+        
+        if (connect_to_server(ctx) == SUCCESS) {
+            if (send_connect_message(ctx) == 0) {
+                printf("[Reconectado; reanudando la sesión en la sala '%s']\n", ctx->room);
+                fflush(stdout);
+                return 0;
+            }
+            SAFE_CLOSE(ctx->server_socket);
+            ctx->connected = 0;
+        }
+    }
+    
+    LOG_ERROR("No se pudo reanudar la sesión tras %d intentos", ctx->reconnect_attempts);
+    return -1;
+}
+
 /**
  * @brief Envía un mensaje de chat al servidor
  * 
@@ -193,132 +297,294 @@ int send_chat_message(client_context_t *ctx, const char *message)
     chat_message_t chat_msg;
     init_message(&chat_msg, MSG_CHAT, ctx->username, message);
     
-    char buffer[BUFFER_SIZE];
-    ssize_t msg_size = serialize_message(&chat_msg, buffer, sizeof(buffer));
+    if (ctx->batch_ms <= 0 || !ctx->batch) {
+        return send_message_to_server(ctx, &chat_msg);
+    }
     
-    if (msg_size < 0) {
-        LOG_ERROR("Error serializando mensaje de chat");
+    char frame[WIRE_MAX_FRAME_SIZE];
+    ssize_t length = serialize_message_as(&chat_msg, ctx->wire_format, frame, sizeof(frame));
+    if (length < 0) {
+        LOG_ERROR("Error serializando mensaje");
         return -1;
     }
     
-    ssize_t sent = send(ctx->server_socket, buffer, msg_size, 0);
-    if (sent != msg_size) {
-        LOG_ERROR("Error enviando mensaje de chat: %s", strerror(errno));
+    if (ctx->batch_length + (size_t)length > CLIENT_BATCH_SIZE && flush_chat_batch(ctx) < 0) {
         return -1;
     }
-    
+    if (ctx->batch_count == 0) {
+        ctx->batch_deadline_ms = client_now_ms() + ctx->batch_ms;
+    }
+    memcpy(ctx->batch_buffer + WIRE_BATCH_HEADER_MAX + ctx->batch_length, frame, (size_t)length);
+    ctx->batch_length += (size_t)length;
+    ctx->batch_count++;
     return 0;
 }
 
 /**
- * @brief Thread para recibir mensajes del servidor
+ * @brief Envía ya los mensajes de chat acumulados
  * 
- * Bucle principal que recibe y procesa mensajes del servidor.
+ * Los frames se acumulan tras un hueco de WIRE_BATCH_HEADER_MAX bytes:
+ * la cabecera se escribe justo delante de ellos y el lote sale con un
+ * único send_all(), sin copiarlo.
  */
-void *receive_thread_func(void *args)
+int flush_chat_batch(client_context_t *ctx)
 {
-    client_thread_args_t *thread_args = (client_thread_args_t*)args;
-    client_context_t *ctx = thread_args->ctx;
+    if (!ctx || ctx->batch_count == 0) return 0;
+    
+    char *start = ctx->batch_buffer + WIRE_BATCH_HEADER_MAX;
+    size_t length = ctx->batch_length;
+    if (ctx->batch_count > 1) {
+        char header[WIRE_BATCH_HEADER_MAX];
+        size_t header_length = wire_put_batch_header(header, length);
+        start -= header_length;
+        memcpy(start, header, header_length);
+        length += header_length;
+    }
     
-    char buffer[BUFFER_SIZE];
-    chat_message_t msg;
+    ctx->batch_length = 0;
+    ctx->batch_count = 0;
     
-    LOG_INFO("Thread de recepción iniciado");
+    if (send_all(ctx->server_socket, start, length) != (ssize_t)length) {
+        LOG_ERROR("Error enviando lote de mensajes: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Muestra el prompt de entrada
+ */
+static void show_prompt(void)
+{
+    printf("> ");
+    fflush(stdout);
+}
+
+/**
+ * @brief Indica si el socket ya tiene más datos sin esperar
+ */
+static int server_has_data(const client_context_t *ctx)
+{
+    struct pollfd pfd;
+    pfd.fd = ctx->server_socket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+/**
+ * @brief Lee del socket y procesa todos los mensajes completos recibidos
+ * 
+ * Vacía el socket (hasta DRAIN_MAX_READS lecturas, para no desatender la
+ * entrada) y pinta todo lo recibido con un único write() al final: en
+ * una ráfaga el terminal no frena la lectura ni llena el buffer del
+ * socket, que acabaría frenando al servidor.
+ * 
+ * @return 0 si la conexión sigue abierta, -1 si se cerró o el flujo es inválido
+ */
+static int handle_server_data(client_context_t *ctx, frame_buffer_t *rx)
+{
+    chat_message_t msg;
+    int result = 0;
     
-    while (ctx->running && ctx->connected) {
-        ssize_t received = recv(ctx->server_socket, buffer, sizeof(buffer), 0);
-        
+    for (int reads = 0; reads < DRAIN_MAX_READS && result == 0; reads++) {
+        ssize_t received = frame_buffer_read(rx, ctx->server_socket);
         if (received <= 0) {
+            if (received < 0 && (errno == EAGAIN || errno == EINTR)) break;
+            
+            /* Lo ya recibido se muestra antes del aviso de cierre */
+            flush_client_output(ctx);
             if (received == 0) {
                 LOG_INFO("Servidor cerró la conexión");
             } else {
                 LOG_ERROR("Error recibiendo datos del servidor: %s", strerror(errno));
             }
-            ctx->connected = 0;
-            ctx->running = 0;
-            break;
+            return -1;
         }
         
-        /* Procesar mensaje recibido */
-        if (deserialize_message(buffer, received, &msg) == 0) {
-            process_server_message(ctx, &msg);
-        } else {
-            LOG_ERROR("Error deserializando mensaje del servidor");
+        int status;
+        while ((status = frame_buffer_next(rx, &msg)) != FRAME_INCOMPLETE) {
+            if (status == FRAME_READY) {
+                process_server_message(ctx, &msg);
+            } else if (status == FRAME_INVALID) {
+                LOG_ERROR("Error deserializando mensaje del servidor");
+            } else {
+                LOG_ERROR("Flujo de datos inválido del servidor");
+                result = -1;
+                break;
+            }
         }
+        
+        if (result == 0 && !server_has_data(ctx)) break;
     }
     
-    LOG_INFO("Thread de recepción finalizado");
-    return NULL;
+    flush_client_output(ctx);
+    return result;
 }
 
 /**
- * @brief Thread para manejar entrada del usuario
+ * @brief Bucle de eventos del cliente
  * 
- * Maneja la entrada del usuario desde el terminal de forma asíncrona.
+ * poll() espera sin timeout salvo con un lote de mensajes pendiente, que
+ * se envía al vencer su ventana: cada despertar corresponde a datos del
+ * servidor, una línea del usuario, una señal o un lote que enviar.
  */
-void *input_thread_func(void *args)
+int client_event_loop(client_context_t *ctx)
 {
-    client_thread_args_t *thread_args = (client_thread_args_t*)args;
-    client_context_t *ctx = thread_args->ctx;
+    if (!ctx || !ctx->connected) return -1;
     
-    char input_buffer[INPUT_BUFFER_SIZE];
+    frame_buffer_t rx;
+    if (frame_buffer_init(&rx, FRAME_BUFFER_SIZE) != SUCCESS) {
+        LOG_ERROR("Error asignando buffer de recepción");
+        return -1;
+    }
     
-    LOG_INFO("Thread de entrada iniciado");
+    struct pollfd fds[POLL_COUNT];
+    fds[POLL_SIGNAL].fd = ctx->signal_fd;
+    fds[POLL_SERVER].fd = ctx->server_socket;
+    fds[POLL_STDIN].fd = STDIN_FILENO;
+    for (int i = 0; i < POLL_COUNT; i++) {
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
     
-    /* Mostrar prompt inicial */
-    pthread_mutex_lock(&ctx->output_mutex);
-    printf("> ");
-    fflush(stdout);
-    pthread_mutex_unlock(&ctx->output_mutex);
+    int result = 0;
+    show_prompt();
     
     while (ctx->running && ctx->connected) {
-        /* Leer entrada del usuario con timeout usando select */
-        fd_set readfds;
-        struct timeval timeout;
-        int stdin_fd = STDIN_FILENO;
+        int timeout = -1;
+        if (ctx->batch_count > 0) {
+            long long remaining = ctx->batch_deadline_ms - client_now_ms();
+            timeout = remaining > 0 ? (int)remaining : 0;
+        }
         
-        FD_ZERO(&readfds);
-        FD_SET(stdin_fd, &readfds);
+        if (poll(fds, POLL_COUNT, timeout) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Error en poll: %s", strerror(errno));
+            result = -1;
+            break;
+        }
         
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
+        if (fds[POLL_SIGNAL].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            if (read(ctx->signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+                LOG_INFO("Señal %u recibida, cerrando cliente...", info.ssi_signo);
+            }
+            ctx->running = 0;
+            break;
+        }
         
-        int select_result = select(stdin_fd + 1, &readfds, NULL, NULL, &timeout);
+        /* Primero lo recibido: un /quit en la misma vuelta cierra el socket */
+        if (fds[POLL_SERVER].revents) {
+            if (handle_server_data(ctx, &rx) < 0) {
+                /* Sin MSG_DISCONNECT: el llamador decide si reconectar */
+                SAFE_CLOSE(ctx->server_socket);
+                ctx->connected = 0;
+                break;
+            }
+        }
         
-        if (select_result > 0 && FD_ISSET(stdin_fd, &readfds)) {
-            /* Hay entrada disponible */
-            if (read_user_input(input_buffer, sizeof(input_buffer)) > 0) {
-                /* Verificar si aún estamos ejecutándose */
-                if (!ctx->running || !ctx->connected) {
-                    break;
-                }
-                
-                /* Procesar comando o mensaje */
-                if (!process_client_command(ctx, input_buffer)) {
-                    /* Es un mensaje normal, enviarlo al servidor */
-                    if (send_chat_message(ctx, input_buffer) < 0) {
-                        LOG_ERROR("Error enviando mensaje al servidor");
-                        break;
-                    }
-                }
-                
-                /* Mostrar nuevo prompt solo después de procesar entrada */
-                if (ctx->running && ctx->connected) {
-                    pthread_mutex_lock(&ctx->output_mutex);
-                    printf("> ");
-                    fflush(stdout);
-                    pthread_mutex_unlock(&ctx->output_mutex);
-                }
+        if (fds[POLL_STDIN].revents) {
+            int input = read_user_input(ctx);
+            if (input == 0) {
+                /* Sin más entrada (p. ej. un bot con stdin redirigido): seguir recibiendo */
+                LOG_INFO("Entrada estándar cerrada; solo se reciben mensajes");
+                fds[POLL_STDIN].fd = -1;
+            } else if (input < 0) {
+                result = -1;
+                break;
             }
-        } else if (select_result < 0 && errno != EINTR) {
-            LOG_ERROR("Error en select: %s", strerror(errno));
+        }
+        
+        if (ctx->batch_count > 0 && ctx->connected &&
+            client_now_ms() >= ctx->batch_deadline_ms && flush_chat_batch(ctx) < 0) {
+            result = -1;
             break;
         }
-        /* Si select_result == 0, fue timeout, continuamos el loop para verificar ctx->running */
     }
     
-    LOG_INFO("Thread de entrada finalizado");
-    return NULL;
+    frame_buffer_free(&rx);
+    return result;
+}
+
+/**
+ * @brief Procesa una línea introducida por el usuario
+ * @return 0 para seguir, -1 si falló el envío
+ */
+static int handle_input_line(client_context_t *ctx, const char *line)
+{
+    /* Procesar comando o mensaje */
+    if (!process_client_command(ctx, line)) {
+        /* Es un mensaje normal, enviarlo al servidor */
+        if (send_chat_message(ctx, line) < 0) {
+            LOG_ERROR("Error enviando mensaje al servidor");
+            return -1;
+        }
+    }
+    
+    /* Mostrar nuevo prompt solo después de procesar entrada */
+    if (ctx->running && ctx->connected) {
+        show_prompt();
+    }
+    return 0;
+}
+
+/**
+ * @brief Añade texto formateado a la salida pendiente del terminal
+ * 
+ * La primera línea de un lote borra antes el prompt. Si no cabe, escribe
+ * lo acumulado y vuelve a intentarlo; una línea mayor que el buffer
+ * entero se trunca.
+ */
+static void output_printf(client_context_t *ctx, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void output_printf(client_context_t *ctx, const char *format, ...)
+{
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (ctx->output_length == 0) {
+            memcpy(ctx->output, "\r\033[K", 4);
+            ctx->output_length = 4;
+        }
+        
+        size_t available = sizeof(ctx->output) - ctx->output_length;
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(ctx->output + ctx->output_length, available, format, args);
+        va_end(args);
+        
+        if (length < 0) return;
+        if ((size_t)length < available) {
+            ctx->output_length += (size_t)length;
+            return;
+        }
+        if (attempt == 0 && ctx->output_length > 4) {
+            flush_client_output(ctx);
+            continue;
+        }
+        ctx->output_length = sizeof(ctx->output) - 1;
+        return;
+    }
+}
+
+/**
+ * @brief Escribe en el terminal la salida acumulada con un solo write()
+ */
+void flush_client_output(client_context_t *ctx)
+{
+    if (!ctx || ctx->output_length == 0) return;
+    
+    /* Lo que quede en el buffer de stdio va antes */
+    fflush(stdout);
+    
+    size_t written = 0;
+    while (written < ctx->output_length) {
+        ssize_t n = write(STDOUT_FILENO, ctx->output + written, ctx->output_length - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        written += (size_t)n;
+    }
+    ctx->output_length = 0;
 }
 
 /**
@@ -331,16 +597,64 @@ void process_server_message(client_context_t *ctx, const chat_message_t *msg)
     if (!ctx || !msg) return;
     
     switch (msg->type) {
+        case MSG_CONNECT:
+            /* Acuse del handshake: el servidor acepta el formato compacto
+             * y, si lo confirma, la compresión */
+            if (message_offers_compact_wire(msg)) {
+                ctx->wire_format = message_offers_deflate(msg) ?
+                                   WIRE_FORMAT_DEFLATE : WIRE_FORMAT_COMPACT;
+                LOG_DEBUG("Formato de red %s negociado con el servidor",
+                          ctx->wire_format == WIRE_FORMAT_DEFLATE ? "compacto con deflate" : "compacto");
+            }
+            /* La lista de usuarios llega después, completa */
+            ctx->presence = message_offers_presence(msg);
+            ctx->who_synced = 0;
+            ctx->batch = message_offers_batch(msg);
+            
+            /* Sesión aceptada: su token sirve para reanudarla */
+            if (message_offers_resume(msg) &&
+                message_get_field(msg, "session", ctx->session, sizeof(ctx->session))) {
+                ctx->reconnect_attempts = 0;
+            }
+            break;
+            
         case MSG_CHAT:
+            /* Los mensajes pueden llegar algo desordenados entre remitentes */
+            if (msg->sequence > ctx->last_sequence) {
+                ctx->last_sequence = msg->sequence;
+            }
+            display_message(ctx, msg);
+            break;
+            
         case MSG_NOTIFICATION:
+        case MSG_PRIVATE:
             display_message(ctx, msg);
             break;
             
+        case MSG_JOIN:
+            /* Confirmación del cambio de sala: la numeración es de cada sala
+             * y se retoma en el punto del historial copiado ("seq=N"); sin
+             * él no se ha recibido nada de la nueva sala */
+            {
+                size_t length = strcspn(msg->content, " ");
+                if (length >= ROOM_NAME_SIZE) length = ROOM_NAME_SIZE - 1;
+                memcpy(ctx->room, msg->content, length);
+                ctx->room[length] = '\0';
+                
+                char sequence[24];
+                ctx->last_sequence = message_get_field(msg, "seq", sequence, sizeof(sequence)) ?
+                                     strtoull(sequence, NULL, 10) : 0;
+            }
+            ctx->who_synced = 0;
+            output_printf(ctx, "[Ahora estás en la sala '%s']\n", ctx->room);
+            break;
+            
         case MSG_ERROR:
-            pthread_mutex_lock(&ctx->output_mutex);
-            printf("\n[ERROR] %s\n", msg->content);
-            fflush(stdout);
-            pthread_mutex_unlock(&ctx->output_mutex);
+            output_printf(ctx, "\n[ERROR] %s\n", msg->content);
+            break;
+            
+        case MSG_PRESENCE:
+            apply_presence(ctx, msg);
             break;
             
         case MSG_KEEPALIVE:
@@ -348,11 +662,7 @@ void process_server_message(client_context_t *ctx, const chat_message_t *msg)
             {
                 chat_message_t response;
                 init_message(&response, MSG_KEEPALIVE, ctx->username, "");
-                char buffer[BUFFER_SIZE];
-                ssize_t msg_size = serialize_message(&response, buffer, sizeof(buffer));
-                if (msg_size > 0) {
-                    send(ctx->server_socket, buffer, msg_size, 0);
-                }
+                send_message_to_server(ctx, &response);
             }
             break;
             
@@ -363,30 +673,167 @@ void process_server_message(client_context_t *ctx, const chat_message_t *msg)
 }
 
 /**
- * @brief Muestra un mensaje en la consola de forma thread-safe
+ * @brief Busca un nombre en la lista de usuarios
+ * @return Posición o -1 si no está
+ */
+static int who_find(const client_context_t *ctx, const char *name)
+{
+    for (int i = 0; i < ctx->who_count; i++) {
+        if (strcmp(ctx->who[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Añade un nombre a la lista de usuarios si no estaba
+ */
+static void who_add(client_context_t *ctx, const char *name)
+{
+    if (who_find(ctx, name) >= 0) return;
+    
+    if (ctx->who_count == ctx->who_capacity) {
+        int capacity = ctx->who_capacity ? ctx->who_capacity * 2 : 16;
+        char (*grown)[USERNAME_SIZE] = realloc(ctx->who, (size_t)capacity * sizeof(*grown));
+        if (!grown) {
+            LOG_ERROR("Sin memoria para la lista de usuarios");
+            return;
+        }
+        ctx->who = grown;
+        ctx->who_capacity = capacity;
+    }
+    
+    strncpy(ctx->who[ctx->who_count], name, USERNAME_SIZE - 1);
+    ctx->who[ctx->who_count][USERNAME_SIZE - 1] = '\0';
+    ctx->who_count++;
+}
+
+/**
+ * @brief Aplica a la lista de usuarios una lista completa o un cambio
  * 
- * Formatea y muestra mensajes con timestamp y formato apropiado.
+ * Los cambios de otra sala (en vuelo al cambiar de sala) se descartan
+ * por el nombre de la sala que llevan.
  */
-void display_message(client_context_t *ctx, const chat_message_t *msg)
+void apply_presence(client_context_t *ctx, const chat_message_t *msg)
 {
     if (!ctx || !msg) return;
     
-    char timestamp[32];
-    format_timestamp(msg->timestamp, timestamp, sizeof(timestamp));
+    char content[MESSAGE_SIZE];
+    strncpy(content, msg->content, sizeof(content) - 1);
+    content[sizeof(content) - 1] = '\0';
+    
+    char op = content[0];
+    char *end;
+    unsigned long long version = strtoull(content + 1, &end, 10);
+    if (end == content + 1 || *end != ' ') return;
+    
+    char *saveptr;
+    const char *room = strtok_r(end, " ", &saveptr);
+    if (!room || strcmp(room, ctx->room) != 0) return;
+    
+    switch (op) {
+        case '=':
+            ctx->who_count = 0;
+            ctx->who_version = version;
+            ctx->who_synced = 1;
+            break;
+            
+        case '&':
+            if (!ctx->who_synced || version != ctx->who_version) return;
+            break;
+            
+        case '+':
+        case '-':
+            if (!ctx->who_synced || version <= ctx->who_version) return;
+            if (version != ctx->who_version + 1) {
+                /* Falta algún cambio: pedir la lista completa */
+                LOG_DEBUG("Presencia desincronizada (versión %llu tras %llu)", version, ctx->who_version);
+                ctx->who_synced = 0;
+                chat_message_t request;
+                init_message(&request, MSG_PRESENCE, ctx->username, "");
+                send_message_to_server(ctx, &request);
+                return;
+            }
+            ctx->who_version = version;
+            break;
+            
+        default:
+            return;
+    }
+    
+    const char *name;
+    while ((name = strtok_r(NULL, " ", &saveptr)) != NULL) {
+        if (op != '-') {
+            who_add(ctx, name);
+            continue;
+        }
+        int index = who_find(ctx, name);
+        if (index >= 0) {
+            memcpy(ctx->who[index], ctx->who[--ctx->who_count], USERNAME_SIZE);
+        }
+    }
+}
+
+/**
+ * @brief Compara dos nombres para ordenar la lista de /who
+ */
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+/**
+ * @brief Muestra los usuarios de la sala actual (/who)
+ */
+void show_who(const client_context_t *ctx)
+{
+    if (!ctx) return;
+    
+    if (!ctx->presence) {
+        printf("El servidor no envía la lista de usuarios.\n");
+        return;
+    }
+    if (!ctx->who_synced) {
+        printf("La lista de usuarios se está actualizando; pruebe de nuevo.\n");
+        return;
+    }
     
-    pthread_mutex_lock(&ctx->output_mutex);
+    /* Copia ordenada: la lista local se mantiene en orden de llegada */
+    char (*names)[USERNAME_SIZE] = malloc((size_t)(ctx->who_count ? ctx->who_count : 1) * sizeof(*names));
+    if (!names) return;
+    memcpy(names, ctx->who, (size_t)ctx->who_count * sizeof(*names));
+    qsort(names, (size_t)ctx->who_count, sizeof(*names), compare_names);
+    
+    printf("Usuarios en la sala '%s' (%d):", ctx->room, ctx->who_count);
+    for (int i = 0; i < ctx->who_count; i++) {
+        printf("%s %s", i ? "," : "", names[i]);
+    }
+    printf("\n");
+    free(names);
+}
+
+/**
+ * @brief Muestra un mensaje en la consola
+ * 
+ * Formatea el mensaje con su marca de tiempo en la salida pendiente. La
+ * marca se guarda por segundo: en una ráfaga localtime() se llama una
+ * vez por segundo distinto y no una por mensaje.
+ */
+void display_message(client_context_t *ctx, const chat_message_t *msg)
+{
+    if (!ctx || !msg) return;
     
-    /* Borrar línea actual del prompt */
-    printf("\r\033[K");
+    if (ctx->stamp[0] == '\0' || msg->timestamp != ctx->stamp_second) {
+        format_timestamp(msg->timestamp, ctx->stamp, sizeof(ctx->stamp));
+        ctx->stamp_second = msg->timestamp;
+    }
     
     if (msg->type == MSG_NOTIFICATION) {
-        printf("%s %s\n", timestamp, msg->content);
+        output_printf(ctx, "%s %s\n", ctx->stamp, msg->content);
+    } else if (msg->type == MSG_PRIVATE) {
+        output_printf(ctx, "%s [privado] <%s> %s\n", ctx->stamp, msg->username, msg->content);
     } else {
-        printf("%s <%s> %s\n", timestamp, msg->username, msg->content);
+        output_printf(ctx, "%s <%s> %s\n", ctx->stamp, msg->username, msg->content);
     }
-    
-    fflush(stdout);
-    pthread_mutex_unlock(&ctx->output_mutex);
 }
 
 /**
@@ -435,26 +882,47 @@ void restore_terminal(client_context_t *ctx)
 }
 
 /**
- * @brief Lee una línea de entrada del usuario
+ * @brief Lee la entrada disponible del usuario y procesa las líneas completas
  * 
- * Lee entrada del usuario desde stdin con manejo de errores.
+ * Se lee directamente del descriptor y no con stdio: un fgets() podría
+ * dejar líneas en el buffer de stdio que poll() ya no señalaría.
  */
-int read_user_input(char *buffer, size_t buffer_size)
+int read_user_input(client_context_t *ctx)
 {
-    if (!buffer || buffer_size == 0) return -1;
+    if (!ctx) return -1;
     
-    if (!fgets(buffer, buffer_size, stdin)) {
+    size_t space = sizeof(ctx->input) - 1 - ctx->input_length;
+    ssize_t n = read(STDIN_FILENO, ctx->input + ctx->input_length, space);
+    if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN) return 1;
+        LOG_ERROR("Error leyendo la entrada estándar: %s", strerror(errno));
         return -1;
     }
+    if (n == 0) {
+        return 0;
+    }
+    ctx->input_length += (size_t)n;
+    
+    /* Procesar cada línea terminada; el resto espera al siguiente read() */
+    size_t start = 0;
+    for (size_t i = 0; i < ctx->input_length && ctx->running && ctx->connected; i++) {
+        if (ctx->input[i] != '\n') continue;
+        
+        ctx->input[i] = '\0';
+        if (handle_input_line(ctx, ctx->input + start) < 0) return -1;
+        start = i + 1;
+    }
     
-    /* Remover salto de línea */
-    size_t len = strlen(buffer);
-    if (len > 0 && buffer[len - 1] == '\n') {
-        buffer[len - 1] = '\0';
-        len--;
+    /* Una línea que llena el buffer se envía en trozos */
+    if (start == 0 && ctx->input_length == sizeof(ctx->input) - 1) {
+        ctx->input[ctx->input_length] = '\0';
+        if (handle_input_line(ctx, ctx->input) < 0) return -1;
+        start = ctx->input_length;
     }
     
-    return (int)len;
+    memmove(ctx->input, ctx->input + start, ctx->input_length - start);
+    ctx->input_length -= start;
+    return 1;
 }
 
 /**
@@ -477,18 +945,12 @@ int process_client_command(client_context_t *ctx, const char *input)
     }
     
     if (strcmp(input, "/quit") == 0 || strcmp(input, "/q") == 0) {
-        pthread_mutex_lock(&ctx->output_mutex);
         printf("Desconectando del chat...\n");
-        pthread_mutex_unlock(&ctx->output_mutex);
         
         /* Enviar mensaje de desconexión al servidor */
         chat_message_t disconnect_msg;
         init_message(&disconnect_msg, MSG_DISCONNECT, ctx->username, "");
-        char buffer[BUFFER_SIZE];
-        ssize_t msg_size = serialize_message(&disconnect_msg, buffer, sizeof(buffer));
-        if (msg_size > 0) {
-            send(ctx->server_socket, buffer, msg_size, 0);
-        }
+        send_message_to_server(ctx, &disconnect_msg);
         
         ctx->running = 0;
         ctx->connected = 0;
@@ -504,10 +966,69 @@ int process_client_command(client_context_t *ctx, const char *input)
         return 1;
     }
     
+    if (strncmp(input, "/join ", 6) == 0 || strncmp(input, "/j ", 3) == 0) {
+        const char *room = strchr(input, ' ') + 1;
+        while (*room == ' ') room++;
+        
+        if (!validate_room_name(room)) {
+            printf("Nombre de sala inválido: use letras, números y '_' (máx. %d)\n",
+                   ROOM_NAME_SIZE - 1);
+            return 1;
+        }
+        
+        chat_message_t join_msg;
+        init_message(&join_msg, MSG_JOIN, ctx->username, room);
+        send_message_to_server(ctx, &join_msg);
+        return 1;
+    }
+    
+    if (strncmp(input, "/msg ", 5) == 0 || strncmp(input, "/m ", 3) == 0) {
+        /* El servidor espera "DESTINO texto" y solo lo entrega a DESTINO */
+        const char *recipient = strchr(input, ' ') + 1;
+        while (*recipient == ' ') recipient++;
+        size_t length = strcspn(recipient, " ");
+        const char *text = recipient + length;
+        while (*text == ' ') text++;
+        
+        char name[USERNAME_SIZE];
+        if (length == 0 || length >= sizeof(name) || *text == '\0') {
+            printf("Uso: /msg USUARIO texto\n");
+            return 1;
+        }
+        memcpy(name, recipient, length);
+        name[length] = '\0';
+        if (!validate_username(name)) {
+            printf("Nombre de usuario inválido: '%s'\n", name);
+            return 1;
+        }
+        
+        char content[MESSAGE_SIZE];
+        snprintf(content, sizeof(content), "%s %s", name, text);
+        chat_message_t private_msg;
+        init_message(&private_msg, MSG_PRIVATE, ctx->username, content);
+        if (send_message_to_server(ctx, &private_msg) == 0) {
+            char timestamp[32];
+            format_timestamp(private_msg.timestamp, timestamp, sizeof(timestamp));
+            output_printf(ctx, "%s [privado a %s] %s\n", timestamp, name, text);
+            flush_client_output(ctx);
+        }
+        return 1;
+    }
+    
+    if (strcmp(input, "/who") == 0 || strcmp(input, "/w") == 0) {
+        show_who(ctx);
+        return 1;
+    }
+    
+    if (strcmp(input, "/leave") == 0 || strcmp(input, "/l") == 0) {
+        chat_message_t leave_msg;
+        init_message(&leave_msg, MSG_LEAVE, ctx->username, "");
+        send_message_to_server(ctx, &leave_msg);
+        return 1;
+    }
+    
     /* Comando no reconocido */
-    pthread_mutex_lock(&ctx->output_mutex);
     printf("Comando no reconocido: %s\nUse /help para ver comandos disponibles.\n", input);
-    pthread_mutex_unlock(&ctx->output_mutex);
     
     return 1;
 }
@@ -523,6 +1044,10 @@ void show_help(void)
     printf("/help, /h     - Mostrar esta ayuda\n");
     printf("/quit, /q     - Salir del chat\n");
     printf("/status, /s   - Mostrar estado de conexión\n");
+    printf("/join, /j SALA - Entrar en una sala (se crea si no existe)\n");
+    printf("/leave, /l    - Volver a la sala '%s'\n", ROOM_DEFAULT_NAME);
+    printf("/msg, /m USUARIO TEXTO - Mensaje privado (solo lo recibe USUARIO)\n");
+    printf("/who, /w      - Usuarios en la sala actual\n");
     printf("\nPara enviar un mensaje, simplemente escriba el texto y presione Enter.\n");
     printf("===========================\n\n");
 }
@@ -540,38 +1065,43 @@ void show_status(client_context_t *ctx)
     printf("Usuario: %s\n", ctx->username);
     printf("Servidor: %s:%d\n", ctx->server_ip, ctx->server_port);
     printf("Estado: %s\n", ctx->connected ? "Conectado" : "Desconectado");
+    printf("Sala: %s\n", ctx->room);
+    printf("Sesión: %s (último mensaje #%llu)\n",
+           ctx->session[0] ? "reanudable" : "sin reanudación", ctx->last_sequence);
     printf("Ejecutándose: %s\n", ctx->running ? "Sí" : "No");
     printf("==========================\n\n");
 }
 
 /**
- * @brief Manejador de señales para el cliente
+ * @brief Configura las señales del cliente
  * 
- * Maneja señales para cierre graceful del cliente.
+ * Las señales de cierre llegan como lecturas del signalfd, de modo que
+ * el bucle de eventos las atiende sin manejadores asíncronos.
  */
-void client_signal_handler(int sig)
+int setup_client_signals(client_context_t *ctx)
 {
-    LOG_INFO("Señal %d recibida, cerrando cliente...", sig);
+    if (!ctx) return -1;
     
-    if (g_client_ctx) {
-        g_client_ctx->running = 0;
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+        LOG_ERROR("Error bloqueando señales: %s", strerror(errno));
+        return -1;
+    }
+    
+    ctx->signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (ctx->signal_fd < 0) {
+        LOG_ERROR("Error creando signalfd: %s", strerror(errno));
+        return -1;
     }
-}
-
-/**
- * @brief Configura manejadores de señales para el cliente
- * 
- * Instala los manejadores de señales apropiados.
- */
-void setup_client_signal_handlers(client_context_t *ctx)
-{
-    g_client_ctx = ctx;
     
-    signal(SIGINT, client_signal_handler);
-    signal(SIGTERM, client_signal_handler);
     signal(SIGPIPE, SIG_IGN);
     
-    LOG_INFO("Manejadores de señales del cliente configurados");
+    LOG_INFO("Señales del cliente configuradas");
+    return 0;
 }
 
 /**
@@ -625,12 +1155,12 @@ int validate_client_params(const char *username, const char *server_ip, int serv
 /**
  * @brief Función principal del cliente
  * 
- * Implementa el bucle principal del cliente con threads para E/S.
+ * Conecta, envía el saludo y ejecuta el bucle de eventos del cliente.
  */
-int run_client(const char *username, const char *server_ip, int server_port)
+int run_client(const char *username, const char *server_ip, int server_port,
+               tls_context_t *tls, int batch_ms)
 {
     client_context_t client_ctx;
-    client_thread_args_t thread_args;
     
     LOG_INFO("Iniciando cliente de chat para usuario '%s'", username);
     
@@ -644,9 +1174,14 @@ int run_client(const char *username, const char *server_ip, int server_port)
         LOG_ERROR("Error inicializando contexto del cliente");
         return ERROR_MEMORY;
     }
+    client_ctx.tls = tls;
+    client_ctx.batch_ms = batch_ms;
     
-    /* Configurar manejadores de señales */
-    setup_client_signal_handlers(&client_ctx);
+    /* Recibir SIGINT/SIGTERM por el signalfd del bucle de eventos */
+    if (setup_client_signals(&client_ctx) < 0) {
+        cleanup_client_context(&client_ctx);
+        return ERROR_SOCKET;
+    }
     
     /* Configurar terminal (opcional) */
     setup_terminal(&client_ctx);  /* No fallar si no es un terminal interactivo */
@@ -667,62 +1202,20 @@ int run_client(const char *username, const char *server_ip, int server_port)
     /* Mostrar mensaje de bienvenida */
     show_welcome_message();
     
-    /* Configurar argumentos para threads */
-    thread_args.ctx = &client_ctx;
-    
-    /* Crear thread de recepción */
-    if (pthread_create(&client_ctx.receive_thread, NULL, receive_thread_func, &thread_args) != 0) {
-        LOG_ERROR("Error creando thread de recepción: %s", strerror(errno));
-        cleanup_client_context(&client_ctx);
-        return ERROR_THREAD;
-    }
-    
-    /* Crear thread de entrada */
-    if (pthread_create(&client_ctx.input_thread, NULL, input_thread_func, &thread_args) != 0) {
-        LOG_ERROR("Error creando thread de entrada: %s", strerror(errno));
-        cleanup_client_context(&client_ctx);
-        return ERROR_THREAD;
-    }
-    
-    /* Esperar a que terminen los threads normalmente */
-    /* Solo usar timeout si explícitamente se solicitó salida */
-    while (client_ctx.running && client_ctx.connected) {
-        usleep(500000); /* 500ms */
-    }
-    
-    /* Ahora que running=0 o connected=0, esperar que threads terminen */
-    int timeout_count = 0;
-    const int max_timeout = 50; /* 5 segundos máximo para terminación */
-    
-    /* Esperar a que los threads realmente terminen */
-    while (timeout_count < max_timeout) {
-        usleep(100000); /* 100ms */
-        timeout_count++;
-        
-        /* Verificar si los threads aún están activos */
-        int receive_alive = (pthread_kill(client_ctx.receive_thread, 0) == 0);
-        int input_alive = (pthread_kill(client_ctx.input_thread, 0) == 0);
-        
-        if (!receive_alive && !input_alive) {
-            break; /* Ambos threads han terminado */
-        }
-    }
-    
-    if (timeout_count >= max_timeout) {
-        LOG_INFO("Timeout esperando terminación de threads, cancelando...");
-        pthread_cancel(client_ctx.receive_thread);
-        pthread_cancel(client_ctx.input_thread);
-    }
-    
-    /* Hacer join a los threads */
-    pthread_join(client_ctx.receive_thread, NULL);
-    pthread_join(client_ctx.input_thread, NULL);
+    /* Atender entrada, servidor y señales hasta terminar; si se pierde la
+     * conexión, reanudar la sesión mientras queden intentos */
+    srandom((unsigned int)time(NULL) ^ (unsigned int)getpid());
+    int loop_result;
+    do {
+        loop_result = client_event_loop(&client_ctx);
+    } while (loop_result == 0 && client_ctx.running && !client_ctx.connected &&
+             reconnect_to_server(&client_ctx) == 0);
     
     /* Limpieza */
     cleanup_client_context(&client_ctx);
     
     printf("\nCliente terminado.\n");
-    return SUCCESS;
+    return loop_result == 0 ? SUCCESS : ERROR_CONNECT;
 }
 
 /**
@@ -735,30 +1228,69 @@ int main(int argc, char *argv[])
     const char *username;
     const char *server_ip = "127.0.0.1";
     int server_port = DEFAULT_PORT;
+    const char *positional[3];
+    int positional_count = 0;
+    int use_tls = 0;
+    const char *tls_ca = NULL;
+    int batch_ms = 0;
+    
+    /* Procesar argumentos de línea de comandos: opciones en cualquier posición */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tls") == 0) {
+            use_tls = 1;
+        } else if (strncmp(argv[i], "--tls-ca=", 9) == 0) {
+            use_tls = 1;
+            tls_ca = argv[i] + 9;
+        } else if (strncmp(argv[i], "--batch-ms=", 11) == 0) {
+            char *end;
+            long value = strtol(argv[i] + 11, &end, 10);
+            if (argv[i][11] == '\0' || *end != '\0' || value < 0 || value > CLIENT_BATCH_MAX_MS) {
+                fprintf(stderr, "Ventana de lote inválida: %s (0-%d ms)\n", argv[i], CLIENT_BATCH_MAX_MS);
+                return EXIT_FAILURE;
+            }
+            batch_ms = (int)value;
+        } else if (positional_count < 3) {
+            positional[positional_count++] = argv[i];
+        }
+    }
     
-    /* Procesar argumentos de línea de comandos */
-    if (argc < 2) {
-        fprintf(stderr, "Uso: %s <nombre_usuario> [ip_servidor] [puerto]\n", argv[0]);
+    if (positional_count < 1) {
+        fprintf(stderr, "Uso: %s <nombre_usuario> [ip_servidor] [puerto] [--tls] [--tls-ca=FILE] "
+                "[--batch-ms=MS]\n", argv[0]);
         fprintf(stderr, "Ejemplo: %s juan 192.168.1.100 8080\n", argv[0]);
+        fprintf(stderr, "TLS: --tls verifica al servidor con las CAs del sistema, "
+                "--tls-ca=FILE con la CA indicada\n");
+        fprintf(stderr, "Lotes: --batch-ms=MS acumula los mensajes de chat durante MS ms "
+                "(0-%d, por defecto 0) y los envía juntos en un solo frame\n", CLIENT_BATCH_MAX_MS);
         return EXIT_FAILURE;
     }
     
-    username = argv[1];
+    username = positional[0];
     
-    if (argc > 2) {
-        server_ip = argv[2];
+    if (positional_count > 1) {
+        server_ip = positional[1];
     }
     
-    if (argc > 3) {
-        server_port = atoi(argv[3]);
+    if (positional_count > 2) {
+        server_port = atoi(positional[2]);
         if (server_port <= 0 || server_port > 65535) {
-            fprintf(stderr, "Puerto inválido: %s\n", argv[3]);
+            fprintf(stderr, "Puerto inválido: %s\n", positional[2]);
+            return EXIT_FAILURE;
+        }
+    }
+    
+    tls_context_t *tls = NULL;
+    if (use_tls) {
+        tls = tls_client_create(tls_ca, 1);
+        if (!tls) {
+            fprintf(stderr, "No se pudo inicializar TLS\n");
             return EXIT_FAILURE;
         }
     }
     
     /* Ejecutar cliente */
-    int result = run_client(username, server_ip, server_port);
+    int result = run_client(username, server_ip, server_port, tls, batch_ms);
+    tls_context_destroy(tls);
     
     if (result == SUCCESS) {
         return EXIT_SUCCESS;
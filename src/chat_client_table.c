@@ -0,0 +1,207 @@
+/**
+ * @file chat_client_table.c
+ * @brief Implementación de la tabla dinámica de clientes
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Los tres índices crecen duplicando su tamaño, así que el coste de
+ * inserción es O(1) amortizado y ninguna operación recorre la tabla.
+ */
+
+#include "../include/chat_client_table.h"
+
+/* ========== FUNCIONES AUXILIARES ========== */
+
+/**
+ * @brief Reparte las cadenas del hash de nombres en el doble de cubetas
+ * @return SUCCESS o ERROR_MEMORY
+ */
+static int grow_name_buckets(client_table_t *table)
+{
+    size_t bucket_count = table->bucket_count * 2;
+    client_info_t **buckets = calloc(bucket_count, sizeof(*buckets));
+    if (!buckets) {
+        return ERROR_MEMORY;
+    }
+
+    for (size_t i = 0; i < table->bucket_count; i++) {
+        client_info_t *client = table->name_buckets[i];
+        while (client) {
+            client_info_t *next = client->name_next;
+            size_t slot = client->name_hash & (bucket_count - 1);
+            client->name_next = buckets[slot];
+            buckets[slot] = client;
+            client = next;
+        }
+    }
+
+    free(table->name_buckets);
+    table->name_buckets = buckets;
+    table->bucket_count = bucket_count;
+    return SUCCESS;
+}
+
+/**
+ * @brief Amplía el índice por socket hasta cubrir un descriptor
+ * @return SUCCESS o ERROR_MEMORY
+ */
+static int grow_fd_index(client_table_t *table, int socket_fd)
+{
+    int fd_capacity = table->fd_capacity;
+    while (fd_capacity <= socket_fd) {
+        fd_capacity *= 2;
+    }
+
+    client_info_t **by_fd = realloc(table->by_fd, (size_t)fd_capacity * sizeof(*by_fd));
+    if (!by_fd) {
+        return ERROR_MEMORY;
+    }
+
+    memset(by_fd + table->fd_capacity, 0,
+           (size_t)(fd_capacity - table->fd_capacity) * sizeof(*by_fd));
+    table->by_fd = by_fd;
+    table->fd_capacity = fd_capacity;
+    return SUCCESS;
+}
+
+/* ========== OPERACIONES DE LA TABLA ========== */
+
+/**
+ * @brief Crea una tabla vacía
+ */
+client_table_t *client_table_create(void)
+{
+    client_table_t *table = calloc(1, sizeof(client_table_t));
+    if (!table) {
+        return NULL;
+    }
+
+    table->capacity = CLIENT_TABLE_INITIAL;
+    table->fd_capacity = CLIENT_TABLE_INITIAL;
+    table->bucket_count = CLIENT_TABLE_INITIAL;
+    table->active = malloc((size_t)table->capacity * sizeof(*table->active));
+    table->by_fd = calloc((size_t)table->fd_capacity, sizeof(*table->by_fd));
+    table->name_buckets = calloc(table->bucket_count, sizeof(*table->name_buckets));
+
+    if (!table->active || !table->by_fd || !table->name_buckets) {
+        client_table_destroy(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+/**
+ * @brief Libera la tabla (no libera los clientes que contenga)
+ */
+void client_table_destroy(client_table_t *table)
+{
+    if (!table) return;
+
+    free(table->active);
+    free(table->by_fd);
+    free(table->name_buckets);
+    free(table);
+}
+
+/**
+ * @brief Inserta un cliente en los tres índices
+ *
+ * Toda la memoria se reserva antes de modificar ningún índice, de modo
+ * que un fallo deja la tabla intacta.
+ */
+int client_table_insert(client_table_t *table, client_info_t *client)
+{
+    if (!table || !client || client->socket_fd < 0) return ERROR_MEMORY;
+
+    if (table->count == table->capacity) {
+        int capacity = table->capacity * 2;
+        client_info_t **active = realloc(table->active, (size_t)capacity * sizeof(*active));
+        if (!active) {
+            return ERROR_MEMORY;
+        }
+        table->active = active;
+        table->capacity = capacity;
+    }
+
+    if (client->socket_fd >= table->fd_capacity &&
+        grow_fd_index(table, client->socket_fd) != SUCCESS) {
+        return ERROR_MEMORY;
+    }
+
+    /* Mantener una carga media de como mucho un cliente por cubeta */
+    if ((size_t)table->count >= table->bucket_count &&
+        grow_name_buckets(table) != SUCCESS) {
+        return ERROR_MEMORY;
+    }
+
+    client->active_index = table->count;
+    table->active[table->count++] = client;
+
+    table->by_fd[client->socket_fd] = client;
+
+    client->name_hash = hash_identifier(client->username);
+    size_t slot = client->name_hash & (table->bucket_count - 1);
+    client->name_next = table->name_buckets[slot];
+    table->name_buckets[slot] = client;
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Quita un cliente de los tres índices en O(1)
+ */
+void client_table_remove(client_table_t *table, client_info_t *client)
+{
+    if (!table || !client || client->active_index < 0) return;
+
+    /* Array denso: el último ocupa el hueco */
+    int last = table->count - 1;
+    table->active[client->active_index] = table->active[last];
+    table->active[client->active_index]->active_index = client->active_index;
+    table->count = last;
+    client->active_index = -1;
+
+    if (client->socket_fd >= 0 && client->socket_fd < table->fd_capacity &&
+        table->by_fd[client->socket_fd] == client) {
+        table->by_fd[client->socket_fd] = NULL;
+    }
+
+    client_info_t **link = &table->name_buckets[client->name_hash & (table->bucket_count - 1)];
+    while (*link && *link != client) {
+        link = &(*link)->name_next;
+    }
+    if (*link) {
+        *link = client->name_next;
+    }
+    client->name_next = NULL;
+}
+
+/**
+ * @brief Busca un cliente por su socket
+ */
+client_info_t *client_table_find_fd(const client_table_t *table, int socket_fd)
+{
+    if (!table || socket_fd < 0 || socket_fd >= table->fd_capacity) return NULL;
+    return table->by_fd[socket_fd];
+}
+
+/**
+ * @brief Busca un cliente por su nombre de usuario
+ */
+client_info_t *client_table_find_name(const client_table_t *table, const char *username)
+{
+    if (!table || !username) return NULL;
+
+    unsigned int hash = hash_identifier(username);
+    client_info_t *client = table->name_buckets[hash & (table->bucket_count - 1)];
+
+    while (client) {
+        if (client->name_hash == hash && strcmp(client->username, username) == 0) {
+            return client;
+        }
+        client = client->name_next;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,951 @@
+/**
+ * @file chat_cluster.c
+ * @brief Implementación del bus de mensajes entre nodos
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Los enlaces salientes solo envían y los entrantes solo reciben: con la
+ * malla completa configurada en todos los nodos, cada par de nodos queda
+ * unido por dos enlaces, uno en cada sentido. La única excepción es el
+ * reto con el que el nodo que acepta abre cada enlace entrante.
+ */
+
+#include <ctype.h>
+#include <netdb.h>
+#include <poll.h>
+#include <netinet/tcp.h>
+#include <sys/random.h>
+
+#include "../include/chat_cluster.h"
+#include "../include/chat_server.h"
+#include "../include/chat_tls.h"
+#include "../include/chat_engine.h"
+#include "../include/chat_metrics.h"
+#include "../include/chat_timer.h"
+
+/**
+ * @brief Enlace saliente hacia un par
+ */
+typedef struct {
+    struct cluster *cluster;                /* Clúster al que pertenece */
+    char host[CLUSTER_HOST_SIZE];           /* Host del par */
+    char port[8];                           /* Puerto del par */
+    pthread_t thread;                       /* Thread que conecta y envía */
+    int thread_started;                     /* El thread se creó */
+
+    /* Protegido por lock */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;                    /* Hay pendientes o hay que parar */
+    int socket_fd;                          /* Socket conectado o -1 */
+    char *pending;                          /* Frames por enviar */
+    size_t pending_length;                  /* Bytes en pending */
+    int pending_frames;                     /* Frames en pending */
+    char *sending;                          /* Lote que escribe el thread (sin lock) */
+} cluster_link_t;
+
+/**
+ * @brief Enlace entrante desde un par
+ */
+typedef struct {
+    int socket_fd;                          /* Socket aceptado o -1 */
+    int greeted;                            /* Ya llegó un saludo válido del par */
+    tls_session_t *tls;                     /* Handshake TLS en curso o NULL */
+    short events;                           /* Eventos que espera el handshake TLS */
+    long long deadline_ms;                  /* Cierre si no ha saludado antes de este instante */
+    char nonce[2 * CLUSTER_NONCE_SIZE + 1]; /* Reto enviado, en hexadecimal */
+    char name[INET_ADDRSTRLEN + 8];         /* IP:puerto del par para los logs */
+    char *buffer;                           /* Bytes recibidos sin procesar */
+    size_t length;                          /* Bytes en buffer */
+} cluster_inbound_t;
+
+struct cluster {
+    server_context_t *ctx;                  /* Destino del fan-out local */
+    unsigned long long node_id;             /* Identificador de este nodo */
+    char secret[CLUSTER_SECRET_MAX];        /* Secreto compartido por los nodos */
+    size_t secret_length;                   /* Bytes del secreto */
+    tls_context_t *tls_client;              /* Contexto de los enlaces salientes o NULL sin TLS */
+    int stop;                               /* Orden de parada (atómico) */
+    int listen_fd;                          /* Socket de los enlaces entrantes */
+    pthread_t receiver;                     /* Thread de los enlaces entrantes */
+    int receiver_started;                   /* El thread se creó */
+    cluster_inbound_t inbound[CLUSTER_MAX_INBOUND];
+    cluster_link_t links[CLUSTER_MAX_PEERS];
+    int link_count;
+};
+
+/* ========== FRAMES ENTRE NODOS ========== */
+
+/**
+ * @brief Serializa un mensaje de una sala en un frame entre nodos
+ * @return Longitud del frame o -1 si no cabe
+ */
+static ssize_t encode_cluster_frame(const char *room, const chat_message_t *msg,
+                                    char *buffer, size_t buffer_size)
+{
+    size_t room_length = strlen(room);
+    if (room_length >= ROOM_NAME_SIZE || buffer_size < CLUSTER_HEADER_SIZE + 1 + room_length) {
+        return -1;
+    }
+
+    size_t offset = CLUSTER_HEADER_SIZE;
+    buffer[offset++] = (char)room_length;
+    memcpy(buffer + offset, room, room_length);
+    offset += room_length;
+
+    ssize_t message_length = serialize_message_as(msg, WIRE_FORMAT_COMPACT,
+                                                  buffer + offset, buffer_size - offset);
+    if (message_length < 0) {
+        return -1;
+    }
+
+    uint32_t body_length = htonl((uint32_t)(offset - CLUSTER_HEADER_SIZE + (size_t)message_length));
+    buffer[0] = (char)CLUSTER_MAGIC;
+    buffer[1] = CLUSTER_VERSION;
+    memcpy(buffer + 2, &body_length, sizeof(body_length));
+
+    return (ssize_t)offset + message_length;
+}
+
+/**
+ * @brief Decodifica el cuerpo de un frame entre nodos
+ * @return 0 en éxito, -1 si el cuerpo no es válido
+ */
+static int decode_cluster_body(const char *body, size_t body_length,
+                               char room[ROOM_NAME_SIZE], chat_message_t *msg)
+{
+    if (body_length < 1) return -1;
+
+    size_t room_length = (unsigned char)body[0];
+    if (room_length >= ROOM_NAME_SIZE || body_length < 1 + room_length + 1) {
+        return -1;
+    }
+    memcpy(room, body + 1, room_length);
+    room[room_length] = '\0';
+
+    /* Entre nodos solo viajan frames compactos */
+    const char *frame = body + 1 + room_length;
+    size_t frame_length = body_length - 1 - room_length;
+    if ((unsigned char)frame[0] != WIRE_MAGIC ||
+        message_frame_length(frame, frame_length) != (ssize_t)frame_length) {
+        return -1;
+    }
+
+    return deserialize_message(frame, frame_length, msg);
+}
+
+/* ========== AUTENTICACIÓN ========== */
+
+/**
+ * @brief Escribe bytes en hexadecimal (2 * length caracteres y el terminador)
+ */
+static void hex_encode(const unsigned char *bytes, size_t length, char *out)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < length; i++) {
+        out[2 * i] = digits[bytes[i] >> 4];
+        out[2 * i + 1] = digits[bytes[i] & 0x0f];
+    }
+    out[2 * length] = '\0';
+}
+
+/**
+ * @brief Calcula el código del saludo: HMAC-SHA256(secreto, "nonce nodo")
+ * @param mac Destino en hexadecimal (2 * TLS_HMAC_SIZE + 1 bytes)
+ * @return 0 en éxito, -1 en error
+ */
+static int greeting_mac(const struct cluster *cluster, const char *nonce,
+                        unsigned long long node_id, char *mac)
+{
+    char data[2 * CLUSTER_NONCE_SIZE + 32];
+    unsigned char raw[TLS_HMAC_SIZE];
+
+    int length = snprintf(data, sizeof(data), "%s %016llx", nonce, node_id);
+    if (length < 0 || (size_t)length >= sizeof(data) ||
+        tls_hmac_sha256(cluster->secret, cluster->secret_length, data, (size_t)length, raw) < 0) {
+        return -1;
+    }
+    hex_encode(raw, sizeof(raw), mac);
+    return 0;
+}
+
+/**
+ * @brief Compara dos códigos sin que el tiempo dependa de dónde difieren
+ */
+static int mac_equal(const char *a, const char *b, size_t length)
+{
+    unsigned char diff = 0;
+    for (size_t i = 0; i < length; i++) {
+        diff |= (unsigned char)(a[i] ^ b[i]);
+    }
+    return diff == 0;
+}
+
+/**
+ * @brief Lee el secreto compartido de un fichero
+ *
+ * Se ignoran los saltos de línea y espacios finales, para que un fichero
+ * escrito con echo funcione igual que uno sin ellos.
+ *
+ * @return 0 en éxito, -1 si no se puede leer o su longitud no es válida
+ */
+static int load_secret(struct cluster *cluster, const char *path)
+{
+    FILE *file = path ? fopen(path, "r") : NULL;
+    if (!file) {
+        LOG_ERROR("No se pudo leer el secreto del clúster %s: %s",
+                 path ? path : "(sin fichero)", path ? strerror(errno) : "falta --cluster-secret-file");
+        return -1;
+    }
+
+    char buffer[CLUSTER_SECRET_MAX + 2];
+    size_t length = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    while (length > 0 && isspace((unsigned char)buffer[length - 1])) {
+        length--;
+    }
+
+    if (length < CLUSTER_SECRET_MIN || length > CLUSTER_SECRET_MAX) {
+        LOG_ERROR("El secreto del clúster en %s debe tener entre %d y %d bytes",
+                 path, CLUSTER_SECRET_MIN, CLUSTER_SECRET_MAX);
+        explicit_bzero(buffer, sizeof(buffer));
+        return -1;
+    }
+
+    memcpy(cluster->secret, buffer, length);
+    cluster->secret_length = length;
+    explicit_bzero(buffer, sizeof(buffer));
+    return 0;
+}
+
+/* ========== ENLACES SALIENTES ========== */
+
+/**
+ * @brief Valida la forma HOST:PORT de un par
+ */
+int cluster_parse_peer(const char *spec)
+{
+    if (!spec) return -1;
+
+    const char *colon = strrchr(spec, ':');
+    if (!colon || colon == spec || (size_t)(colon - spec) >= CLUSTER_HOST_SIZE) {
+        return -1;
+    }
+
+    char *end;
+    long port = strtol(colon + 1, &end, 10);
+    if (colon[1] == '\0' || *end != '\0' || port <= 0 || port > 65535) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Recibe un frame entre nodos completo de un socket bloqueante
+ * @return 0 en éxito, -1 en error, cierre o timeout (SO_RCVTIMEO)
+ */
+static int recv_cluster_frame(int fd, char room[ROOM_NAME_SIZE], chat_message_t *msg)
+{
+    char frame[CLUSTER_MAX_FRAME];
+    uint32_t body_length;
+
+    if (recv(fd, frame, CLUSTER_HEADER_SIZE, MSG_WAITALL) != CLUSTER_HEADER_SIZE) {
+        return -1;
+    }
+    memcpy(&body_length, frame + 2, sizeof(body_length));
+    body_length = ntohl(body_length);
+    if ((unsigned char)frame[0] != CLUSTER_MAGIC || frame[1] != CLUSTER_VERSION ||
+        body_length > CLUSTER_MAX_FRAME - CLUSTER_HEADER_SIZE ||
+        recv(fd, frame + CLUSTER_HEADER_SIZE, body_length, MSG_WAITALL) != (ssize_t)body_length) {
+        return -1;
+    }
+    return decode_cluster_body(frame + CLUSTER_HEADER_SIZE, body_length, room, msg);
+}
+
+/**
+ * @brief Resuelve el par y abre la conexión
+ *
+ * Se resuelve en cada intento: un nombre DNS puede cambiar de dirección
+ * cuando el par se reinicia. SO_SNDTIMEO acota también connect() y
+ * SO_RCVTIMEO la espera del reto; con TLS el handshake va antes del reto.
+ *
+ * @return Socket conectado y autenticado o -1
+ */
+static int link_connect(cluster_link_t *link)
+{
+    struct addrinfo hints, *results = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(link->host, link->port, &hints, &results) != 0 || !results) {
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        freeaddrinfo(results);
+        return -1;
+    }
+
+    /* Los lotes ya agrupan los frames: Nagle solo añadiría latencia */
+    int opt = 1;
+    struct timeval timeout = { CLUSTER_SEND_TIMEOUT_MS / 1000, (CLUSTER_SEND_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    timeout.tv_sec = CLUSTER_HANDSHAKE_MS / 1000;
+    timeout.tv_usec = (CLUSTER_HANDSHAKE_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int result = connect(fd, results->ai_addr, results->ai_addrlen);
+    freeaddrinfo(results);
+    if (result < 0 ||
+        (link->cluster->tls_client &&
+         tls_handshake(link->cluster->tls_client, fd, NULL, CLUSTER_HANDSHAKE_MS, NULL) < 0)) {
+        SAFE_CLOSE(fd);
+        return -1;
+    }
+
+    /* Reto del par: un nonce que el saludo debe firmar con el secreto */
+    chat_message_t challenge;
+    char room[ROOM_NAME_SIZE];
+    char nonce[2 * CLUSTER_NONCE_SIZE + 1];
+    int version = 0;
+    if (recv_cluster_frame(fd, room, &challenge) < 0 || challenge.type != MSG_CONNECT ||
+        sscanf(challenge.content, "cluster=%d nonce=%64[0-9a-f]", &version, nonce) != 2 ||
+        version != CLUSTER_VERSION || strlen(nonce) != 2 * CLUSTER_NONCE_SIZE) {
+        LOG_DEBUG("Reto inválido o ausente del nodo %s:%s", link->host, link->port);
+        SAFE_CLOSE(fd);
+        return -1;
+    }
+
+    /* Saludo: identifica al nodo de origen y prueba que conoce el secreto */
+    chat_message_t hello;
+    char mac[2 * TLS_HMAC_SIZE + 1];
+    char content[160];
+    char frame[CLUSTER_MAX_FRAME];
+    if (greeting_mac(link->cluster, nonce, link->cluster->node_id, mac) < 0) {
+        SAFE_CLOSE(fd);
+        return -1;
+    }
+    snprintf(content, sizeof(content), "cluster=%d node=%016llx mac=%s",
+             CLUSTER_VERSION, link->cluster->node_id, mac);
+    init_message(&hello, MSG_CONNECT, "cluster", content);
+
+    ssize_t length = encode_cluster_frame("", &hello, frame, sizeof(frame));
+    if (length < 0 || send_all(fd, frame, (size_t)length) != length) {
+        SAFE_CLOSE(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Calcula el instante absoluto (CLOCK_REALTIME) dentro de wait_ms
+ */
+static void deadline_after(struct timespec *deadline, long long wait_ms)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += (time_t)(wait_ms / 1000);
+    deadline->tv_nsec += (long)(wait_ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/**
+ * @brief Espera hasta que pase el tiempo indicado o llegue la orden de parada
+ */
+static void link_wait(cluster_link_t *link, long long wait_ms)
+{
+    struct timespec deadline;
+    deadline_after(&deadline, wait_ms);
+
+    pthread_mutex_lock(&link->lock);
+    while (!__atomic_load_n(&link->cluster->stop, __ATOMIC_ACQUIRE) &&
+           pthread_cond_timedwait(&link->cond, &link->lock, &deadline) == 0) {
+    }
+    pthread_mutex_unlock(&link->lock);
+}
+
+/**
+ * @brief Indica si el par cerró un enlace saliente
+ *
+ * El par nunca escribe en él: que sea legible significa cierre o error.
+ * Así un par reiniciado se detecta sin esperar a perder el próximo lote.
+ */
+static int link_peer_closed(int fd)
+{
+    char byte;
+    ssize_t received = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR);
+}
+
+/**
+ * @brief Cierra un enlace saliente y descarta lo pendiente
+ *
+ * Lo que llegue se descarta hasta reconectar, en lugar de entregarlo con
+ * retraso. Se llama con el lock del enlace.
+ */
+static void link_close(cluster_link_t *link, int lost_frames)
+{
+    SAFE_CLOSE(link->socket_fd);
+    metrics_add(METRIC_CLUSTER_DROPPED, (unsigned long long)(lost_frames + link->pending_frames));
+    link->pending_length = 0;
+    link->pending_frames = 0;
+}
+
+/**
+ * @brief Thread de un enlace saliente: conecta, reconecta y envía lotes
+ *
+ * Mientras escribe un lote, los productores llenan el otro buffer; al
+ * terminar intercambia ambos y envía todo lo acumulado en una escritura.
+ */
+static void *link_thread(void *arg)
+{
+    cluster_link_t *link = (cluster_link_t*)arg;
+    struct cluster *cluster = link->cluster;
+    long long retry_ms = CLUSTER_RETRY_MIN_MS;
+    int was_connected = 1;
+
+    while (!__atomic_load_n(&cluster->stop, __ATOMIC_ACQUIRE)) {
+        if (link->socket_fd < 0) {
+            int fd = link_connect(link);
+            if (fd < 0) {
+                /* Solo se registra la primera caída, no cada reintento */
+                if (was_connected) {
+                    LOG_ERROR("No se pudo conectar con el nodo %s:%s, reintentando",
+                             link->host, link->port);
+                    was_connected = 0;
+                }
+                link_wait(link, retry_ms);
+                retry_ms = retry_ms * 2 < CLUSTER_RETRY_MAX_MS ? retry_ms * 2 : CLUSTER_RETRY_MAX_MS;
+                continue;
+            }
+
+            pthread_mutex_lock(&link->lock);
+            link->socket_fd = fd;
+            pthread_mutex_unlock(&link->lock);
+
+            LOG_INFO("Enlace con el nodo %s:%s establecido", link->host, link->port);
+            was_connected = 1;
+        }
+
+        /* Esperar frames revisando de vez en cuando que el par siga ahí */
+        int peer_closed = 0;
+        pthread_mutex_lock(&link->lock);
+        while (link->pending_length == 0 && !__atomic_load_n(&cluster->stop, __ATOMIC_ACQUIRE)) {
+            struct timespec deadline;
+            deadline_after(&deadline, CLUSTER_POLL_MS);
+            if (pthread_cond_timedwait(&link->cond, &link->lock, &deadline) == ETIMEDOUT &&
+                link_peer_closed(link->socket_fd)) {
+                peer_closed = 1;
+                break;
+            }
+        }
+        if (peer_closed) {
+            LOG_INFO("El nodo %s:%s cerró el enlace", link->host, link->port);
+            link_close(link, 0);
+            pthread_mutex_unlock(&link->lock);
+            link_wait(link, retry_ms);
+            retry_ms = retry_ms * 2 < CLUSTER_RETRY_MAX_MS ? retry_ms * 2 : CLUSTER_RETRY_MAX_MS;
+            continue;
+        }
+
+        char *batch = link->pending;
+        size_t batch_length = link->pending_length;
+        int batch_frames = link->pending_frames;
+        link->pending = link->sending;
+        link->sending = batch;
+        link->pending_length = 0;
+        link->pending_frames = 0;
+        pthread_mutex_unlock(&link->lock);
+
+        if (batch_length == 0) {
+            continue;
+        }
+
+        if (send_all(link->socket_fd, batch, batch_length) == (ssize_t)batch_length) {
+            /* La espera vuelve al mínimo solo con un enlace que entrega */
+            retry_ms = CLUSTER_RETRY_MIN_MS;
+            metrics_add(METRIC_CLUSTER_FRAMES_OUT, (unsigned long long)batch_frames);
+            continue;
+        }
+
+        if (!__atomic_load_n(&cluster->stop, __ATOMIC_ACQUIRE)) {
+            LOG_ERROR("Enlace con el nodo %s:%s perdido: %s", link->host, link->port,
+                     strerror(errno));
+        }
+        pthread_mutex_lock(&link->lock);
+        link_close(link, batch_frames);
+        pthread_mutex_unlock(&link->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Reenvía un mensaje de una sala a todos los pares conectados
+ */
+void cluster_publish(cluster_t *cluster, const char *room, const chat_message_t *msg)
+{
+    if (!cluster || cluster->link_count == 0 || !room || !msg) return;
+
+    char frame[CLUSTER_MAX_FRAME];
+    ssize_t length = encode_cluster_frame(room, msg, frame, sizeof(frame));
+    if (length < 0) {
+        LOG_ERROR("Error al serializar mensaje para el clúster");
+        return;
+    }
+
+    unsigned long long dropped = 0;
+    for (int i = 0; i < cluster->link_count; i++) {
+        cluster_link_t *link = &cluster->links[i];
+
+        pthread_mutex_lock(&link->lock);
+        if (link->socket_fd < 0 || link->pending_length + (size_t)length > CLUSTER_QUEUE_BYTES) {
+            dropped++;
+        } else {
+            memcpy(link->pending + link->pending_length, frame, (size_t)length);
+            if (link->pending_length == 0) {
+                pthread_cond_signal(&link->cond);
+            }
+            link->pending_length += (size_t)length;
+            link->pending_frames++;
+        }
+        pthread_mutex_unlock(&link->lock);
+    }
+
+    if (dropped > 0) {
+        metrics_add(METRIC_CLUSTER_DROPPED, dropped);
+    }
+}
+
+/* ========== ENLACES ENTRANTES ========== */
+
+/**
+ * @brief Envía el reto con el que empieza un enlace entrante
+ *
+ * El socket es no bloqueante, pero es la primera escritura en él y cabe
+ * de sobra en el buffer de envío.
+ *
+ * @return 0 en éxito, -1 si el enlace debe cerrarse
+ */
+static int send_challenge(cluster_inbound_t *inbound)
+{
+    unsigned char nonce[CLUSTER_NONCE_SIZE];
+    if (getrandom(nonce, sizeof(nonce), 0) != (ssize_t)sizeof(nonce)) {
+        LOG_ERROR("No se pudo generar el reto del enlace de %s", inbound->name);
+        return -1;
+    }
+    hex_encode(nonce, sizeof(nonce), inbound->nonce);
+
+    chat_message_t challenge;
+    char content[2 * CLUSTER_NONCE_SIZE + 32];
+    char frame[CLUSTER_MAX_FRAME];
+    snprintf(content, sizeof(content), "cluster=%d nonce=%s", CLUSTER_VERSION, inbound->nonce);
+    init_message(&challenge, MSG_CONNECT, "cluster", content);
+
+    ssize_t length = encode_cluster_frame("", &challenge, frame, sizeof(frame));
+    if (length < 0 || send(inbound->socket_fd, frame, (size_t)length, MSG_NOSIGNAL) != length) {
+        LOG_ERROR("No se pudo enviar el reto al enlace de %s", inbound->name);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Avanza el handshake TLS de un enlace entrante y, al terminar, envía el reto
+ * @return 0 en éxito o si hay que esperar, -1 si el enlace debe cerrarse
+ */
+static int advance_inbound_tls(cluster_inbound_t *inbound)
+{
+    tls_step_t step = tls_session_step(inbound->tls);
+    if (step == TLS_STEP_WANT_READ || step == TLS_STEP_WANT_WRITE) {
+        inbound->events = step == TLS_STEP_WANT_READ ? POLLIN : POLLOUT;
+        return 0;
+    }
+
+    tls_session_free(inbound->tls);
+    inbound->tls = NULL;
+    inbound->events = POLLIN;
+    if (step != TLS_STEP_DONE) {
+        LOG_ERROR("Handshake TLS fallido en el enlace de %s", inbound->name);
+        return -1;
+    }
+    return send_challenge(inbound);
+}
+
+/**
+ * @brief Atiende un frame completo de un enlace entrante
+ * @return 0 en éxito, -1 si el enlace debe cerrarse
+ */
+static int handle_cluster_frame(struct cluster *cluster, cluster_inbound_t *inbound,
+                                const char *body, size_t body_length)
+{
+    char room[ROOM_NAME_SIZE];
+    chat_message_t msg;
+
+    if (decode_cluster_body(body, body_length, room, &msg) < 0) {
+        LOG_ERROR("Frame inválido del nodo %s", inbound->name);
+        return -1;
+    }
+
+    if (!inbound->greeted) {
+        int version = 0;
+        unsigned long long node_id = 0;
+        char mac[2 * TLS_HMAC_SIZE + 1];
+        char expected[2 * TLS_HMAC_SIZE + 1];
+        if (msg.type != MSG_CONNECT ||
+            sscanf(msg.content, "cluster=%d node=%llx mac=%64[0-9a-f]", &version, &node_id, mac) != 3 ||
+            version != CLUSTER_VERSION || strlen(mac) != 2 * TLS_HMAC_SIZE) {
+            LOG_ERROR("Saludo inválido en el enlace de %s", inbound->name);
+            return -1;
+        }
+        if (greeting_mac(cluster, inbound->nonce, node_id, expected) < 0 ||
+            !mac_equal(mac, expected, 2 * TLS_HMAC_SIZE)) {
+            LOG_ERROR("El enlace de %s no conoce el secreto del clúster, se rechaza", inbound->name);
+            return -1;
+        }
+        if (node_id == cluster->node_id) {
+            LOG_ERROR("El nodo %s es este mismo nodo, revise --peer", inbound->name);
+            return -1;
+        }
+        inbound->greeted = 1;
+        LOG_INFO("Enlace entrante del nodo %016llx (%s)", node_id, inbound->name);
+        return 0;
+    }
+
+    /* Solo se aceptan mensajes de sala; no se reenvían a otros pares */
+    if ((msg.type != MSG_CHAT && msg.type != MSG_NOTIFICATION) || !validate_room_name(room)) {
+        LOG_ERROR("Mensaje inesperado (tipo %d) del nodo %s", msg.type, inbound->name);
+        return -1;
+    }
+
+    metrics_add(METRIC_CLUSTER_FRAMES_IN, 1);
+    broadcast_to_room_name(cluster->ctx, room, &msg);
+    return 0;
+}
+
+/**
+ * @brief Lee de un enlace entrante y procesa los frames completos
+ * @return 0 si el enlace sigue abierto, -1 si debe cerrarse
+ */
+static int read_inbound(struct cluster *cluster, cluster_inbound_t *inbound)
+{
+    ssize_t received = recv(inbound->socket_fd, inbound->buffer + inbound->length,
+                            CLUSTER_RECV_BUFFER - inbound->length, 0);
+    if (received == 0) {
+        LOG_INFO("Enlace entrante de %s cerrado", inbound->name);
+        return -1;
+    }
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EINTR) return 0;
+        LOG_ERROR("Error leyendo del enlace de %s: %s", inbound->name, strerror(errno));
+        return -1;
+    }
+    inbound->length += (size_t)received;
+
+    size_t offset = 0;
+    while (inbound->length - offset >= CLUSTER_HEADER_SIZE) {
+        const char *header = inbound->buffer + offset;
+        uint32_t body_length;
+        memcpy(&body_length, header + 2, sizeof(body_length));
+        body_length = ntohl(body_length);
+
+        if ((unsigned char)header[0] != CLUSTER_MAGIC || header[1] != CLUSTER_VERSION ||
+            body_length > CLUSTER_MAX_FRAME - CLUSTER_HEADER_SIZE) {
+            LOG_ERROR("Cabecera inválida en el enlace de %s", inbound->name);
+            return -1;
+        }
+        if (inbound->length - offset < CLUSTER_HEADER_SIZE + body_length) {
+            break;
+        }
+
+        if (handle_cluster_frame(cluster, inbound, header + CLUSTER_HEADER_SIZE, body_length) < 0) {
+            return -1;
+        }
+        offset += CLUSTER_HEADER_SIZE + body_length;
+    }
+
+    if (offset > 0) {
+        memmove(inbound->buffer, inbound->buffer + offset, inbound->length - offset);
+        inbound->length -= offset;
+    }
+    return 0;
+}
+
+/**
+ * @brief Cierra un enlace entrante y deja libre su hueco
+ */
+static void close_inbound(cluster_inbound_t *inbound)
+{
+    tls_session_free(inbound->tls);
+    inbound->tls = NULL;
+    SAFE_CLOSE(inbound->socket_fd);
+    free(inbound->buffer);
+    inbound->buffer = NULL;
+    inbound->length = 0;
+    inbound->greeted = 0;
+}
+
+/**
+ * @brief Acepta los enlaces entrantes pendientes
+ */
+static void accept_inbound(struct cluster *cluster)
+{
+    for (;;) {
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        int fd = accept4(cluster->listen_fd, (struct sockaddr*)&addr, &addr_len,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+                LOG_ERROR("Error en accept del puerto del clúster: %s", strerror(errno));
+            }
+            return;
+        }
+
+        cluster_inbound_t *inbound = NULL;
+        for (int i = 0; i < CLUSTER_MAX_INBOUND && !inbound; i++) {
+            if (cluster->inbound[i].socket_fd < 0) {
+                inbound = &cluster->inbound[i];
+            }
+        }
+
+        char *buffer = inbound ? malloc(CLUSTER_RECV_BUFFER) : NULL;
+        if (!buffer) {
+            LOG_ERROR("Enlace entrante rechazado: %s", inbound ? "sin memoria" : "demasiados enlaces");
+            close(fd);
+            continue;
+        }
+
+        int opt = 1;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt));
+
+        inbound->socket_fd = fd;
+        inbound->buffer = buffer;
+        inbound->length = 0;
+        inbound->greeted = 0;
+        inbound->events = POLLIN;
+        inbound->deadline_ms = timer_now_ms() + CLUSTER_HANDSHAKE_MS;
+        snprintf(inbound->name, sizeof(inbound->name), "%s:%d",
+                 inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+
+        /* Con TLS el reto viaja ya cifrado, tras el handshake */
+        if (cluster->ctx->tls) {
+            inbound->tls = tls_session_start(cluster->ctx->tls, fd, NULL);
+            if (!inbound->tls || advance_inbound_tls(inbound) < 0) {
+                close_inbound(inbound);
+            }
+        } else if (send_challenge(inbound) < 0) {
+            close_inbound(inbound);
+        }
+    }
+}
+
+/**
+ * @brief Thread de los enlaces entrantes
+ *
+ * Entrega cada mensaje con el fan-out local del servidor: las colas de
+ * salida admiten escrituras desde cualquier thread.
+ */
+static void *receiver_thread(void *arg)
+{
+    struct cluster *cluster = (struct cluster*)arg;
+
+    while (!__atomic_load_n(&cluster->stop, __ATOMIC_ACQUIRE)) {
+        struct pollfd fds[CLUSTER_MAX_INBOUND + 1];
+        cluster_inbound_t *owners[CLUSTER_MAX_INBOUND + 1];
+        int count = 0;
+
+        fds[count].fd = cluster->listen_fd;
+        fds[count].events = POLLIN;
+        owners[count++] = NULL;
+        for (int i = 0; i < CLUSTER_MAX_INBOUND; i++) {
+            if (cluster->inbound[i].socket_fd >= 0) {
+                fds[count].fd = cluster->inbound[i].socket_fd;
+                fds[count].events = cluster->inbound[i].events;
+                owners[count++] = &cluster->inbound[i];
+            }
+        }
+
+        int ready = poll(fds, (nfds_t)count, CLUSTER_POLL_MS);
+        if (ready < 0) {
+            if (errno != EINTR) {
+                LOG_ERROR("Error en poll del clúster: %s", strerror(errno));
+                break;
+            }
+            continue;
+        }
+
+        long long now_ms = timer_now_ms();
+        for (int i = 1; i < count; i++) {
+            cluster_inbound_t *inbound = owners[i];
+            int failed = 0;
+            if (fds[i].revents & (POLLIN | POLLOUT | POLLHUP | POLLERR)) {
+                failed = inbound->tls ? advance_inbound_tls(inbound) < 0
+                                      : read_inbound(cluster, inbound) < 0;
+            }
+            /* Un enlace sin autenticar no puede retener su hueco indefinidamente */
+            if (!failed && !inbound->greeted && now_ms >= inbound->deadline_ms) {
+                LOG_ERROR("El enlace de %s no completó el saludo a tiempo", inbound->name);
+                failed = 1;
+            }
+            if (failed) {
+                close_inbound(inbound);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            accept_inbound(cluster);
+        }
+    }
+
+    return NULL;
+}
+
+/* ========== CICLO DE VIDA ========== */
+
+/**
+ * @brief Identificador aleatorio del nodo
+ */
+static unsigned long long generate_node_id(void)
+{
+    unsigned long long id;
+    if (getrandom(&id, sizeof(id), 0) != (ssize_t)sizeof(id)) {
+        id = ((unsigned long long)getpid() << 32) ^ (unsigned long long)timer_now_ms();
+    }
+    return id;
+}
+
+/**
+ * @brief Arranca el clúster
+ */
+cluster_t *cluster_create(server_context_t *ctx, const cluster_options_t *options)
+{
+    if (!ctx || !options || options->peer_count < 0 || options->peer_count > CLUSTER_MAX_PEERS) {
+        return NULL;
+    }
+    const char *const *peers = options->peers;
+    int peer_count = options->peer_count;
+
+    cluster_t *cluster = calloc(1, sizeof(cluster_t));
+    if (!cluster) {
+        return NULL;
+    }
+    cluster->ctx = ctx;
+    cluster->node_id = generate_node_id();
+    cluster->listen_fd = -1;
+    for (int i = 0; i < CLUSTER_MAX_INBOUND; i++) {
+        cluster->inbound[i].socket_fd = -1;
+    }
+
+    /* Sin secreto ni HMAC (NO_TLS=1) no hay forma de autenticar a los pares */
+    unsigned char probe[TLS_HMAC_SIZE];
+    if (load_secret(cluster, options->secret_file) < 0 ||
+        tls_hmac_sha256(cluster->secret, cluster->secret_length, "", 0, probe) < 0) {
+        cluster_destroy(cluster);
+        return NULL;
+    }
+
+    if (ctx->tls) {
+        cluster->tls_client = tls_client_create(options->ca_file, 1);
+        if (!cluster->tls_client) {
+            LOG_ERROR("Error creando el contexto TLS de los enlaces del clúster");
+            cluster_destroy(cluster);
+            return NULL;
+        }
+    }
+
+    cluster->listen_fd = create_listen_socket(options->address, options->port, SOMAXCONN);
+    if (cluster->listen_fd < 0) {
+        cluster_destroy(cluster);
+        return NULL;
+    }
+    set_nonblocking(cluster->listen_fd);
+
+    /* Las señales deben llegar a los threads del servidor, no a estos */
+    sigset_t all_signals, previous;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &previous);
+
+    int failed = pthread_create(&cluster->receiver, NULL, receiver_thread, cluster) != 0;
+    cluster->receiver_started = !failed;
+
+    for (int i = 0; i < peer_count && !failed; i++) {
+        cluster_link_t *link = &cluster->links[i];
+        const char *colon = strrchr(peers[i], ':');
+
+        link->cluster = cluster;
+        link->socket_fd = -1;
+        snprintf(link->host, sizeof(link->host), "%.*s", (int)(colon - peers[i]), peers[i]);
+        snprintf(link->port, sizeof(link->port), "%s", colon + 1);
+        link->pending = malloc(CLUSTER_QUEUE_BYTES);
+        link->sending = malloc(CLUSTER_QUEUE_BYTES);
+        pthread_mutex_init(&link->lock, NULL);
+        pthread_cond_init(&link->cond, NULL);
+        cluster->link_count++;
+
+        failed = !link->pending || !link->sending ||
+                 pthread_create(&link->thread, NULL, link_thread, link) != 0;
+        link->thread_started = !failed;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (failed) {
+        LOG_ERROR("Error creando los threads del clúster");
+        cluster_destroy(cluster);
+        return NULL;
+    }
+
+    LOG_INFO("Clúster: nodo %016llx, enlaces entrantes en %s:%d, %d pares, %s",
+            cluster->node_id, options->address, options->port, peer_count,
+            cluster->tls_client ? "TLS" : "sin cifrar");
+    return cluster;
+}
+
+/**
+ * @brief Cierra los enlaces y espera a sus threads
+ */
+void cluster_destroy(cluster_t *cluster)
+{
+    if (!cluster) return;
+
+    __atomic_store_n(&cluster->stop, 1, __ATOMIC_RELEASE);
+
+    /* Despertar a cada thread saliente, también si está bloqueado en send() */
+    for (int i = 0; i < cluster->link_count; i++) {
+        cluster_link_t *link = &cluster->links[i];
+        pthread_mutex_lock(&link->lock);
+        if (link->socket_fd >= 0) {
+            shutdown(link->socket_fd, SHUT_RDWR);
+        }
+        pthread_cond_broadcast(&link->cond);
+        pthread_mutex_unlock(&link->lock);
+    }
+
+    for (int i = 0; i < cluster->link_count; i++) {
+        cluster_link_t *link = &cluster->links[i];
+        if (link->thread_started) {
+            pthread_join(link->thread, NULL);
+        }
+        SAFE_CLOSE(link->socket_fd);
+        free(link->pending);
+        free(link->sending);
+        pthread_mutex_destroy(&link->lock);
+        pthread_cond_destroy(&link->cond);
+    }
+
+    if (cluster->receiver_started) {
+        pthread_join(cluster->receiver, NULL);
+    }
+    for (int i = 0; i < CLUSTER_MAX_INBOUND; i++) {
+        close_inbound(&cluster->inbound[i]);
+    }
+    SAFE_CLOSE(cluster->listen_fd);
+    tls_context_destroy(cluster->tls_client);
+    explicit_bzero(cluster->secret, sizeof(cluster->secret));
+    free(cluster);
+}
@@ -6,10 +6,9 @@
  */
 
 #include "../include/chat_common.h"
-#include <stdarg.h>
-
-/* Mutex global para logging thread-safe */
-static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+#include "../include/chat_compress.h"
+#include <fcntl.h>
+#include <poll.h>
 
 /**
  * @brief Inicializa una estructura de mensaje
@@ -47,6 +46,159 @@ void init_message(chat_message_t *msg, message_type_t type,
     msg->length = sizeof(chat_message_t);
 }
 
+/* Espacio reservado para la cabecera: magic, versión y varint de longitud */
+#define WIRE_HEADER_MAX     (2 + 5)
+
+/**
+ * @brief Codifica un entero como varint LEB128
+ * @return Bytes escritos o 0 si no hay espacio
+ */
+static size_t put_varint(unsigned char *out, size_t available, uint64_t value)
+{
+    size_t written = 0;
+    
+    do {
+        if (written >= available) return 0;
+        unsigned char byte = (unsigned char)(value & 0x7F);
+        value >>= 7;
+        out[written++] = value ? (unsigned char)(byte | 0x80) : byte;
+    } while (value);
+    
+    return written;
+}
+
+/**
+ * @brief Decodifica un varint LEB128
+ * @return Bytes consumidos, 0 si faltan bytes, -1 si el varint es inválido
+ */
+static int get_varint(const unsigned char *in, size_t available, uint64_t *value)
+{
+    uint64_t result = 0;
+    
+    for (size_t i = 0; i < available; i++) {
+        if (i >= 10) return -1;
+        result |= (uint64_t)(in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *value = result;
+            return (int)(i + 1);
+        }
+    }
+    
+    return available >= 10 ? -1 : 0;
+}
+
+/**
+ * @brief Serializa un mensaje en formato legacy
+ * 
+ * Copia la estructura completa tal como la esperan los clientes antiguos.
+ */
+static ssize_t serialize_legacy(const chat_message_t *msg, char *buffer, size_t buffer_size)
+{
+    if (buffer_size < LEGACY_FRAME_SIZE) {
+        return -1;
+    }
+    
+    legacy_wire_message_t wire;
+    memset(&wire, 0, sizeof(wire));
+    wire.type = msg->type;
+    memcpy(wire.username, msg->username, USERNAME_SIZE);
+    memcpy(wire.content, msg->content, MESSAGE_SIZE);
+    wire.timestamp = msg->timestamp;
+    wire.length = msg->length;
+    
+    memcpy(buffer, &wire, LEGACY_FRAME_SIZE);
+    return (ssize_t)LEGACY_FRAME_SIZE;
+}
+
+/**
+ * @brief Serializa un mensaje en formato compacto
+ * 
+ * El cuerpo se escribe dejando hueco para la cabecera y después se
+ * desplaza para que quede justo tras el varint de longitud.
+ */
+static ssize_t serialize_compact(const chat_message_t *msg, char *buffer, size_t buffer_size)
+{
+    if (buffer_size <= WIRE_HEADER_MAX) {
+        return -1;
+    }
+    
+    unsigned char *out = (unsigned char*)buffer;
+    size_t pos = WIRE_HEADER_MAX;
+    size_t username_len = strnlen(msg->username, USERNAME_SIZE - 1);
+    size_t content_len = strnlen(msg->content, MESSAGE_SIZE - 1);
+    size_t n;
+    
+#define PUT_VARINT(value) do { \
+        n = put_varint(out + pos, buffer_size - pos, (uint64_t)(value)); \
+        if (n == 0) return -1; \
+        pos += n; \
+    } while (0)
+    
+    PUT_VARINT(msg->type);
+    PUT_VARINT(0);                          /* flags: reservado para campos opcionales */
+    PUT_VARINT(msg->timestamp > 0 ? msg->timestamp : 0);
+    
+    PUT_VARINT(username_len);
+    if (buffer_size - pos < username_len) return -1;
+    memcpy(out + pos, msg->username, username_len);
+    pos += username_len;
+    
+    PUT_VARINT(content_len);
+    if (buffer_size - pos < content_len) return -1;
+    memcpy(out + pos, msg->content, content_len);
+    pos += content_len;
+    
+#undef PUT_VARINT
+    
+    /* Escribir la cabecera y mover el cuerpo tras ella */
+    size_t body_len = pos - WIRE_HEADER_MAX;
+    unsigned char header[WIRE_HEADER_MAX];
+    header[0] = WIRE_MAGIC;
+    header[1] = WIRE_VERSION;
+    size_t header_len = 2 + put_varint(header + 2, sizeof(header) - 2, body_len);
+    
+    memmove(out + header_len, out + WIRE_HEADER_MAX, body_len);
+    memcpy(out, header, header_len);
+    
+    return (ssize_t)(header_len + body_len);
+}
+
+/**
+ * @brief Serializa un mensaje como frame compacto con el cuerpo comprimido
+ * 
+ * Los frames menores que wire_deflate_threshold() o que no se reducen al
+ * comprimirlos se devuelven como frames compactos normales.
+ */
+static ssize_t serialize_deflate(const chat_message_t *msg, char *buffer, size_t buffer_size)
+{
+    ssize_t compact_len = serialize_compact(msg, buffer, buffer_size);
+    if (compact_len < 0 || (size_t)compact_len < wire_deflate_threshold()) {
+        return compact_len;
+    }
+    
+    uint64_t body_len;
+    int n = get_varint((const unsigned char*)buffer + 2, (size_t)compact_len - 2, &body_len);
+    if (n <= 0) {
+        return -1;
+    }
+    
+    /* Un cuerpo comprimido más corto nunca alarga el varint de longitud */
+    unsigned char packed[WIRE_MAX_FRAME_SIZE];
+    ssize_t packed_len = wire_deflate((const unsigned char*)buffer + 2 + n,
+                                      (size_t)body_len, packed, (size_t)body_len - 1);
+    if (packed_len <= 0) {
+        return compact_len;
+    }
+    
+    unsigned char *out = (unsigned char*)buffer;
+    out[0] = WIRE_MAGIC;
+    out[1] = WIRE_VERSION_DEFLATE;
+    size_t pos = 2 + put_varint(out + 2, buffer_size - 2, (uint64_t)packed_len);
+    memcpy(out + pos, packed, (size_t)packed_len);
+    
+    return (ssize_t)(pos + (size_t)packed_len);
+}
+
 /**
  * @brief Serializa un mensaje para envío por red
  * 
@@ -55,14 +207,150 @@ void init_message(chat_message_t *msg, message_type_t type,
  */
 ssize_t serialize_message(const chat_message_t *msg, char *buffer, size_t buffer_size)
 {
-    if (!msg || !buffer || buffer_size < sizeof(chat_message_t)) {
+    return serialize_message_as(msg, WIRE_FORMAT_LEGACY, buffer, buffer_size);
+}
+
+/**
+ * @brief Serializa un mensaje en el formato de red indicado
+ */
+ssize_t serialize_message_as(const chat_message_t *msg, wire_format_t format,
+                             char *buffer, size_t buffer_size)
+{
+    if (!msg || !buffer) {
+        return -1;
+    }
+    
+    if (format == WIRE_FORMAT_COMPACT) {
+        return serialize_compact(msg, buffer, buffer_size);
+    }
+    
+    if (format == WIRE_FORMAT_DEFLATE) {
+        return serialize_deflate(msg, buffer, buffer_size);
+    }
+    
+    return serialize_legacy(msg, buffer, buffer_size);
+}
+
+/**
+ * @brief Lee la cabecera de un frame compacto
+ * @return Longitud de la cabecera, 0 si faltan bytes, -1 si es inválida
+ */
+static int parse_compact_header(const unsigned char *in, size_t available, uint64_t *body_len)
+{
+    if (available < 2) return 0;
+    if (in[0] != WIRE_MAGIC) return -1;
+    if (in[1] != WIRE_VERSION && in[1] != WIRE_VERSION_DEFLATE) return -1;
+    
+    int n = get_varint(in + 2, available - 2, body_len);
+    if (n <= 0) return n;
+    if (*body_len == 0 || *body_len > WIRE_MAX_FRAME_SIZE) return -1;
+    
+    return 2 + n;
+}
+
+/**
+ * @brief Determina la longitud del frame que comienza en un buffer
+ * 
+ * Los frames legacy tienen tamaño fijo; los compactos declaran la
+ * longitud de su cuerpo en la cabecera.
+ */
+ssize_t message_frame_length(const char *buffer, size_t available)
+{
+    if (!buffer || available == 0) return 0;
+    
+    const unsigned char *in = (const unsigned char*)buffer;
+    size_t envelope = 0;
+    
+    /* El envoltorio de secuencia precede a un frame compacto */
+    if (in[0] == WIRE_MAGIC && available >= 2 && in[1] == WIRE_VERSION_SEQUENCE) {
+        if (available <= WIRE_SEQUENCE_HEADER) return 0;
+        envelope = WIRE_SEQUENCE_HEADER;
+        in += envelope;
+        available -= envelope;
+        if (in[0] != WIRE_MAGIC) return -1;
+    }
+    
+    if (in[0] == WIRE_MAGIC) {
+        uint64_t body_len;
+        int header_len = parse_compact_header(in, available, &body_len);
+        if (header_len <= 0) return header_len;
+        
+        size_t frame_len = (size_t)header_len + (size_t)body_len;
+        return available >= frame_len ? (ssize_t)(envelope + frame_len) : 0;
+    }
+    
+    /* Legacy: validar el tipo en cuanto esté disponible para detectar basura */
+    if (available >= sizeof(message_type_t)) {
+        message_type_t type;
+        memcpy(&type, buffer, sizeof(type));
+        if ((int)type < MSG_CONNECT || type >= MSG_TYPE_COUNT) return -1;
+    }
+    
+    return available >= LEGACY_FRAME_SIZE ? (ssize_t)LEGACY_FRAME_SIZE : 0;
+}
+
+/**
+ * @brief Decodifica el cuerpo de un frame compacto
+ */
+static int parse_compact_body(const unsigned char *body, uint64_t body_len, chat_message_t *msg)
+{
+    size_t pos = 0;
+    uint64_t type, flags, timestamp, username_len, content_len;
+    int n;
+    
+#define GET_VARINT(target) do { \
+        n = get_varint(body + pos, (size_t)body_len - pos, &(target)); \
+        if (n <= 0) return -1; \
+        pos += (size_t)n; \
+    } while (0)
+    
+    GET_VARINT(type);
+    GET_VARINT(flags);
+    GET_VARINT(timestamp);
+    
+    GET_VARINT(username_len);
+    if (username_len >= USERNAME_SIZE || body_len - pos < username_len) return -1;
+    memcpy(msg->username, body + pos, (size_t)username_len);
+    pos += (size_t)username_len;
+    
+    GET_VARINT(content_len);
+    if (content_len >= MESSAGE_SIZE || body_len - pos < content_len) return -1;
+    memcpy(msg->content, body + pos, (size_t)content_len);
+    pos += (size_t)content_len;
+    
+#undef GET_VARINT
+    
+    (void)flags;    /* Sin campos opcionales en esta versión */
+    
+    if (type >= MSG_TYPE_COUNT) return -1;
+    
+    msg->type = (message_type_t)type;
+    msg->timestamp = (time_t)timestamp;
+    msg->length = sizeof(chat_message_t);
+    return 0;
+}
+
+/**
+ * @brief Deserializa un frame compacto, descomprimiendo el cuerpo si hace falta
+ */
+static int deserialize_compact(const unsigned char *in, size_t available, chat_message_t *msg)
+{
+    uint64_t body_len;
+    int header_len = parse_compact_header(in, available, &body_len);
+    if (header_len <= 0 || available - (size_t)header_len < body_len) {
         return -1;
     }
     
-    /* Copia directa de la estructura (network byte order se manejará si es necesario) */
-    memcpy(buffer, msg, sizeof(chat_message_t));
+    if (in[1] != WIRE_VERSION_DEFLATE) {
+        return parse_compact_body(in + header_len, body_len, msg);
+    }
     
-    return sizeof(chat_message_t);
+    unsigned char body[WIRE_MAX_FRAME_SIZE];
+    ssize_t inflated = wire_inflate(in + header_len, (size_t)body_len, body, sizeof(body));
+    if (inflated <= 0) {
+        return -1;
+    }
+    return parse_compact_body(body, (uint64_t)inflated, msg);
 }
 
 /**
@@ -73,18 +361,50 @@ ssize_t serialize_message(const chat_message_t *msg, char *buffer, size_t buffer
  */
 int deserialize_message(const char *buffer, size_t buffer_size, chat_message_t *msg)
 {
-    if (!buffer || !msg || buffer_size < sizeof(chat_message_t)) {
+    if (!buffer || !msg || buffer_size == 0) {
+        return -1;
+    }
+    
+    memset(msg, 0, sizeof(chat_message_t));
+    
+    if ((unsigned char)buffer[0] == WIRE_MAGIC) {
+        const unsigned char *in = (const unsigned char*)buffer;
+        unsigned long long sequence = 0;
+        
+        if (buffer_size > WIRE_SEQUENCE_HEADER && in[1] == WIRE_VERSION_SEQUENCE) {
+            for (int i = 2; i < WIRE_SEQUENCE_HEADER; i++) {
+                sequence = (sequence << 8) | in[i];
+            }
+            in += WIRE_SEQUENCE_HEADER;
+            buffer_size -= WIRE_SEQUENCE_HEADER;
+        }
+        
+        if (deserialize_compact(in, buffer_size, msg) < 0) {
+            return -1;
+        }
+        msg->sequence = sequence;
+        return 0;
+    }
+    
+    if (buffer_size < LEGACY_FRAME_SIZE) {
         return -1;
     }
     
-    /* Copia directa a la estructura */
-    memcpy(msg, buffer, sizeof(chat_message_t));
+    /* Copia directa de la disposición legacy */
+    legacy_wire_message_t wire;
+    memcpy(&wire, buffer, LEGACY_FRAME_SIZE);
     
     /* Validaciones básicas */
-    if (msg->type < MSG_CONNECT || msg->type > MSG_KEEPALIVE) {
+    if ((int)wire.type < MSG_CONNECT || wire.type >= MSG_TYPE_COUNT) {
         return -1;
     }
     
+    msg->type = wire.type;
+    memcpy(msg->username, wire.username, USERNAME_SIZE);
+    memcpy(msg->content, wire.content, MESSAGE_SIZE);
+    msg->timestamp = wire.timestamp;
+    msg->length = wire.length;
+    
     /* Asegurar terminación nula de strings */
     msg->username[USERNAME_SIZE - 1] = '\0';
     msg->content[MESSAGE_SIZE - 1] = '\0';
@@ -92,6 +412,247 @@ int deserialize_message(const char *buffer, size_t buffer_size, chat_message_t *
     return 0;
 }
 
+/**
+ * @brief Indica si un MSG_CONNECT anuncia soporte del formato compacto
+ * 
+ * Los clientes nuevos envían WIRE_CAPABILITY en el contenido del
+ * MSG_CONNECT (siempre en formato legacy); los antiguos lo dejan vacío.
+ */
+int message_offers_compact_wire(const chat_message_t *msg)
+{
+    if (!msg || msg->type != MSG_CONNECT) return 0;
+    
+    return strstr(msg->content, WIRE_CAPABILITY) != NULL;
+}
+
+/**
+ * @brief Indica si un MSG_CONNECT anuncia soporte de compresión deflate
+ * 
+ * Sirve en ambos sentidos: el cliente lo anuncia en su MSG_CONNECT y el
+ * servidor lo confirma en la respuesta si lo acepta.
+ */
+int message_offers_deflate(const chat_message_t *msg)
+{
+    if (!msg || msg->type != MSG_CONNECT) return 0;
+    
+    return strstr(msg->content, WIRE_DEFLATE_CAPABILITY) != NULL;
+}
+
+/**
+ * @brief Indica si un MSG_CONNECT anuncia la reanudación de sesiones
+ * 
+ * Como la compresión, sirve en ambos sentidos: el servidor la confirma en
+ * su respuesta junto con el token de la sesión.
+ */
+int message_offers_resume(const chat_message_t *msg)
+{
+    if (!msg || msg->type != MSG_CONNECT) return 0;
+    
+    return strstr(msg->content, WIRE_RESUME_CAPABILITY) != NULL;
+}
+
+/**
+ * @brief Indica si un MSG_CONNECT anuncia la lista de usuarios (MSG_PRESENCE)
+ */
+int message_offers_presence(const chat_message_t *msg)
+{
+    if (!msg || msg->type != MSG_CONNECT) return 0;
+    
+    return strstr(msg->content, WIRE_PRESENCE_CAPABILITY) != NULL;
+}
+
+/**
+ * @brief Indica si un MSG_CONNECT anuncia los lotes de mensajes
+ */
+int message_offers_batch(const chat_message_t *msg)
+{
+    if (!msg || msg->type != MSG_CONNECT) return 0;
+    
+    return strstr(msg->content, WIRE_BATCH_CAPABILITY) != NULL;
+}
+
+/**
+ * @brief Extrae el valor de un campo "clave=valor" del contenido
+ * 
+ * La clave solo cuenta al principio del contenido o tras un espacio, así
+ * "seq" no coincide dentro de otra clave.
+ */
+int message_get_field(const chat_message_t *msg, const char *key,
+                      char *value, size_t value_size)
+{
+    if (!msg || !key || !value || value_size == 0) return 0;
+    
+    size_t key_len = strlen(key);
+    const char *field = msg->content;
+    
+    while ((field = strstr(field, key)) != NULL) {
+        if ((field == msg->content || field[-1] == ' ') && field[key_len] == '=') {
+            const char *start = field + key_len + 1;
+            size_t length = strcspn(start, " ");
+            if (length >= value_size) return 0;
+            
+            memcpy(value, start, length);
+            value[length] = '\0';
+            return 1;
+        }
+        field += key_len;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Escribe la cabecera del envoltorio de secuencia
+ */
+void wire_put_sequence_header(char *header, unsigned long long sequence)
+{
+    unsigned char *out = (unsigned char*)header;
+    
+    out[0] = WIRE_MAGIC;
+    out[1] = WIRE_VERSION_SEQUENCE;
+    for (int i = WIRE_SEQUENCE_HEADER - 1; i >= 2; i--) {
+        out[i] = (unsigned char)(sequence & 0xFF);
+        sequence >>= 8;
+    }
+}
+
+/**
+ * @brief Escribe la cabecera de un lote
+ */
+size_t wire_put_batch_header(char *header, size_t batch_length)
+{
+    unsigned char *out = (unsigned char*)header;
+    
+    out[0] = WIRE_MAGIC;
+    out[1] = WIRE_VERSION_BATCH;
+    return 2 + put_varint(out + 2, WIRE_BATCH_HEADER_MAX - 2, (uint64_t)batch_length);
+}
+
+/**
+ * @brief Lee la cabecera de un lote
+ * 
+ * Un lote vacío o mayor que WIRE_MAX_BATCH_SIZE es inválido.
+ */
+int wire_parse_batch_header(const char *buffer, size_t available, size_t *batch_length)
+{
+    const unsigned char *in = (const unsigned char*)buffer;
+    
+    if (available < 2) return 0;
+    if (in[0] != WIRE_MAGIC || in[1] != WIRE_VERSION_BATCH) return -1;
+    
+    uint64_t length;
+    int n = get_varint(in + 2, available - 2, &length);
+    if (n <= 0) return n;
+    if (length == 0 || length > WIRE_MAX_BATCH_SIZE) return -1;
+    
+    *batch_length = (size_t)length;
+    return 2 + n;
+}
+
+/**
+ * @brief Envía un buffer completo por un socket
+ * 
+ * Un único send() puede escribir menos bytes de los pedidos, y en
+ * sockets no bloqueantes puede fallar con EAGAIN si el buffer del
+ * kernel está lleno. En ambos casos se continúa hasta completar.
+ */
+ssize_t send_all(int socket_fd, const char *buffer, size_t length)
+{
+    if (socket_fd < 0 || !buffer) return -1;
+    
+    size_t total = 0;
+    while (total < length) {
+        ssize_t sent = send(socket_fd, buffer + total, length - total, MSG_NOSIGNAL);
+        
+        if (sent > 0) {
+            total += (size_t)sent;
+            continue;
+        }
+        
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            /* Esperar a que el socket vuelva a ser escribible */
+            struct pollfd pfd;
+            pfd.fd = socket_fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            
+            int ready = poll(&pfd, 1, SEND_TIMEOUT_MS);
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready > 0 && !(pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+                continue;
+            }
+            if (ready == 0) {
+                errno = ETIMEDOUT;
+            }
+        }
+        
+        return -1;
+    }
+    
+    return (ssize_t)total;
+}
+
+/**
+ * @brief Crea un socket de escucha TCP en una dirección concreta
+ */
+int create_listen_socket(const char *address, int port, int backlog)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (!address || inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+        LOG_ERROR("Dirección de escucha inválida: %s", address ? address : "(nula)");
+        return ERROR_BIND;
+    }
+    
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Error al crear socket: %s", strerror(errno));
+        return ERROR_SOCKET;
+    }
+    
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        LOG_ERROR("Error al configurar SO_REUSEADDR: %s", strerror(errno));
+        SAFE_CLOSE(fd);
+        return ERROR_SOCKET;
+    }
+    
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        LOG_ERROR("Error en bind a %s:%d: %s", address, port, strerror(errno));
+        SAFE_CLOSE(fd);
+        return ERROR_BIND;
+    }
+    
+    if (listen(fd, backlog) < 0) {
+        LOG_ERROR("Error al configurar socket en modo listen: %s", strerror(errno));
+        SAFE_CLOSE(fd);
+        return ERROR_LISTEN;
+    }
+    
+    return fd;
+}
+
+/**
+ * @brief Configura un socket en modo no bloqueante
+ */
+int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
 /**
  * @brief Formatea un timestamp para mostrar
  * 
@@ -113,27 +674,27 @@ void format_timestamp(time_t timestamp, char *buffer, size_t buffer_size)
 }
 
 /**
- * @brief Valida un nombre de usuario
+ * @brief Valida un identificador (nombre de usuario o de sala)
  * 
- * Verifica que el nombre de usuario cumple con los criterios:
+ * Verifica que el identificador cumple con los criterios:
  * - No vacío
  * - Solo caracteres alfanuméricos y '_'
- * - Longitud apropiada
+ * - Longitud menor que max_size
  */
-int validate_username(const char *username)
+static int validate_identifier(const char *name, size_t max_size)
 {
-    if (!username || strlen(username) == 0) {
+    if (!name || strlen(name) == 0) {
         return 0;
     }
     
-    size_t len = strlen(username);
-    if (len >= USERNAME_SIZE) {
+    size_t len = strlen(name);
+    if (len >= max_size) {
         return 0;
     }
     
     /* Verificar caracteres válidos */
     for (size_t i = 0; i < len; i++) {
-        char c = username[i];
+        char c = name[i];
         if (!((c >= 'a' && c <= 'z') || 
               (c >= 'A' && c <= 'Z') || 
               (c >= '0' && c <= '9') || 
@@ -146,33 +707,32 @@ int validate_username(const char *username)
 }
 
 /**
- * @brief Función de logging thread-safe
- * 
- * Implementa logging seguro para entornos multi-thread,
- * incluyendo timestamp y nivel de log.
+ * @brief Valida un nombre de usuario
  */
-void safe_log(const char *level, const char *format, ...)
+int validate_username(const char *username)
 {
-    /* Adquirir mutex para operación atómica */
-    pthread_mutex_lock(&log_mutex);
-    
-    /* Obtener timestamp actual */
-    time_t now = time(NULL);
-    char timestamp[32];
-    format_timestamp(now, timestamp, sizeof(timestamp));
-    
-    /* Imprimir prefijo con timestamp y nivel */
-    printf("%s [%s] ", timestamp, level);
-    
-    /* Imprimir mensaje con argumentos variables */
-    va_list args;
-    va_start(args, format);
-    vprintf(format, args);
-    va_end(args);
+    return validate_identifier(username, USERNAME_SIZE);
+}
+
+/**
+ * @brief Valida un nombre de sala
+ */
+int validate_room_name(const char *name)
+{
+    return validate_identifier(name, ROOM_NAME_SIZE);
+}
+
+/**
+ * @brief Hash FNV-1a de un identificador
+ */
+unsigned int hash_identifier(const char *name)
+{
+    unsigned int hash = 2166136261u;
     
-    printf("\n");
-    fflush(stdout);
+    for (const unsigned char *p = (const unsigned char*)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
     
-    /* Liberar mutex */
-    pthread_mutex_unlock(&log_mutex);
+    return hash;
 }
@@ -0,0 +1,181 @@
+/**
+ * @file chat_compress.c
+ * @brief Implementación de la compresión deflate de los frames compactos
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Los streams de zlib se reutilizan con deflateReset()/inflateReset(): crear
+ * uno reserva decenas de KB, y un broadcast o un recv no deben pagar eso.
+ */
+
+#include "../include/chat_compress.h"
+#include <zlib.h>
+
+/**
+ * @brief Diccionario preestablecido de deflate
+ *
+ * zlib busca coincidencias desde el final, así que lo más frecuente va al
+ * final: avisos del servidor y palabras comunes del chat. Debe ser idéntico
+ * en ambos extremos (ver WIRE_DEFLATE_CAPABILITY).
+ */
+static const char wire_dictionary[] =
+    "http://https://www.youtube.com/watch?v= .com .org .net .es "
+    "jajaja jejeje hahaha lol xD :) :( :D ;) <3 ok vale sip nop "
+    "thanks thank you please sorry what where when why how because "
+    "the and that this with have from they will would there their "
+    "about people think know just like time good really right "
+    "porque también pero cuando donde quien como cómo qué cuál "
+    "entonces después antes ahora hoy mañana ayer semana mes año "
+    "trabajo reunión proyecto equipo problema solución mensaje "
+    "gracias de nada por favor perdón disculpa buenos días buenas "
+    "tardes buenas noches hola a todos adiós hasta luego nos vemos "
+    "está están estoy estamos tengo tienes tiene tenemos puedo puede "
+    "hacer hecho voy vamos creo que no sé si claro bueno muy bien "
+    "de la que el en y a los se del las un por con no una su para es "
+    "al lo como más o pero sus le ya fue este ha sí porque esta son "
+    "Nombre de usuario inválido. Nombre de sala inválido "
+    "No se pudo entrar en la sala Ya estás en la sala '"
+    "Nombre de usuario en uso. Elija otro. Servidor lleno. Intente más tarde. "
+    "mensajes omitidos por saturación "
+    "Conectado al chat. ¡Bienvenido! "
+    "[Usuario  salió de la sala][Usuario  entró en la sala]"
+    "[Usuario  se desconectó][Usuario  se conectó]Sistema";
+
+/* Umbral de compresión (atómico: lo fija el servidor al arrancar) */
+static size_t deflate_threshold = WIRE_DEFLATE_MIN_SIZE;
+
+/**
+ * @brief Streams de zlib de un thread
+ */
+typedef struct {
+    z_stream deflater;
+    z_stream inflater;
+    int deflater_ready;                     /* deflateInit2() hecho */
+    int inflater_ready;                     /* inflateInit2() hecho */
+} wire_streams_t;
+
+static __thread wire_streams_t *thread_streams = NULL;
+static pthread_key_t streams_key;
+static pthread_once_t streams_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Libera los streams de un thread que termina
+ */
+static void release_thread_streams(void *data)
+{
+    wire_streams_t *streams = data;
+
+    if (streams->deflater_ready) deflateEnd(&streams->deflater);
+    if (streams->inflater_ready) inflateEnd(&streams->inflater);
+    free(streams);
+}
+
+static void create_streams_key(void)
+{
+    pthread_key_create(&streams_key, release_thread_streams);
+}
+
+/**
+ * @brief Streams del thread actual (NULL si no hay memoria)
+ */
+static wire_streams_t *get_thread_streams(void)
+{
+    if (!thread_streams) {
+        thread_streams = calloc(1, sizeof(wire_streams_t));
+        if (!thread_streams) {
+            return NULL;
+        }
+        pthread_once(&streams_key_once, create_streams_key);
+        pthread_setspecific(streams_key, thread_streams);
+    }
+    return thread_streams;
+}
+
+/**
+ * @brief Cambia el tamaño a partir del cual se comprime
+ */
+void wire_set_deflate_threshold(size_t min_size)
+{
+    __atomic_store_n(&deflate_threshold, min_size, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Tamaño a partir del cual se comprime
+ */
+size_t wire_deflate_threshold(void)
+{
+    return __atomic_load_n(&deflate_threshold, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Comprime un cuerpo de frame compacto
+ */
+ssize_t wire_deflate(const unsigned char *in, size_t in_length,
+                     unsigned char *out, size_t out_size)
+{
+    wire_streams_t *streams = get_thread_streams();
+    if (!streams || !in || !out) return -1;
+
+    z_stream *stream = &streams->deflater;
+    if (!streams->deflater_ready) {
+        if (deflateInit2(stream, WIRE_DEFLATE_LEVEL, Z_DEFLATED, -WIRE_DEFLATE_WINDOW_BITS,
+                         WIRE_DEFLATE_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return -1;
+        }
+        streams->deflater_ready = 1;
+    } else if (deflateReset(stream) != Z_OK) {
+        return -1;
+    }
+
+    if (deflateSetDictionary(stream, (const Bytef*)wire_dictionary,
+                             sizeof(wire_dictionary) - 1) != Z_OK) {
+        return -1;
+    }
+
+    stream->next_in = (Bytef*)in;
+    stream->avail_in = (uInt)in_length;
+    stream->next_out = out;
+    stream->avail_out = (uInt)out_size;
+
+    /* Sin espacio para terminar: comprimido no sería más corto */
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
+        return -1;
+    }
+    return (ssize_t)stream->total_out;
+}
+
+/**
+ * @brief Descomprime un cuerpo de frame comprimido
+ */
+ssize_t wire_inflate(const unsigned char *in, size_t in_length,
+                     unsigned char *out, size_t out_size)
+{
+    wire_streams_t *streams = get_thread_streams();
+    if (!streams || !in || !out) return -1;
+
+    z_stream *stream = &streams->inflater;
+    if (!streams->inflater_ready) {
+        if (inflateInit2(stream, -WIRE_DEFLATE_WINDOW_BITS) != Z_OK) {
+            return -1;
+        }
+        streams->inflater_ready = 1;
+    } else if (inflateReset(stream) != Z_OK) {
+        return -1;
+    }
+
+    /* En deflate crudo el diccionario se fija antes de los datos */
+    if (inflateSetDictionary(stream, (const Bytef*)wire_dictionary,
+                             sizeof(wire_dictionary) - 1) != Z_OK) {
+        return -1;
+    }
+
+    stream->next_in = (Bytef*)in;
+    stream->avail_in = (uInt)in_length;
+    stream->next_out = out;
+    stream->avail_out = (uInt)out_size;
+
+    if (inflate(stream, Z_FINISH) != Z_STREAM_END || stream->avail_in != 0) {
+        return -1;
+    }
+    return (ssize_t)stream->total_out;
+}
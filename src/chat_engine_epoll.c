@@ -0,0 +1,1130 @@
+/**
+ * @file chat_engine_epoll.c
+ * @brief Motores de E/S basados en epoll edge-triggered (epoll y reactor)
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Atiende a todos los clientes con unos pocos threads de event loop en
+ * lugar de un thread por conexión. Cada loop tiene su propia instancia
+ * epoll y la conexión aceptada queda asignada a ese loop durante toda
+ * su vida.
+ *
+ * - Motor "epoll": el socket de escucha es único y se registra en todos
+ *   los loops con EPOLLEXCLUSIVE; el broadcast usa la lista global.
+ * - Motor "reactor": cada loop (shard) tiene su propio socket de escucha
+ *   con SO_REUSEPORT y su propia lista de clientes, indexada por sala. El
+ *   fan-out (broadcast_hook) entrega a los clientes locales y publica los
+ *   frames serializados una sola vez en el inbox lock-free de cada uno de
+ *   los demás shards, que los entregan a sus miembros de la sala; ningún
+ *   shard lee el estado de otro ni toma clients_mutex para ello.
+ *
+ * Los mensajes de chat de una sala usan ese fan-out en el reactor. Los
+ * avisos de entrada y salida, la presencia y, en el motor epoll, también
+ * el chat recorren la lista de miembros de la sala bajo clients_mutex;
+ * sus colas admiten escrituras desde cualquier loop.
+ *
+ * En ambos motores los sockets se registran también con EPOLLOUT
+ * edge-triggered: cuando la cola de salida de un cliente queda esperando,
+ * el loop dueño la vacía en cuanto el socket vuelve a ser escribible.
+ *
+ * Cada loop tiene una rueda de temporizadores con uno por conexión: antes
+ * del handshake vence a los ctx->timeout_ms y después revisa la actividad
+ * del cliente (check_client_liveness). Leer datos solo actualiza la marca
+ * de actividad; el temporizador se reprograma al vencer.
+ *
+ * Con TLS, cada evento de una conexión nueva avanza su handshake hasta que
+ * kTLS queda instalado; el plazo es el mismo temporizador del handshake.
+ *
+ * En un reinicio en caliente (ver chat_handoff.h) los clientes heredados
+ * se reparten entre los loops antes de arrancarlos, y al ceder el
+ * servidor cada conexión deja en su cliente el frame recibido a medias.
+ */
+
+#include "../include/chat_engine.h"
+#include "../include/chat_client_table.h"
+#include "../include/chat_room.h"
+#include "../include/chat_metrics.h"
+#include "../include/chat_timer.h"
+#include "../include/chat_trace.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <sched.h>
+
+#define SHARD_MEMBERS_INITIAL   64                  /* Capacidad inicial de clientes por shard */
+#define SHARD_ROOM_MEMBERS_INITIAL 8                /* Capacidad inicial de una sala en un shard */
+#define SHARD_ROOM_BUCKETS      256                 /* Cubetas del índice de salas (potencia de 2) */
+
+/* Marcas para distinguir los descriptores internos en epoll_event.data.ptr */
+static char listener_tag;
+static char wake_tag;
+
+struct epoll_loop;
+
+/* Loop que se ejecuta en el thread actual (NULL fuera de los event loops) */
+static __thread struct epoll_loop *current_loop = NULL;
+
+/**
+ * @brief Estado de una conexión atendida por un event loop
+ *
+ * Los bytes recibidos se acumulan en el buffer de frames hasta completar
+ * cada mensaje.
+ */
+typedef struct epoll_conn {
+    int fd;                                 /* Socket del cliente */
+    struct sockaddr_in addr;                /* Dirección del cliente */
+    client_info_t *client;                  /* NULL hasta completar el handshake */
+    tls_session_t *tls;                     /* Handshake TLS pendiente o NULL */
+    frame_buffer_t rx;                      /* Bytes recibidos sin procesar */
+    int member_index;                       /* Posición en members del shard o -1 */
+    struct shard_room *room;                /* Sala en el índice del shard o NULL */
+    int room_index;                         /* Posición en los miembros de esa sala */
+    wheel_timer_t timer;                    /* Handshake o revisión de actividad */
+    struct epoll_conn *prev;                /* Lista de conexiones del loop */
+    struct epoll_conn *next;
+} epoll_conn_t;
+
+/**
+ * @brief Miembros de una sala atendidos por un shard
+ *
+ * Cada shard indexa por sala sus propios clientes registrados; solo lo
+ * toca el thread del shard, así que no lleva lock. Se crea con el primer
+ * miembro y se libera al salir el último.
+ */
+typedef struct shard_room {
+    char name[ROOM_NAME_SIZE];              /* Nombre de la sala */
+    unsigned int name_hash;                 /* Hash del nombre */
+    struct shard_room *hash_next;           /* Siguiente en la cubeta */
+    struct epoll_conn **members;            /* Conexiones del shard en la sala */
+    int member_count;
+    int member_capacity;
+} shard_room_t;
+
+/**
+ * @brief Nodo del inbox de un shard
+ *
+ * Cada broadcast reserva un nodo por shard destino dentro del mismo
+ * bloque que el sobre, de modo que publicar en N inboxes cuesta una
+ * sola asignación de memoria.
+ */
+typedef struct shard_inbox_node {
+    struct shard_inbox_node *next;          /* Siguiente nodo de la pila */
+    struct shard_frame *frame;              /* Sobre compartido */
+} shard_inbox_node_t;
+
+/**
+ * @brief Sobre de un broadcast publicado en los inboxes de otros shards
+ *
+ * Se libera cuando el último shard destino termina de encolarlo; los
+ * frames serializados siguen vivos mientras alguna cola de salida los
+ * retenga.
+ */
+typedef struct shard_frame {
+    int refcount;                           /* Shards pendientes de entregar */
+    int exclude_socket;                     /* Socket excluido del broadcast */
+    unsigned long long started_ns;          /* Inicio del broadcast (latencia de fan-out) */
+    shard_inbox_node_t *nodes;              /* Un nodo por shard destino */
+    char room[ROOM_NAME_SIZE];              /* Sala destino ("" = todos los clientes) */
+    unsigned int room_hash;                 /* Hash de room */
+    int count;                              /* Frames del lote */
+    shared_frame_t *frames[BROADCAST_BATCH_MAX]; /* Mensajes serializados una sola vez */
+} shard_frame_t;
+
+/**
+ * @brief Estado de un thread de event loop
+ */
+typedef struct epoll_loop {
+    int index;                              /* Número de loop */
+    int epoll_fd;                           /* Instancia epoll del loop */
+    pthread_t thread;                       /* Thread que ejecuta el loop */
+    server_context_t *ctx;                  /* Contexto del servidor */
+    epoll_conn_t *connections;              /* Conexiones asignadas al loop */
+    timer_wheel_t timers;                   /* Temporizadores de las conexiones */
+    
+    /* Solo en modo reactor */
+    int sharded;                            /* El loop es un shard del reactor */
+    int listen_fd;                          /* Socket SO_REUSEPORT propio */
+    int wake_fd;                            /* eventfd para señalar el inbox */
+    shard_inbox_node_t *inbox;              /* Pila MPSC lock-free de broadcasts */
+    epoll_conn_t **members;                 /* Clientes registrados del shard */
+    int member_count;
+    int member_capacity;
+    shard_room_t *rooms[SHARD_ROOM_BUCKETS]; /* Clientes del shard por sala */
+} epoll_loop_t;
+
+/**
+ * @brief Estado global del motor reactor
+ */
+typedef struct {
+    epoll_loop_t *shards;                   /* Array de shards */
+    int shard_count;                        /* Número de shards */
+} reactor_engine_t;
+
+/* Conexiones de los event loops y sobres de broadcast entre shards */
+static chat_pool_t conn_pool = POOL_INITIALIZER("conexiones_epoll",
+    sizeof(epoll_conn_t), 64, POOL_CACHE_OBJECTS / 4);
+static chat_pool_t envelope_pool = POOL_INITIALIZER("sobres_reactor",
+    sizeof(shard_frame_t) + REACTOR_MAX_SHARDS * sizeof(shard_inbox_node_t), 64, POOL_CACHE_OBJECTS);
+
+/**
+ * @brief Busca una sala en el índice del shard
+ */
+static shard_room_t *find_shard_room(epoll_loop_t *loop, const char *name, unsigned int hash)
+{
+    shard_room_t *room = loop->rooms[hash & (SHARD_ROOM_BUCKETS - 1)];
+    for (; room; room = room->hash_next) {
+        if (room->name_hash == hash && strcmp(room->name, name) == 0) {
+            return room;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Saca una conexión de su sala en el índice del shard en O(1)
+ *
+ * La sala del shard se libera al quedarse sin miembros.
+ */
+static void leave_shard_room(epoll_loop_t *loop, epoll_conn_t *conn)
+{
+    shard_room_t *room = conn->room;
+    if (!room) return;
+
+    int last = room->member_count - 1;
+    room->members[conn->room_index] = room->members[last];
+    room->members[conn->room_index]->room_index = conn->room_index;
+    room->member_count = last;
+    conn->room = NULL;
+
+    if (room->member_count == 0) {
+        shard_room_t **link = &loop->rooms[room->name_hash & (SHARD_ROOM_BUCKETS - 1)];
+        while (*link != room) {
+            link = &(*link)->hash_next;
+        }
+        *link = room->hash_next;
+        free(room->members);
+        free(room);
+    }
+}
+
+/**
+ * @brief Coloca una conexión en el índice del shard según la sala de su cliente
+ *
+ * La sala del cliente solo cambia en el thread que lo atiende, que es el
+ * de este shard, así que se lee sin clients_mutex.
+ *
+ * @return 0 en éxito, -1 si no hay memoria
+ */
+static int join_shard_room(epoll_loop_t *loop, epoll_conn_t *conn)
+{
+    const chat_room_t *target = conn->client->room;
+    if (conn->room && target && conn->room->name_hash == target->name_hash &&
+        strcmp(conn->room->name, target->name) == 0) {
+        return 0;
+    }
+
+    leave_shard_room(loop, conn);
+    if (!target) return 0;
+
+    shard_room_t *room = find_shard_room(loop, target->name, target->name_hash);
+    if (!room) {
+        room = calloc(1, sizeof(*room));
+        if (!room) {
+            return -1;
+        }
+        memcpy(room->name, target->name, ROOM_NAME_SIZE);
+        room->name_hash = target->name_hash;
+        room->hash_next = loop->rooms[room->name_hash & (SHARD_ROOM_BUCKETS - 1)];
+        loop->rooms[room->name_hash & (SHARD_ROOM_BUCKETS - 1)] = room;
+    }
+
+    if (room->member_count == room->member_capacity) {
+        int capacity = room->member_capacity ? room->member_capacity * 2 : SHARD_ROOM_MEMBERS_INITIAL;
+        epoll_conn_t **members = realloc(room->members, (size_t)capacity * sizeof(*members));
+        if (!members) {
+            if (room->member_count == 0) {
+                /* Recién creada: deshacer el alta para no dejarla vacía en el índice */
+                loop->rooms[room->name_hash & (SHARD_ROOM_BUCKETS - 1)] = room->hash_next;
+                free(room);
+            }
+            return -1;
+        }
+        room->members = members;
+        room->member_capacity = capacity;
+    }
+
+    conn->room = room;
+    conn->room_index = room->member_count;
+    room->members[room->member_count++] = conn;
+    return 0;
+}
+
+/**
+ * @brief Agrega una conexión con handshake completo a los clientes del shard
+ * @return 0 en éxito, -1 si no hay memoria
+ */
+static int add_shard_member(epoll_loop_t *loop, epoll_conn_t *conn)
+{
+    if (loop->member_count == loop->member_capacity) {
+        int capacity = loop->member_capacity ? loop->member_capacity * 2 : SHARD_MEMBERS_INITIAL;
+        epoll_conn_t **members = realloc(loop->members, (size_t)capacity * sizeof(*members));
+        if (!members) {
+            return -1;
+        }
+        loop->members = members;
+        loop->member_capacity = capacity;
+    }
+
+    if (join_shard_room(loop, conn) < 0) {
+        return -1;
+    }
+
+    conn->member_index = loop->member_count;
+    loop->members[loop->member_count++] = conn;
+    return 0;
+}
+
+/**
+ * @brief Quita una conexión de los clientes del shard en O(1)
+ */
+static void remove_shard_member(epoll_loop_t *loop, epoll_conn_t *conn)
+{
+    int index = conn->member_index;
+    if (index < 0) return;
+
+    leave_shard_room(loop, conn);
+
+    int last = loop->member_count - 1;
+    loop->members[index] = loop->members[last];
+    loop->members[index]->member_index = index;
+    loop->member_count = last;
+    conn->member_index = -1;
+}
+
+/**
+ * @brief Encola frames compartidos para los clientes locales del shard
+ *
+ * Con sala, recorre solo los miembros que el shard tiene en ella; sin
+ * sala, todos sus clientes registrados. Si una cola falla, el propio
+ * shard detectará el cierre del socket y hará la desconexión.
+ *
+ * @return Número de clientes a los que se encolaron los mensajes
+ */
+static int deliver_to_shard(epoll_loop_t *loop, const char *room_name, unsigned int room_hash,
+                            shared_frame_t **frames, int count, int exclude_socket)
+{
+    epoll_conn_t **members = loop->members;
+    int member_count = loop->member_count;
+    if (room_name) {
+        shard_room_t *room = find_shard_room(loop, room_name, room_hash);
+        members = room ? room->members : NULL;
+        member_count = room ? room->member_count : 0;
+    }
+
+    int delivered = 0;
+    for (int i = 0; i < member_count; i++) {
+        epoll_conn_t *conn = members[i];
+        if (conn->fd == exclude_socket) continue;
+
+        /* Quien entró en la sala después de numerarse estos mensajes ya
+         * los recibió con el historial */
+        int first = 0;
+        while (room_name && first < count && frames[first]->sequence != 0 &&
+               frames[first]->sequence <= conn->client->room_sequence) {
+            first++;
+        }
+        if (first == count) continue;
+
+        int pushed = count - first == 1 ?
+            outbound_queue_push(conn->client->outbound, frames[first]) :
+            outbound_queue_push_batch(conn->client->outbound, frames + first, count - first);
+        if (pushed == 0) {
+            delivered++;
+        }
+    }
+
+    return delivered;
+}
+
+/**
+ * @brief Publica un nodo en el inbox de un shard (múltiples productores)
+ *
+ * Solo se escribe en el eventfd cuando el inbox estaba vacío: el shard
+ * destino lee el eventfd antes de vaciar la pila, así que ningún nodo
+ * queda sin señalizar.
+ */
+static void push_shard_inbox(epoll_loop_t *loop, shard_inbox_node_t *node)
+{
+    shard_inbox_node_t *head = __atomic_load_n(&loop->inbox, __ATOMIC_RELAXED);
+    do {
+        node->next = head;
+    } while (!__atomic_compare_exchange_n(&loop->inbox, &head, node, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (!head) {
+        uint64_t one = 1;
+        if (write(loop->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_ERROR("Error despertando shard %d: %s", loop->index, strerror(errno));
+        }
+    }
+}
+
+/**
+ * @brief Libera la referencia de un shard sobre un frame compartido
+ */
+static void release_shard_frame(shard_frame_t *frame)
+{
+    if (__atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        /* El último shard en entregar cierra el fan-out */
+        metrics_record_since(METRIC_FANOUT_LATENCY, frame->started_ns);
+        for (int i = 0; i < frame->count; i++) {
+            shared_frame_release(frame->frames[i]);
+        }
+        pool_free(&envelope_pool, frame);
+    }
+}
+
+/**
+ * @brief Extrae todos los nodos del inbox en orden de publicación
+ */
+static shard_inbox_node_t *take_shard_inbox(epoll_loop_t *loop)
+{
+    shard_inbox_node_t *node = __atomic_exchange_n(&loop->inbox, NULL, __ATOMIC_ACQUIRE);
+    shard_inbox_node_t *ordered = NULL;
+
+    /* La pila entrega en orden inverso; se invierte para mantener FIFO */
+    while (node) {
+        shard_inbox_node_t *next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+    }
+
+    return ordered;
+}
+
+/**
+ * @brief Entrega a los clientes locales los broadcasts llegados de otros shards
+ */
+static void drain_shard_inbox(epoll_loop_t *loop)
+{
+    uint64_t pending;
+    if (read(loop->wake_fd, &pending, sizeof(pending)) < 0 && errno != EAGAIN) {
+        LOG_ERROR("Error leyendo eventfd del shard %d: %s", loop->index, strerror(errno));
+    }
+
+    shard_inbox_node_t *node = take_shard_inbox(loop);
+    while (node) {
+        /* El nodo vive dentro del frame: leer el siguiente antes de liberarlo */
+        shard_inbox_node_t *next = node->next;
+        shard_frame_t *frame = node->frame;
+
+        deliver_to_shard(loop, frame->room[0] ? frame->room : NULL, frame->room_hash,
+                         frame->frames, frame->count, frame->exclude_socket);
+        release_shard_frame(frame);
+        node = next;
+    }
+}
+
+/**
+ * @brief Fan-out del motor reactor (ver broadcast_hook)
+ *
+ * Encola directamente para los miembros del shard actual y publica los
+ * frames, ya serializados, en el inbox de los demás shards, que los
+ * entregan a sus propios miembros de la sala sin tomar clients_mutex. La
+ * entrega remota es asíncrona, así que solo se cuentan los destinatarios
+ * del shard actual.
+ */
+static int reactor_broadcast(server_context_t *ctx, const char *room_name,
+                             shared_frame_t **frames, int count, int exclude_socket)
+{
+    reactor_engine_t *engine = (reactor_engine_t*)ctx->engine_data;
+    epoll_loop_t *self = current_loop;
+    unsigned long long started = metrics_now_ns();
+    unsigned int room_hash = room_name ? hash_identifier(room_name) : 0;
+
+    int remote_shards = engine->shard_count - (self ? 1 : 0);
+    int remote_published = 0;
+
+    if (remote_shards > 0) {
+        /* Sobre y nodos de inbox en un único bloque */
+        shard_frame_t *envelope = pool_alloc(&envelope_pool);
+        if (!envelope) {
+            LOG_ERROR("Error asignando memoria para broadcast entre shards");
+        } else {
+            envelope->refcount = remote_shards;
+            envelope->exclude_socket = exclude_socket;
+            envelope->started_ns = started;
+            envelope->nodes = (shard_inbox_node_t*)(envelope + 1);
+            envelope->room[0] = '\0';
+            if (room_name) {
+                strncpy(envelope->room, room_name, ROOM_NAME_SIZE - 1);
+                envelope->room[ROOM_NAME_SIZE - 1] = '\0';
+            }
+            envelope->room_hash = room_hash;
+            envelope->count = count;
+            for (int i = 0; i < count; i++) {
+                shared_frame_retain(frames[i]);
+                envelope->frames[i] = frames[i];
+            }
+
+            for (int i = 0; i < engine->shard_count; i++) {
+                epoll_loop_t *shard = &engine->shards[i];
+                if (shard == self) continue;
+
+                envelope->nodes[i].frame = envelope;
+                push_shard_inbox(shard, &envelope->nodes[i]);
+            }
+            remote_published = 1;
+        }
+    }
+
+    int delivered = self ? deliver_to_shard(self, room_name, room_hash, frames, count,
+                                            exclude_socket) : 0;
+
+    /* Con shards remotos la latencia se registra al entregar el último */
+    if (!remote_published) {
+        metrics_record_since(METRIC_FANOUT_LATENCY, started);
+    }
+    return delivered;
+}
+
+/**
+ * @brief Actualiza el índice de salas del shard tras un cambio de sala
+ *
+ * Se llama desde el thread que atiende al cliente, que es el de su shard.
+ * Buscar la conexión recorre los clientes del shard; cambiar de sala es
+ * poco frecuente frente a los mensajes.
+ */
+static void reactor_room_changed(server_context_t *ctx, client_info_t *client)
+{
+    (void)ctx;
+    epoll_loop_t *loop = current_loop;
+    if (!loop) return;
+
+    for (int i = 0; i < loop->member_count; i++) {
+        epoll_conn_t *conn = loop->members[i];
+        if (conn->client != client) continue;
+
+        if (join_shard_room(loop, conn) < 0) {
+            /* Sin memoria: cerrar antes que dejarlo en una sala equivocada */
+            LOG_ERROR("Error indexando la sala de '%s' en el shard %d",
+                     client->username, loop->index);
+            shutdown(conn->fd, SHUT_RDWR);
+        }
+        return;
+    }
+}
+
+/**
+ * @brief Libera una conexión y la desvincula de su loop
+ *
+ * Si el cliente completó el handshake se delega en la lógica común de
+ * desconexión, que cierra el socket y notifica al resto de usuarios.
+ */
+static void close_connection(epoll_loop_t *loop, epoll_conn_t *conn)
+{
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    timer_wheel_cancel(&loop->timers, &conn->timer);
+
+    /* Dejar de recibir broadcasts antes de notificar la desconexión */
+    if (loop->sharded) {
+        remove_shard_member(loop, conn);
+    }
+
+    if (conn->client) {
+        handle_client_disconnect(loop->ctx, conn->client);
+    } else {
+        SAFE_CLOSE(conn->fd);
+    }
+    tls_session_free(conn->tls);
+
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        loop->connections = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+
+    frame_buffer_free(&conn->rx);
+    pool_free(&conn_pool, conn);
+}
+
+/**
+ * @brief Reprograma el temporizador de un cliente según su actividad
+ * @return 0 si la conexión sigue viva, -1 si debe cerrarse
+ */
+static int schedule_liveness_check(epoll_loop_t *loop, epoll_conn_t *conn)
+{
+    long long next_check;
+
+    if (check_client_liveness(loop->ctx, conn->client, timer_now_ms(), &next_check) < 0) {
+        return -1;
+    }
+
+    if (next_check > 0) {
+        timer_wheel_arm(&loop->timers, &conn->timer, next_check);
+    } else {
+        timer_wheel_cancel(&loop->timers, &conn->timer);
+    }
+    return 0;
+}
+
+/**
+ * @brief Vencimiento del temporizador de una conexión
+ *
+ * Se ejecuta en el thread del loop dueño desde timer_wheel_advance().
+ */
+static void connection_timer_expired(void *data)
+{
+    epoll_conn_t *conn = (epoll_conn_t*)data;
+    epoll_loop_t *loop = current_loop;
+
+    if (!conn->client) {
+        LOG_INFO("Conexión en socket %d sin handshake tras %lld ms, cerrando",
+                conn->fd, loop->ctx->timeout_ms);
+        close_connection(loop, conn);
+        return;
+    }
+
+    if (schedule_liveness_check(loop, conn) < 0) {
+        close_connection(loop, conn);
+    }
+}
+
+/**
+ * @brief Procesa todos los mensajes completos acumulados en una conexión
+ * @return 0 si la conexión sigue activa, -1 si debe cerrarse
+ */
+static int process_buffered_messages(epoll_loop_t *loop, epoll_conn_t *conn)
+{
+    int status;
+
+    while ((status = process_client_frames(loop->ctx, &conn->rx, conn->fd,
+                                           conn->addr, &conn->client)) == 1) {
+        /* Handshake completado: el cliente pasa a recibir broadcasts del shard */
+        if (loop->sharded && add_shard_member(loop, conn) < 0) {
+            LOG_ERROR("Error registrando cliente '%s' en el shard %d",
+                     conn->client->username, loop->index);
+            return -1;
+        }
+
+        /* El temporizador del handshake pasa a revisar la actividad */
+        if (schedule_liveness_check(loop, conn) < 0) {
+            return -1;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * @brief Lee todo lo disponible en una conexión (edge-triggered)
+ *
+ * Cada lectura llena el espacio libre del buffer de frames, de modo que
+ * un único recv puede traer muchos mensajes.
+ *
+ * @return 0 si la conexión sigue activa, -1 si debe cerrarse
+ */
+static int read_connection(epoll_loop_t *loop, epoll_conn_t *conn)
+{
+    for (;;) {
+        ssize_t received = frame_buffer_read(&conn->rx, conn->fd);
+
+        if (received > 0) {
+            metrics_add(METRIC_BYTES_IN, (unsigned long long)received);
+            CHAT_TRACE2(recv, conn->fd, received);
+            if (process_buffered_messages(loop, conn) < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        if (received == 0) {
+            if (conn->client) {
+                LOG_INFO("Cliente '%s' cerró la conexión", conn->client->username);
+            }
+            return -1;
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            /* Socket drenado: esperar al siguiente flanco */
+            return 0;
+        }
+
+        LOG_ERROR("Error recibiendo datos del cliente en socket %d: %s",
+                 conn->fd, strerror(errno));
+        return -1;
+    }
+}
+
+/**
+ * @brief Acepta todas las conexiones pendientes y las asigna al loop
+ */
+static void accept_connections(epoll_loop_t *loop)
+{
+    for (;;) {
+        int listen_fd = loop->sharded ? loop->listen_fd : loop->ctx->server_socket;
+        if (listen_fd < 0) return;
+
+        struct sockaddr_in client_addr;
+        socklen_t client_addr_len = sizeof(client_addr);
+        int client_socket = accept4(listen_fd, (struct sockaddr*)&client_addr,
+                                    &client_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (client_socket < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && loop->ctx->running) {
+                LOG_ERROR("Error en accept: %s", strerror(errno));
+                metrics_add(METRIC_ACCEPT_ERRORS, 1);
+            }
+            return;
+        }
+        if (server_admit_connection(loop->ctx, client_socket, &client_addr) < 0) {
+            continue;
+        }
+        metrics_add(METRIC_CONNECTIONS, 1);
+
+        epoll_conn_t *conn = pool_calloc(&conn_pool);
+        if (!conn || frame_buffer_init(&conn->rx, FRAME_BUFFER_SIZE) != SUCCESS) {
+            LOG_ERROR("Error asignando memoria para conexión");
+            pool_free(&conn_pool, conn);
+            SAFE_CLOSE(client_socket);
+            continue;
+        }
+
+        conn->fd = client_socket;
+        conn->addr = client_addr;
+        conn->member_index = -1;
+        timer_init(&conn->timer, connection_timer_expired, conn);
+
+        if (loop->ctx->tls) {
+            conn->tls = tls_session_start(loop->ctx->tls, client_socket, NULL);
+            if (!conn->tls) {
+                LOG_ERROR("Error iniciando el handshake TLS en socket %d", client_socket);
+                metrics_add(METRIC_TLS_FAILURES, 1);
+                SAFE_CLOSE(client_socket);
+                frame_buffer_free(&conn->rx);
+                pool_free(&conn_pool, conn);
+                continue;
+            }
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) < 0) {
+            LOG_ERROR("Error registrando cliente en epoll: %s", strerror(errno));
+            SAFE_CLOSE(client_socket);
+            tls_session_free(conn->tls);
+            frame_buffer_free(&conn->rx);
+            pool_free(&conn_pool, conn);
+            continue;
+        }
+
+        conn->next = loop->connections;
+        if (loop->connections) {
+            loop->connections->prev = conn;
+        }
+        loop->connections = conn;
+
+        /* El handshake debe completarse dentro del timeout de conexión */
+        timer_wheel_arm(&loop->timers, &conn->timer, timer_now_ms() + loop->ctx->timeout_ms);
+
+        LOG_INFO("Nueva conexión desde %s:%d (loop %d)",
+                inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), loop->index);
+    }
+}
+
+/**
+ * @brief Cuerpo de un thread de event loop
+ */
+static void *epoll_loop_thread(void *args)
+{
+    epoll_loop_t *loop = (epoll_loop_t*)args;
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+
+    current_loop = loop;
+
+    if (loop->sharded) {
+        /* Un shard por CPU: fijar el thread para conservar la caché */
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus > 0) {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(loop->index % (int)cpus, &cpu_set);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+        }
+    }
+
+    LOG_INFO("Event loop %d iniciado", loop->index);
+
+    timer_wheel_init(&loop->timers, timer_now_ms());
+
+    /* Solo los clientes heredados están ya en la lista: falta el shard y
+     * su temporizador */
+    epoll_conn_t *adopted = loop->connections;
+    while (adopted) {
+        epoll_conn_t *next = adopted->next;
+        if ((loop->sharded && add_shard_member(loop, adopted) < 0) ||
+            schedule_liveness_check(loop, adopted) < 0) {
+            close_connection(loop, adopted);
+        }
+        adopted = next;
+    }
+
+    while (loop->ctx->running) {
+        int timeout = timer_wheel_timeout_ms(&loop->timers, timer_now_ms(), EPOLL_WAIT_TIMEOUT_MS);
+        int ready = epoll_wait(loop->epoll_fd, events, EPOLL_MAX_EVENTS, timeout);
+
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Error en epoll_wait: %s", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < ready && loop->ctx->running; i++) {
+            void *tag = events[i].data.ptr;
+
+            if (tag == &listener_tag) {
+                accept_connections(loop);
+                continue;
+            }
+            if (tag == &wake_tag) {
+                drain_shard_inbox(loop);
+                continue;
+            }
+
+            epoll_conn_t *conn = (epoll_conn_t*)tag;
+
+            int close_needed = 0;
+            int tls_ready = 0;
+            if (conn->tls) {
+                /* Tras el último paso puede haber frames ya recibidos sin
+                 * flanco nuevo: se leen en esta misma pasada */
+                tls_step_t step = server_tls_step(&conn->tls, conn->fd);
+                if (step == TLS_STEP_WANT_READ || step == TLS_STEP_WANT_WRITE) {
+                    continue;
+                }
+                close_needed = step == TLS_STEP_FAILED;
+                tls_ready = 1;
+            }
+            if (!close_needed && (events[i].events & EPOLLOUT) && conn->client) {
+                /* Socket escribible de nuevo: continuar con la cola de salida */
+                close_needed = outbound_queue_flush(conn->client->outbound) < 0;
+            }
+            if (!close_needed &&
+                (tls_ready || (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))) {
+                close_needed = read_connection(loop, conn) < 0;
+            }
+
+            if (close_needed) {
+                close_connection(loop, conn);
+            }
+        }
+
+        /* Después de los eventos: ningún evento de este lote apunta ya a
+         * una conexión que cierre un temporizador */
+        timer_wheel_advance(&loop->timers, timer_now_ms());
+    }
+
+    current_loop = NULL;
+    LOG_INFO("Event loop %d finalizado", loop->index);
+    return NULL;
+}
+
+/**
+ * @brief Registra un descriptor interno (escucha o eventfd) en un loop
+ * @return 0 en éxito, -1 en error
+ */
+static int register_loop_fd(epoll_loop_t *loop, int fd, uint32_t events, void *tag)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = tag;
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/**
+ * @brief Ejecuta los loops hasta el cierre del servidor
+ *
+ * El thread que llama ejecuta el loop 0 y el resto se lanzan como
+ * threads adicionales; todos terminan cuando ctx->running pasa a 0.
+ */
+static void run_event_loops(server_context_t *ctx, epoll_loop_t *loops, int loop_count)
+{
+    int started = 1;
+    for (; started < loop_count; started++) {
+        if (pthread_create(&loops[started].thread, NULL, epoll_loop_thread, &loops[started]) != 0) {
+            LOG_ERROR("Error creando thread de event loop: %s", strerror(errno));
+            break;
+        }
+    }
+
+    epoll_loop_thread(&loops[0]);
+
+    /* Si el loop 0 terminó por error, detener también al resto */
+    ctx->running = 0;
+    for (int i = 1; i < started; i++) {
+        pthread_join(loops[i].thread, NULL);
+    }
+}
+
+/**
+ * @brief Reparte entre los loops los clientes heredados de la versión anterior
+ *
+ * Se llama antes de arrancar los loops, así que ningún otro thread toca
+ * la tabla; se recorre de atrás adelante porque remove_client() mueve el
+ * último cliente al hueco que deja.
+ */
+static void adopt_connections(server_context_t *ctx, epoll_loop_t *loops, int loop_count)
+{
+    for (int i = ctx->clients->count - 1; i >= 0; i--) {
+        client_info_t *client = ctx->clients->active[i];
+        epoll_loop_t *loop = &loops[i % loop_count];
+
+        epoll_conn_t *conn = pool_calloc(&conn_pool);
+        if (!conn || frame_buffer_init(&conn->rx, FRAME_BUFFER_SIZE) != SUCCESS) {
+            LOG_ERROR("Error asignando memoria para el cliente heredado '%s'", client->username);
+            pool_free(&conn_pool, conn);
+            remove_client(ctx, client->socket_fd);
+            continue;
+        }
+
+        conn->fd = client->socket_fd;
+        conn->addr = client->address;
+        conn->client = client;
+        conn->member_index = -1;
+        timer_init(&conn->timer, connection_timer_expired, conn);
+
+        /* La versión anterior pudo usar sockets bloqueantes (motor threads) */
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (set_nonblocking(conn->fd) < 0 ||
+            server_restore_client_input(client, &conn->rx) < 0 ||
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) < 0) {
+            LOG_ERROR("Error adoptando al cliente heredado '%s': %s",
+                     client->username, strerror(errno));
+            frame_buffer_free(&conn->rx);
+            pool_free(&conn_pool, conn);
+            remove_client(ctx, client->socket_fd);
+            continue;
+        }
+
+        conn->next = loop->connections;
+        if (loop->connections) {
+            loop->connections->prev = conn;
+        }
+        loop->connections = conn;
+    }
+}
+
+/**
+ * @brief Libera el estado de los loops tras su finalización
+ *
+ * Los clientes registrados se cierran en cleanup_server_context(); aquí
+ * solo se cierran las conexiones que no completaron el handshake. Si el
+ * servidor se cede, cada cliente guarda lo que quedó sin procesar.
+ */
+static void release_event_loops(epoll_loop_t *loops, int loop_count)
+{
+    for (int i = 0; i < loop_count; i++) {
+        epoll_loop_t *loop = &loops[i];
+
+        epoll_conn_t *conn = loop->connections;
+        while (conn) {
+            epoll_conn_t *next = conn->next;
+            if (!conn->client) {
+                SAFE_CLOSE(conn->fd);
+            } else if (loop->ctx->handing_off) {
+                server_stash_client_input(conn->client, &conn->rx);
+            }
+            tls_session_free(conn->tls);
+            frame_buffer_free(&conn->rx);
+            pool_free(&conn_pool, conn);
+            conn = next;
+        }
+
+        if (loop->sharded) {
+            /* Descartar broadcasts que no llegaron a entregarse */
+            shard_inbox_node_t *node = take_shard_inbox(loop);
+            while (node) {
+                shard_inbox_node_t *next = node->next;
+                release_shard_frame(node->frame);
+                node = next;
+            }
+            for (int b = 0; b < SHARD_ROOM_BUCKETS; b++) {
+                shard_room_t *room = loop->rooms[b];
+                while (room) {
+                    shard_room_t *next = room->hash_next;
+                    free(room->members);
+                    free(room);
+                    room = next;
+                }
+            }
+            free(loop->members);
+            SAFE_CLOSE(loop->listen_fd);
+            SAFE_CLOSE(loop->wake_fd);
+        }
+
+        SAFE_CLOSE(loop->epoll_fd);
+    }
+}
+
+/**
+ * @brief Motor epoll: pocos event loops edge-triggered con sockets no bloqueantes
+ */
+int run_epoll_engine(server_context_t *ctx, const server_config_t *config)
+{
+    int loop_count = resolve_event_loop_count(config->event_loops, EPOLL_MAX_LOOPS);
+
+    /* Crear socket del servidor */
+    ctx->server_socket = create_server_socket(config->port, 0);
+    server_close_inherited_listeners();
+    if (ctx->server_socket < 0) {
+        return ctx->server_socket;
+    }
+
+    if (set_nonblocking(ctx->server_socket) < 0) {
+        LOG_ERROR("Error configurando socket del servidor no bloqueante: %s", strerror(errno));
+        return ERROR_SOCKET;
+    }
+
+    epoll_loop_t *loops = calloc((size_t)loop_count, sizeof(epoll_loop_t));
+    if (!loops) {
+        LOG_ERROR("Error asignando memoria para event loops");
+        return ERROR_MEMORY;
+    }
+
+    int result = SUCCESS;
+    int created = 0;
+
+    /* Crear una instancia epoll por loop con el socket de escucha compartido */
+    for (; created < loop_count; created++) {
+        epoll_loop_t *loop = &loops[created];
+        loop->index = created;
+        loop->ctx = ctx;
+        loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->epoll_fd < 0) {
+            LOG_ERROR("Error creando instancia epoll: %s", strerror(errno));
+            result = ERROR_SOCKET;
+            break;
+        }
+
+        if (register_loop_fd(loop, ctx->server_socket, EPOLLIN | EPOLLEXCLUSIVE, &listener_tag) < 0) {
+            LOG_ERROR("Error registrando socket de escucha en epoll: %s", strerror(errno));
+            SAFE_CLOSE(loop->epoll_fd);
+            result = ERROR_SOCKET;
+            break;
+        }
+    }
+
+    if (result == SUCCESS) {
+        adopt_connections(ctx, loops, loop_count);
+        LOG_INFO("Servidor iniciado correctamente con %d event loops. Esperando conexiones...",
+                loop_count);
+        print_server_stats(ctx);
+        run_event_loops(ctx, loops, loop_count);
+    }
+
+    release_event_loops(loops, created);
+    free(loops);
+
+    return result;
+}
+
+/**
+ * @brief Inicializa un shard del reactor con su socket de escucha y su eventfd
+ * @return 0 en éxito, código de error negativo en fallo
+ */
+static int init_reactor_shard(epoll_loop_t *loop, server_context_t *ctx, int index, int port)
+{
+    loop->index = index;
+    loop->ctx = ctx;
+    loop->sharded = 1;
+    loop->listen_fd = -1;
+    loop->wake_fd = -1;
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        LOG_ERROR("Error creando instancia epoll: %s", strerror(errno));
+        return ERROR_SOCKET;
+    }
+
+    loop->listen_fd = create_server_socket(port, 1);
+    if (loop->listen_fd < 0) {
+        return loop->listen_fd;
+    }
+
+    if (set_nonblocking(loop->listen_fd) < 0 ||
+        register_loop_fd(loop, loop->listen_fd, EPOLLIN, &listener_tag) < 0) {
+        LOG_ERROR("Error registrando socket de escucha del shard %d: %s", index, strerror(errno));
+        return ERROR_SOCKET;
+    }
+
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->wake_fd < 0 || register_loop_fd(loop, loop->wake_fd, EPOLLIN, &wake_tag) < 0) {
+        LOG_ERROR("Error creando eventfd del shard %d: %s", index, strerror(errno));
+        return ERROR_SOCKET;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Motor reactor: un event loop por CPU con SO_REUSEPORT
+ */
+int run_reactor_engine(server_context_t *ctx, const server_config_t *config)
+{
+    int shard_count = resolve_event_loop_count(config->event_loops, REACTOR_MAX_SHARDS);
+
+    epoll_loop_t *shards = calloc((size_t)shard_count, sizeof(epoll_loop_t));
+    if (!shards) {
+        LOG_ERROR("Error asignando memoria para los shards del reactor");
+        return ERROR_MEMORY;
+    }
+
+    int result = SUCCESS;
+    int created = 0;
+
+    for (; created < shard_count; created++) {
+        result = init_reactor_shard(&shards[created], ctx, created, config->port);
+        if (result != SUCCESS) {
+            created++;  /* Liberar también el shard parcialmente creado */
+            break;
+        }
+    }
+    server_close_inherited_listeners();
+
+    if (result == SUCCESS) {
+        adopt_connections(ctx, shards, shard_count);
+
+        reactor_engine_t engine;
+        engine.shards = shards;
+        engine.shard_count = shard_count;
+
+        ctx->engine_data = &engine;
+        ctx->broadcast_hook = reactor_broadcast;
+        ctx->room_hook = reactor_room_changed;
+
+        LOG_INFO("Servidor iniciado correctamente con %d shards SO_REUSEPORT. Esperando conexiones...",
+                shard_count);
+        print_server_stats(ctx);
+        run_event_loops(ctx, shards, shard_count);
+
+        ctx->broadcast_hook = NULL;
+        ctx->room_hook = NULL;
+        ctx->engine_data = NULL;
+    }
+
+    release_event_loops(shards, created);
+    free(shards);
+
+    return result;
+}
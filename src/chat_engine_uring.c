@@ -0,0 +1,1151 @@
+/**
+ * @file chat_engine_uring.c
+ * @brief Motor de E/S basado en io_uring
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Igual que el motor epoll, unos pocos event loops comparten el socket de
+ * escucha y cada conexión queda asignada al loop que la aceptó. Cada loop
+ * tiene su propio anillo io_uring y habla con el kernel a través de las
+ * colas compartidas, sin liburing:
+ *
+ * - Aceptación: un único IORING_OP_ACCEPT multishot por loop.
+ * - Recepción: un IORING_OP_RECV multishot por conexión que elige sus
+ *   buffers de un anillo de buffers provistos del loop; los bytes se copian
+ *   al buffer de frames de la conexión y el buffer vuelve al anillo.
+ * - Envío: las colas de salida trabajan en modo asíncrono. Un broadcast
+ *   solo encola y avisa; el loop dueño prepara un IORING_OP_SENDMSG con
+ *   la cabeza de cada cola avisada y los envía todos juntos en la misma
+ *   llamada a io_uring_enter() que espera las siguientes completions, o
+ *   justo después del bloque recibido que los generó.
+ *
+ * Los avisos de colas de otros loops llegan por un inbox MPSC lock-free y
+ * un eventfd que el loop dueño mantiene leído con IORING_OP_READ. Así, un
+ * mensaje repartido a N clientes cuesta una sola syscall por loop en lugar
+ * de N sendmsg().
+ *
+ * Con TLS, el handshake de cada conexión nueva avanza con IORING_OP_POLL_ADD
+ * de un solo disparo y el recv multishot se arma cuando kTLS ya está
+ * instalado: desde ahí los buffers provistos reciben texto claro.
+ *
+ * Una conexión cerrada no se libera hasta que el kernel entrega las
+ * completions de todas sus operaciones en curso; shutdown() las hace
+ * terminar de inmediato.
+ */
+
+#include "../include/chat_engine.h"
+#include "../include/chat_metrics.h"
+#include "../include/chat_timer.h"
+#include "../include/chat_trace.h"
+
+#include <sys/syscall.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <stdint.h>
+
+/* Operación de cada completion en los bits bajos de user_data (loops y
+ * conexiones están alineados al menos a 8 bytes) */
+#define URING_OP_ACCEPT     0
+#define URING_OP_WAKE       1
+#define URING_OP_RECV       2
+#define URING_OP_SEND       3
+#define URING_OP_POLL       4
+#define URING_OP_MASK       7ULL
+
+#define URING_BUFFER_GROUP  0                   /* Grupo del anillo de buffers */
+
+struct uring_loop;
+
+/* Loop que se ejecuta en el thread actual (NULL fuera de los event loops) */
+static __thread struct uring_loop *current_uring_loop = NULL;
+
+/**
+ * @brief Colas compartidas con el kernel de un anillo io_uring
+ */
+typedef struct {
+    int fd;                                 /* Descriptor del anillo */
+    int disabled;                           /* Creado con IORING_SETUP_R_DISABLED */
+    void *ring_map;                         /* Colas SQ y CQ (una sola proyección) */
+    size_t ring_map_size;
+    struct io_uring_sqe *sqes;              /* Entradas de envío */
+    size_t sqes_map_size;
+
+    unsigned *sq_head;                      /* Lo escribe el kernel */
+    unsigned *sq_tail;                      /* Lo publica el loop */
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sqe_tail;                      /* Entradas preparadas (aún sin publicar) */
+
+    unsigned *cq_head;                      /* Lo avanza el loop */
+    unsigned *cq_tail;                      /* Lo escribe el kernel */
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+} uring_ring_t;
+
+/**
+ * @brief Estado de una conexión atendida por un loop io_uring
+ */
+typedef struct uring_conn {
+    int fd;                                 /* Socket del cliente */
+    struct sockaddr_in addr;                /* Dirección del cliente */
+    client_info_t *client;                  /* NULL hasta completar el handshake */
+    tls_session_t *tls;                     /* Handshake TLS pendiente o NULL */
+    outbound_queue_t *outbound;             /* Referencia propia a la cola de salida */
+    frame_buffer_t rx;                      /* Bytes recibidos sin procesar */
+    wheel_timer_t timer;                    /* Handshake o revisión de actividad */
+    struct uring_loop *loop;                /* Loop dueño */
+
+    int pending_ops;                        /* Operaciones en el kernel */
+    int recv_armed;                         /* Hay un recv multishot activo */
+    int closing;                            /* Cerrada, esperando sus completions */
+
+    /* Envío asíncrono */
+    int send_listed;                        /* En la lista de envíos o en el inbox (atómico) */
+    struct uring_conn *send_next;           /* Siguiente en esa lista */
+    struct msghdr send_msg;
+    struct iovec send_iov[OUTBOUND_IOV_MAX];
+    shared_frame_t *send_frames[OUTBOUND_IOV_MAX];
+    int send_count;                         /* Frames del envío en curso */
+
+    struct uring_conn *prev;                /* Lista de conexiones del loop */
+    struct uring_conn *next;
+} uring_conn_t;
+
+/**
+ * @brief Estado de un thread de event loop io_uring
+ */
+typedef struct uring_loop {
+    int index;                              /* Número de loop */
+    pthread_t thread;                       /* Thread que ejecuta el loop */
+    server_context_t *ctx;                  /* Contexto del servidor */
+    uring_ring_t ring;                      /* Anillo del loop */
+    uring_conn_t *connections;              /* Conexiones asignadas al loop */
+    timer_wheel_t timers;                   /* Temporizadores de las conexiones */
+    int accept_armed;                       /* Hay un accept multishot activo */
+
+    /* Buffers provistos para recv */
+    struct io_uring_buf_ring *buf_ring;     /* Anillo compartido con el kernel */
+    size_t buf_ring_size;
+    char *buffers;                          /* URING_BUFFER_COUNT buffers contiguos */
+    unsigned short buf_tail;                /* Próxima posición libre del anillo */
+
+    /* Envíos pendientes de preparar */
+    uring_conn_t *send_list;                /* Colas avisadas desde este loop */
+    uring_conn_t *inbox;                    /* Pila MPSC de colas avisadas desde otros */
+    int wake_fd;                            /* eventfd para señalar el inbox */
+    uint64_t wake_value;                    /* Destino del IORING_OP_READ del eventfd */
+} uring_loop_t;
+
+static chat_pool_t conn_pool = POOL_INITIALIZER("conexiones_uring",
+    sizeof(uring_conn_t), 64, POOL_CACHE_OBJECTS / 4);
+
+static void close_connection(uring_loop_t *loop, uring_conn_t *conn);
+
+/* ========== ANILLO ========== */
+
+/**
+ * @brief Crea un anillo io_uring y proyecta sus colas
+ *
+ * Se pide un único thread emisor con el trabajo diferido hasta la espera;
+ * el anillo nace deshabilitado para que lo habilite el thread del loop.
+ * En kernels que no aceptan esas opciones se crea un anillo básico.
+ *
+ * @return 0 en éxito, -1 en error (errno)
+ */
+static int setup_ring(uring_ring_t *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+                   IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN |
+                   IORING_SETUP_R_DISABLED;
+    params.cq_entries = entries * 2;
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 2;
+        fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        close(fd);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    ring->fd = fd;
+    ring->disabled = (params.flags & IORING_SETUP_R_DISABLED) != 0;
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_map_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->ring_map = mmap(NULL, ring->ring_map_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->ring_map == MAP_FAILED) {
+        ring->ring_map = NULL;
+        return -1;
+    }
+
+    ring->sqes_map_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return -1;
+    }
+
+    char *base = (char*)ring->ring_map;
+    ring->sq_head = (unsigned*)(base + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(base + params.sq_off.tail);
+    ring->sq_array = (unsigned*)(base + params.sq_off.array);
+    ring->sq_mask = *(unsigned*)(base + params.sq_off.ring_mask);
+    ring->sq_entries = *(unsigned*)(base + params.sq_off.ring_entries);
+    ring->sqe_tail = *ring->sq_tail;
+
+    ring->cq_head = (unsigned*)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned*)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+
+    return 0;
+}
+
+/**
+ * @brief Libera un anillo y sus proyecciones
+ */
+static void destroy_ring(uring_ring_t *ring)
+{
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_map_size);
+    if (ring->ring_map) munmap(ring->ring_map, ring->ring_map_size);
+    ring->sqes = NULL;
+    ring->ring_map = NULL;
+    SAFE_CLOSE(ring->fd);
+}
+
+/**
+ * @brief Publica las entradas preparadas, las envía y espera completions
+ * @param min_complete Completions a esperar (0 = solo enviar)
+ * @param timeout_ms Espera máxima si min_complete > 0
+ * @return 0 en éxito, -1 en error (errno; ETIME e EINTR no son errores)
+ */
+static int enter_ring(uring_ring_t *ring, unsigned min_complete, int timeout_ms)
+{
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+
+    /* Solo la espera ejecuta el trabajo diferido del anillo: un envío
+     * intermedio no adelanta completions de recv a las de los envíos */
+    unsigned flags = 0;
+    if (min_complete > 0) {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+
+    long result = syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, flags,
+                          min_complete > 0 ? (void*)&arg : NULL,
+                          min_complete > 0 ? sizeof(arg) : 0);
+    if (result < 0 && errno != ETIME && errno != EINTR) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Obtiene una entrada de envío libre inicializada a cero
+ *
+ * Si la cola está llena se envía lo preparado antes de reutilizarla.
+ *
+ * @return Entrada o NULL si el kernel no acepta más
+ */
+static struct io_uring_sqe *get_sqe(uring_ring_t *ring)
+{
+    if (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        if (enter_ring(ring, 0, 0) < 0 ||
+            ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    unsigned index = ring->sqe_tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sqe_tail++;
+    return sqe;
+}
+
+/**
+ * @brief Codifica puntero y operación en el user_data de una entrada
+ */
+static uint64_t make_user_data(void *ptr, int op)
+{
+    return (uint64_t)(uintptr_t)ptr | (uint64_t)op;
+}
+
+/* ========== BUFFERS PROVISTOS ========== */
+
+/**
+ * @brief Devuelve un buffer al anillo de buffers provistos
+ */
+static void recycle_buffer(uring_loop_t *loop, unsigned short bid)
+{
+    struct io_uring_buf *buf = &loop->buf_ring->bufs[loop->buf_tail & (URING_BUFFER_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(loop->buffers + (size_t)bid * URING_BUFFER_SIZE);
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = bid;
+    loop->buf_tail++;
+    __atomic_store_n(&loop->buf_ring->tail, loop->buf_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Registra el anillo de buffers provistos del loop
+ * @return 0 en éxito, -1 en error (errno)
+ */
+static int setup_buffers(uring_loop_t *loop)
+{
+    loop->buf_ring_size = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+    void *ring = mmap(NULL, loop->buf_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return -1;
+    }
+    loop->buf_ring = (struct io_uring_buf_ring*)ring;
+
+    loop->buffers = mmap(NULL, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE,
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (loop->buffers == MAP_FAILED) {
+        loop->buffers = NULL;
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)loop->buf_ring;
+    reg.ring_entries = URING_BUFFER_COUNT;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, loop->ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return -1;
+    }
+
+    for (unsigned short bid = 0; bid < URING_BUFFER_COUNT; bid++) {
+        recycle_buffer(loop, bid);
+    }
+    return 0;
+}
+
+/* ========== OPERACIONES ========== */
+
+/**
+ * @brief Arma el accept multishot sobre el socket de escucha compartido
+ */
+static void arm_accept(uring_loop_t *loop)
+{
+    struct io_uring_sqe *sqe = get_sqe(&loop->ring);
+    if (!sqe) {
+        LOG_ERROR("Cola de envío llena: no se pudo armar accept en el loop %d", loop->index);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->ctx->server_socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = make_user_data(loop, URING_OP_ACCEPT);
+    loop->accept_armed = 1;
+}
+
+/**
+ * @brief Arma la lectura del eventfd del inbox
+ */
+static void arm_wake(uring_loop_t *loop)
+{
+    struct io_uring_sqe *sqe = get_sqe(&loop->ring);
+    if (!sqe) {
+        LOG_ERROR("Cola de envío llena: no se pudo armar el eventfd del loop %d", loop->index);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = loop->wake_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&loop->wake_value;
+    sqe->len = sizeof(loop->wake_value);
+    sqe->user_data = make_user_data(loop, URING_OP_WAKE);
+}
+
+/**
+ * @brief Arma el recv multishot de una conexión
+ * @return 0 en éxito, -1 si la cola de envío está llena
+ */
+static int arm_recv(uring_loop_t *loop, uring_conn_t *conn)
+{
+    struct io_uring_sqe *sqe = get_sqe(&loop->ring);
+    if (!sqe) {
+        LOG_ERROR("Cola de envío llena: no se pudo armar recv en socket %d", conn->fd);
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = make_user_data(conn, URING_OP_RECV);
+
+    conn->recv_armed = 1;
+    conn->pending_ops++;
+    return 0;
+}
+
+/**
+ * @brief Espera a que el socket de una conexión esté listo para el handshake TLS
+ * @return 0 en éxito, -1 si la cola de envío está llena
+ */
+static int arm_poll(uring_loop_t *loop, uring_conn_t *conn, unsigned events)
+{
+    struct io_uring_sqe *sqe = get_sqe(&loop->ring);
+    if (!sqe) {
+        LOG_ERROR("Cola de envío llena: no se pudo armar poll en socket %d", conn->fd);
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = conn->fd;
+    sqe->poll32_events = events;
+    sqe->user_data = make_user_data(conn, URING_OP_POLL);
+
+    conn->pending_ops++;
+    return 0;
+}
+
+/**
+ * @brief Avanza el handshake TLS y arma la siguiente espera
+ *
+ * Al terminar el handshake se arma el recv multishot: lo que el cliente
+ * envíe desde ese momento ya llega descifrado por kTLS.
+ *
+ * @return 0 si la conexión sigue activa, -1 si debe cerrarse
+ */
+static int advance_tls_handshake(uring_loop_t *loop, uring_conn_t *conn)
+{
+    switch (server_tls_step(&conn->tls, conn->fd)) {
+        case TLS_STEP_DONE:
+            return arm_recv(loop, conn);
+        case TLS_STEP_WANT_READ:
+            return arm_poll(loop, conn, POLLIN);
+        case TLS_STEP_WANT_WRITE:
+            return arm_poll(loop, conn, POLLOUT);
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief Añade una conexión a la lista de envíos del loop
+ */
+static void list_send(uring_loop_t *loop, uring_conn_t *conn)
+{
+    __atomic_store_n(&conn->send_listed, 1, __ATOMIC_RELAXED);
+    conn->send_next = loop->send_list;
+    loop->send_list = conn;
+}
+
+/**
+ * @brief Aviso de una cola de salida que pasa a tener datos pendientes
+ *
+ * Se ejecuta con el lock de la cola tomado y en cualquier thread. Desde
+ * el propio loop basta con apuntar la conexión; desde otro se publica en
+ * el inbox y solo se escribe en el eventfd si estaba vacío.
+ */
+static void uring_submit_hook(void *arg)
+{
+    uring_conn_t *conn = (uring_conn_t*)arg;
+    uring_loop_t *loop = conn->loop;
+
+    if (loop == current_uring_loop) {
+        list_send(loop, conn);
+        return;
+    }
+
+    __atomic_store_n(&conn->send_listed, 1, __ATOMIC_RELAXED);
+    uring_conn_t *head = __atomic_load_n(&loop->inbox, __ATOMIC_RELAXED);
+    do {
+        conn->send_next = head;
+    } while (!__atomic_compare_exchange_n(&loop->inbox, &head, conn, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (!head) {
+        uint64_t one = 1;
+        if (write(loop->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_ERROR("Error despertando loop %d: %s", loop->index, strerror(errno));
+        }
+    }
+}
+
+/**
+ * @brief Libera una conexión cerrada cuando ya no queda nada en el kernel
+ */
+static void release_connection_if_idle(uring_loop_t *loop, uring_conn_t *conn)
+{
+    if (!conn->closing || conn->pending_ops > 0 ||
+        __atomic_load_n(&conn->send_listed, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        loop->connections = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+
+    outbound_queue_release(conn->outbound);
+    tls_session_free(conn->tls);
+    frame_buffer_free(&conn->rx);
+    pool_free(&conn_pool, conn);
+}
+
+/**
+ * @brief Prepara el envío de la cabeza de la cola de una conexión
+ */
+static void submit_send(uring_loop_t *loop, uring_conn_t *conn)
+{
+    int count = outbound_queue_prepare_send(conn->outbound, conn->send_iov,
+                                            conn->send_frames, OUTBOUND_IOV_MAX);
+    if (count <= 0) {
+        /* Cola vacía, o cerrada: el recv verá el shutdown y cerrará */
+        return;
+    }
+
+    struct io_uring_sqe *sqe = get_sqe(&loop->ring);
+    if (!sqe) {
+        LOG_ERROR("Cola de envío llena: descartando la conexión del socket %d", conn->fd);
+        for (int i = 0; i < count; i++) {
+            shared_frame_release(conn->send_frames[i]);
+        }
+        outbound_queue_complete_send(conn->outbound, -EIO);
+        return;
+    }
+
+    memset(&conn->send_msg, 0, sizeof(conn->send_msg));
+    conn->send_msg.msg_iov = conn->send_iov;
+    conn->send_msg.msg_iovlen = (size_t)count;
+    conn->send_count = count;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&conn->send_msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = make_user_data(conn, URING_OP_SEND);
+    conn->pending_ops++;
+}
+
+/**
+ * @brief Prepara los envíos de todas las colas avisadas desde la última vuelta
+ */
+static void flush_sends(uring_loop_t *loop)
+{
+    uring_conn_t *conn;
+
+    while ((conn = loop->send_list) != NULL) {
+        loop->send_list = conn->send_next;
+        __atomic_store_n(&conn->send_listed, 0, __ATOMIC_RELAXED);
+
+        if (conn->closing) {
+            release_connection_if_idle(loop, conn);
+            continue;
+        }
+        submit_send(loop, conn);
+    }
+}
+
+/**
+ * @brief Pasa a la lista de envíos las colas avisadas desde otros loops
+ */
+static void drain_inbox(uring_loop_t *loop)
+{
+    uring_conn_t *conn = __atomic_exchange_n(&loop->inbox, NULL, __ATOMIC_ACQUIRE);
+    while (conn) {
+        uring_conn_t *next = conn->send_next;
+        conn->send_next = loop->send_list;
+        loop->send_list = conn;
+        conn = next;
+    }
+}
+
+/* ========== CONEXIONES ========== */
+
+/**
+ * @brief Reprograma el temporizador de un cliente según su actividad
+ * @return 0 si la conexión sigue viva, -1 si debe cerrarse
+ */
+static int schedule_liveness_check(uring_loop_t *loop, uring_conn_t *conn)
+{
+    long long next_check;
+
+    if (check_client_liveness(loop->ctx, conn->client, timer_now_ms(), &next_check) < 0) {
+        return -1;
+    }
+
+    if (next_check > 0) {
+        timer_wheel_arm(&loop->timers, &conn->timer, next_check);
+    } else {
+        timer_wheel_cancel(&loop->timers, &conn->timer);
+    }
+    return 0;
+}
+
+/**
+ * @brief Vencimiento del temporizador de una conexión
+ */
+static void connection_timer_expired(void *data)
+{
+    uring_conn_t *conn = (uring_conn_t*)data;
+    uring_loop_t *loop = current_uring_loop;
+
+    if (!conn->client) {
+        LOG_INFO("Conexión en socket %d sin handshake tras %lld ms, cerrando",
+                conn->fd, loop->ctx->timeout_ms);
+        close_connection(loop, conn);
+        return;
+    }
+
+    if (schedule_liveness_check(loop, conn) < 0) {
+        close_connection(loop, conn);
+    }
+}
+
+/**
+ * @brief Cierra una conexión; la memoria se libera con su última completion
+ *
+ * shutdown() termina el recv multishot y cualquier envío en curso antes
+ * de que la lógica común cierre el socket.
+ */
+static void close_connection(uring_loop_t *loop, uring_conn_t *conn)
+{
+    if (conn->closing) return;
+
+    conn->closing = 1;
+    timer_wheel_cancel(&loop->timers, &conn->timer);
+    shutdown(conn->fd, SHUT_RDWR);
+
+    if (conn->client) {
+        handle_client_disconnect(loop->ctx, conn->client);
+        conn->client = NULL;
+    } else {
+        SAFE_CLOSE(conn->fd);
+    }
+
+    release_connection_if_idle(loop, conn);
+}
+
+/**
+ * @brief Procesa todos los mensajes completos acumulados en una conexión
+ * @return 0 si la conexión sigue activa, -1 si debe cerrarse
+ */
+static int process_buffered_messages(uring_loop_t *loop, uring_conn_t *conn)
+{
+    int status;
+
+    while ((status = process_client_frames(loop->ctx, &conn->rx, conn->fd,
+                                           conn->addr, &conn->client)) == 1) {
+        /* Handshake completado: la cola de salida pasa a modo asíncrono */
+        conn->outbound = conn->client->outbound;
+        outbound_queue_retain(conn->outbound);
+        outbound_queue_set_submit(conn->outbound, uring_submit_hook, conn);
+
+        if (schedule_liveness_check(loop, conn) < 0) {
+            return -1;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * @brief Registra en el loop una conexión recién aceptada
+ */
+static void open_connection(uring_loop_t *loop, int client_socket)
+{
+    /* El accept multishot no devuelve direcciones por conexión */
+    struct sockaddr_in client_addr;
+    socklen_t addr_len = sizeof(client_addr);
+    if (getpeername(client_socket, (struct sockaddr*)&client_addr, &addr_len) < 0) {
+        memset(&client_addr, 0, sizeof(client_addr));
+    }
+
+    if (server_admit_connection(loop->ctx, client_socket, &client_addr) < 0) {
+        return;
+    }
+    metrics_add(METRIC_CONNECTIONS, 1);
+
+    uring_conn_t *conn = pool_calloc(&conn_pool);
+    if (!conn || frame_buffer_init(&conn->rx, FRAME_BUFFER_SIZE) != SUCCESS) {
+        LOG_ERROR("Error asignando memoria para conexión");
+        pool_free(&conn_pool, conn);
+        SAFE_CLOSE(client_socket);
+        return;
+    }
+
+    conn->addr = client_addr;
+    conn->fd = client_socket;
+    conn->loop = loop;
+    timer_init(&conn->timer, connection_timer_expired, conn);
+
+    conn->next = loop->connections;
+    if (loop->connections) {
+        loop->connections->prev = conn;
+    }
+    loop->connections = conn;
+
+    /* Con TLS el recv se arma al terminar el handshake */
+    if (loop->ctx->tls) {
+        conn->tls = tls_session_start(loop->ctx->tls, client_socket, NULL);
+    }
+    if ((loop->ctx->tls ? advance_tls_handshake(loop, conn) : arm_recv(loop, conn)) < 0) {
+        close_connection(loop, conn);
+        return;
+    }
+
+    /* El handshake debe completarse dentro del timeout de conexión */
+    timer_wheel_arm(&loop->timers, &conn->timer, timer_now_ms() + loop->ctx->timeout_ms);
+
+    LOG_INFO("Nueva conexión desde %s:%d (loop %d)",
+            inet_ntoa(conn->addr.sin_addr), ntohs(conn->addr.sin_port), loop->index);
+}
+
+/* ========== COMPLETIONS ========== */
+
+/**
+ * @brief Completion del accept multishot
+ */
+static void handle_accept(uring_loop_t *loop, int result, unsigned flags)
+{
+    if (!(flags & IORING_CQE_F_MORE)) {
+        loop->accept_armed = 0;
+    }
+
+    if (result >= 0) {
+        open_connection(loop, result);
+    } else if (result != -EINTR && result != -EAGAIN && result != -ECANCELED &&
+               loop->ctx->running) {
+        LOG_ERROR("Error en accept: %s", strerror(-result));
+        metrics_add(METRIC_ACCEPT_ERRORS, 1);
+    }
+
+    if (!loop->accept_armed && loop->ctx->running) {
+        arm_accept(loop);
+    }
+}
+
+/**
+ * @brief Completion del recv multishot de una conexión
+ */
+static void handle_recv(uring_loop_t *loop, uring_conn_t *conn, int result, unsigned flags)
+{
+    if (!(flags & IORING_CQE_F_MORE)) {
+        conn->recv_armed = 0;
+        conn->pending_ops--;
+    }
+
+    int has_buffer = (flags & IORING_CQE_F_BUFFER) != 0;
+    unsigned short bid = (unsigned short)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+    if (conn->closing) {
+        if (has_buffer) recycle_buffer(loop, bid);
+        release_connection_if_idle(loop, conn);
+        return;
+    }
+
+    int close_needed = 0;
+
+    if (result > 0 && has_buffer) {
+        metrics_add(METRIC_BYTES_IN, (unsigned long long)result);
+        CHAT_TRACE2(recv, conn->fd, result);
+        const char *data = loop->buffers + (size_t)bid * URING_BUFFER_SIZE;
+
+        if (frame_buffer_append(&conn->rx, data, (size_t)result) < 0) {
+            LOG_ERROR("Buffer de recepción lleno en socket %d", conn->fd);
+            close_needed = 1;
+        } else {
+            close_needed = process_buffered_messages(loop, conn) < 0;
+        }
+    } else if (result == 0) {
+        if (conn->client) {
+            LOG_INFO("Cliente '%s' cerró la conexión", conn->client->username);
+        }
+        close_needed = 1;
+    } else if (result < 0 && result != -ENOBUFS) {
+        /* Sin buffers libres basta con volver a armar el recv */
+        LOG_ERROR("Error recibiendo datos del cliente en socket %d: %s",
+                 conn->fd, strerror(-result));
+        close_needed = 1;
+    }
+
+    if (has_buffer) {
+        recycle_buffer(loop, bid);
+    }
+
+    if (close_needed) {
+        close_connection(loop, conn);
+    } else if (!conn->recv_armed && arm_recv(loop, conn) < 0) {
+        close_connection(loop, conn);
+    }
+}
+
+/**
+ * @brief Completion de la espera de un handshake TLS
+ */
+static void handle_poll(uring_loop_t *loop, uring_conn_t *conn, int result)
+{
+    conn->pending_ops--;
+
+    if (conn->closing) {
+        release_connection_if_idle(loop, conn);
+        return;
+    }
+
+    if (result < 0) {
+        LOG_ERROR("Error esperando el handshake TLS en socket %d: %s", conn->fd, strerror(-result));
+        close_connection(loop, conn);
+    } else if (advance_tls_handshake(loop, conn) < 0) {
+        close_connection(loop, conn);
+    }
+}
+
+/**
+ * @brief Completion de un envío de la cola de salida
+ */
+static void handle_send(uring_loop_t *loop, uring_conn_t *conn, int result)
+{
+    conn->pending_ops--;
+    for (int i = 0; i < conn->send_count; i++) {
+        shared_frame_release(conn->send_frames[i]);
+    }
+    conn->send_count = 0;
+
+    int more = outbound_queue_complete_send(conn->outbound, result);
+
+    if (conn->closing) {
+        release_connection_if_idle(loop, conn);
+        return;
+    }
+
+    /* Un error cerró la cola con shutdown(): el recv hará la desconexión */
+    if (more > 0) {
+        list_send(loop, conn);
+    }
+}
+
+/**
+ * @brief Envía ya los envíos que generó un bloque recibido
+ *
+ * Igual que el envío en línea del motor epoll: la salida avanza al ritmo
+ * de la entrada en lugar de esperar al final de la vuelta, con una sola
+ * syscall para todas las colas avisadas. Los envíos que el kernel completa
+ * en la propia llamada quedan en la CQ detrás de recv ya entregados; se
+ * procesan aquí mismo y se marcan como atendidos, para que la siguiente
+ * tanda de la cola salga con el siguiente bloque recibido.
+ */
+static void submit_pending_sends(uring_loop_t *loop)
+{
+    if (!loop->send_list) return;
+
+    uring_ring_t *ring = &loop->ring;
+    unsigned seen = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    flush_sends(loop);
+    if (enter_ring(ring, 0, 0) < 0) {
+        LOG_ERROR("Error en io_uring_enter: %s", strerror(errno));
+        return;
+    }
+
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; seen != tail; seen++) {
+        struct io_uring_cqe *cqe = &ring->cqes[seen & ring->cq_mask];
+        if (cqe->user_data == 0 || (cqe->user_data & URING_OP_MASK) != URING_OP_SEND) {
+            continue;
+        }
+
+        uring_conn_t *conn = (uring_conn_t*)(uintptr_t)(cqe->user_data & ~URING_OP_MASK);
+        cqe->user_data = 0;
+        handle_send(loop, conn, cqe->res);
+    }
+}
+
+/**
+ * @brief Procesa todas las completions disponibles
+ */
+static void reap_completions(uring_loop_t *loop)
+{
+    uring_ring_t *ring = &loop->ring;
+    unsigned head = *ring->cq_head;
+
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) && loop->ctx->running) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        uint64_t user_data = cqe->user_data;
+        int result = cqe->res;
+        unsigned flags = cqe->flags;
+
+        /* Liberar la entrada antes de procesarla: el procesado puede
+         * preparar y enviar nuevas operaciones */
+        head++;
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+        /* Ya atendida por submit_pending_sends() */
+        if (user_data == 0) continue;
+
+        void *ptr = (void*)(uintptr_t)(user_data & ~URING_OP_MASK);
+        switch ((int)(user_data & URING_OP_MASK)) {
+            case URING_OP_ACCEPT:
+                handle_accept(loop, result, flags);
+                break;
+
+            case URING_OP_WAKE:
+                drain_inbox(loop);
+                arm_wake(loop);
+                break;
+
+            case URING_OP_RECV:
+                handle_recv(loop, (uring_conn_t*)ptr, result, flags);
+                submit_pending_sends(loop);
+                break;
+
+            case URING_OP_SEND:
+                handle_send(loop, (uring_conn_t*)ptr, result);
+                break;
+
+            case URING_OP_POLL:
+                handle_poll(loop, (uring_conn_t*)ptr, result);
+                break;
+        }
+    }
+}
+
+/* ========== EVENT LOOPS ========== */
+
+/**
+ * @brief Cuerpo de un thread de event loop io_uring
+ *
+ * Cada vuelta prepara los envíos pendientes, los envía junto con la
+ * espera de completions en una sola io_uring_enter() y procesa lo que
+ * haya llegado.
+ */
+static void *uring_loop_thread(void *args)
+{
+    uring_loop_t *loop = (uring_loop_t*)args;
+
+    current_uring_loop = loop;
+
+    /* El thread que habilita el anillo pasa a ser su único emisor */
+    if (loop->ring.disabled &&
+        syscall(__NR_io_uring_register, loop->ring.fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0) < 0) {
+        LOG_ERROR("Error habilitando anillo io_uring del loop %d: %s", loop->index, strerror(errno));
+        loop->ctx->running = 0;
+        current_uring_loop = NULL;
+        return NULL;
+    }
+
+    LOG_INFO("Event loop io_uring %d iniciado", loop->index);
+
+    timer_wheel_init(&loop->timers, timer_now_ms());
+    arm_accept(loop);
+    arm_wake(loop);
+
+    while (loop->ctx->running) {
+        flush_sends(loop);
+
+        int timeout = timer_wheel_timeout_ms(&loop->timers, timer_now_ms(), EPOLL_WAIT_TIMEOUT_MS);
+        if (enter_ring(&loop->ring, 1, timeout) < 0 && errno != EBUSY && errno != EAGAIN) {
+            LOG_ERROR("Error en io_uring_enter: %s", strerror(errno));
+            break;
+        }
+
+        reap_completions(loop);
+        timer_wheel_advance(&loop->timers, timer_now_ms());
+    }
+
+    current_uring_loop = NULL;
+    LOG_INFO("Event loop io_uring %d finalizado", loop->index);
+    return NULL;
+}
+
+/**
+ * @brief Crea el anillo, los buffers provistos y el eventfd de un loop
+ * @return 0 en éxito, código de error negativo en fallo
+ */
+static int init_uring_loop(uring_loop_t *loop, server_context_t *ctx, int index)
+{
+    loop->index = index;
+    loop->ctx = ctx;
+    loop->ring.fd = -1;
+    loop->wake_fd = -1;
+
+    if (setup_ring(&loop->ring, URING_QUEUE_DEPTH) < 0) {
+        LOG_ERROR("Error creando anillo io_uring (requiere Linux 6.0 o posterior): %s",
+                 strerror(errno));
+        return ERROR_SOCKET;
+    }
+
+    if (setup_buffers(loop) < 0) {
+        LOG_ERROR("Error registrando buffers provistos de io_uring: %s", strerror(errno));
+        return ERROR_SOCKET;
+    }
+
+    /* Bloqueante: lo lee el propio anillo */
+    loop->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (loop->wake_fd < 0) {
+        LOG_ERROR("Error creando eventfd del loop %d: %s", index, strerror(errno));
+        return ERROR_SOCKET;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Ejecuta los loops hasta el cierre del servidor
+ *
+ * El thread que llama ejecuta el loop 0 y el resto se lanzan como
+ * threads adicionales; todos terminan cuando ctx->running pasa a 0.
+ */
+static void run_uring_loops(server_context_t *ctx, uring_loop_t *loops, int loop_count)
+{
+    int started = 1;
+    for (; started < loop_count; started++) {
+        if (pthread_create(&loops[started].thread, NULL, uring_loop_thread, &loops[started]) != 0) {
+            LOG_ERROR("Error creando thread de event loop: %s", strerror(errno));
+            break;
+        }
+    }
+
+    uring_loop_thread(&loops[0]);
+
+    ctx->running = 0;
+    for (int i = 1; i < started; i++) {
+        pthread_join(loops[i].thread, NULL);
+    }
+}
+
+/**
+ * @brief Libera el estado de los loops tras su finalización
+ *
+ * Los anillos se cierran primero para que el kernel cancele las
+ * operaciones en curso. Los clientes registrados se cierran en
+ * cleanup_server_context(); aquí solo se cierran las conexiones que no
+ * completaron el handshake.
+ */
+static void release_uring_loops(uring_loop_t *loops, int loop_count)
+{
+    for (int i = 0; i < loop_count; i++) {
+        destroy_ring(&loops[i].ring);
+    }
+
+    for (int i = 0; i < loop_count; i++) {
+        uring_loop_t *loop = &loops[i];
+
+        uring_conn_t *conn = loop->connections;
+        while (conn) {
+            uring_conn_t *next = conn->next;
+            if (!conn->client && !conn->closing) {
+                SAFE_CLOSE(conn->fd);
+            }
+            for (int f = 0; f < conn->send_count; f++) {
+                shared_frame_release(conn->send_frames[f]);
+            }
+            if (conn->outbound) {
+                outbound_queue_set_submit(conn->outbound, NULL, NULL);
+                outbound_queue_release(conn->outbound);
+            }
+            tls_session_free(conn->tls);
+            frame_buffer_free(&conn->rx);
+            pool_free(&conn_pool, conn);
+            conn = next;
+        }
+
+        if (loop->buf_ring) munmap(loop->buf_ring, loop->buf_ring_size);
+        if (loop->buffers) munmap(loop->buffers, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+        SAFE_CLOSE(loop->wake_fd);
+    }
+}
+
+/**
+ * @brief Motor io_uring: accept y recv multishot, envíos agrupados por vuelta
+ */
+int run_uring_engine(server_context_t *ctx, const server_config_t *config)
+{
+    int loop_count = resolve_event_loop_count(config->event_loops, URING_MAX_LOOPS);
+
+    /* Socket de escucha bloqueante: el anillo espera por él */
+    ctx->server_socket = create_server_socket(config->port, 0);
+    if (ctx->server_socket < 0) {
+        return ctx->server_socket;
+    }
+
+    uring_loop_t *loops = calloc((size_t)loop_count, sizeof(uring_loop_t));
+    if (!loops) {
+        LOG_ERROR("Error asignando memoria para event loops");
+        return ERROR_MEMORY;
+    }
+
+    int result = SUCCESS;
+    int created = 0;
+
+    for (; created < loop_count; created++) {
+        result = init_uring_loop(&loops[created], ctx, created);
+        if (result != SUCCESS) {
+            created++;  /* Liberar también el loop parcialmente creado */
+            break;
+        }
+    }
+
+    if (result == SUCCESS) {
+        LOG_INFO("Servidor iniciado correctamente con %d anillos io_uring. Esperando conexiones...",
+                loop_count);
+        print_server_stats(ctx);
+        run_uring_loops(ctx, loops, loop_count);
+    }
+
+    release_uring_loops(loops, created);
+    free(loops);
+
+    return result;
+}
+
+#else /* Sin soporte de io_uring en las cabeceras del sistema */
+
+/**
+ * @brief Motor io_uring no disponible en esta compilación
+ */
+int run_uring_engine(server_context_t *ctx, const server_config_t *config)
+{
+    (void)ctx;
+    (void)config;
+    LOG_ERROR("Motor io_uring no disponible: compilado sin <linux/io_uring.h> reciente");
+    return ERROR_SOCKET;
+}
+
+#endif
@@ -0,0 +1,297 @@
+/**
+ * @file chat_fanout.c
+ * @brief Fan-out de los mensajes a las colas de salida de los clientes
+ * @author Sistema de Chat Socket
+ * @date 2025
+ * 
+ * Reparto de broadcasts, mensajes de sala y privados (declarados en
+ * chat_server.h). Está separado de chat_server.c, que contiene main, para
+ * que los microbenchmarks midan estas mismas funciones con una tabla de
+ * clientes y salas propia.
+ */
+
+#include "../include/chat_server.h"
+#include "../include/chat_client_table.h"
+#include "../include/chat_room.h"
+#include "../include/chat_history.h"
+#include "../include/chat_metrics.h"
+#include "../include/chat_trace.h"
+
+/* Destinatarios de broadcasts en salas grandes */
+static chat_pool_t recipients_pool = POOL_INITIALIZER("destinatarios",
+    MAX_CLIENTS * sizeof(outbound_queue_t*), 1, 1);
+
+/**
+ * @brief Reparte frames ya serializados con el fan-out propio del motor
+ * 
+ * Sin clients_mutex: la sala de member_of solo cambia en el thread que
+ * procesa sus mensajes, que es el que llama. Los mensajes de chat se
+ * numeran en el historial antes de publicarlos, así que quien entra en la
+ * sala mientras tanto descarta los que ya recibió con el historial.
+ * Suelta las referencias de frames.
+ */
+static int fan_out_with_hook(server_context_t *ctx, const client_info_t *member_of,
+                             const char *room_name, shared_frame_t **frames, int count,
+                             int exclude_socket, unsigned long long started)
+{
+    if (member_of) {
+        room_name = member_of->room ? member_of->room->name : NULL;
+    }
+    
+    int sent = 0;
+    if (room_name || !member_of) {
+        if (room_name && frames[0]->type == MSG_CHAT) {
+            for (int i = 0; i < count; i++) {
+                history_record(ctx->history, room_name, frames[i]);
+            }
+        }
+        sent = ctx->broadcast_hook(ctx, room_name, frames, count, exclude_socket);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        shared_frame_release(frames[i]);
+    }
+    CHAT_TRACE3(fanout_done, sent, sent, started);
+    return sent;
+}
+
+/**
+ * @brief Encola uno o varios mensajes para todos los clientes de un grupo
+ * 
+ * Serializa cada mensaje una sola vez en un frame compartido. clients_mutex
+ * solo se mantiene mientras se copian las colas de los destinatarios;
+ * el encolado y la escritura se hacen después, sin bloquear a nadie.
+ * Varios mensajes comparten la misma instantánea de destinatarios y cada
+ * cola los recibe juntos en una sola escritura.
+ * 
+ * Los mensajes de chat de una sala se guardan en su historial en la
+ * misma sección crítica; persistirlos no añade E/S a este camino.
+ * 
+ * @param member_of Cliente cuya sala recibe los mensajes, o NULL
+ * @param room_name Sala buscada por nombre si member_of es NULL; con
+ *                  ambos a NULL se recorren todos los clientes conectados
+ * @param msgs Mensajes, todos del mismo tipo
+ * @param count Número de mensajes (1-BROADCAST_BATCH_MAX)
+ */
+int fan_out_messages(server_context_t *ctx, const client_info_t *member_of,
+                     const char *room_name, const chat_message_t *msgs, int count,
+                     int exclude_socket)
+{
+    unsigned long long started = metrics_now_ns();
+    shared_frame_t *frames[BROADCAST_BATCH_MAX];
+    for (int i = 0; i < count; i++) {
+        frames[i] = shared_frame_create(&msgs[i]);
+        if (!frames[i]) {
+            LOG_ERROR("Error al serializar mensaje para broadcast");
+            while (i-- > 0) {
+                shared_frame_release(frames[i]);
+            }
+            return 0;
+        }
+    }
+    message_type_t type = msgs[0].type;
+    
+    /* Los motores con fan-out propio (reactor) reparten el chat de las salas
+     * y los avisos globales sin clients_mutex */
+    if (ctx->broadcast_hook && (type == MSG_CHAT || (!member_of && !room_name))) {
+        return fan_out_with_hook(ctx, member_of, room_name, frames, count, exclude_socket, started);
+    }
+    
+    outbound_queue_t *stack_recipients[BROADCAST_STACK_RECIPIENTS];
+    outbound_queue_t **recipients = stack_recipients;
+    int recipient_count = 0;
+    
+    /* Instantánea de destinatarios recorriendo el array denso de la sala
+     * o de la tabla: cada cola queda retenida */
+    const char *trace_room = member_of && member_of->room ? member_of->room->name : room_name;
+    CHAT_TRACE2(fanout_lock, trace_room, count);
+    pthread_mutex_lock(&ctx->clients_mutex);
+    CHAT_TRACE2(fanout_locked, trace_room, count);
+    
+    client_info_t **members = ctx->clients->active;
+    int member_count = ctx->clients->count;
+    if (member_of || room_name) {
+        const chat_room_t *room = member_of ? member_of->room : room_table_find(ctx->rooms, room_name);
+        if (member_of) {
+            room_name = room ? room->name : NULL;
+        }
+        members = room ? room->members : NULL;
+        member_count = room ? room->member_count : 0;
+        if (room_name && type == MSG_CHAT) {
+            for (int i = 0; i < count; i++) {
+                history_record(ctx->history, room_name, frames[i]);
+            }
+        }
+    }
+    
+    /* Por encima del límite por defecto de clientes no hay objeto del pool */
+    if (member_count > MAX_CLIENTS) {
+        recipients = malloc((size_t)member_count * sizeof(*recipients));
+    } else if (member_count > BROADCAST_STACK_RECIPIENTS) {
+        recipients = pool_alloc(&recipients_pool);
+    }
+    if (!recipients) {
+        pthread_mutex_unlock(&ctx->clients_mutex);
+        LOG_ERROR("Error asignando memoria para destinatarios del broadcast");
+        for (int i = 0; i < count; i++) {
+            shared_frame_release(frames[i]);
+        }
+        return 0;
+    }
+    
+    for (int i = 0; i < member_count; i++) {
+        client_info_t *client = members[i];
+        if (type == MSG_PRESENCE && !client->presence) {
+            continue;
+        }
+        if (client->socket_fd != exclude_socket) {
+            outbound_queue_retain(client->outbound);
+            recipients[recipient_count++] = client->outbound;
+        }
+    }
+    
+    pthread_mutex_unlock(&ctx->clients_mutex);
+    
+    int sent_count = 0;
+    for (int i = 0; i < recipient_count; i++) {
+        /* Si falla, la cola ya despertó al lector para la desconexión */
+        int pushed = count == 1 ? outbound_queue_push(recipients[i], frames[0])
+                                : outbound_queue_push_batch(recipients[i], frames, count);
+        if (pushed == 0) {
+            sent_count++;
+        }
+        outbound_queue_release(recipients[i]);
+    }
+    
+    if (member_count > MAX_CLIENTS) {
+        free(recipients);
+    } else if (recipients != stack_recipients) {
+        pool_free(&recipients_pool, recipients);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        shared_frame_release(frames[i]);
+    }
+    CHAT_TRACE3(fanout_done, recipient_count, sent_count, started);
+    metrics_record_since(METRIC_FANOUT_LATENCY, started);
+    return sent_count;
+}
+
+/**
+ * @brief Encola un mensaje para todos los clientes de un grupo
+ */
+static int fan_out_message(server_context_t *ctx, const client_info_t *member_of,
+                           const char *room_name, const chat_message_t *msg,
+                           int exclude_socket)
+{
+    return fan_out_messages(ctx, member_of, room_name, msg, 1, exclude_socket);
+}
+
+/**
+ * @brief Envía un mensaje a todos los clientes conectados (broadcast)
+ */
+int broadcast_message(server_context_t *ctx, const chat_message_t *msg, int exclude_socket)
+{
+    if (!ctx || !msg) return 0;
+    
+    metrics_add(METRIC_BROADCASTS, 1);
+    return fan_out_message(ctx, NULL, NULL, msg, exclude_socket);
+}
+
+/**
+ * @brief Envía un mensaje a los miembros de la sala de un cliente
+ * 
+ * Solo recorre los miembros de la sala, en todos los motores: las colas
+ * de salida admiten escrituras desde cualquier thread. Los otros nodos
+ * del clúster reciben el mensaje una vez y hacen su propio fan-out.
+ */
+int broadcast_to_room(server_context_t *ctx, const client_info_t *member_of,
+                      const chat_message_t *msg, int exclude_socket)
+{
+    if (!ctx || !member_of || !msg) return 0;
+    
+    metrics_add(METRIC_BROADCASTS, 1);
+    int sent = fan_out_message(ctx, member_of, NULL, msg, exclude_socket);
+    if (member_of->room) {
+        cluster_publish(ctx->cluster, member_of->room->name, msg);
+    }
+    return sent;
+}
+
+/**
+ * @brief Envía varios mensajes de chat a la sala de un cliente en un solo recorrido
+ * 
+ * Al clúster se reenvían de uno en uno: cluster_publish() ya los agrupa
+ * en el buffer de cada enlace.
+ */
+int broadcast_batch_to_room(server_context_t *ctx, const client_info_t *member_of,
+                            const chat_message_t *msgs, int count)
+{
+    if (!ctx || !member_of || !msgs || count <= 0 || count > BROADCAST_BATCH_MAX) return 0;
+    
+    metrics_add(METRIC_BROADCASTS, 1);
+    if (count > 1) {
+        metrics_add(METRIC_BATCHED_MESSAGES, (unsigned long long)count);
+    }
+    int sent = fan_out_messages(ctx, member_of, NULL, msgs, count, -1);
+    if (member_of->room) {
+        for (int i = 0; i < count; i++) {
+            cluster_publish(ctx->cluster, member_of->room->name, &msgs[i]);
+        }
+    }
+    return sent;
+}
+
+/**
+ * @brief Envía un mensaje de otro nodo a los miembros locales de una sala
+ */
+int broadcast_to_room_name(server_context_t *ctx, const char *room_name,
+                           const chat_message_t *msg)
+{
+    if (!ctx || !room_name || !msg) return 0;
+    
+    metrics_add(METRIC_BROADCASTS, 1);
+    return fan_out_message(ctx, NULL, room_name, msg, -1);
+}
+
+/**
+ * @brief Entrega un mensaje privado a un único usuario
+ * 
+ * Como el fan-out, serializa fuera del lock y bajo clients_mutex solo
+ * retiene la cola del destinatario.
+ */
+int send_private_message(server_context_t *ctx, const client_info_t *sender,
+                         const char *recipient, const char *text)
+{
+    if (!ctx || !sender || !recipient || !text) return ERROR_NOT_FOUND;
+    
+    chat_message_t private_msg;
+    init_message(&private_msg, MSG_PRIVATE, sender->username, text);
+    shared_frame_t *frame = shared_frame_create(&private_msg);
+    if (!frame) {
+        LOG_ERROR("Error al serializar mensaje privado");
+        return ERROR_MEMORY;
+    }
+    
+    outbound_queue_t *outbound = NULL;
+    pthread_mutex_lock(&ctx->clients_mutex);
+    client_info_t *target = client_table_find_name(ctx->clients, recipient);
+    if (target && target->outbound) {
+        outbound = target->outbound;
+        outbound_queue_retain(outbound);
+    }
+    pthread_mutex_unlock(&ctx->clients_mutex);
+    
+    int result = ERROR_NOT_FOUND;
+    if (outbound) {
+        /* Si falla, la cola ya despertó al lector para la desconexión */
+        result = outbound_queue_push(outbound, frame) == 0 ? SUCCESS : ERROR_FULL;
+        outbound_queue_release(outbound);
+    }
+    
+    shared_frame_release(frame);
+    if (result == SUCCESS) {
+        metrics_add(METRIC_PRIVATE_MESSAGES, 1);
+    }
+    return result;
+}
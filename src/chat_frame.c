@@ -0,0 +1,244 @@
+/**
+ * @file chat_frame.c
+ * @brief Implementación del reensamblado de frames sobre el flujo TCP
+ * @author Sistema de Chat Socket
+ * @date 2025
+ */
+
+#include "../include/chat_frame.h"
+#include "../include/chat_pool.h"
+#include <sys/uio.h>
+
+/* Anillos de recepción del tamaño por defecto (uno por conexión) */
+static chat_pool_t rx_buffer_pool = POOL_INITIALIZER("buffers_rx",
+    FRAME_BUFFER_SIZE, 16, 4);
+
+/**
+ * @brief Inicializa un buffer de frames
+ * 
+ * La capacidad se redondea a potencia de dos para poder calcular las
+ * posiciones del anillo con una máscara. Los anillos de FRAME_BUFFER_SIZE
+ * salen de un pool para que la rotación de conexiones no use el heap.
+ */
+int frame_buffer_init(frame_buffer_t *fb, size_t capacity)
+{
+    if (!fb) return ERROR_MEMORY;
+    
+    size_t size = WIRE_MAX_FRAME_SIZE;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    
+    fb->data = size == FRAME_BUFFER_SIZE ? pool_alloc(&rx_buffer_pool) : malloc(size);
+    if (!fb->data) {
+        return ERROR_MEMORY;
+    }
+    
+    fb->capacity = size;
+    fb->head = 0;
+    fb->tail = 0;
+    fb->batch_remaining = 0;
+    return SUCCESS;
+}
+
+/**
+ * @brief Libera la memoria de un buffer de frames
+ */
+void frame_buffer_free(frame_buffer_t *fb)
+{
+    if (!fb) return;
+    
+    if (fb->capacity == FRAME_BUFFER_SIZE) {
+        pool_free(&rx_buffer_pool, fb->data);
+    } else {
+        free(fb->data);
+    }
+    fb->data = NULL;
+    fb->capacity = 0;
+    fb->head = 0;
+    fb->tail = 0;
+    fb->batch_remaining = 0;
+}
+
+/**
+ * @brief Bytes recibidos pendientes de procesar
+ */
+size_t frame_buffer_pending(const frame_buffer_t *fb)
+{
+    return fb ? fb->tail - fb->head : 0;
+}
+
+/**
+ * @brief Copia los bytes pendientes sin consumirlos
+ */
+size_t frame_buffer_peek(const frame_buffer_t *fb, char *data, size_t length)
+{
+    if (!fb || !fb->data || !data) return 0;
+    
+    size_t available = fb->tail - fb->head;
+    if (length > available) {
+        length = available;
+    }
+    
+    size_t start = fb->head & (fb->capacity - 1);
+    size_t first = fb->capacity - start;
+    if (first > length) {
+        first = length;
+    }
+    
+    memcpy(data, fb->data + start, first);
+    memcpy(data + first, fb->data, length - first);
+    return length;
+}
+
+/**
+ * @brief Lee del socket todo lo que quepa en el espacio libre del anillo
+ */
+ssize_t frame_buffer_read(frame_buffer_t *fb, int fd)
+{
+    if (!fb || !fb->data) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    /* Con el buffer vacío se vuelve al inicio para leer en un solo tramo */
+    if (fb->head == fb->tail) {
+        fb->head = 0;
+        fb->tail = 0;
+    }
+    
+    size_t free_space = fb->capacity - (fb->tail - fb->head);
+    if (free_space == 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    
+    size_t mask = fb->capacity - 1;
+    size_t start = fb->tail & mask;
+    size_t first = fb->capacity - start;
+    if (first > free_space) {
+        first = free_space;
+    }
+    
+    struct iovec iov[2];
+    int iov_count = 1;
+    iov[0].iov_base = fb->data + start;
+    iov[0].iov_len = first;
+    if (free_space > first) {
+        iov[1].iov_base = fb->data;
+        iov[1].iov_len = free_space - first;
+        iov_count = 2;
+    }
+    
+    ssize_t received;
+    do {
+        received = readv(fd, iov, iov_count);
+    } while (received < 0 && errno == EINTR);
+    
+    if (received > 0) {
+        fb->tail += (size_t)received;
+    }
+    
+    return received;
+}
+
+/**
+ * @brief Copia al anillo bytes ya recibidos por otro medio
+ */
+int frame_buffer_append(frame_buffer_t *fb, const char *data, size_t length)
+{
+    if (!fb || !fb->data) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    if (fb->head == fb->tail) {
+        fb->head = 0;
+        fb->tail = 0;
+    }
+    
+    if (length > fb->capacity - (fb->tail - fb->head)) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    
+    size_t mask = fb->capacity - 1;
+    size_t start = fb->tail & mask;
+    size_t first = fb->capacity - start;
+    if (first > length) {
+        first = length;
+    }
+    
+    memcpy(fb->data + start, data, first);
+    memcpy(fb->data, data + first, length - first);
+    fb->tail += length;
+    
+    return 0;
+}
+
+/**
+ * @brief Extrae el siguiente mensaje completo del buffer
+ * 
+ * Los frames contiguos se decodifican en el propio anillo; solo los que
+ * cruzan el final se copian antes a scratch. De un lote solo se guarda
+ * cuántos bytes quedan: sus frames no necesitan caber juntos en el anillo.
+ */
+int frame_buffer_next(frame_buffer_t *fb, chat_message_t *msg)
+{
+    if (!fb || !msg) return FRAME_CORRUPT;
+    
+    size_t available = fb->tail - fb->head;
+    if (available == 0) {
+        return FRAME_INCOMPLETE;
+    }
+    
+    size_t start = fb->head & (fb->capacity - 1);
+    size_t contiguous = fb->capacity - start;
+    const char *frame = fb->data + start;
+    size_t view = available;
+    
+    if (contiguous < available && contiguous < WIRE_MAX_FRAME_SIZE) {
+        /* El frame puede cruzar el final del anillo: linealizar */
+        view = available < WIRE_MAX_FRAME_SIZE ? available : WIRE_MAX_FRAME_SIZE;
+        memcpy(fb->scratch, frame, contiguous);
+        memcpy(fb->scratch + contiguous, fb->data, view - contiguous);
+        frame = fb->scratch;
+    } else if (view > contiguous) {
+        view = contiguous;
+    }
+    
+    /* Cabecera de lote: consumirla y seguir con su primer frame */
+    if (view >= 2 && (unsigned char)frame[0] == WIRE_MAGIC &&
+        (unsigned char)frame[1] == WIRE_VERSION_BATCH) {
+        size_t batch_length;
+        int header_length = wire_parse_batch_header(frame, view, &batch_length);
+        if (header_length == 0) {
+            return FRAME_INCOMPLETE;
+        }
+        if (header_length < 0 || fb->batch_remaining > 0) {
+            return FRAME_CORRUPT;
+        }
+        fb->head += (size_t)header_length;
+        fb->batch_remaining = batch_length;
+        return frame_buffer_next(fb, msg);
+    }
+    
+    ssize_t frame_length = message_frame_length(frame, view);
+    if (frame_length == 0) {
+        return FRAME_INCOMPLETE;
+    }
+    if (frame_length < 0 || (size_t)frame_length > WIRE_MAX_FRAME_SIZE) {
+        return FRAME_CORRUPT;
+    }
+    if (fb->batch_remaining > 0) {
+        if ((size_t)frame_length > fb->batch_remaining) {
+            return FRAME_CORRUPT;
+        }
+        fb->batch_remaining -= (size_t)frame_length;
+    }
+    
+    int result = deserialize_message(frame, (size_t)frame_length, msg);
+    fb->head += (size_t)frame_length;
+    
+    return result == 0 ? FRAME_READY : FRAME_INVALID;
+}
@@ -0,0 +1,477 @@
+/**
+ * @file chat_handoff.c
+ * @brief Implementación del reinicio en caliente
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Los descriptores viajan como SCM_RIGHTS en el mismo sendmsg() que su
+ * registro. En un socket Unix de tipo stream el kernel no junta en una
+ * misma lectura datos con descriptores distintos adjuntos, así que cada
+ * registro se lee completo con recvmsg() y se recogen los descriptores
+ * de cualquiera de sus fragmentos.
+ */
+
+#include <poll.h>
+#include <sys/un.h>
+
+#include "../include/chat_handoff.h"
+#include "../include/chat_server.h"
+#include "../include/chat_client_table.h"
+#include "../include/chat_room.h"
+#include "../include/chat_timer.h"
+
+struct handoff {
+    server_context_t *ctx;                  /* Servidor que se cede */
+    int port;                               /* Puerto de los clientes */
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)]; /* Socket Unix */
+    int listen_fd;                          /* Espera a la versión nueva */
+    int peer_fd;                            /* Versión nueva conectada o -1 */
+    int listeners[HANDOFF_MAX_LISTENERS];   /* Duplicados de los sockets de escucha */
+    int listener_count;
+    int stop;                               /* Orden de parada (atómico) */
+    pthread_t thread;                       /* Thread que atiende PATH */
+    int thread_started;                     /* El thread se creó */
+};
+
+/**
+ * @brief Rellena la dirección de un socket Unix
+ * @return 0 en éxito, -1 si la ruta es demasiado larga
+ */
+static int unix_address(const char *path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        LOG_ERROR("Ruta del socket de reinicio demasiado larga: %s", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+ * @brief Acota cada lectura y escritura del socket Unix
+ */
+static void set_handoff_timeouts(int fd)
+{
+    struct timeval timeout;
+    timeout.tv_sec = HANDOFF_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (HANDOFF_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * @brief Envía un bloque con descriptores adjuntos y el resto sin ellos
+ * @return 0 en éxito, -1 en error
+ */
+static int send_with_fds(int fd, const void *data, size_t length, const int *fds, int fd_count)
+{
+    union {
+        char buffer[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_LISTENERS)];
+        struct cmsghdr align;
+    } control;
+    const char *cursor = data;
+
+    while (length > 0) {
+        struct iovec iov = { (void*)cursor, length };
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        if (fd_count > 0) {
+            memset(&control, 0, sizeof(control));
+            message.msg_control = control.buffer;
+            message.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)fd_count);
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)fd_count);
+            memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)fd_count);
+        }
+
+        ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        /* Los descriptores viajan con el primer fragmento */
+        fd_count = 0;
+        cursor += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+/**
+ * @brief Lee un bloque completo y recoge los descriptores adjuntos
+ * @param fd_count Descriptores recibidos (el llamador cierra los que sobren)
+ * @return 0 en éxito, -1 en error o cierre
+ */
+static int recv_with_fds(int fd, void *data, size_t length, int *fds, int max_fds, int *fd_count)
+{
+    union {
+        char buffer[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_LISTENERS)];
+        struct cmsghdr align;
+    } control;
+    char *cursor = data;
+
+    if (fd_count) *fd_count = 0;
+
+    while (length > 0) {
+        struct iovec iov = { cursor, length };
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        ssize_t received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) {
+            return -1;
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg;
+             cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+            int count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            for (int i = 0; i < count; i++) {
+                int received_fd;
+                memcpy(&received_fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                if (fd_count && *fd_count < max_fds) {
+                    fds[(*fd_count)++] = received_fd;
+                } else {
+                    close(received_fd);
+                }
+            }
+        }
+        if (message.msg_flags & MSG_CTRUNC) {
+            LOG_ERROR("Descriptores del reinicio en caliente truncados");
+        }
+
+        cursor += received;
+        length -= (size_t)received;
+    }
+    return 0;
+}
+
+/* ========== VERSIÓN NUEVA ========== */
+
+/**
+ * @brief Recibe un cliente y lo registra en el servidor
+ * @return 1 si se adoptó, 0 si se descartó, -1 si el flujo se rompió
+ */
+static int receive_client(server_context_t *ctx, int fd)
+{
+    handoff_client_t state;
+    int client_fd = -1;
+    int fd_count = 0;
+
+    if (recv_with_fds(fd, &state, sizeof(state), &client_fd, 1, &fd_count) < 0) {
+        return -1;
+    }
+    if (fd_count == 0) {
+        client_fd = -1;
+    }
+
+    state.username[USERNAME_SIZE - 1] = '\0';
+    state.room[ROOM_NAME_SIZE - 1] = '\0';
+    state.session[SESSION_TOKEN_SIZE - 1] = '\0';
+
+    char *output = state.output_length > 0 ? malloc(state.output_length) : NULL;
+    char *input = state.input_length > 0 ? malloc(state.input_length) : NULL;
+    int failed = (state.output_length > 0 && !output) || (state.input_length > 0 && !input);
+    if (failed ||
+        (output && recv_with_fds(fd, output, state.output_length, NULL, 0, NULL) < 0) ||
+        (input && recv_with_fds(fd, input, state.input_length, NULL, 0, NULL) < 0)) {
+        free(output);
+        free(input);
+        SAFE_CLOSE(client_fd);
+        return -1;
+    }
+
+    int adopted = 0;
+    if (client_fd < 0) {
+        LOG_ERROR("Cliente heredado '%s' sin socket adjunto", state.username);
+    } else if (server_adopt_client(ctx, client_fd, &state, output, input) == SUCCESS) {
+        adopted = 1;
+    } else {
+        SAFE_CLOSE(client_fd);
+    }
+
+    free(output);
+    free(input);
+    return adopted;
+}
+
+/**
+ * @brief Hereda el estado de la versión anterior si hay una escuchando
+ */
+int handoff_receive(server_context_t *ctx, const char *path)
+{
+    struct sockaddr_un addr;
+    if (!ctx || !path || unix_address(path, &addr) < 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Error al crear el socket de reinicio: %s", strerror(errno));
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        /* Nadie escucha: primer arranque o la versión anterior ya terminó */
+        LOG_INFO("Sin versión anterior en %s, arranque en frío", path);
+        close(fd);
+        return -1;
+    }
+    set_handoff_timeouts(fd);
+
+    LOG_INFO("Versión anterior encontrada en %s, esperando su estado...", path);
+    long long started = timer_now_ms();
+    errno = 0;
+
+    handoff_header_t header;
+    int listeners[HANDOFF_MAX_LISTENERS];
+    int listener_count = 0;
+    if (recv_with_fds(fd, &header, sizeof(header), listeners, HANDOFF_MAX_LISTENERS,
+                      &listener_count) < 0) {
+        LOG_ERROR("La versión anterior no envió su estado: %s",
+                 errno ? strerror(errno) : "conexión cerrada");
+        close(fd);
+        return -1;
+    }
+
+    if (header.magic != HANDOFF_MAGIC || header.version != HANDOFF_VERSION) {
+        LOG_ERROR("Estado de reinicio incompatible (versión %u, se esperaba %d)",
+                 header.version, HANDOFF_VERSION);
+        for (int i = 0; i < listener_count; i++) {
+            close(listeners[i]);
+        }
+        close(fd);
+        return -1;
+    }
+
+    server_inherit_listeners(listeners, listener_count);
+
+    int adopted = 0;
+    for (int i = 0; i < header.client_count; i++) {
+        int result = receive_client(ctx, fd);
+        if (result < 0) {
+            LOG_ERROR("Estado de reinicio cortado tras %d de %d clientes",
+                     i, header.client_count);
+            break;
+        }
+        adopted += result;
+    }
+
+    /* Confirmar: la versión anterior ya puede terminar */
+    char ack = 1;
+    if (send(fd, &ack, 1, MSG_NOSIGNAL) != 1) {
+        LOG_ERROR("Error confirmando el reinicio en caliente: %s", strerror(errno));
+    }
+    close(fd);
+
+    LOG_INFO("Reinicio en caliente: %d sockets de escucha y %d/%d clientes heredados en %lld ms",
+            listener_count, adopted, header.client_count, timer_now_ms() - started);
+    return adopted;
+}
+
+/* ========== VERSIÓN ANTERIOR ========== */
+
+/**
+ * @brief Espera a que se conecte la versión nueva
+ *
+ * Los sockets de escucha se duplican antes de detener el motor, que
+ * cierra los suyos al terminar.
+ */
+static void *handoff_thread(void *arg)
+{
+    handoff_t *handoff = (handoff_t*)arg;
+    server_context_t *ctx = handoff->ctx;
+
+    while (ctx->running && !__atomic_load_n(&handoff->stop, __ATOMIC_ACQUIRE)) {
+        struct pollfd pfd = { handoff->listen_fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, HANDOFF_POLL_MS);
+        if (ready < 0 && errno != EINTR) {
+            LOG_ERROR("Error en poll del socket de reinicio: %s", strerror(errno));
+            break;
+        }
+        if (ready <= 0) continue;
+
+        int peer_fd = accept4(handoff->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (peer_fd < 0) continue;
+
+        handoff->listener_count = server_dup_listeners(handoff->port, handoff->listeners,
+                                                       HANDOFF_MAX_LISTENERS);
+        handoff->peer_fd = peer_fd;
+        set_handoff_timeouts(peer_fd);
+
+        LOG_INFO("Versión nueva conectada en %s: cediendo el servidor", handoff->path);
+        ctx->handing_off = 1;
+        ctx->running = 0;
+        break;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Escucha en PATH a la versión que vendrá a sustituir a esta
+ */
+handoff_t *handoff_listen(server_context_t *ctx, const char *path, int port)
+{
+    struct sockaddr_un addr;
+    if (!ctx || !path || unix_address(path, &addr) < 0) return NULL;
+
+    handoff_t *handoff = calloc(1, sizeof(handoff_t));
+    if (!handoff) {
+        return NULL;
+    }
+    handoff->ctx = ctx;
+    handoff->port = port;
+    handoff->peer_fd = -1;
+    strcpy(handoff->path, path);
+
+    /* Una versión anterior ya entregó su estado (o murió): PATH es nuestro */
+    unlink(path);
+    handoff->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (handoff->listen_fd < 0 ||
+        bind(handoff->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(handoff->listen_fd, 1) < 0) {
+        LOG_ERROR("Error escuchando en el socket de reinicio %s: %s", path, strerror(errno));
+        SAFE_CLOSE(handoff->listen_fd);
+        free(handoff);
+        return NULL;
+    }
+
+    /* Las señales deben llegar a los threads del servidor, no a este */
+    sigset_t all_signals, previous;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &previous);
+    handoff->thread_started = pthread_create(&handoff->thread, NULL, handoff_thread, handoff) == 0;
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (!handoff->thread_started) {
+        LOG_ERROR("Error creando el thread de reinicio en caliente");
+        handoff_destroy(handoff);
+        return NULL;
+    }
+
+    LOG_INFO("Reinicio en caliente disponible en %s", path);
+    return handoff;
+}
+
+/**
+ * @brief Envía el estado a la versión nueva
+ *
+ * El motor ya está detenido, así que la tabla no cambia; las colas se
+ * vacían de una en una mientras se envían.
+ */
+int handoff_send(handoff_t *handoff, server_context_t *ctx)
+{
+    if (!handoff || handoff->peer_fd < 0 || !ctx) return -1;
+
+    long long started = timer_now_ms();
+    int fd = handoff->peer_fd;
+    errno = 0;
+
+    pthread_mutex_lock(&ctx->clients_mutex);
+    int client_count = ctx->clients->count;
+    client_info_t **clients = client_count > 0 ?
+                              malloc((size_t)client_count * sizeof(client_info_t*)) : NULL;
+    if (clients) {
+        memcpy(clients, ctx->clients->active, (size_t)client_count * sizeof(client_info_t*));
+    } else {
+        client_count = 0;
+    }
+    pthread_mutex_unlock(&ctx->clients_mutex);
+
+    handoff_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HANDOFF_MAGIC;
+    header.version = HANDOFF_VERSION;
+    header.listener_count = handoff->listener_count;
+    header.client_count = client_count;
+
+    int result = send_with_fds(fd, &header, sizeof(header),
+                               handoff->listeners, handoff->listener_count);
+    int sent = 0;
+
+    for (int i = 0; i < client_count && result == 0; i++) {
+        client_info_t *client = clients[i];
+        handoff_client_t state;
+        char *output = NULL;
+        size_t output_length = 0;
+
+        outbound_queue_detach(client->outbound, &output, &output_length);
+
+        memset(&state, 0, sizeof(state));
+        memcpy(state.username, client->username, USERNAME_SIZE - 1);
+        if (client->room) {
+            memcpy(state.room, client->room->name, ROOM_NAME_SIZE - 1);
+        } else {
+            strcpy(state.room, ROOM_DEFAULT_NAME);
+        }
+        state.address = client->address;
+        state.connect_time = (int64_t)client->connect_time;
+        state.last_activity_ms = __atomic_load_n(&client->last_activity_ms, __ATOMIC_RELAXED);
+        state.keepalive_sent_ms = __atomic_load_n(&client->keepalive_sent_ms, __ATOMIC_RELAXED);
+        state.wire_format = (int32_t)client->outbound->wire_format;
+        state.sequenced = client->outbound->sequenced;
+        state.presence = client->presence;
+        memcpy(state.session, client->session, SESSION_TOKEN_SIZE - 1);
+        state.output_length = (uint32_t)output_length;
+        state.input_length = (uint32_t)client->handoff_input_length;
+
+        result = send_with_fds(fd, &state, sizeof(state), &client->socket_fd, 1);
+        if (result == 0 && output_length > 0) {
+            result = send_with_fds(fd, output, output_length, NULL, 0);
+        }
+        if (result == 0 && client->handoff_input_length > 0) {
+            result = send_with_fds(fd, client->handoff_input, client->handoff_input_length, NULL, 0);
+        }
+        free(output);
+        sent += result == 0;
+    }
+    free(clients);
+
+    char ack = 0;
+    if (result == 0 && recv(fd, &ack, 1, 0) != 1) {
+        result = -1;
+    }
+
+    if (result < 0) {
+        LOG_ERROR("Reinicio en caliente fallido tras %d de %d clientes: %s",
+                 sent, client_count, errno ? strerror(errno) : "conexión cerrada");
+    } else {
+        LOG_INFO("Reinicio en caliente: %d clientes y %d sockets de escucha entregados en %lld ms",
+                sent, handoff->listener_count, timer_now_ms() - started);
+    }
+    return result;
+}
+
+/**
+ * @brief Deja de escuchar y libera el estado
+ */
+void handoff_destroy(handoff_t *handoff)
+{
+    if (!handoff) return;
+
+    __atomic_store_n(&handoff->stop, 1, __ATOMIC_RELEASE);
+    if (handoff->thread_started) {
+        pthread_join(handoff->thread, NULL);
+    }
+
+    if (handoff->peer_fd < 0) {
+        unlink(handoff->path);
+    }
+    SAFE_CLOSE(handoff->listen_fd);
+    SAFE_CLOSE(handoff->peer_fd);
+    for (int i = 0; i < handoff->listener_count; i++) {
+        close(handoff->listeners[i]);
+    }
+    free(handoff);
+}
@@ -0,0 +1,715 @@
+/**
+ * @file chat_history.c
+ * @brief Implementación del historial por sala y de su persistencia
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Los anillos guardan referencias a los frames compartidos ya
+ * serializados, así que reenviar el historial no vuelve a serializar
+ * nada. La persistencia copia la codificación compacta del frame con su
+ * envoltorio de secuencia: al recuperar se deserializa y se vuelve a
+ * crear el frame con su timestamp y su número originales, y cada sala
+ * sigue numerando desde el último.
+ */
+
+#include "../include/chat_history.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HISTORY_SEGMENT_MAGIC   0x54534843u         /* "CHST" */
+#define HISTORY_RECORD_MAGIC    0x52534843u         /* "CHSR" */
+#define HISTORY_FORMAT_VERSION  1
+
+/**
+ * @brief Cabecera de un segmento en disco
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation;
+} history_segment_header_t;
+
+/**
+ * @brief Cabecera de un registro en disco
+ *
+ * La generación del segmento en cada registro invalida los registros que
+ * quedan de una vuelta anterior cuando el segmento se reutiliza.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t generation;                    /* 32 bits bajos de la generación */
+    uint32_t length;                        /* Bytes de la carga */
+    uint32_t checksum;                      /* FNV-1a de la carga */
+} history_record_header_t;
+
+/* Mensajes pendientes de persistir: uno por mensaje de chat */
+static chat_pool_t pending_pool = POOL_INITIALIZER("historial_pendiente",
+    sizeof(history_pending_t), 256, POOL_CACHE_OBJECTS);
+
+/* ========== ANILLOS EN MEMORIA ========== */
+
+/**
+ * @brief Saca una sala de la lista LRU
+ */
+static void lru_unlink(chat_history_t *history, history_room_t *room)
+{
+    if (room->lru_prev) {
+        room->lru_prev->lru_next = room->lru_next;
+    } else {
+        history->lru_head = room->lru_next;
+    }
+    if (room->lru_next) {
+        room->lru_next->lru_prev = room->lru_prev;
+    } else {
+        history->lru_tail = room->lru_prev;
+    }
+    room->lru_prev = room->lru_next = NULL;
+}
+
+/**
+ * @brief Pone una sala al frente de la lista LRU
+ */
+static void lru_push_front(chat_history_t *history, history_room_t *room)
+{
+    room->lru_prev = NULL;
+    room->lru_next = history->lru_head;
+    if (history->lru_head) {
+        history->lru_head->lru_prev = room;
+    }
+    history->lru_head = room;
+    if (!history->lru_tail) {
+        history->lru_tail = room;
+    }
+}
+
+/**
+ * @brief Busca el anillo de una sala
+ */
+static history_room_t *find_room(const chat_history_t *history, const char *name, unsigned int hash)
+{
+    history_room_t *room = history->buckets[hash & (HISTORY_BUCKETS - 1)];
+
+    while (room) {
+        if (room->name_hash == hash && strcmp(room->name, name) == 0) {
+            return room;
+        }
+        room = room->hash_next;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Libera el anillo de una sala tras quitarlo del hash y de la LRU
+ */
+static void destroy_room(chat_history_t *history, history_room_t *room)
+{
+    history_room_t **link = &history->buckets[room->name_hash & (HISTORY_BUCKETS - 1)];
+    while (*link && *link != room) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = room->hash_next;
+    }
+    lru_unlink(history, room);
+    history->room_count--;
+
+    for (int i = 0; i < room->count; i++) {
+        shared_frame_release(room->frames[(room->head + i) % history->depth]);
+    }
+    free(room);
+}
+
+/**
+ * @brief Busca el contador de secuencia de una sala
+ */
+static history_sequence_t *find_sequence(const chat_history_t *history, const char *name,
+                                         unsigned int hash)
+{
+    history_sequence_t *sequence = history->sequences[hash & (HISTORY_BUCKETS - 1)];
+
+    while (sequence) {
+        if (sequence->name_hash == hash && strcmp(sequence->name, name) == 0) {
+            return sequence;
+        }
+        sequence = sequence->hash_next;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Obtiene el contador de secuencia de una sala, creándolo a 0
+ * @return Contador o NULL si no hay memoria
+ */
+static history_sequence_t *get_sequence(chat_history_t *history, const char *name, unsigned int hash)
+{
+    history_sequence_t *sequence = find_sequence(history, name, hash);
+    if (sequence) {
+        return sequence;
+    }
+
+    sequence = calloc(1, sizeof(history_sequence_t));
+    if (!sequence) {
+        return NULL;
+    }
+
+    strncpy(sequence->name, name, ROOM_NAME_SIZE - 1);
+    sequence->name[ROOM_NAME_SIZE - 1] = '\0';
+    sequence->name_hash = hash;
+
+    size_t slot = hash & (HISTORY_BUCKETS - 1);
+    sequence->hash_next = history->sequences[slot];
+    history->sequences[slot] = sequence;
+    return sequence;
+}
+
+/**
+ * @brief Obtiene el anillo de una sala, creándolo si hace falta
+ *
+ * Con HISTORY_MAX_ROOMS salas se expulsa la de actividad más antigua; su
+ * contador de secuencia se conserva.
+ *
+ * @return Anillo o NULL si no hay memoria
+ */
+static history_room_t *get_room(chat_history_t *history, const char *name)
+{
+    unsigned int hash = hash_identifier(name);
+    history_room_t *room = find_room(history, name, hash);
+    if (room) {
+        return room;
+    }
+
+    if (history->room_count >= HISTORY_MAX_ROOMS && history->lru_tail) {
+        LOG_DEBUG("Historial de la sala '%s' expulsado por inactividad", history->lru_tail->name);
+        destroy_room(history, history->lru_tail);
+    }
+
+    history_sequence_t *sequence = get_sequence(history, name, hash);
+    if (!sequence) {
+        return NULL;
+    }
+
+    room = calloc(1, sizeof(history_room_t) + (size_t)history->depth * sizeof(shared_frame_t*));
+    if (!room) {
+        return NULL;
+    }
+    room->sequence = sequence;
+
+    strncpy(room->name, name, ROOM_NAME_SIZE - 1);
+    room->name[ROOM_NAME_SIZE - 1] = '\0';
+    room->name_hash = hash;
+
+    size_t slot = hash & (HISTORY_BUCKETS - 1);
+    room->hash_next = history->buckets[slot];
+    history->buckets[slot] = room;
+    lru_push_front(history, room);
+    history->room_count++;
+
+    return room;
+}
+
+/**
+ * @brief Añade un frame al anillo de una sala, sustituyendo al más antiguo
+ */
+static void ring_append(chat_history_t *history, history_room_t *room, shared_frame_t *frame)
+{
+    shared_frame_retain(frame);
+    if (room->count < history->depth) {
+        room->frames[(room->head + room->count) % history->depth] = frame;
+        room->count++;
+    } else {
+        shared_frame_release(room->frames[room->head]);
+        room->frames[room->head] = frame;
+        room->head = (room->head + 1) % history->depth;
+    }
+
+    if (history->lru_head != room) {
+        lru_unlink(history, room);
+        lru_push_front(history, room);
+    }
+}
+
+/* ========== SEGMENTOS ========== */
+
+/**
+ * @brief FNV-1a de la carga de un registro
+ */
+static uint32_t record_checksum(const char *data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Abre y proyecta un segmento, creándolo si no existe
+ * @return SUCCESS o ERROR_SOCKET
+ */
+static int open_segment(history_segment_t *segment, const char *directory, int index)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/history-%d.seg", directory, index);
+
+    segment->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (segment->fd < 0) {
+        LOG_ERROR("Error abriendo segmento de historial %s: %s", path, strerror(errno));
+        return ERROR_SOCKET;
+    }
+
+    struct stat info;
+    if (fstat(segment->fd, &info) < 0 ||
+        (info.st_size != HISTORY_SEGMENT_SIZE && ftruncate(segment->fd, HISTORY_SEGMENT_SIZE) < 0)) {
+        LOG_ERROR("Error dimensionando segmento de historial %s: %s", path, strerror(errno));
+        SAFE_CLOSE(segment->fd);
+        return ERROR_SOCKET;
+    }
+
+    segment->map = mmap(NULL, HISTORY_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        segment->fd, 0);
+    if (segment->map == MAP_FAILED) {
+        LOG_ERROR("Error proyectando segmento de historial %s: %s", path, strerror(errno));
+        segment->map = NULL;
+        SAFE_CLOSE(segment->fd);
+        return ERROR_SOCKET;
+    }
+
+    history_segment_header_t header;
+    memcpy(&header, segment->map, sizeof(header));
+    segment->generation = (header.magic == HISTORY_SEGMENT_MAGIC &&
+                           header.version == HISTORY_FORMAT_VERSION) ? header.generation : 0;
+    segment->offset = sizeof(header);
+    return SUCCESS;
+}
+
+/**
+ * @brief Reinicia un segmento con una generación nueva
+ */
+static void reset_segment(history_segment_t *segment, unsigned long long generation)
+{
+    history_segment_header_t header;
+    header.magic = HISTORY_SEGMENT_MAGIC;
+    header.version = HISTORY_FORMAT_VERSION;
+    header.generation = generation;
+    memcpy(segment->map, &header, sizeof(header));
+
+    segment->generation = generation;
+    segment->offset = sizeof(header);
+}
+
+/**
+ * @brief Reconstruye los anillos a partir de los registros de un segmento
+ *
+ * Deja segment->offset tras el último registro válido.
+ */
+static void recover_segment(chat_history_t *history, history_segment_t *segment)
+{
+    size_t offset = sizeof(history_segment_header_t);
+
+    while (offset + sizeof(history_record_header_t) <= HISTORY_SEGMENT_SIZE) {
+        history_record_header_t header;
+        memcpy(&header, segment->map + offset, sizeof(header));
+
+        const char *payload = segment->map + offset + sizeof(header);
+        if (header.magic != HISTORY_RECORD_MAGIC ||
+            header.generation != (uint32_t)segment->generation ||
+            header.length < 2 ||
+            header.length > HISTORY_SEGMENT_SIZE - offset - sizeof(header) ||
+            header.checksum != record_checksum(payload, header.length)) {
+            break;
+        }
+
+        size_t room_length = (unsigned char)payload[0];
+        chat_message_t msg;
+        if (room_length > 0 && room_length < ROOM_NAME_SIZE && room_length + 1 < header.length &&
+            deserialize_message(payload + 1 + room_length, header.length - 1 - room_length, &msg) == 0) {
+            char room[ROOM_NAME_SIZE];
+            memcpy(room, payload + 1, room_length);
+            room[room_length] = '\0';
+
+            history_room_t *ring = get_room(history, room);
+            shared_frame_t *frame = ring ? shared_frame_create(&msg) : NULL;
+            if (frame) {
+                ring_append(history, ring, frame);
+                if (frame->sequence > ring->sequence->last) {
+                    ring->sequence->last = frame->sequence;
+                }
+                shared_frame_release(frame);
+                history->recovered++;
+            }
+        }
+
+        offset += sizeof(header) + header.length;
+    }
+
+    segment->offset = offset;
+}
+
+/**
+ * @brief Añade un registro al segmento activo, alternando si está lleno
+ */
+static void append_record(chat_history_t *history, const char *room, const shared_frame_t *frame)
+{
+    size_t room_length = strlen(room);
+    size_t frame_length;
+    const char *frame_data = shared_frame_encoding(frame, WIRE_FORMAT_COMPACT, 1, &frame_length);
+    size_t length = 1 + room_length + frame_length;
+    size_t needed = sizeof(history_record_header_t) + length;
+
+    history_segment_t *segment = &history->segments[history->active];
+    if (segment->offset + needed > HISTORY_SEGMENT_SIZE) {
+        /* El segmento lleno queda como el más antiguo; el otro se reutiliza */
+        msync(segment->map, HISTORY_SEGMENT_SIZE, MS_ASYNC);
+        unsigned long long generation = segment->generation + 1;
+        history->active = (history->active + 1) % HISTORY_SEGMENT_COUNT;
+        segment = &history->segments[history->active];
+        reset_segment(segment, generation);
+    }
+
+    /* Primero la carga y después la cabecera que la valida */
+    char *payload = segment->map + segment->offset + sizeof(history_record_header_t);
+    payload[0] = (char)room_length;
+    memcpy(payload + 1, room, room_length);
+    memcpy(payload + 1 + room_length, frame_data, frame_length);
+
+    history_record_header_t header;
+    header.magic = HISTORY_RECORD_MAGIC;
+    header.generation = (uint32_t)segment->generation;
+    header.length = (uint32_t)length;
+    header.checksum = record_checksum(payload, length);
+    memcpy(segment->map + segment->offset, &header, sizeof(header));
+
+    segment->offset += needed;
+    history->persisted++;
+}
+
+/**
+ * @brief Copia a los segmentos todos los mensajes pendientes
+ * @return Mensajes persistidos
+ */
+static int drain_pending(chat_history_t *history)
+{
+    history_pending_t *node = __atomic_exchange_n(&history->pending, NULL, __ATOMIC_ACQUIRE);
+    history_pending_t *ordered = NULL;
+
+    /* La pila entrega en orden inverso; se invierte para mantener FIFO */
+    while (node) {
+        history_pending_t *next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+    }
+
+    int count = 0;
+    while (ordered) {
+        history_pending_t *next = ordered->next;
+        append_record(history, ordered->room, ordered->frame);
+        shared_frame_release(ordered->frame);
+        pool_free(&pending_pool, ordered);
+        ordered = next;
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Thread escritor: vuelca lo pendiente y pide msync periódicos
+ */
+static void *history_writer(void *arg)
+{
+    chat_history_t *history = (chat_history_t*)arg;
+    long wait_ms = HISTORY_FLUSH_MIN_MS;
+    long since_sync_ms = 0;
+    int dirty = 0;
+
+    while (!__atomic_load_n(&history->writer_stop, __ATOMIC_ACQUIRE)) {
+        if (drain_pending(history) > 0) {
+            dirty = 1;
+            wait_ms = HISTORY_FLUSH_MIN_MS;
+        } else if (wait_ms < HISTORY_FLUSH_MAX_MS) {
+            wait_ms = wait_ms * 2 > HISTORY_FLUSH_MAX_MS ? HISTORY_FLUSH_MAX_MS : wait_ms * 2;
+        }
+
+        since_sync_ms += wait_ms;
+        if (dirty && since_sync_ms >= HISTORY_SYNC_MS) {
+            msync(history->segments[history->active].map, HISTORY_SEGMENT_SIZE, MS_ASYNC);
+            since_sync_ms = 0;
+            dirty = 0;
+        }
+
+        struct timespec pause = { 0, wait_ms * 1000000L };
+        nanosleep(&pause, NULL);
+    }
+
+    drain_pending(history);
+    return NULL;
+}
+
+/* ========== OPERACIONES DEL HISTORIAL ========== */
+
+/**
+ * @brief Crea el historial y recupera el contenido persistido
+ */
+chat_history_t *history_create(int depth, const char *directory)
+{
+    if (depth <= 0 || depth > HISTORY_MAX_DEPTH) return NULL;
+
+    chat_history_t *history = calloc(1, sizeof(chat_history_t));
+    if (!history) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&history->lock, NULL) != 0) {
+        free(history);
+        return NULL;
+    }
+    history->depth = depth;
+    for (int i = 0; i < HISTORY_SEGMENT_COUNT; i++) {
+        history->segments[i].fd = -1;
+    }
+
+    if (!directory) {
+        return history;
+    }
+
+    for (int i = 0; i < HISTORY_SEGMENT_COUNT; i++) {
+        if (open_segment(&history->segments[i], directory, i) != SUCCESS) {
+            history_destroy(history);
+            return NULL;
+        }
+    }
+    history->persistent = 1;
+
+    /* Recorrer los segmentos del más antiguo al más reciente */
+    unsigned long long newest = 0;
+    for (;;) {
+        int next = -1;
+        for (int i = 0; i < HISTORY_SEGMENT_COUNT; i++) {
+            unsigned long long generation = history->segments[i].generation;
+            if (generation > newest && (next < 0 || generation < history->segments[next].generation)) {
+                next = i;
+            }
+        }
+        if (next < 0) break;
+
+        recover_segment(history, &history->segments[next]);
+        newest = history->segments[next].generation;
+        history->active = next;
+    }
+
+    if (newest == 0) {
+        history->active = 0;
+        reset_segment(&history->segments[0], 1);
+    }
+
+    LOG_INFO("Historial: %llu mensajes recuperados de %d salas (%s, segmento %d, generación %llu)",
+            history->recovered, history->room_count, directory, history->active,
+            history->segments[history->active].generation);
+    return history;
+}
+
+/**
+ * @brief Arranca el thread escritor
+ */
+int history_start(chat_history_t *history)
+{
+    if (!history || !history->persistent || history->writer_running) return SUCCESS;
+
+    /* El escritor hereda una máscara llena: las señales van a los demás threads */
+    sigset_t all_signals, previous;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &previous);
+
+    __atomic_store_n(&history->writer_stop, 0, __ATOMIC_RELAXED);
+    int created = pthread_create(&history->writer, NULL, history_writer, history) == 0;
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (!created) {
+        LOG_ERROR("Error creando thread del historial: %s", strerror(errno));
+        return ERROR_THREAD;
+    }
+    history->writer_running = 1;
+    return SUCCESS;
+}
+
+/**
+ * @brief Persiste lo pendiente, detiene el escritor y libera el historial
+ */
+void history_destroy(chat_history_t *history)
+{
+    if (!history) return;
+
+    if (history->writer_running) {
+        __atomic_store_n(&history->writer_stop, 1, __ATOMIC_RELEASE);
+        pthread_join(history->writer, NULL);
+        history->writer_running = 0;
+    }
+
+    if (history->persistent) {
+        drain_pending(history);
+        LOG_INFO("Historial: %llu mensajes persistidos", history->persisted);
+    }
+
+    for (int i = 0; i < HISTORY_SEGMENT_COUNT; i++) {
+        history_segment_t *segment = &history->segments[i];
+        if (segment->map) {
+            msync(segment->map, HISTORY_SEGMENT_SIZE, MS_SYNC);
+            munmap(segment->map, HISTORY_SEGMENT_SIZE);
+        }
+        SAFE_CLOSE(segment->fd);
+    }
+
+    while (history->lru_head) {
+        destroy_room(history, history->lru_head);
+    }
+    for (int i = 0; i < HISTORY_BUCKETS; i++) {
+        while (history->sequences[i]) {
+            history_sequence_t *next = history->sequences[i]->hash_next;
+            free(history->sequences[i]);
+            history->sequences[i] = next;
+        }
+    }
+    pthread_mutex_destroy(&history->lock);
+    free(history);
+}
+
+/**
+ * @brief Añade un mensaje al anillo de una sala y lo programa para persistir
+ */
+void history_record(chat_history_t *history, const char *room, shared_frame_t *frame)
+{
+    if (!history || !room || !frame) return;
+
+    pthread_mutex_lock(&history->lock);
+    history_room_t *ring = get_room(history, room);
+    if (!ring) {
+        pthread_mutex_unlock(&history->lock);
+        LOG_ERROR("Error asignando memoria para el historial de la sala '%s'", room);
+        return;
+    }
+
+    shared_frame_set_sequence(frame, ++ring->sequence->last);
+    ring_append(history, ring, frame);
+    pthread_mutex_unlock(&history->lock);
+
+    if (!history->persistent) return;
+
+    history_pending_t *node = pool_alloc(&pending_pool);
+    if (!node) {
+        LOG_ERROR("Error asignando memoria para persistir el historial");
+        return;
+    }
+    strncpy(node->room, room, ROOM_NAME_SIZE - 1);
+    node->room[ROOM_NAME_SIZE - 1] = '\0';
+    shared_frame_retain(frame);
+    node->frame = frame;
+
+    history_pending_t *head = __atomic_load_n(&history->pending, __ATOMIC_RELAXED);
+    do {
+        node->next = head;
+    } while (!__atomic_compare_exchange_n(&history->pending, &head, node, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**
+ * @brief Copia con una referencia cada una los últimos count mensajes de un anillo
+ */
+static int copy_ring_tail(const chat_history_t *history, const history_room_t *ring,
+                          int count, shared_frame_t **frames)
+{
+    int first = ring->count - count;
+    for (int i = 0; i < count; i++) {
+        frames[i] = ring->frames[(ring->head + first + i) % history->depth];
+        shared_frame_retain(frames[i]);
+    }
+    return count;
+}
+
+/**
+ * @brief Copia los mensajes recientes de una sala
+ */
+int history_snapshot(chat_history_t *history, const char *room, shared_frame_t **frames,
+                     unsigned long long *last)
+{
+    if (last) *last = 0;
+    if (!history || !room || !frames) return 0;
+
+    unsigned int hash = hash_identifier(room);
+    pthread_mutex_lock(&history->lock);
+
+    const history_sequence_t *sequence = find_sequence(history, room, hash);
+    if (last && sequence) {
+        *last = sequence->last;
+    }
+
+    history_room_t *ring = find_room(history, room, hash);
+    int copied = ring ? copy_ring_tail(history, ring, ring->count, frames) : 0;
+
+    pthread_mutex_unlock(&history->lock);
+    return copied;
+}
+
+/**
+ * @brief Copia los mensajes de una sala posteriores a un número de secuencia
+ *
+ * Los números se asignan con el lock del historial tomado al añadir al
+ * anillo, así que el anillo está ordenado y basta recorrerlo desde el
+ * final hasta el último mensaje que el cliente ya tenía.
+ */
+int history_snapshot_since(chat_history_t *history, const char *room,
+                           unsigned long long after, shared_frame_t **frames,
+                           unsigned long long *missed, unsigned long long *last)
+{
+    if (missed) *missed = 0;
+    if (last) *last = 0;
+    if (!history || !room || !frames) return 0;
+
+    unsigned int hash = hash_identifier(room);
+    pthread_mutex_lock(&history->lock);
+
+    const history_sequence_t *sequence = find_sequence(history, room, hash);
+    if (last && sequence) {
+        *last = sequence->last;
+    }
+
+    history_room_t *ring = find_room(history, room, hash);
+    if (!ring) {
+        /* Anillo expulsado: todo lo posterior a after se perdió */
+        if (missed && sequence && after > 0 && sequence->last > after) {
+            *missed = sequence->last - after;
+        }
+        pthread_mutex_unlock(&history->lock);
+        return 0;
+    }
+
+    /* Sin número previo o con la numeración reiniciada: todo el anillo */
+    if (after == 0 || after > ring->sequence->last) {
+        int copied = copy_ring_tail(history, ring, ring->count, frames);
+        pthread_mutex_unlock(&history->lock);
+        return copied;
+    }
+
+    int newer = 0;
+    while (newer < ring->count) {
+        const shared_frame_t *frame = ring->frames[(ring->head + ring->count - 1 - newer) % history->depth];
+        if (frame->sequence <= after) break;
+        newer++;
+    }
+    copy_ring_tail(history, ring, newer, frames);
+
+    /* Lo que falta entre el último visto y el más antiguo del anillo */
+    unsigned long long oldest = newer > 0 ? frames[0]->sequence : ring->sequence->last + 1;
+    if (missed && oldest > after + 1) {
+        *missed = oldest - after - 1;
+    }
+
+    pthread_mutex_unlock(&history->lock);
+    return newer;
+}
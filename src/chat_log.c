@@ -0,0 +1,395 @@
+/**
+ * @file chat_log.c
+ * @brief Implementación del logging asíncrono sin locks
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cada anillo tiene un único productor (el thread dueño) y un único
+ * consumidor (el volcador), así que basta con publicar head y tail con
+ * semántica release/acquire. Los anillos nunca se liberan mientras el
+ * proceso vive: cuando su thread termina quedan libres para que otro
+ * thread los reutilice, lo que mantiene acotada la memoria con el motor
+ * de un thread por cliente.
+ */
+
+#include "../include/chat_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+
+/* ========== ESTRUCTURAS INTERNAS ========== */
+
+/**
+ * @brief Línea de log pendiente de volcar
+ */
+typedef struct {
+    time_t when;                            /* Segundo en que se registró */
+    int level;                              /* Nivel del mensaje */
+    int length;                             /* Bytes válidos en text */
+    char text[LOG_LINE_SIZE];               /* Mensaje ya formateado */
+} log_entry_t;
+
+/**
+ * @brief Anillo de un thread productor
+ *
+ * head y tail son contadores libres que solo crecen; el relleno evita
+ * que el productor y el volcador compartan línea de caché.
+ */
+typedef struct log_ring {
+    unsigned int head;                      /* Próxima entrada a escribir (productor) */
+    char pad_head[60];
+    unsigned int tail;                      /* Próxima entrada a volcar (volcador) */
+    char pad_tail[60];
+    unsigned long dropped;                  /* Entradas descartadas por anillo lleno */
+    int owned;                              /* 1 mientras un thread lo usa */
+    struct log_ring *next;                  /* Siguiente anillo registrado */
+    log_entry_t entries[LOG_RING_ENTRIES];
+} log_ring_t;
+
+/**
+ * @brief Caché del texto de timestamp, regenerado una vez por segundo
+ */
+typedef struct {
+    time_t second;
+    char text[16];
+} log_clock_t;
+
+/* ========== ESTADO GLOBAL ========== */
+
+int log_min_level = DEFAULT_LOG_LEVEL;
+
+/* Serializa la salida síncrona con los lotes del volcador */
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static log_clock_t sync_clock = { -1, "" };
+
+static log_ring_t *ring_list = NULL;
+static __thread log_ring_t *thread_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static int async_running = 0;
+static int flusher_stop = 0;
+static pthread_t flusher_thread;
+static log_clock_t flusher_clock = { -1, "" };
+static char flusher_batch[LOG_BATCH_SIZE];
+
+static const char *const level_names[] = { "DEBUG", "INFO", "ERROR", "OFF" };
+
+/* ========== FUNCIONES AUXILIARES ========== */
+
+/**
+ * @brief Devuelve "[HH:MM:SS]" para un instante, formateando solo al cambiar de segundo
+ */
+static const char *clock_text(log_clock_t *clock, time_t now)
+{
+    if (now != clock->second) {
+        struct tm tm_info;
+        if (localtime_r(&now, &tm_info)) {
+            snprintf(clock->text, sizeof(clock->text), "[%02d:%02d:%02d]",
+                    tm_info.tm_hour, tm_info.tm_min, tm_info.tm_sec);
+        } else {
+            strcpy(clock->text, "[--:--:--]");
+        }
+        clock->second = now;
+    }
+
+    return clock->text;
+}
+
+/**
+ * @brief Libera el anillo de un thread que termina para que otro lo reutilice
+ */
+static void release_thread_ring(void *ring)
+{
+    __atomic_store_n(&((log_ring_t*)ring)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void create_ring_key(void)
+{
+    pthread_key_create(&ring_key, release_thread_ring);
+}
+
+/**
+ * @brief Obtiene el anillo del thread actual, reutilizando uno libre si lo hay
+ * @return Anillo o NULL si no hay memoria
+ */
+static log_ring_t *get_thread_ring(void)
+{
+    if (thread_ring) {
+        return thread_ring;
+    }
+
+    pthread_once(&ring_key_once, create_ring_key);
+
+    log_ring_t *ring = __atomic_load_n(&ring_list, __ATOMIC_ACQUIRE);
+    for (; ring; ring = ring->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&ring->owned, &expected, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (!ring) {
+        ring = calloc(1, sizeof(log_ring_t));
+        if (!ring) {
+            return NULL;
+        }
+        ring->owned = 1;
+        ring->next = __atomic_load_n(&ring_list, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&ring_list, &ring->next, ring, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            /* ring->next ya contiene la cabeza actual */
+        }
+    }
+
+    pthread_setspecific(ring_key, ring);
+    thread_ring = ring;
+    return ring;
+}
+
+/**
+ * @brief Copia un mensaje al anillo sin bloquear
+ */
+static void ring_push(log_ring_t *ring, log_level_t level, const char *format, va_list args)
+{
+    unsigned int head = ring->head;
+    unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= LOG_RING_ENTRIES) {
+        __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    log_entry_t *entry = &ring->entries[head & (LOG_RING_ENTRIES - 1)];
+    entry->when = time(NULL);
+    entry->level = level;
+
+    int length = vsnprintf(entry->text, sizeof(entry->text), format, args);
+    if (length < 0) {
+        length = 0;
+    } else if (length >= (int)sizeof(entry->text)) {
+        length = sizeof(entry->text) - 1;
+    }
+    entry->length = length;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Escribe el lote acumulado en stdout
+ */
+static void write_batch(size_t *used)
+{
+    if (*used == 0) return;
+
+    pthread_mutex_lock(&log_mutex);
+    fwrite(flusher_batch, 1, *used, stdout);
+    fflush(stdout);
+    pthread_mutex_unlock(&log_mutex);
+
+    *used = 0;
+}
+
+/**
+ * @brief Añade una línea completa al lote, escribiéndolo antes si no cabe
+ */
+static void append_line(size_t *used, time_t when, int level, const char *text, int length)
+{
+    /* "[HH:MM:SS] [NIVEL] " + texto + '\n' */
+    size_t needed = 16 + 8 + (size_t)length + 1;
+    if (*used + needed > sizeof(flusher_batch)) {
+        write_batch(used);
+    }
+
+    int written = snprintf(flusher_batch + *used, sizeof(flusher_batch) - *used,
+                           "%s [%s] %.*s\n", clock_text(&flusher_clock, when),
+                           level_names[level], length, text);
+    if (written > 0) {
+        *used += (size_t)written;
+    }
+}
+
+/**
+ * @brief Vuelca el contenido de todos los anillos
+ * @return Número de líneas volcadas
+ */
+static unsigned long drain_rings(void)
+{
+    unsigned long lines = 0;
+    size_t used = 0;
+
+    log_ring_t *ring = __atomic_load_n(&ring_list, __ATOMIC_ACQUIRE);
+    for (; ring; ring = ring->next) {
+        unsigned long dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+        if (dropped > 0) {
+            char notice[64];
+            int length = snprintf(notice, sizeof(notice),
+                                  "%lu mensajes de log descartados (anillo lleno)", dropped);
+            append_line(&used, time(NULL), LOG_LEVEL_ERROR, notice, length);
+            lines++;
+        }
+
+        unsigned int tail = ring->tail;
+        unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        for (; tail != head; tail++) {
+            const log_entry_t *entry = &ring->entries[tail & (LOG_RING_ENTRIES - 1)];
+            append_line(&used, entry->when, entry->level, entry->text, entry->length);
+            lines++;
+        }
+
+        /* Las entradas ya están copiadas al lote: el productor puede reutilizarlas */
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    write_batch(&used);
+    return lines;
+}
+
+/**
+ * @brief Thread de volcado: espera más cuanto menos actividad hay
+ */
+static void *log_flusher(void *arg)
+{
+    (void)arg;
+    long wait_ms = LOG_FLUSH_MIN_MS;
+
+    while (!__atomic_load_n(&flusher_stop, __ATOMIC_ACQUIRE)) {
+        if (drain_rings() > 0) {
+            wait_ms = LOG_FLUSH_MIN_MS;
+        } else if (wait_ms < LOG_FLUSH_MAX_MS) {
+            wait_ms = wait_ms * 2 > LOG_FLUSH_MAX_MS ? LOG_FLUSH_MAX_MS : wait_ms * 2;
+        }
+
+        struct timespec pause = { 0, wait_ms * 1000000L };
+        nanosleep(&pause, NULL);
+    }
+
+    drain_rings();
+    return NULL;
+}
+
+/**
+ * @brief Escribe un mensaje directamente en stdout
+ */
+static void write_sync(log_level_t level, const char *format, va_list args)
+{
+    pthread_mutex_lock(&log_mutex);
+
+    printf("%s [%s] ", clock_text(&sync_clock, time(NULL)), level_names[level]);
+    vprintf(format, args);
+    printf("\n");
+    fflush(stdout);
+
+    pthread_mutex_unlock(&log_mutex);
+}
+
+/* ========== API DEL LOGGER ========== */
+
+/**
+ * @brief Registra un mensaje con timestamp y nivel
+ */
+void safe_log(log_level_t level, const char *format, ...)
+{
+    if ((int)level < LOG_LEVEL_DEBUG || (int)level >= LOG_LEVEL_OFF) return;
+
+    va_list args;
+    va_start(args, format);
+
+    log_ring_t *ring = NULL;
+    if (__atomic_load_n(&async_running, __ATOMIC_ACQUIRE)) {
+        ring = get_thread_ring();
+    }
+
+    if (ring) {
+        ring_push(ring, level, format, args);
+    } else {
+        write_sync(level, format, args);
+    }
+
+    va_end(args);
+}
+
+/**
+ * @brief Cambia el nivel mínimo de log en tiempo de ejecución
+ */
+void log_set_level(log_level_t level)
+{
+    __atomic_store_n(&log_min_level, (int)level, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Interpreta un nombre de nivel
+ */
+int parse_log_level(const char *name, log_level_t *level)
+{
+    if (!name || !level) return -1;
+
+    for (int i = LOG_LEVEL_DEBUG; i <= LOG_LEVEL_OFF; i++) {
+        if (strcasecmp(name, level_names[i]) == 0) {
+            *level = (log_level_t)i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Nombre legible de un nivel de log
+ */
+const char *log_level_name(log_level_t level)
+{
+    if ((int)level < LOG_LEVEL_DEBUG || (int)level > LOG_LEVEL_OFF) return "?";
+    return level_names[level];
+}
+
+/**
+ * @brief Arranca el thread de volcado asíncrono
+ */
+int log_start_async(void)
+{
+    int result = 0;
+
+    pthread_mutex_lock(&log_mutex);
+    if (!async_running) {
+        /* El volcador hereda una máscara llena: las señales van a los demás threads */
+        sigset_t all_signals, previous;
+        sigfillset(&all_signals);
+        pthread_sigmask(SIG_SETMASK, &all_signals, &previous);
+
+        __atomic_store_n(&flusher_stop, 0, __ATOMIC_RELAXED);
+        if (pthread_create(&flusher_thread, NULL, log_flusher, NULL) == 0) {
+            __atomic_store_n(&async_running, 1, __ATOMIC_RELEASE);
+        } else {
+            result = -1;
+        }
+
+        pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    }
+    pthread_mutex_unlock(&log_mutex);
+
+    return result;
+}
+
+/**
+ * @brief Detiene el volcador tras escribir todo lo pendiente
+ */
+void log_stop_async(void)
+{
+    pthread_mutex_lock(&log_mutex);
+    int running = async_running;
+    __atomic_store_n(&async_running, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&log_mutex);
+
+    if (!running) return;
+
+    /* El volcador hace una última pasada antes de terminar */
+    __atomic_store_n(&flusher_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(flusher_thread, NULL);
+}
@@ -0,0 +1,678 @@
+/**
+ * @file chat_metrics.c
+ * @brief Implementación de las métricas del servidor y del endpoint /metrics
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cada shard tiene un único escritor (el thread dueño), así que los
+ * contadores se actualizan con una carga y un almacenamiento relajados,
+ * sin instrucciones con lock. Como en el logger, los shards de threads
+ * terminados se reutilizan y nunca se liberan: sus valores acumulados
+ * siguen contando en los totales.
+ */
+
+#include "../include/chat_metrics.h"
+#include "../include/chat_server.h"
+#include "../include/chat_client_table.h"
+#include "../include/chat_room.h"
+#include "../include/chat_pool.h"
+#include <poll.h>
+#include <stdarg.h>
+#include <sys/time.h>
+
+/* ========== ESTRUCTURAS INTERNAS ========== */
+
+/**
+ * @brief Métricas escritas por un thread
+ */
+typedef struct metrics_shard {
+    unsigned long long counters[METRIC_COUNTER_COUNT];
+    unsigned long long buckets[METRIC_HISTOGRAM_COUNT][METRICS_HIST_BUCKETS];
+    unsigned long long sums[METRIC_HISTOGRAM_COUNT];
+    unsigned long long gauges[METRIC_GAUGE_COUNT];  /* Variaciones acumuladas (módulo 2^64) */
+    int owned;                              /* 1 mientras un thread lo usa */
+    struct metrics_shard *next;             /* Siguiente shard registrado */
+} metrics_shard_t;
+
+/**
+ * @brief Buffer de salida que recuerda cuántos bytes harían falta
+ */
+typedef struct {
+    char *data;
+    size_t size;
+    size_t used;
+} metrics_writer_t;
+
+/* ========== ESTADO GLOBAL ========== */
+
+static metrics_shard_t *shard_list = NULL;
+static __thread metrics_shard_t *thread_shard = NULL;
+static pthread_key_t shard_key;
+static pthread_once_t shard_key_once = PTHREAD_ONCE_INIT;
+
+/* Destino compartido (con sumas atómicas) si un thread no obtiene shard */
+static metrics_shard_t fallback_shard;
+
+static const char *const counter_names[METRIC_COUNTER_COUNT] = {
+    "chat_messages_in_total",
+    "chat_messages_out_total",
+    "chat_bytes_in_total",
+    "chat_bytes_out_total",
+    "chat_broadcasts_total",
+    "chat_dropped_sends_total",
+    "chat_connections_total",
+    "chat_accept_errors_total",
+    "chat_accept_rejected_total",
+    "chat_tls_handshakes_total",
+    "chat_tls_resumed_total",
+    "chat_tls_failures_total",
+    "chat_deflate_frames_total",
+    "chat_deflate_saved_bytes_total",
+    "chat_cluster_frames_out_total",
+    "chat_cluster_frames_in_total",
+    "chat_cluster_dropped_total",
+    "chat_handoff_clients_total",
+    "chat_session_resumes_total",
+    "chat_resume_replayed_total",
+    "chat_private_messages_total",
+    "chat_rate_limited_client_total",
+    "chat_rate_limited_ip_total",
+    "chat_presence_snapshots_total",
+    "chat_batched_messages_total",
+};
+
+static const char *const counter_help[METRIC_COUNTER_COUNT] = {
+    "Frames recibidos de clientes",
+    "Frames escritos completos a clientes",
+    "Bytes leidos de sockets de clientes",
+    "Bytes escritos a sockets de clientes",
+    "Broadcasts iniciados",
+    "Frames descartados o agrupados por desborde de la cola de salida",
+    "Conexiones aceptadas",
+    "Fallos de accept()",
+    "Conexiones rechazadas por el limitador de admision",
+    "Handshakes TLS completados con kTLS",
+    "Handshakes TLS que reanudaron una sesion",
+    "Handshakes TLS fallidos o sin kTLS",
+    "Frames compartidos comprimidos con deflate",
+    "Bytes ahorrados por la compresion, una vez por frame",
+    "Frames enviados a nodos del cluster, uno por enlace",
+    "Frames recibidos de nodos del cluster",
+    "Frames no reenviados al cluster por enlace caido o lleno",
+    "Clientes heredados de la version anterior en reinicios en caliente",
+    "Handshakes que reanudaron una sesion anterior",
+    "Mensajes del historial reenviados al reanudar sesiones",
+    "Mensajes privados entregados a su destinatario",
+    "Mensajes descartados por superar el limite de envio por cliente",
+    "Mensajes descartados por superar el limite de envio por IP",
+    "Listas completas de usuarios enviadas al entrar en una sala o resincronizar",
+    "Mensajes de chat repartidos en un mismo recorrido de la sala con otros",
+};
+
+static const char *const histogram_names[METRIC_HISTOGRAM_COUNT] = {
+    "chat_fanout_latency_seconds",
+    "chat_send_latency_seconds",
+};
+
+static const char *const histogram_help[METRIC_HISTOGRAM_COUNT] = {
+    "Tiempo desde que empieza un broadcast hasta encolarlo para todos los destinatarios",
+    "Duracion de cada sendmsg() a un cliente",
+};
+
+static const char *const gauge_names[METRIC_GAUGE_COUNT] = {
+    "chat_outbound_queued_bytes",
+    "chat_outbound_queued_frames",
+    "chat_outbound_congested_clients",
+};
+
+static const char *const gauge_help[METRIC_GAUGE_COUNT] = {
+    "Bytes pendientes en todas las colas de salida",
+    "Frames pendientes en todas las colas de salida",
+    "Colas por encima de la marca alta",
+};
+
+/* Límites publicados: potencias de dos de 2^10 ns (~1 us) a 2^34 ns (~17 s) */
+#define EXPORT_MIN_EXPONENT     10
+#define EXPORT_MAX_EXPONENT     34
+
+/* Estado del puerto de administración */
+static pthread_t admin_thread;
+static int admin_running = 0;
+static int admin_stop = 0;
+static int admin_socket = -1;
+static server_context_t *admin_ctx = NULL;
+
+/* ========== SHARDS POR THREAD ========== */
+
+/**
+ * @brief Libera el shard de un thread que termina para que otro lo reutilice
+ */
+static void release_thread_shard(void *shard)
+{
+    __atomic_store_n(&((metrics_shard_t*)shard)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void create_shard_key(void)
+{
+    pthread_key_create(&shard_key, release_thread_shard);
+}
+
+/**
+ * @brief Obtiene el shard del thread actual, reutilizando uno libre si lo hay
+ * @return Shard o NULL si no hay memoria
+ */
+static metrics_shard_t *get_thread_shard(void)
+{
+    if (thread_shard) {
+        return thread_shard;
+    }
+
+    pthread_once(&shard_key_once, create_shard_key);
+
+    metrics_shard_t *shard = __atomic_load_n(&shard_list, __ATOMIC_ACQUIRE);
+    for (; shard; shard = shard->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&shard->owned, &expected, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (!shard) {
+        /* Alineado a línea de caché para no compartirla con otro shard */
+        void *memory = NULL;
+        if (posix_memalign(&memory, 64, sizeof(metrics_shard_t)) != 0) {
+            return NULL;
+        }
+        shard = memset(memory, 0, sizeof(metrics_shard_t));
+        shard->owned = 1;
+        shard->next = __atomic_load_n(&shard_list, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&shard_list, &shard->next, shard, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            /* shard->next ya contiene la cabeza actual */
+        }
+    }
+
+    pthread_setspecific(shard_key, shard);
+    thread_shard = shard;
+    return shard;
+}
+
+/**
+ * @brief Suma a una celda del shard propio (un solo escritor) o del compartido
+ */
+static void shard_add(metrics_shard_t *shard, unsigned long long *slot, unsigned long long amount)
+{
+    if (shard) {
+        __atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) + amount, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(slot, amount, __ATOMIC_RELAXED);
+    }
+}
+
+/* ========== HISTOGRAMAS ========== */
+
+/**
+ * @brief Bucket de un valor: exponente de la potencia de dos y subdivisión lineal
+ */
+static int bucket_index(unsigned long long value)
+{
+    if (value < METRICS_SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    unsigned long long max_value = (1ULL << (METRICS_MAX_EXPONENT + 1)) - 1;
+    if (value > max_value) {
+        value = max_value;
+    }
+
+    int exponent = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (exponent - METRICS_SUB_BITS)) & (METRICS_SUB_BUCKETS - 1);
+    return (exponent - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS + sub;
+}
+
+/**
+ * @brief Límite superior (exclusivo) de un bucket
+ */
+static unsigned long long bucket_upper_bound(int index)
+{
+    if (index < METRICS_SUB_BUCKETS) {
+        return (unsigned long long)index + 1;
+    }
+
+    int exponent = index / METRICS_SUB_BUCKETS + METRICS_SUB_BITS - 1;
+    int sub = index % METRICS_SUB_BUCKETS;
+    return (unsigned long long)(METRICS_SUB_BUCKETS + sub + 1) << (exponent - METRICS_SUB_BITS);
+}
+
+/* ========== API DE MÉTRICAS ========== */
+
+/**
+ * @brief Instante monotónico actual en nanosegundos
+ */
+unsigned long long metrics_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+/**
+ * @brief Suma a un contador del shard del thread actual
+ */
+void metrics_add(metric_counter_t counter, unsigned long long amount)
+{
+    if ((unsigned)counter >= METRIC_COUNTER_COUNT) return;
+
+    metrics_shard_t *shard = get_thread_shard();
+    metrics_shard_t *target = shard ? shard : &fallback_shard;
+    shard_add(shard, &target->counters[counter], amount);
+}
+
+/**
+ * @brief Registra una muestra en un histograma del shard del thread actual
+ */
+void metrics_record(metric_histogram_t histogram, unsigned long long value_ns)
+{
+    if ((unsigned)histogram >= METRIC_HISTOGRAM_COUNT) return;
+
+    metrics_shard_t *shard = get_thread_shard();
+    metrics_shard_t *target = shard ? shard : &fallback_shard;
+    shard_add(shard, &target->buckets[histogram][bucket_index(value_ns)], 1);
+    shard_add(shard, &target->sums[histogram], value_ns);
+}
+
+/**
+ * @brief Registra el tiempo transcurrido desde un instante de metrics_now_ns()
+ */
+void metrics_record_since(metric_histogram_t histogram, unsigned long long start_ns)
+{
+    unsigned long long now = metrics_now_ns();
+    metrics_record(histogram, now > start_ns ? now - start_ns : 0);
+}
+
+/**
+ * @brief Suma un contador de todos los shards
+ */
+unsigned long long metrics_counter_total(metric_counter_t counter)
+{
+    if ((unsigned)counter >= METRIC_COUNTER_COUNT) return 0;
+
+    unsigned long long total = __atomic_load_n(&fallback_shard.counters[counter], __ATOMIC_RELAXED);
+    metrics_shard_t *shard = __atomic_load_n(&shard_list, __ATOMIC_ACQUIRE);
+    for (; shard; shard = shard->next) {
+        total += __atomic_load_n(&shard->counters[counter], __ATOMIC_RELAXED);
+    }
+
+    return total;
+}
+
+/**
+ * @brief Suma (o resta, con delta negativo) a un gauge en el shard del thread actual
+ *
+ * La resta se hace como suma módulo 2^64, así que un shard puede quedar
+ * "negativo" (un thread encola y otro vacía) y el total sigue siendo exacto.
+ */
+void metrics_gauge_add(metric_gauge_t gauge, long long delta)
+{
+    if ((unsigned)gauge >= METRIC_GAUGE_COUNT || delta == 0) return;
+
+    metrics_shard_t *shard = get_thread_shard();
+    metrics_shard_t *target = shard ? shard : &fallback_shard;
+    shard_add(shard, &target->gauges[gauge], (unsigned long long)delta);
+}
+
+/**
+ * @brief Valor de un gauge sumando todos los shards
+ */
+long long metrics_gauge_total(metric_gauge_t gauge)
+{
+    if ((unsigned)gauge >= METRIC_GAUGE_COUNT) return 0;
+
+    unsigned long long total = __atomic_load_n(&fallback_shard.gauges[gauge], __ATOMIC_RELAXED);
+    metrics_shard_t *shard = __atomic_load_n(&shard_list, __ATOMIC_ACQUIRE);
+    for (; shard; shard = shard->next) {
+        total += __atomic_load_n(&shard->gauges[gauge], __ATOMIC_RELAXED);
+    }
+
+    /* Los shards se leen uno a uno: un valor transitorio negativo se publica como 0 */
+    long long value = (long long)total;
+    return value > 0 ? value : 0;
+}
+
+/**
+ * @brief Suma un shard a un histograma agregado
+ */
+static void add_shard_histogram(const metrics_shard_t *shard, metric_histogram_t histogram,
+                                metrics_histogram_t *out)
+{
+    for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        unsigned long long value = __atomic_load_n(&shard->buckets[histogram][i], __ATOMIC_RELAXED);
+        out->buckets[i] += value;
+        out->count += value;
+    }
+    out->sum += __atomic_load_n(&shard->sums[histogram], __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Agrega un histograma de todos los shards
+ */
+void metrics_histogram_snapshot(metric_histogram_t histogram, metrics_histogram_t *out)
+{
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if ((unsigned)histogram >= METRIC_HISTOGRAM_COUNT) return;
+
+    add_shard_histogram(&fallback_shard, histogram, out);
+    metrics_shard_t *shard = __atomic_load_n(&shard_list, __ATOMIC_ACQUIRE);
+    for (; shard; shard = shard->next) {
+        add_shard_histogram(shard, histogram, out);
+    }
+}
+
+/**
+ * @brief Percentil aproximado de un histograma agregado
+ */
+unsigned long long metrics_percentile(const metrics_histogram_t *hist, double percentile)
+{
+    if (!hist || hist->count == 0) return 0;
+
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * (double)hist->count);
+    if (rank >= hist->count) {
+        rank = hist->count - 1;
+    }
+
+    unsigned long long seen = 0;
+    for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen > rank) {
+            return bucket_upper_bound(i);
+        }
+    }
+
+    return bucket_upper_bound(METRICS_HIST_BUCKETS - 1);
+}
+
+/* ========== EXPOSICIÓN PROMETHEUS ========== */
+
+/**
+ * @brief printf sobre el buffer de salida; sigue contando aunque no quepa
+ */
+static void writer_printf(metrics_writer_t *writer, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void writer_printf(metrics_writer_t *writer, const char *format, ...)
+{
+    size_t available = writer->used < writer->size ? writer->size - writer->used : 0;
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(available ? writer->data + writer->used : NULL, available, format, args);
+    va_end(args);
+
+    if (length > 0) {
+        writer->used += (size_t)length;
+    }
+}
+
+/**
+ * @brief Publica un histograma con límites en potencias de dos
+ *
+ * Los límites de los buckets HDR caen exactamente en cada potencia de dos,
+ * así que los acumulados publicados son exactos.
+ */
+static void render_histogram(metrics_writer_t *writer, metric_histogram_t histogram)
+{
+    metrics_histogram_t hist;
+    metrics_histogram_snapshot(histogram, &hist);
+
+    const char *name = histogram_names[histogram];
+    writer_printf(writer, "# HELP %s %s\n# TYPE %s histogram\n", name, histogram_help[histogram], name);
+
+    unsigned long long cumulative = 0;
+    int index = 0;
+    for (int exponent = EXPORT_MIN_EXPONENT; exponent <= EXPORT_MAX_EXPONENT; exponent++) {
+        unsigned long long bound = 1ULL << exponent;
+        while (index < METRICS_HIST_BUCKETS && bucket_upper_bound(index) <= bound) {
+            cumulative += hist.buckets[index++];
+        }
+        writer_printf(writer, "%s_bucket{le=\"%.9g\"} %llu\n", name, (double)bound / 1e9, cumulative);
+    }
+
+    writer_printf(writer, "%s_bucket{le=\"+Inf\"} %llu\n", name, hist.count);
+    writer_printf(writer, "%s_sum %.9f\n", name, (double)hist.sum / 1e9);
+    writer_printf(writer, "%s_count %llu\n", name, hist.count);
+}
+
+/**
+ * @brief Genera la exposición en formato de texto de Prometheus
+ */
+size_t metrics_render(server_context_t *ctx, char *buffer, size_t size)
+{
+    metrics_writer_t writer = { buffer, size, 0 };
+
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        writer_printf(&writer, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                      counter_names[i], counter_help[i], counter_names[i],
+                      counter_names[i], metrics_counter_total((metric_counter_t)i));
+    }
+
+    for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+        render_histogram(&writer, (metric_histogram_t)i);
+    }
+
+    /* Gauges de las colas de salida, mantenidos al encolar y al escribir */
+    for (int i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        writer_printf(&writer, "# HELP %s %s\n# TYPE %s gauge\n%s %lld\n",
+                      gauge_names[i], gauge_help[i], gauge_names[i],
+                      gauge_names[i], metrics_gauge_total((metric_gauge_t)i));
+    }
+    writer_printf(&writer, "# HELP chat_outbound_peak_queue_bytes Cola de salida mas profunda desde el arranque\n"
+                  "# TYPE chat_outbound_peak_queue_bytes gauge\nchat_outbound_peak_queue_bytes %zu\n",
+                  outbound_peak_queue_bytes());
+
+    /* Gauges de clientes y salas: dos lecturas bajo clients_mutex */
+    if (ctx) {
+        pthread_mutex_lock(&ctx->clients_mutex);
+        int clients = ctx->clients->count;
+        int rooms = ctx->rooms ? ctx->rooms->count : 0;
+        pthread_mutex_unlock(&ctx->clients_mutex);
+
+        writer_printf(&writer, "# HELP chat_clients_connected Clientes registrados\n"
+                      "# TYPE chat_clients_connected gauge\nchat_clients_connected %d\n", clients);
+        writer_printf(&writer, "# HELP chat_clients_max Limite de clientes\n"
+                      "# TYPE chat_clients_max gauge\nchat_clients_max %d\n", ctx->max_clients);
+        writer_printf(&writer, "# HELP chat_rooms Salas existentes\n"
+                      "# TYPE chat_rooms gauge\nchat_rooms %d\n", rooms);
+    }
+
+    /* Uso y marca máxima de cada pool de memoria */
+    pool_stats_t pools[POOL_MAX_POOLS];
+    int pool_count = pool_stats_all(pools, POOL_MAX_POOLS);
+    writer_printf(&writer, "# HELP chat_pool_objects_in_use Objetos entregados por cada pool\n"
+                  "# TYPE chat_pool_objects_in_use gauge\n");
+    for (int i = 0; i < pool_count; i++) {
+        writer_printf(&writer, "chat_pool_objects_in_use{pool=\"%s\"} %zu\n",
+                      pools[i].name, pools[i].in_use);
+    }
+    writer_printf(&writer, "# HELP chat_pool_objects_high_water Maximo de objetos entregados por cada pool\n"
+                  "# TYPE chat_pool_objects_high_water gauge\n");
+    for (int i = 0; i < pool_count; i++) {
+        writer_printf(&writer, "chat_pool_objects_high_water{pool=\"%s\"} %zu\n",
+                      pools[i].name, pools[i].high_water);
+    }
+    writer_printf(&writer, "# HELP chat_pool_slab_bytes Memoria reservada en slabs por cada pool\n"
+                  "# TYPE chat_pool_slab_bytes gauge\n");
+    for (int i = 0; i < pool_count; i++) {
+        writer_printf(&writer, "chat_pool_slab_bytes{pool=\"%s\"} %zu\n",
+                      pools[i].name, pools[i].slab_bytes);
+    }
+
+    return writer.used;
+}
+
+/**
+ * @brief Registra en el log un resumen de las métricas
+ */
+void metrics_log_summary(void)
+{
+    LOG_INFO("Métricas: %llu mensajes recibidos, %llu enviados, %llu broadcasts, %llu descartados, "
+             "%llu conexiones, %llu errores de accept, %llu rechazadas",
+             metrics_counter_total(METRIC_MESSAGES_IN), metrics_counter_total(METRIC_MESSAGES_OUT),
+             metrics_counter_total(METRIC_BROADCASTS), metrics_counter_total(METRIC_DROPPED_SENDS),
+             metrics_counter_total(METRIC_CONNECTIONS), metrics_counter_total(METRIC_ACCEPT_ERRORS),
+             metrics_counter_total(METRIC_ACCEPT_REJECTED));
+
+    for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+        metrics_histogram_t hist;
+        metrics_histogram_snapshot((metric_histogram_t)i, &hist);
+        if (hist.count == 0) continue;
+
+        LOG_INFO("Métricas: %s p50 %llu ns, p99 %llu ns, p99.9 %llu ns (%llu muestras)",
+                 histogram_names[i], metrics_percentile(&hist, 50.0),
+                 metrics_percentile(&hist, 99.0), metrics_percentile(&hist, 99.9), hist.count);
+    }
+}
+
+/* ========== PUERTO DE ADMINISTRACIÓN ========== */
+
+/**
+ * @brief Atiende una petición HTTP y cierra la conexión
+ */
+static void serve_admin_request(int fd)
+{
+    struct timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    /* Basta con la línea de petición; las cabeceras se ignoran */
+    char request[1024];
+    size_t used = 0;
+    while (used < sizeof(request) - 1) {
+        ssize_t received = recv(fd, request + used, sizeof(request) - 1 - used, 0);
+        if (received <= 0) break;
+        used += (size_t)received;
+        request[used] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+    }
+    request[used] = '\0';
+
+    char header[256];
+    int is_metrics = strncmp(request, "GET /metrics", 12) == 0 &&
+                     (request[12] == ' ' || request[12] == '?' || request[12] == '\r');
+
+    if (!is_metrics) {
+        static const char not_found[] = "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n"
+                                        "Content-Length: 10\r\nConnection: close\r\n\r\nnot found\n";
+        send_all(fd, not_found, sizeof(not_found) - 1);
+        return;
+    }
+
+    size_t size = METRICS_RESPONSE_SIZE;
+    char *body = malloc(size);
+    size_t length = body ? metrics_render(admin_ctx, body, size) : 0;
+    if (body && length >= size) {
+        size = length + 1;
+        char *larger = realloc(body, size);
+        if (larger) {
+            body = larger;
+            length = metrics_render(admin_ctx, body, size);
+        }
+        if (length >= size) {
+            length = size - 1;
+        }
+    }
+
+    if (!body) {
+        LOG_ERROR("Error asignando memoria para la respuesta de métricas");
+        return;
+    }
+
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                 "Content-Length: %zu\r\nConnection: close\r\n\r\n", length);
+    if (send_all(fd, header, (size_t)header_length) == header_length) {
+        send_all(fd, body, length);
+    }
+    free(body);
+}
+
+/**
+ * @brief Thread del puerto de administración
+ */
+static void *admin_server_thread(void *arg)
+{
+    (void)arg;
+
+    while (!__atomic_load_n(&admin_stop, __ATOMIC_ACQUIRE)) {
+        struct pollfd pfd = { admin_socket, POLLIN, 0 };
+        int ready = poll(&pfd, 1, METRICS_POLL_MS);
+        if (ready <= 0) {
+            if (ready < 0 && errno != EINTR) {
+                LOG_ERROR("Error en poll del puerto de métricas: %s", strerror(errno));
+                break;
+            }
+            continue;
+        }
+
+        int fd = accept4(admin_socket, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+                LOG_ERROR("Error en accept del puerto de métricas: %s", strerror(errno));
+            }
+            continue;
+        }
+
+        serve_admin_request(fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Arranca el puerto de administración con el endpoint /metrics
+ */
+int metrics_server_start(server_context_t *ctx, const char *address, int port)
+{
+    if (!ctx || admin_running) return ERROR_SOCKET;
+
+    admin_socket = create_listen_socket(address, port, SOMAXCONN);
+    if (admin_socket < 0) {
+        return admin_socket;
+    }
+
+    admin_ctx = ctx;
+    admin_stop = 0;
+
+    /* Las señales deben llegar a los threads del servidor, no a este */
+    sigset_t all_signals, previous;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &previous);
+    int created = pthread_create(&admin_thread, NULL, admin_server_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (created != 0) {
+        LOG_ERROR("Error creando thread del puerto de métricas");
+        SAFE_CLOSE(admin_socket);
+        return ERROR_THREAD;
+    }
+
+    admin_running = 1;
+    LOG_INFO("Métricas disponibles en http://%s:%d/metrics", address, port);
+    return SUCCESS;
+}
+
+/**
+ * @brief Detiene el puerto de administración (si está arrancado)
+ */
+void metrics_server_stop(void)
+{
+    if (!admin_running) return;
+
+    __atomic_store_n(&admin_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(admin_thread, NULL);
+    SAFE_CLOSE(admin_socket);
+    admin_running = 0;
+    admin_ctx = NULL;
+}
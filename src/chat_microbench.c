@@ -0,0 +1,659 @@
+/**
+ * @file chat_microbench.c
+ * @brief Implementación de los microbenchmarks de las primitivas del chat
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cada prueba recibe el número de iteraciones y ejecuta la operación en
+ * un bucle cerrado; los resultados pasan por una variable volatile para
+ * que el compilador no elimine el trabajo. El fan-out llama a
+ * broadcast_to_room() del servidor (chat_fanout.c) con una tabla de
+ * clientes, una sala y un historial en memoria propios, sin motor de E/S:
+ * mide el mismo camino que un mensaje de chat en el motor epoll.
+ */
+
+#include "../include/chat_microbench.h"
+#include "../include/chat_client_table.h"
+#include "../include/chat_room.h"
+#include "../include/chat_history.h"
+
+/* Llamadas de asignación hechas desde el código enlazado (ver Makefile) */
+static unsigned long long allocation_count = 0;
+
+/* Destino de los resultados para que el bucle no se optimice */
+static volatile long long microbench_sink;
+
+/* ========== CONTADOR DE ASIGNACIONES ========== */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&allocation_count, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+/* ========== FUNCIONES AUXILIARES ========== */
+
+/**
+ * @brief Instante monotónico actual en nanosegundos
+ */
+static unsigned long long microbench_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+/**
+ * @brief Mensaje de chat de prueba con payload bytes de contenido
+ */
+static void build_test_message(chat_message_t *msg, int payload)
+{
+    char content[MESSAGE_SIZE];
+    static const char text[] = "hola a todos desde la sala general ";
+
+    if (payload >= MESSAGE_SIZE) {
+        payload = MESSAGE_SIZE - 1;
+    }
+    for (int i = 0; i < payload; i++) {
+        content[i] = text[i % (int)(sizeof(text) - 1)];
+    }
+    content[payload] = '\0';
+
+    init_message(msg, MSG_CHAT, "usuario_bench", content);
+    msg->timestamp = 1700000000;
+}
+
+/* ========== CALIBRACIÓN ========== */
+
+/**
+ * @brief Trabajo fijo ajeno al chat con el que se normalizan las demás pruebas
+ *
+ * FNV-1a sobre un bloque de MICROBENCH_CALIBRATION_BYTES: cada byte
+ * depende del anterior, así que el compilador no puede vectorizarlo y el
+ * coste sigue a la velocidad de la CPU.
+ */
+static unsigned long long bench_calibration(void *arg, unsigned long long iterations)
+{
+    const unsigned char *block = arg;
+    unsigned int hash = 2166136261u;
+
+    for (unsigned long long i = 0; i < iterations; i++) {
+        for (int b = 0; b < MICROBENCH_CALIBRATION_BYTES; b++) {
+            hash = (hash ^ block[b]) * 16777619u;
+        }
+    }
+
+    microbench_sink = hash;
+    return 0;
+}
+
+/* ========== PRUEBAS DE CODIFICACIÓN Y VALIDACIÓN ========== */
+
+/**
+ * @brief Codificación de un frame en un formato de red
+ */
+typedef struct {
+    chat_message_t message;                 /* Mensaje a codificar */
+    wire_format_t format;                   /* Formato de red */
+    char frame[BUFFER_SIZE];                /* Frame ya codificado (para deserializar) */
+    size_t length;                          /* Bytes de frame */
+} codec_case_t;
+
+static unsigned long long bench_serialize(void *arg, unsigned long long iterations)
+{
+    codec_case_t *codec = arg;
+    char buffer[BUFFER_SIZE];
+    long long total = 0;
+
+    for (unsigned long long i = 0; i < iterations; i++) {
+        ssize_t length = codec->format == WIRE_FORMAT_LEGACY
+            ? serialize_message(&codec->message, buffer, sizeof(buffer))
+            : serialize_message_as(&codec->message, codec->format, buffer, sizeof(buffer));
+        total += length;
+    }
+
+    microbench_sink = total;
+    return 0;
+}
+
+static unsigned long long bench_deserialize(void *arg, unsigned long long iterations)
+{
+    codec_case_t *codec = arg;
+    chat_message_t msg;
+    long long total = 0;
+
+    for (unsigned long long i = 0; i < iterations; i++) {
+        total += deserialize_message(codec->frame, codec->length, &msg);
+        total += (long long)msg.length;
+    }
+
+    microbench_sink = total;
+    return 0;
+}
+
+static unsigned long long bench_init_message(void *arg, unsigned long long iterations)
+{
+    const chat_message_t *source = arg;
+    chat_message_t msg;
+    long long total = 0;
+
+    for (unsigned long long i = 0; i < iterations; i++) {
+        init_message(&msg, MSG_CHAT, source->username, source->content);
+        total += (long long)msg.length;
+    }
+
+    microbench_sink = total;
+    return 0;
+}
+
+static unsigned long long bench_validate_username(void *arg, unsigned long long iterations)
+{
+    const char *username = arg;
+    long long total = 0;
+
+    for (unsigned long long i = 0; i < iterations; i++) {
+        total += validate_username(username);
+    }
+
+    microbench_sink = total;
+    return 0;
+}
+
+/* ========== PRUEBAS DEL FAN-OUT ========== */
+
+static unsigned long long bench_shared_frame(void *arg, unsigned long long iterations)
+{
+    const chat_message_t *msg = arg;
+    long long total = 0;
+
+    for (unsigned long long i = 0; i < iterations; i++) {
+        shared_frame_t *frame = shared_frame_create(msg);
+        if (frame) {
+            total++;
+            shared_frame_release(frame);
+        }
+    }
+
+    microbench_sink = total;
+    return 0;
+}
+
+/**
+ * @brief Lee todo lo pendiente en el extremo de cada destinatario
+ * @return Nanosegundos empleados (no cuentan en la medida)
+ */
+static unsigned long long drain_receivers(microbench_fanout_t *fanout)
+{
+    unsigned long long started = microbench_now_ns();
+    char buffer[65536];
+
+    for (int i = 0; i <= fanout->count; i++) {
+        while (recv(fanout->receivers[i], buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+        }
+    }
+
+    return microbench_now_ns() - started;
+}
+
+static unsigned long long bench_fanout(void *arg, unsigned long long iterations)
+{
+    microbench_fanout_t *fanout = arg;
+    const client_info_t *sender = fanout->clients[0];
+    unsigned long long excluded = 0;
+    long long delivered = 0;
+
+    for (unsigned long long i = 0; i < iterations; i++) {
+        delivered += broadcast_to_room(&fanout->ctx, sender, &fanout->message, sender->socket_fd);
+
+        if ((i + 1) % MICROBENCH_DRAIN_EVERY == 0 || i + 1 == iterations) {
+            excluded += drain_receivers(fanout);
+        }
+    }
+
+    microbench_sink = delivered;
+    return excluded;
+}
+
+/**
+ * @brief Crea el contexto del servidor con el remitente y los destinatarios en una sala
+ *
+ * Cada cliente tiene un socketpair y su cola de salida, como los que crea
+ * add_client(); el historial es solo de memoria, con la profundidad por
+ * defecto del servidor.
+ *
+ * @return 0 en éxito, -1 en error
+ */
+static int fanout_init(microbench_fanout_t *fanout, int recipients, int payload)
+{
+    memset(fanout, 0, sizeof(*fanout));
+    build_test_message(&fanout->message, payload);
+
+    server_context_t *ctx = &fanout->ctx;
+    pthread_mutex_init(&ctx->clients_mutex, NULL);
+    ctx->clients = client_table_create();
+    ctx->rooms = room_table_create();
+    ctx->history = history_create(HISTORY_DEFAULT_DEPTH, NULL);
+    ctx->max_clients = recipients + 1;
+    ctx->server_socket = -1;
+    ctx->running = 1;
+
+    /* El remitente (índice 0) está en la sala pero se excluye del reparto */
+    fanout->receivers = calloc((size_t)recipients + 1, sizeof(*fanout->receivers));
+    fanout->clients = calloc((size_t)recipients + 1, sizeof(*fanout->clients));
+    if (!ctx->clients || !ctx->rooms || !ctx->history || !fanout->receivers || !fanout->clients) {
+        fprintf(stderr, "Sin memoria para %d destinatarios\n", recipients);
+        return -1;
+    }
+
+    for (int i = 0; i <= recipients; i++) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+            fprintf(stderr, "Error creando el socketpair %d: %s\n", i, strerror(errno));
+            return -1;
+        }
+
+        client_info_t *client = calloc(1, sizeof(client_info_t));
+        outbound_queue_t *outbound = outbound_queue_create(pair[0], WIRE_FORMAT_COMPACT, NULL);
+        if (!client || !outbound) {
+            outbound_queue_release(outbound);
+            free(client);
+            close(pair[0]);
+            close(pair[1]);
+            fprintf(stderr, "Error creando el cliente %d\n", i);
+            return -1;
+        }
+        client->socket_fd = pair[0];
+        client->active = 1;
+        client->outbound = outbound;
+        client->active_index = -1;
+        client->room_index = -1;
+        snprintf(client->username, sizeof(client->username), "bench_%d", i);
+
+        fanout->clients[i] = client;
+        fanout->receivers[i] = pair[1];
+        fanout->count = i;
+        if (client_table_insert(ctx->clients, client) != SUCCESS ||
+            room_table_join(ctx->rooms, client, ROOM_DEFAULT_NAME) != SUCCESS) {
+            fprintf(stderr, "Error registrando el cliente %d\n", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Cierra los clientes, sus colas y sus sockets y libera el contexto
+ */
+static void fanout_destroy(microbench_fanout_t *fanout)
+{
+    server_context_t *ctx = &fanout->ctx;
+
+    for (int i = 0; fanout->clients && i <= fanout->count; i++) {
+        client_info_t *client = fanout->clients[i];
+        if (!client) continue;
+        if (ctx->rooms) room_table_leave(ctx->rooms, client);
+        if (ctx->clients) client_table_remove(ctx->clients, client);
+        outbound_queue_close(client->outbound);
+        outbound_queue_release(client->outbound);
+        SAFE_CLOSE(client->socket_fd);
+        SAFE_CLOSE(fanout->receivers[i]);
+        free(client);
+    }
+    client_table_destroy(ctx->clients);
+    room_table_destroy(ctx->rooms);
+    history_destroy(ctx->history);
+    pthread_mutex_destroy(&ctx->clients_mutex);
+    free(fanout->clients);
+    free(fanout->receivers);
+    fanout->clients = NULL;
+    fanout->receivers = NULL;
+    fanout->count = 0;
+}
+
+/* ========== MEDICIÓN ========== */
+
+/**
+ * @brief Ejecuta una prueba y mide su tiempo neto y sus asignaciones
+ * @return Nanosegundos netos
+ */
+static unsigned long long measure_case(const microbench_case_t *test, unsigned long long iterations,
+                                       unsigned long long *allocations)
+{
+    unsigned long long allocated = __atomic_load_n(&allocation_count, __ATOMIC_RELAXED);
+    unsigned long long started = microbench_now_ns();
+    unsigned long long excluded = test->run(test->arg, iterations);
+    unsigned long long elapsed = microbench_now_ns() - started;
+
+    *allocations = __atomic_load_n(&allocation_count, __ATOMIC_RELAXED) - allocated;
+    return elapsed > excluded ? elapsed - excluded : 1;
+}
+
+/**
+ * @brief Calibra las iteraciones para time_ms y se queda con la repetición más rápida
+ */
+static void run_case(const microbench_case_t *test, int time_ms, int repeat,
+                     microbench_result_t *result)
+{
+    unsigned long long target = (unsigned long long)time_ms * 1000000ULL;
+    unsigned long long iterations = 1;
+    unsigned long long allocations = 0;
+
+    /* Crecer hasta que una pasada dure al menos una décima del objetivo */
+    for (;;) {
+        unsigned long long elapsed = measure_case(test, iterations, &allocations);
+        if (elapsed >= target / 10 || iterations >= 1000000000ULL) {
+            iterations = (unsigned long long)((double)iterations * (double)target / (double)elapsed);
+            break;
+        }
+        iterations = elapsed > 0 && target / 5 / elapsed < 100 ? iterations * (target / 5 / elapsed + 1)
+                                                               : iterations * 100;
+    }
+    if (iterations == 0) {
+        iterations = 1;
+    }
+
+    memcpy(result->name, test->name, sizeof(result->name));
+    result->iterations = iterations;
+    result->ns_per_op = 0.0;
+
+    for (int r = 0; r < repeat; r++) {
+        unsigned long long elapsed = measure_case(test, iterations, &allocations);
+        double ns_per_op = (double)elapsed / (double)iterations;
+        if (r == 0 || ns_per_op < result->ns_per_op) {
+            result->ns_per_op = ns_per_op;
+            result->allocs_per_op = (double)allocations / (double)iterations;
+        }
+    }
+}
+
+/* ========== REFERENCIA ========== */
+
+/**
+ * @brief Guarda los tiempos relativos y las asignaciones como referencia
+ *
+ * No se guardan nanosegundos: dependen de la máquina, mientras que el
+ * cociente con la calibración se mantiene entre máquinas parecidas.
+ *
+ * @return 0 en éxito, -1 si no se pudo escribir
+ */
+static int save_baseline(const char *path, const microbench_result_t *results, int count)
+{
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "No se pudo crear la referencia %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    fprintf(file, "# Referencia de chat_microbench: ns/op de cada prueba dividido por el de %s\n",
+            MICROBENCH_CALIBRATION_NAME);
+    fprintf(file, "# prueba\trelativo\tasignaciones/op\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "%s\t%.4f\t%.2f\n", results[i].name, results[i].relative,
+                results[i].allocs_per_op);
+    }
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error escribiendo la referencia %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Lee una referencia guardada con --save-baseline
+ * @return Resultados leídos o -1 si no se pudo abrir
+ */
+static int load_baseline(const char *path, microbench_result_t *baseline, int max)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "No se pudo abrir la referencia %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char line[256];
+    int count = 0;
+    while (count < max && fgets(line, sizeof(line), file)) {
+        microbench_result_t *entry = &baseline[count];
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (sscanf(line, "%63s %lf %lf", entry->name, &entry->relative,
+                   &entry->allocs_per_op) == 3) {
+            count++;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+/**
+ * @brief Compara los tiempos relativos y las asignaciones con la referencia
+ * @return Número de pruebas que empeoraron
+ */
+static int compare_baseline(const microbench_result_t *results, int count,
+                            const microbench_result_t *baseline, int baseline_count,
+                            int tolerance)
+{
+    int regressions = 0;
+
+    fprintf(stderr, "\n=== COMPARACIÓN CON LA REFERENCIA (tolerancia %d%%) ===\n", tolerance);
+    for (int i = 0; i < count; i++) {
+        const microbench_result_t *base = NULL;
+        for (int b = 0; b < baseline_count; b++) {
+            if (strcmp(baseline[b].name, results[i].name) == 0) {
+                base = &baseline[b];
+                break;
+            }
+        }
+        if (!base) {
+            fprintf(stderr, "%-24s sin referencia\n", results[i].name);
+            continue;
+        }
+
+        double change = base->relative > 0 ? (results[i].relative / base->relative - 1.0) * 100.0 : 0.0;
+        int slower = change > (double)tolerance;
+        int allocates_more = results[i].allocs_per_op > base->allocs_per_op + 0.01;
+        fprintf(stderr, "%-24s %10.3f relativo (ref. %.3f, %+6.1f%%)  %6.2f asig/op (ref. %.2f)%s\n",
+                results[i].name, results[i].relative, base->relative, change,
+                results[i].allocs_per_op, base->allocs_per_op,
+                slower || allocates_more ? "  <-- EMPEORA" : "");
+        if (slower || allocates_more) {
+            regressions++;
+        }
+    }
+
+    return regressions;
+}
+
+/* ========== PROGRAMA PRINCIPAL ========== */
+
+/**
+ * @brief Muestra el uso de los microbenchmarks
+ */
+static void print_microbench_usage(const char *program)
+{
+    fprintf(stderr, "Uso: %s [--time-ms=MS] [--repeat=N] [--recipients=N] [--size=BYTES] "
+            "[--filter=TEXTO] [--baseline=FICHERO] [--tolerance=PCT] [--save-baseline=FICHERO]\n",
+            program);
+    fprintf(stderr, "  --time-ms     Duración de cada repetición (por defecto %d)\n",
+            MICROBENCH_DEFAULT_TIME_MS);
+    fprintf(stderr, "  --repeat      Repeticiones por prueba; se informa la más rápida (por defecto %d)\n",
+            MICROBENCH_DEFAULT_REPEAT);
+    fprintf(stderr, "  --recipients  Destinatarios del fan-out, hasta %d (por defecto %d)\n",
+            MICROBENCH_MAX_RECIPIENTS, MICROBENCH_DEFAULT_RECIPIENTS);
+    fprintf(stderr, "  --size        Bytes de contenido del mensaje (por defecto %d)\n",
+            MICROBENCH_DEFAULT_PAYLOAD);
+    fprintf(stderr, "  --filter      Solo las pruebas cuyo nombre contiene TEXTO\n");
+    fprintf(stderr, "  --baseline    Comparar con una referencia y fallar si algo empeora\n");
+    fprintf(stderr, "  --tolerance   %% de tiempo relativo tolerado sobre la referencia (por defecto %d)\n",
+            MICROBENCH_DEFAULT_TOLERANCE);
+    fprintf(stderr, "  --save-baseline Guardar los tiempos relativos de esta ejecución como referencia\n");
+    fprintf(stderr, "Tiempo relativo: ns/op de la prueba dividido por el de %s, que no depende del "
+            "código del chat\n", MICROBENCH_CALIBRATION_NAME);
+}
+
+/**
+ * @brief Interpreta un entero positivo de una opción --nombre=valor
+ * @return 0 si es válido, -1 si no
+ */
+static int parse_positive(const char *arg, size_t prefix_length, int *value)
+{
+    char *end = NULL;
+    long parsed = strtol(arg + prefix_length, &end, 10);
+    if (!end || *end != '\0' || parsed < 1 || parsed > 1000000L) {
+        fprintf(stderr, "Valor inválido: %s\n", arg);
+        return -1;
+    }
+    *value = (int)parsed;
+    return 0;
+}
+
+/**
+ * @brief Función main de los microbenchmarks
+ */
+int main(int argc, char *argv[])
+{
+    int time_ms = MICROBENCH_DEFAULT_TIME_MS;
+    int repeat = MICROBENCH_DEFAULT_REPEAT;
+    int recipients = MICROBENCH_DEFAULT_RECIPIENTS;
+    int payload = MICROBENCH_DEFAULT_PAYLOAD;
+    int tolerance = MICROBENCH_DEFAULT_TOLERANCE;
+    const char *filter = NULL;
+    const char *baseline_path = NULL;
+    const char *save_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        int ok = 0;
+        if (strncmp(argv[i], "--time-ms=", 10) == 0) {
+            ok = parse_positive(argv[i], 10, &time_ms);
+        } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            ok = parse_positive(argv[i], 9, &repeat);
+        } else if (strncmp(argv[i], "--recipients=", 13) == 0) {
+            ok = parse_positive(argv[i], 13, &recipients);
+            if (ok == 0 && recipients > MICROBENCH_MAX_RECIPIENTS) ok = -1;
+        } else if (strncmp(argv[i], "--size=", 7) == 0) {
+            ok = parse_positive(argv[i], 7, &payload);
+            if (ok == 0 && payload >= MESSAGE_SIZE) ok = -1;
+        } else if (strncmp(argv[i], "--tolerance=", 12) == 0) {
+            ok = parse_positive(argv[i], 12, &tolerance);
+        } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+            baseline_path = argv[i] + 11;
+        } else if (strncmp(argv[i], "--save-baseline=", 16) == 0) {
+            save_path = argv[i] + 16;
+        } else {
+            ok = -1;
+        }
+
+        if (ok < 0) {
+            print_microbench_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    log_set_level(LOG_LEVEL_ERROR);
+
+    static codec_case_t legacy, compact;
+    chat_message_t message;
+    build_test_message(&message, payload);
+
+    legacy.message = message;
+    legacy.format = WIRE_FORMAT_LEGACY;
+    compact.message = message;
+    compact.format = WIRE_FORMAT_COMPACT;
+    ssize_t legacy_length = serialize_message(&message, legacy.frame, sizeof(legacy.frame));
+    ssize_t compact_length = serialize_message_as(&message, WIRE_FORMAT_COMPACT,
+                                                  compact.frame, sizeof(compact.frame));
+    if (legacy_length < 0 || compact_length < 0) {
+        fprintf(stderr, "No se pudo codificar el mensaje de prueba\n");
+        return EXIT_FAILURE;
+    }
+    legacy.length = (size_t)legacy_length;
+    compact.length = (size_t)compact_length;
+
+    microbench_fanout_t fanout;
+    if (fanout_init(&fanout, recipients, payload) < 0) {
+        fanout_destroy(&fanout);
+        return EXIT_FAILURE;
+    }
+
+    static char valid_username[] = "usuario_42";
+    static unsigned char calibration_block[MICROBENCH_CALIBRATION_BYTES];
+    for (int i = 0; i < MICROBENCH_CALIBRATION_BYTES; i++) {
+        calibration_block[i] = (unsigned char)(i * 31 + 7);
+    }
+
+    /* La calibración va primero y se ejecuta siempre, también con --filter */
+    microbench_case_t cases[] = {
+        { MICROBENCH_CALIBRATION_NAME, bench_calibration, calibration_block },
+        { "init_message", bench_init_message, &message },
+        { "validate_username", bench_validate_username, valid_username },
+        { "serialize_legacy", bench_serialize, &legacy },
+        { "serialize_compact", bench_serialize, &compact },
+        { "deserialize_legacy", bench_deserialize, &legacy },
+        { "deserialize_compact", bench_deserialize, &compact },
+        { "shared_frame_create", bench_shared_frame, &message },
+        { "", bench_fanout, &fanout },
+    };
+    int case_count = (int)(sizeof(cases) / sizeof(cases[0]));
+    snprintf(cases[case_count - 1].name, sizeof(cases[case_count - 1].name),
+             "broadcast_%d", recipients);
+
+    microbench_result_t results[MICROBENCH_MAX_RESULTS];
+    int result_count = 0;
+
+    printf("# prueba\titeraciones\tns/op\trelativo\tasignaciones/op\n");
+    fflush(stdout);
+    for (int i = 0; i < case_count; i++) {
+        if (i > 0 && filter && !strstr(cases[i].name, filter)) continue;
+        microbench_result_t *result = &results[result_count];
+        run_case(&cases[i], time_ms, repeat, result);
+        result->relative = result->ns_per_op / results[0].ns_per_op;
+        printf("%s\t%llu\t%.2f\t%.3f\t%.2f\n", result->name, result->iterations,
+               result->ns_per_op, result->relative, result->allocs_per_op);
+        fflush(stdout);
+        result_count++;
+    }
+
+    fanout_destroy(&fanout);
+
+    if (save_path && save_baseline(save_path, results, result_count) < 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (baseline_path) {
+        microbench_result_t baseline[MICROBENCH_MAX_RESULTS];
+        int baseline_count = load_baseline(baseline_path, baseline, MICROBENCH_MAX_RESULTS);
+        if (baseline_count < 0) {
+            return EXIT_FAILURE;
+        }
+        int regressions = compare_baseline(results, result_count, baseline, baseline_count,
+                                           tolerance);
+        if (regressions > 0) {
+            fprintf(stderr, "%d prueba(s) empeoran respecto a %s\n", regressions, baseline_path);
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr, "Sin regresiones respecto a %s\n", baseline_path);
+    }
+
+    return EXIT_SUCCESS;
+}
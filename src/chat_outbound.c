@@ -0,0 +1,1170 @@
+/**
+ * @file chat_outbound.c
+ * @brief Implementación de frames compartidos y colas de salida por cliente
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Cada cola tiene su propio mutex, que solo protege la lista de frames y
+ * la escritura no bloqueante sobre el socket; nunca se toma mientras se
+ * mantiene clients_mutex, de modo que un cliente lento no frena a los demás.
+ *
+ * Al desbordar la marca alta nunca se toca el primer frame si ya se envió
+ * una parte, ni los que están en un envío asíncrono en curso: el flujo de
+ * bytes del cliente debe seguir siendo válido.
+ *
+ * El agrupador de escrituras guarda las colas sucias en una lista
+ * enlazada a través de las propias colas (cada una retiene una
+ * referencia mientras está apuntada). El orden de locks es siempre cola
+ * y después agrupador.
+ */
+
+#include "../include/chat_outbound.h"
+#include "../include/chat_metrics.h"
+#include "../include/chat_trace.h"
+#include <sys/uio.h>
+#include <stdint.h>
+
+/* ========== POOLS ========== */
+
+/* Frames con un mensaje de chat normal y frames con codificaciones máximas */
+static chat_pool_t small_frame_pool = POOL_INITIALIZER("frames",
+    sizeof(shared_frame_t) + FRAME_SMALL_PAYLOAD, 256, POOL_CACHE_OBJECTS);
+static chat_pool_t large_frame_pool = POOL_INITIALIZER("frames_grandes",
+    sizeof(shared_frame_t) + WIRE_FORMAT_COUNT * (BUFFER_SIZE + WIRE_SEQUENCE_HEADER), 64,
+    POOL_CACHE_OBJECTS / 4);
+static chat_pool_t node_pool = POOL_INITIALIZER("nodos_salida",
+    sizeof(outbound_node_t), 1024, POOL_CACHE_OBJECTS * 4);
+static chat_pool_t queue_pool = POOL_INITIALIZER("colas_salida",
+    sizeof(outbound_queue_t), 64, POOL_CACHE_OBJECTS / 4);
+
+/* ========== AGRUPADOR DE ESCRITURAS ========== */
+
+/**
+ * @brief Estado del thread que vacía las colas una vez por ventana
+ */
+typedef struct {
+    pthread_mutex_t lock;                   /* Protege la lista y stop */
+    pthread_cond_t cond;                    /* Señala la primera cola sucia */
+    outbound_queue_t *dirty;                /* Colas pendientes de vaciar */
+    unsigned int window_us;                 /* Ventana de agrupación */
+    int running;                            /* Las colas difieren sus escrituras (atómico) */
+    int stop;                               /* Orden de terminar */
+    pthread_t thread;
+} outbound_flusher_t;
+
+static outbound_flusher_t flusher = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0, 0
+};
+
+static int flush_locked(outbound_queue_t *queue);
+
+/* Colas con el formato deflate: sin ninguna no se comprime (atómico) */
+static int deflate_queues = 0;
+
+/* Mayor profundidad alcanzada por una cola (atómico) */
+static size_t peak_queue_bytes = 0;
+
+/**
+ * @brief Lleva la cuenta de colas deflate al cambiar el formato de una
+ */
+static void track_wire_format(wire_format_t old_format, wire_format_t new_format)
+{
+    if (old_format == new_format) return;
+    if (new_format == WIRE_FORMAT_DEFLATE) {
+        __atomic_add_fetch(&deflate_queues, 1, __ATOMIC_RELAXED);
+    } else if (old_format == WIRE_FORMAT_DEFLATE) {
+        __atomic_sub_fetch(&deflate_queues, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* ========== FRAMES COMPARTIDOS ========== */
+
+/**
+ * @brief Serializa un mensaje en todos los formatos en un frame compartido
+ *
+ * La cabecera y las codificaciones se reservan en un único bloque del
+ * pool más pequeño en el que caben. La codificación deflate apunta a la
+ * compacta cuando no hay ninguna cola deflate o comprimir no compensa; un
+ * cliente que negocia deflate también acepta frames compactos, así que
+ * una cola que cambia de formato entre medias sigue recibiendo frames
+ * válidos.
+ *
+ * Los mensajes de chat reservan delante de las codificaciones compacta y
+ * deflate el hueco del envoltorio de secuencia, que se rellena con
+ * msg->sequence o después con shared_frame_set_sequence().
+ */
+shared_frame_t *shared_frame_create(const chat_message_t *msg)
+{
+    if (!msg) return NULL;
+
+    char buffers[WIRE_FORMAT_COUNT][BUFFER_SIZE];
+    size_t total_length = 0;
+    ssize_t length[WIRE_FORMAT_COUNT];
+
+    int deflate = __atomic_load_n(&deflate_queues, __ATOMIC_RELAXED) > 0;
+
+    for (int f = 0; f < WIRE_FORMAT_COUNT; f++) {
+        if (f == WIRE_FORMAT_DEFLATE && !deflate) {
+            length[f] = 0;
+            continue;
+        }
+        length[f] = serialize_message_as(msg, (wire_format_t)f, buffers[f], BUFFER_SIZE);
+        if (length[f] < 0) {
+            LOG_ERROR("Error al serializar mensaje para frame compartido");
+            return NULL;
+        }
+        total_length += (size_t)length[f];
+    }
+
+    /* Sin compresión la codificación deflate es la compacta */
+    if (deflate && (unsigned char)buffers[WIRE_FORMAT_DEFLATE][1] == WIRE_VERSION_DEFLATE) {
+        metrics_add(METRIC_DEFLATE_FRAMES, 1);
+        metrics_add(METRIC_DEFLATE_SAVED_BYTES,
+                    (unsigned long long)(length[WIRE_FORMAT_COMPACT] - length[WIRE_FORMAT_DEFLATE]));
+    } else {
+        total_length -= (size_t)length[WIRE_FORMAT_DEFLATE];
+        length[WIRE_FORMAT_DEFLATE] = 0;
+    }
+
+    size_t envelope[WIRE_FORMAT_COUNT] = { 0 };
+    if (msg->type == MSG_CHAT) {
+        for (int f = WIRE_FORMAT_COMPACT; f < WIRE_FORMAT_COUNT; f++) {
+            envelope[f] = length[f] > 0 ? WIRE_SEQUENCE_HEADER : 0;
+            total_length += envelope[f];
+        }
+    }
+
+    chat_pool_t *pool = total_length <= FRAME_SMALL_PAYLOAD ? &small_frame_pool : &large_frame_pool;
+    shared_frame_t *frame = pool_alloc(pool);
+    if (!frame) {
+        LOG_ERROR("Error asignando memoria para frame compartido");
+        return NULL;
+    }
+
+    frame->refcount = 1;
+    frame->pool = pool;
+    frame->type = msg->type;
+    frame->sequence = 0;
+
+    char *cursor = (char*)(frame + 1);
+    for (int f = 0; f < WIRE_FORMAT_COUNT; f++) {
+        cursor += envelope[f];
+        frame->data[f] = cursor;
+        frame->length[f] = (size_t)length[f];
+        memcpy(cursor, buffers[f], (size_t)length[f]);
+        cursor += length[f];
+    }
+
+    if (length[WIRE_FORMAT_DEFLATE] == 0) {
+        frame->data[WIRE_FORMAT_DEFLATE] = frame->data[WIRE_FORMAT_COMPACT];
+        frame->length[WIRE_FORMAT_DEFLATE] = frame->length[WIRE_FORMAT_COMPACT];
+    }
+
+    if (msg->type == MSG_CHAT) {
+        shared_frame_set_sequence(frame, msg->sequence);
+    }
+
+    return frame;
+}
+
+/**
+ * @brief Asigna el número de secuencia de un mensaje de chat
+ *
+ * Solo reescribe las cabeceras del envoltorio; el frame aún no debe ser
+ * visible para otros threads.
+ */
+void shared_frame_set_sequence(shared_frame_t *frame, unsigned long long sequence)
+{
+    frame->sequence = sequence;
+    wire_put_sequence_header(frame->data[WIRE_FORMAT_COMPACT] - WIRE_SEQUENCE_HEADER, sequence);
+    if (frame->data[WIRE_FORMAT_DEFLATE] != frame->data[WIRE_FORMAT_COMPACT]) {
+        wire_put_sequence_header(frame->data[WIRE_FORMAT_DEFLATE] - WIRE_SEQUENCE_HEADER, sequence);
+    }
+}
+
+/**
+ * @brief Codificación de un frame en un formato, con o sin envoltorio
+ */
+const char *shared_frame_encoding(const shared_frame_t *frame, wire_format_t format,
+                                  int sequenced, size_t *length)
+{
+    if (sequenced && frame->sequence && format != WIRE_FORMAT_LEGACY) {
+        *length = frame->length[format] + WIRE_SEQUENCE_HEADER;
+        return frame->data[format] - WIRE_SEQUENCE_HEADER;
+    }
+
+    *length = frame->length[format];
+    return frame->data[format];
+}
+
+/**
+ * @brief Toma una referencia adicional sobre un frame
+ */
+void shared_frame_retain(shared_frame_t *frame)
+{
+    __atomic_add_fetch(&frame->refcount, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Suelta una referencia y libera el frame si era la última
+ */
+void shared_frame_release(shared_frame_t *frame)
+{
+    if (frame && __atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (frame->pool) {
+            pool_free(frame->pool, frame);
+        } else {
+            free(frame);
+        }
+    }
+}
+
+/* ========== LÍMITES Y POLÍTICAS ========== */
+
+/* Nombres de las políticas, indexados por overflow_policy_t */
+static const char *const overflow_policy_names[] = { "drop", "coalesce", "disconnect" };
+
+#define OVERFLOW_POLICY_COUNT (sizeof(overflow_policy_names) / sizeof(overflow_policy_names[0]))
+
+/**
+ * @brief Inicializa unos límites con los valores por defecto
+ */
+void outbound_limits_init(outbound_limits_t *limits)
+{
+    outbound_limits_set_high(limits, OUTBOUND_HIGH_WATERMARK);
+    limits->policy = DEFAULT_OVERFLOW_POLICY;
+}
+
+/**
+ * @brief Fija la marca alta y deriva la marca baja
+ */
+void outbound_limits_set_high(outbound_limits_t *limits, size_t high_watermark)
+{
+    limits->high_watermark = high_watermark;
+    limits->low_watermark = high_watermark / OUTBOUND_LOW_DIVISOR;
+}
+
+/**
+ * @brief Interpreta el nombre de una política de desborde
+ */
+int parse_overflow_policy(const char *name, overflow_policy_t *policy)
+{
+    if (!name || !policy) return -1;
+
+    for (size_t i = 0; i < OVERFLOW_POLICY_COUNT; i++) {
+        if (strcmp(name, overflow_policy_names[i]) == 0) {
+            *policy = (overflow_policy_t)i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Nombre de una política de desborde
+ */
+const char *overflow_policy_name(overflow_policy_t policy)
+{
+    if ((size_t)policy >= OVERFLOW_POLICY_COUNT) return "desconocida";
+    return overflow_policy_names[policy];
+}
+
+/* ========== COLAS DE SALIDA ========== */
+
+/**
+ * @brief Crea la cola de salida de un cliente
+ */
+outbound_queue_t *outbound_queue_create(int socket_fd, wire_format_t format,
+                                        const outbound_limits_t *limits)
+{
+    outbound_queue_t *queue = pool_calloc(&queue_pool);
+    if (!queue) {
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&queue->lock, NULL) != 0) {
+        pool_free(&queue_pool, queue);
+        return NULL;
+    }
+
+    queue->refcount = 1;
+    queue->socket_fd = socket_fd;
+    queue->wire_format = format;
+    track_wire_format(WIRE_FORMAT_LEGACY, format);
+    queue->wake_fd = -1;
+    if (limits) {
+        queue->limits = *limits;
+    } else {
+        outbound_limits_init(&queue->limits);
+    }
+    return queue;
+}
+
+/**
+ * @brief Toma una referencia adicional sobre una cola
+ */
+void outbound_queue_retain(outbound_queue_t *queue)
+{
+    __atomic_add_fetch(&queue->refcount, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Descarta todos los frames pendientes (con el lock tomado)
+ */
+static void discard_pending_locked(outbound_queue_t *queue)
+{
+    metrics_gauge_add(METRIC_QUEUED_BYTES, -(long long)queue->queued_bytes);
+    metrics_gauge_add(METRIC_QUEUED_FRAMES, -(long long)queue->queued_frames);
+    if (queue->congested) {
+        /* Una cola vacía (cerrada o liberada) deja de contar como congestionada */
+        queue->congested = 0;
+        metrics_gauge_add(METRIC_CONGESTED_QUEUES, -1);
+    }
+
+    outbound_node_t *node = queue->head;
+    while (node) {
+        outbound_node_t *next = node->next;
+        shared_frame_release(node->frame);
+        pool_free(&node_pool, node);
+        node = next;
+    }
+
+    queue->head = queue->tail = NULL;
+    queue->head_offset = 0;
+    queue->queued_frames = 0;
+    queue->queued_bytes = 0;
+    queue->write_pending = 0;
+}
+
+/**
+ * @brief Suelta una referencia y libera la cola si era la última
+ */
+void outbound_queue_release(outbound_queue_t *queue)
+{
+    if (!queue || __atomic_sub_fetch(&queue->refcount, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+
+    discard_pending_locked(queue);
+    track_wire_format(queue->wire_format, WIRE_FORMAT_LEGACY);
+    pthread_mutex_destroy(&queue->lock);
+    pool_free(&queue_pool, queue);
+}
+
+/**
+ * @brief Cambia el formato de red usado para los próximos frames
+ */
+void outbound_queue_set_format(outbound_queue_t *queue, wire_format_t format)
+{
+    pthread_mutex_lock(&queue->lock);
+    track_wire_format(queue->wire_format, format);
+    queue->wire_format = format;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Activa el envoltorio de secuencia en los próximos mensajes de chat
+ */
+void outbound_queue_set_sequenced(outbound_queue_t *queue, int sequenced)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->sequenced = sequenced;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Registra el eventfd con el que despertar al dueño de la conexión
+ */
+void outbound_queue_set_wake_fd(outbound_queue_t *queue, int wake_fd)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->wake_fd = wake_fd;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Sale del estado de congestión al bajar de la marca baja
+ */
+static void update_congestion_locked(outbound_queue_t *queue)
+{
+    if (queue->congested && queue->queued_bytes <= queue->limits.low_watermark) {
+        queue->congested = 0;
+        metrics_gauge_add(METRIC_CONGESTED_QUEUES, -1);
+        LOG_INFO("Cola de salida del socket %d por debajo de la marca baja (%zu bytes)",
+                queue->socket_fd, queue->queued_bytes);
+    }
+}
+
+/**
+ * @brief Libera los frames que sendmsg() terminó de escribir
+ */
+static void consume_sent_locked(outbound_queue_t *queue, size_t sent)
+{
+    unsigned long completed = 0;
+    size_t written = sent;
+
+    queue->queued_bytes -= sent;
+    metrics_add(METRIC_BYTES_OUT, sent);
+    metrics_gauge_add(METRIC_QUEUED_BYTES, -(long long)sent);
+    update_congestion_locked(queue);
+
+    while (sent > 0 && queue->head) {
+        outbound_node_t *node = queue->head;
+        size_t remaining = node->length - queue->head_offset;
+
+        if (sent < remaining) {
+            queue->head_offset += sent;
+            break;
+        }
+
+        sent -= remaining;
+        queue->head = node->next;
+        if (!queue->head) {
+            queue->tail = NULL;
+        }
+        queue->head_offset = 0;
+        queue->queued_frames--;
+        completed++;
+
+        shared_frame_release(node->frame);
+        pool_free(&node_pool, node);
+    }
+
+    metrics_add(METRIC_MESSAGES_OUT, completed);
+    metrics_gauge_add(METRIC_QUEUED_FRAMES, -(long long)completed);
+    CHAT_TRACE3(sent, queue->socket_fd, written, completed);
+}
+
+/**
+ * @brief Escribe frames pendientes hasta vaciar la cola o llenar el socket
+ *
+ * Combina hasta OUTBOUND_IOV_MAX frames por syscall apuntando
+ * directamente a los datos compartidos, sin copiarlos.
+ *
+ * @return 0 en éxito (aunque queden datos), -1 si la conexión falló
+ */
+static int flush_locked(outbound_queue_t *queue)
+{
+    while (queue->head) {
+        struct iovec iov[OUTBOUND_IOV_MAX];
+        int count = 0;
+        size_t offset = queue->head_offset;
+
+        outbound_node_t *node = queue->head;
+        for (; node && count < OUTBOUND_IOV_MAX; node = node->next) {
+            iov[count].iov_base = (char*)node->data + offset;
+            iov[count].iov_len = node->length - offset;
+            offset = 0;
+            count++;
+        }
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = (size_t)count;
+
+        /* Lo ya encolado va entero en este sendmsg(); MSG_MORE solo cuando
+         * quedan frames fuera de iov y la siguiente vuelta los envía. En la
+         * última escritura retendría la cola del lote en el kernel (hasta
+         * 200 ms) sin nada que la complete */
+        int more_queued = node != NULL;
+        int flags = MSG_DONTWAIT | MSG_NOSIGNAL | (more_queued ? MSG_MORE : 0);
+
+        unsigned long long started = metrics_now_ns();
+        ssize_t sent = sendmsg(queue->socket_fd, &message, flags);
+        CHAT_TRACE4(sendmsg, queue->socket_fd, count, sent, started);
+        metrics_record_since(METRIC_SEND_LATENCY, started);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                /* Socket lleno: continuar cuando vuelva a ser escribible */
+                queue->write_pending = 1;
+                return 0;
+            }
+            LOG_ERROR("Error enviando datos al socket %d: %s",
+                     queue->socket_fd, strerror(errno));
+            /* Despertar al lector, que realiza la desconexión completa; el
+             * socket sigue siendo de este cliente porque la cola no se cerró */
+            shutdown(queue->socket_fd, SHUT_RDWR);
+            queue->closed = 1;
+            discard_pending_locked(queue);
+            return -1;
+        }
+
+        consume_sent_locked(queue, (size_t)sent);
+    }
+
+    queue->write_pending = 0;
+    return 0;
+}
+
+/**
+ * @brief Escribe lo pendiente y avisa al dueño si el socket se llenó
+ * @return 0 en éxito (aunque queden datos), -1 si la conexión falló
+ */
+static int flush_and_wake_locked(outbound_queue_t *queue)
+{
+    int flushed = flush_locked(queue);
+    if (flushed == 0 && queue->write_pending && queue->wake_fd >= 0) {
+        uint64_t one = 1;
+        if (write(queue->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_ERROR("Error despertando al dueño del socket %d: %s",
+                     queue->socket_fd, strerror(errno));
+        }
+    }
+    return flushed;
+}
+
+/**
+ * @brief Apunta la cola para el siguiente tick del agrupador
+ * @return 1 si quedó apuntada (o ya lo estaba), 0 si el agrupador no está activo
+ */
+static int schedule_flush_locked(outbound_queue_t *queue)
+{
+    if (queue->flush_scheduled) return 1;
+    if (!__atomic_load_n(&flusher.running, __ATOMIC_ACQUIRE)) return 0;
+
+    pthread_mutex_lock(&flusher.lock);
+    if (flusher.stop) {
+        pthread_mutex_unlock(&flusher.lock);
+        return 0;
+    }
+
+    outbound_queue_retain(queue);
+    queue->flush_scheduled = 1;
+    queue->flush_next = flusher.dirty;
+    if (!flusher.dirty) {
+        /* Primera cola de la ventana: arranca la cuenta del tick */
+        pthread_cond_signal(&flusher.cond);
+    }
+    flusher.dirty = queue;
+    pthread_mutex_unlock(&flusher.lock);
+    return 1;
+}
+
+/**
+ * @brief Añade un nodo al final de la cola (con el lock tomado)
+ */
+static void append_node_locked(outbound_queue_t *queue, outbound_node_t *node,
+                               shared_frame_t *frame)
+{
+    shared_frame_retain(frame);
+    node->next = NULL;
+    node->frame = frame;
+    node->data = shared_frame_encoding(frame, queue->wire_format, queue->sequenced, &node->length);
+    node->skipped = 0;
+    node->pinned = 0;
+
+    if (queue->tail) {
+        queue->tail->next = node;
+    } else {
+        queue->head = node;
+    }
+    queue->tail = node;
+    queue->queued_frames++;
+    queue->queued_bytes += node->length;
+    metrics_gauge_add(METRIC_QUEUED_BYTES, (long long)node->length);
+    metrics_gauge_add(METRIC_QUEUED_FRAMES, 1);
+
+    if (queue->queued_bytes > queue->peak_bytes) {
+        queue->peak_bytes = queue->queued_bytes;
+
+        size_t peak = __atomic_load_n(&peak_queue_bytes, __ATOMIC_RELAXED);
+        while (peak < queue->peak_bytes &&
+               !__atomic_compare_exchange_n(&peak_queue_bytes, &peak, queue->peak_bytes, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            /* peak ya contiene el máximo actual */
+        }
+    }
+}
+
+/**
+ * @brief Quita de la cola los frames sin enviar que cumplan un criterio
+ *
+ * El primer frame se conserva si ya se escribió una parte, y también los
+ * que forman parte de un envío asíncrono en curso o vienen de una cola
+ * restaurada, que pueden empezar a mitad de un frame. Con
+ * only_notifications se eliminan solo notificaciones y avisos, de la más
+ * antigua a la más reciente, hasta bajar de target_bytes.
+ *
+ * @return Número de mensajes eliminados (incluidos los que resumían avisos)
+ */
+static unsigned long evict_unsent_locked(outbound_queue_t *queue, int only_notifications,
+                                         size_t target_bytes)
+{
+    unsigned long evicted = 0;
+    unsigned long lost = 0;
+    size_t freed_bytes = 0;
+    long long freed_frames = 0;
+    outbound_node_t *prev = NULL;
+    outbound_node_t *node = queue->head;
+
+    int keep = queue->inflight;
+    if (keep == 0 && queue->head_offset > 0) {
+        keep = 1;
+    }
+    for (; node && keep > 0; keep--) {
+        prev = node;
+        node = node->next;
+    }
+
+    while (node && queue->queued_bytes > target_bytes) {
+        outbound_node_t *next = node->next;
+
+        if (node->pinned ||
+            (only_notifications && node->frame->type != MSG_NOTIFICATION)) {
+            prev = node;
+            node = next;
+            continue;
+        }
+
+        if (prev) {
+            prev->next = next;
+        } else {
+            queue->head = next;
+        }
+        if (queue->tail == node) {
+            queue->tail = prev;
+        }
+
+        queue->queued_frames--;
+        queue->queued_bytes -= node->length;
+        freed_frames++;
+        freed_bytes += node->length;
+        evicted += node->skipped ? node->skipped : 1;
+        /* Los mensajes que resume un aviso ya se contaron al agruparlos */
+        lost += node->skipped ? 0 : 1;
+
+        shared_frame_release(node->frame);
+        pool_free(&node_pool, node);
+        node = next;
+    }
+
+    metrics_add(METRIC_DROPPED_SENDS, lost);
+    metrics_gauge_add(METRIC_QUEUED_BYTES, -(long long)freed_bytes);
+    metrics_gauge_add(METRIC_QUEUED_FRAMES, -freed_frames);
+    return evicted;
+}
+
+/**
+ * @brief Sustituye todo lo pendiente por un único aviso de mensajes omitidos
+ * @return 0 en éxito, -1 si no hay memoria para el aviso
+ */
+static int coalesce_pending_locked(outbound_queue_t *queue)
+{
+    unsigned long skipped = evict_unsent_locked(queue, 0, 0);
+    if (skipped == 0) {
+        return 0;
+    }
+
+    queue->coalesced_frames += skipped;
+
+    char text[MESSAGE_SIZE];
+    snprintf(text, sizeof(text), "[Se omitieron %lu mensajes por congestión]", skipped);
+
+    chat_message_t notice;
+    init_message(&notice, MSG_NOTIFICATION, "Sistema", text);
+
+    shared_frame_t *frame = shared_frame_create(&notice);
+    outbound_node_t *node = pool_alloc(&node_pool);
+    if (!frame || !node) {
+        shared_frame_release(frame);
+        pool_free(&node_pool, node);
+        return -1;
+    }
+
+    append_node_locked(queue, node, frame);
+    node->skipped = skipped;
+    shared_frame_release(frame);
+    return 0;
+}
+
+/**
+ * @brief Aplica la política de desborde antes de encolar un frame
+ * @return 0 si el frame entra, 1 si se descarta, -1 si se desconecta al cliente
+ */
+static int apply_overflow_policy_locked(outbound_queue_t *queue, size_t incoming)
+{
+    if (!queue->congested) {
+        queue->congested = 1;
+        queue->overflows++;
+        metrics_gauge_add(METRIC_CONGESTED_QUEUES, 1);
+        LOG_INFO("Cola de salida del socket %d supera la marca alta (%zu bytes, política: %s)",
+                queue->socket_fd, queue->queued_bytes, overflow_policy_name(queue->limits.policy));
+    }
+
+    switch (queue->limits.policy) {
+        case OVERFLOW_DROP:
+            queue->dropped_frames += evict_unsent_locked(queue, 1, queue->limits.low_watermark);
+            if (queue->queued_bytes + incoming > queue->limits.high_watermark) {
+                queue->dropped_frames++;
+                metrics_add(METRIC_DROPPED_SENDS, 1);
+                return 1;
+            }
+            return 0;
+
+        case OVERFLOW_COALESCE:
+            if (coalesce_pending_locked(queue) < 0) {
+                queue->dropped_frames++;
+                metrics_add(METRIC_DROPPED_SENDS, 1);
+                return 1;
+            }
+            return 0;
+
+        case OVERFLOW_DISCONNECT:
+        default:
+            LOG_ERROR("Desconectando cliente lento en socket %d (%zu bytes pendientes)",
+                     queue->socket_fd, queue->queued_bytes);
+            shutdown(queue->socket_fd, SHUT_RDWR);
+            queue->closed = 1;
+            discard_pending_locked(queue);
+            return -1;
+    }
+}
+
+/**
+ * @brief Encola una referencia a un frame para el cliente
+ */
+int outbound_queue_push(outbound_queue_t *queue, shared_frame_t *frame)
+{
+    return outbound_queue_push_batch(queue, &frame, 1);
+}
+
+/**
+ * @brief Encola varios frames y los escribe con una sola pasada de sendmsg()
+ *
+ * Los nodos se reservan antes de tomar el lock, igual que en un push
+ * individual; la política de desborde se aplica a cada frame.
+ */
+int outbound_queue_push_batch(outbound_queue_t *queue, shared_frame_t **frames, int count)
+{
+    if (!queue || !frames || count <= 0) return -1;
+
+    outbound_node_t *spare = NULL;
+    for (int i = 0; i < count; i++) {
+        outbound_node_t *node = pool_alloc(&node_pool);
+        if (!node) {
+            LOG_ERROR("Error asignando memoria para la cola de salida");
+            while (spare) {
+                outbound_node_t *next = spare->next;
+                pool_free(&node_pool, spare);
+                spare = next;
+            }
+            return -1;
+        }
+        node->next = spare;
+        spare = node;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+
+    int result = 0;
+    for (int i = 0; i < count && !queue->closed; i++) {
+        size_t incoming;
+        shared_frame_encoding(frames[i], queue->wire_format, queue->sequenced, &incoming);
+        if (queue->queued_bytes + incoming > queue->limits.high_watermark) {
+            int verdict = apply_overflow_policy_locked(queue, incoming);
+            if (verdict != 0) {
+                result = verdict;
+                continue;
+            }
+        }
+
+        outbound_node_t *node = spare;
+        spare = node->next;
+        append_node_locked(queue, node, frames[i]);
+    }
+
+    CHAT_TRACE3(enqueue, queue->socket_fd, count, queue->queued_bytes);
+    if (queue->closed) {
+        result = -1;
+    } else if (!queue->write_pending && queue->submit) {
+        /* Modo asíncrono: el dueño de la conexión prepara el envío */
+        queue->write_pending = 1;
+        queue->submit(queue->submit_arg);
+    } else if (!queue->write_pending && !schedule_flush_locked(queue)) {
+        /* Con escrituras pendientes los frames esperan al aviso de escritura
+         * y con el agrupador activo, al siguiente tick */
+        int flushed = flush_and_wake_locked(queue);
+        if (flushed != 0) {
+            result = flushed;
+        }
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    while (spare) {
+        outbound_node_t *next = spare->next;
+        pool_free(&node_pool, spare);
+        spare = next;
+    }
+    return result;
+}
+
+/**
+ * @brief Escribe todo lo posible sin bloquear
+ */
+int outbound_queue_flush(outbound_queue_t *queue)
+{
+    if (!queue) return -1;
+
+    pthread_mutex_lock(&queue->lock);
+    int result = queue->closed ? -1 : (queue->submit ? 0 : flush_locked(queue));
+    pthread_mutex_unlock(&queue->lock);
+
+    return result;
+}
+
+/**
+ * @brief Pasa la cola a modo asíncrono (o la devuelve al síncrono con NULL)
+ */
+void outbound_queue_set_submit(outbound_queue_t *queue, outbound_submit_func_t submit, void *arg)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->submit = submit;
+    queue->submit_arg = arg;
+    /* Lo que el modo síncrono dejó esperando pasa también al dueño */
+    if (submit && !queue->closed && queue->head) {
+        queue->write_pending = 1;
+        submit(arg);
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Prepara un envío asíncrono con la cabeza de la cola
+ */
+int outbound_queue_prepare_send(outbound_queue_t *queue, struct iovec *iov,
+                                shared_frame_t **frames, int max)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+
+    int count = 0;
+    size_t offset = queue->head_offset;
+    for (outbound_node_t *node = queue->head; node && count < max; node = node->next) {
+        iov[count].iov_base = (char*)node->data + offset;
+        iov[count].iov_len = node->length - offset;
+        frames[count] = node->frame;
+        shared_frame_retain(node->frame);
+        offset = 0;
+        count++;
+    }
+
+    queue->inflight = count;
+    if (count == 0) {
+        queue->write_pending = 0;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+/**
+ * @brief Confirma un envío asíncrono preparado con outbound_queue_prepare_send()
+ */
+int outbound_queue_complete_send(outbound_queue_t *queue, ssize_t result)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    queue->inflight = 0;
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+
+    if (result < 0 && result != -EINTR && result != -EAGAIN) {
+        LOG_ERROR("Error enviando datos al socket %d: %s",
+                 queue->socket_fd, strerror((int)-result));
+        /* Igual que en el modo síncrono: el lector hace la desconexión */
+        shutdown(queue->socket_fd, SHUT_RDWR);
+        queue->closed = 1;
+        discard_pending_locked(queue);
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+
+    if (result > 0) {
+        consume_sent_locked(queue, (size_t)result);
+    }
+
+    int more = queue->head != NULL;
+    if (!more) {
+        queue->write_pending = 0;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return more;
+}
+
+/**
+ * @brief Indica si la cola espera a que el socket vuelva a ser escribible
+ */
+int outbound_queue_pending(outbound_queue_t *queue)
+{
+    if (!queue) return 0;
+
+    pthread_mutex_lock(&queue->lock);
+    int pending = queue->write_pending;
+    pthread_mutex_unlock(&queue->lock);
+
+    return pending;
+}
+
+/**
+ * @brief Obtiene las métricas de profundidad de una cola
+ */
+void outbound_queue_stats(outbound_queue_t *queue, outbound_stats_t *stats)
+{
+    if (!queue || !stats) return;
+
+    pthread_mutex_lock(&queue->lock);
+    stats->queued_frames = queue->queued_frames;
+    stats->queued_bytes = queue->queued_bytes;
+    stats->peak_bytes = queue->peak_bytes;
+    stats->dropped_frames = queue->dropped_frames;
+    stats->coalesced_frames = queue->coalesced_frames;
+    stats->overflows = queue->overflows;
+    stats->congested = queue->congested;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Máximo de bytes pendientes que ha alcanzado cualquier cola
+ */
+size_t outbound_peak_queue_bytes(void)
+{
+    return __atomic_load_n(&peak_queue_bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Cierra la cola y descarta los frames pendientes
+ */
+void outbound_queue_close(outbound_queue_t *queue)
+{
+    if (!queue) return;
+
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    queue->wake_fd = -1;
+    discard_pending_locked(queue);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Cierra la cola y copia los bytes que quedaban sin enviar
+ *
+ * La copia empieza en la parte no enviada del primer frame, así que
+ * puede comenzar a mitad de un frame.
+ */
+int outbound_queue_detach(outbound_queue_t *queue, char **data, size_t *length)
+{
+    *data = NULL;
+    *length = 0;
+    if (!queue) return 0;
+
+    pthread_mutex_lock(&queue->lock);
+
+    int result = 0;
+    size_t total = queue->queued_bytes;
+    if (total > 0) {
+        char *copy = malloc(total);
+        if (copy) {
+            size_t offset = 0;
+            size_t skip = queue->head_offset;
+            for (outbound_node_t *node = queue->head; node; node = node->next) {
+                memcpy(copy + offset, node->data + skip, node->length - skip);
+                offset += node->length - skip;
+                skip = 0;
+            }
+            *data = copy;
+            *length = offset;
+        } else {
+            LOG_ERROR("Error copiando la cola de salida del socket %d", queue->socket_fd);
+            result = -1;
+        }
+    }
+
+    queue->closed = 1;
+    queue->wake_fd = -1;
+    discard_pending_locked(queue);
+    pthread_mutex_unlock(&queue->lock);
+
+    return result;
+}
+
+/**
+ * @brief Encola bytes ya codificados en el formato de la cola
+ *
+ * Se guardan en un frame propio fuera de los pools (puede superar el
+ * tamaño de un frame grande) con la misma codificación en todos los
+ * formatos. El nodo queda fijado: como puede empezar a mitad de un
+ * frame, descartarlo o resumirlo en un aviso rompería el framing.
+ */
+int outbound_queue_restore(outbound_queue_t *queue, const char *data, size_t length)
+{
+    if (!queue || !data || length == 0) return 0;
+
+    shared_frame_t *frame = malloc(sizeof(shared_frame_t) + length);
+    outbound_node_t *node = pool_alloc(&node_pool);
+    if (!frame || !node) {
+        LOG_ERROR("Error asignando memoria para restaurar la cola de salida");
+        free(frame);
+        pool_free(&node_pool, node);
+        return -1;
+    }
+
+    frame->refcount = 1;
+    frame->pool = NULL;
+    frame->type = MSG_CHAT;
+    frame->sequence = 0;
+    memcpy(frame + 1, data, length);
+    for (int f = 0; f < WIRE_FORMAT_COUNT; f++) {
+        frame->data[f] = (char*)(frame + 1);
+        frame->length[f] = length;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    int result = queue->closed ? -1 : 0;
+    if (result == 0) {
+        append_node_locked(queue, node, frame);
+        node->pinned = 1;
+        node = NULL;
+        if (!queue->write_pending) {
+            result = flush_and_wake_locked(queue);
+        }
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    pool_free(&node_pool, node);
+    shared_frame_release(frame);
+    return result;
+}
+
+/* ========== THREAD DEL AGRUPADOR ========== */
+
+/**
+ * @brief Vacía una lista de colas sucias y suelta sus referencias
+ */
+static void flush_dirty_list(outbound_queue_t *queue)
+{
+    while (queue) {
+        outbound_queue_t *next = queue->flush_next;
+
+        pthread_mutex_lock(&queue->lock);
+        queue->flush_scheduled = 0;
+        queue->flush_next = NULL;
+        /* Si el socket se llenó, el aviso de escritura del motor sigue */
+        if (!queue->closed && !queue->write_pending) {
+            flush_and_wake_locked(queue);
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        outbound_queue_release(queue);
+        queue = next;
+    }
+}
+
+/**
+ * @brief Invierte la lista de colas sucias (se apuntan por la cabeza)
+ */
+static outbound_queue_t *reverse_dirty_list(outbound_queue_t *queue)
+{
+    outbound_queue_t *reversed = NULL;
+    while (queue) {
+        outbound_queue_t *next = queue->flush_next;
+        queue->flush_next = reversed;
+        reversed = queue;
+        queue = next;
+    }
+    return reversed;
+}
+
+/**
+ * @brief Bucle del agrupador: espera la primera cola sucia, deja pasar la
+ *        ventana y escribe todas las colas apuntadas mientras tanto
+ */
+static void *flusher_thread(void *arg)
+{
+    (void)arg;
+
+    struct timespec window;
+    window.tv_sec = flusher.window_us / 1000000;
+    window.tv_nsec = (long)(flusher.window_us % 1000000) * 1000;
+
+    pthread_mutex_lock(&flusher.lock);
+    while (!flusher.stop) {
+        if (!flusher.dirty) {
+            pthread_cond_wait(&flusher.cond, &flusher.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&flusher.lock);
+
+        nanosleep(&window, NULL);
+
+        pthread_mutex_lock(&flusher.lock);
+        outbound_queue_t *dirty = flusher.dirty;
+        flusher.dirty = NULL;
+        pthread_mutex_unlock(&flusher.lock);
+
+        /* En orden de llegada: los primeros en ensuciarse llevan más esperando */
+        flush_dirty_list(reverse_dirty_list(dirty));
+
+        pthread_mutex_lock(&flusher.lock);
+    }
+
+    outbound_queue_t *dirty = flusher.dirty;
+    flusher.dirty = NULL;
+    pthread_mutex_unlock(&flusher.lock);
+
+    flush_dirty_list(reverse_dirty_list(dirty));
+    return NULL;
+}
+
+/**
+ * @brief Arranca el agrupador de escrituras
+ */
+int outbound_flusher_start(unsigned int window_us)
+{
+    if (window_us == 0 || __atomic_load_n(&flusher.running, __ATOMIC_ACQUIRE)) return -1;
+
+    flusher.window_us = window_us;
+    flusher.stop = 0;
+
+    /* Igual que el volcador del log: las señales van a los demás threads */
+    sigset_t all_signals, previous;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &previous);
+    int created = pthread_create(&flusher.thread, NULL, flusher_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (created != 0) {
+        return -1;
+    }
+
+    __atomic_store_n(&flusher.running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Detiene el agrupador tras escribir las colas apuntadas
+ */
+void outbound_flusher_stop(void)
+{
+    if (!__atomic_load_n(&flusher.running, __ATOMIC_ACQUIRE)) return;
+
+    /* Las colas vuelven a escribir al encolar; el thread vacía lo apuntado */
+    __atomic_store_n(&flusher.running, 0, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&flusher.lock);
+    flusher.stop = 1;
+    pthread_cond_signal(&flusher.cond);
+    pthread_mutex_unlock(&flusher.lock);
+
+    pthread_join(flusher.thread, NULL);
+}
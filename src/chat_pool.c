@@ -0,0 +1,355 @@
+/**
+ * @file chat_pool.c
+ * @brief Implementación de los pools de objetos de tamaño fijo
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * La caché de cada thread es un array estático indexado por el id del
+ * pool. Cuando se vacía se rellena con la mitad de su capacidad tomando
+ * el lock del pool una sola vez, y cuando se llena devuelve la mitad; así
+ * un thread que solo reserva o solo libera (productor y consumidor de
+ * frames en threads distintos) paga el lock una vez por lote.
+ */
+
+#include "../include/chat_pool.h"
+
+/* ========== ESTRUCTURAS INTERNAS ========== */
+
+#define POOL_ALIGNMENT  16              /* Alineación de cada objeto */
+#define POOL_SLAB_HEADER POOL_ALIGNMENT /* Cabecera del slab (enlace a la lista) */
+
+/**
+ * @brief Objetos libres de un pool en la caché de un thread
+ */
+typedef struct {
+    pool_object_t *head;
+    int count;
+} pool_cache_t;
+
+static chat_pool_t *pool_registry[POOL_MAX_POOLS];
+static int pool_registry_count = 0;
+static pthread_mutex_t pool_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ========== CONTABILIDAD ========== */
+
+/**
+ * @brief Separación entre objetos consecutivos de un slab
+ */
+static size_t object_stride(const chat_pool_t *pool)
+{
+    size_t size = pool->object_size < sizeof(pool_object_t) ?
+                  sizeof(pool_object_t) : pool->object_size;
+    return (size + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1);
+}
+
+/**
+ * @brief Cuenta un objeto entregado y actualiza la marca máxima
+ */
+static void count_alloc(chat_pool_t *pool)
+{
+    size_t now = __atomic_add_fetch(&pool->in_use, 1, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&pool->high_water, __ATOMIC_RELAXED);
+
+    while (now > peak &&
+           !__atomic_compare_exchange_n(&pool->high_water, &peak, now, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * @brief Registra el pool en su primer uso (le asigna id y estadísticas)
+ */
+static void register_pool(chat_pool_t *pool)
+{
+    if (__atomic_load_n(&pool->id, __ATOMIC_ACQUIRE) != 0) return;
+
+    pthread_mutex_lock(&pool_registry_lock);
+    if (pool->id == 0 && pool_registry_count < POOL_MAX_POOLS) {
+        pool_registry[pool_registry_count] = pool;
+        __atomic_store_n(&pool->id, pool_registry_count + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&pool_registry_count, pool_registry_count + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&pool_registry_lock);
+}
+
+#ifndef CHAT_POOL_DISABLE
+
+static __thread pool_cache_t thread_caches[POOL_MAX_POOLS];
+static __thread int thread_cache_bound = 0;
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+/* ========== SLABS Y LISTA GLOBAL ========== */
+
+/**
+ * @brief Trocea un slab nuevo en la lista global (con el lock tomado)
+ */
+static int grow_locked(chat_pool_t *pool)
+{
+    size_t stride = object_stride(pool);
+    size_t objects = pool->slab_objects > 0 ? pool->slab_objects : 1;
+    char *slab = malloc(POOL_SLAB_HEADER + stride * objects);
+    if (!slab) {
+        return -1;
+    }
+
+    *(void**)slab = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count++;
+
+    /* En orden inverso para que los primeros objetos salgan primero */
+    for (size_t i = objects; i > 0; i--) {
+        pool_object_t *object = (pool_object_t*)(slab + POOL_SLAB_HEADER + (i - 1) * stride);
+        object->next = pool->free_list;
+        pool->free_list = object;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Saca hasta count objetos de la lista global
+ * @return Cadena de objetos (NULL si no hay memoria)
+ */
+static pool_object_t *take_global(chat_pool_t *pool, int count, int *taken)
+{
+    pool_object_t *head = NULL;
+    *taken = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (*taken < count) {
+        if (!pool->free_list && grow_locked(pool) != 0) {
+            break;
+        }
+        pool_object_t *object = pool->free_list;
+        pool->free_list = object->next;
+        object->next = head;
+        head = object;
+        (*taken)++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return head;
+}
+
+/**
+ * @brief Devuelve una cadena de objetos a la lista global
+ */
+static void return_global(chat_pool_t *pool, pool_object_t *head, pool_object_t *tail)
+{
+    pthread_mutex_lock(&pool->lock);
+    tail->next = pool->free_list;
+    pool->free_list = head;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* ========== CACHÉS POR THREAD ========== */
+
+/**
+ * @brief Devuelve count objetos de una caché a su pool
+ */
+static void flush_cache(chat_pool_t *pool, pool_cache_t *cache, int count)
+{
+    if (count <= 0 || !cache->head) return;
+
+    pool_object_t *head = cache->head;
+    pool_object_t *tail = head;
+    int moved = 1;
+    while (moved < count && tail->next) {
+        tail = tail->next;
+        moved++;
+    }
+
+    cache->head = tail->next;
+    cache->count -= moved;
+    return_global(pool, head, tail);
+}
+
+/**
+ * @brief Vacía las cachés del thread que termina
+ */
+static void release_thread_caches(void *caches)
+{
+    pool_cache_t *own = caches;
+    int count = __atomic_load_n(&pool_registry_count, __ATOMIC_ACQUIRE);
+
+    for (int i = 0; i < count; i++) {
+        flush_cache(pool_registry[i], &own[i], own[i].count);
+    }
+}
+
+static void create_cache_key(void)
+{
+    pthread_key_create(&cache_key, release_thread_caches);
+}
+
+/**
+ * @brief Caché del thread para el pool
+ * @return Caché o NULL si el pool no usa caché
+ */
+static pool_cache_t *thread_cache(chat_pool_t *pool)
+{
+    if (pool->cache_limit <= 0) {
+        return NULL;
+    }
+
+    register_pool(pool);
+    int id = __atomic_load_n(&pool->id, __ATOMIC_ACQUIRE);
+    if (id == 0) {
+        /* Registro lleno: el pool funciona sin caché */
+        return NULL;
+    }
+
+    if (!thread_cache_bound) {
+        /* El destructor solo se ejecuta para valores distintos de NULL */
+        pthread_once(&cache_key_once, create_cache_key);
+        pthread_setspecific(cache_key, thread_caches);
+        thread_cache_bound = 1;
+    }
+
+    return &thread_caches[id - 1];
+}
+
+/* ========== RESERVA Y LIBERACIÓN ========== */
+
+/**
+ * @brief Reserva un objeto del pool
+ */
+void *pool_alloc(chat_pool_t *pool)
+{
+    pool_cache_t *cache = thread_cache(pool);
+    pool_object_t *object;
+    int taken;
+
+    if (!cache) {
+        register_pool(pool);
+        object = take_global(pool, 1, &taken);
+        if (!object) return NULL;
+    } else {
+        if (!cache->head) {
+            int batch = pool->cache_limit / 2 > 0 ? pool->cache_limit / 2 : 1;
+            cache->head = take_global(pool, batch, &taken);
+            cache->count = taken;
+            if (!cache->head) return NULL;
+        }
+        object = cache->head;
+        cache->head = object->next;
+        cache->count--;
+    }
+
+    count_alloc(pool);
+    return object;
+}
+
+/**
+ * @brief Devuelve un objeto al pool
+ */
+void pool_free(chat_pool_t *pool, void *object)
+{
+    if (!object) return;
+
+    __atomic_sub_fetch(&pool->in_use, 1, __ATOMIC_RELAXED);
+
+    pool_object_t *node = object;
+    pool_cache_t *cache = thread_cache(pool);
+
+    if (!cache) {
+        node->next = NULL;
+        return_global(pool, node, node);
+        return;
+    }
+
+    node->next = cache->head;
+    cache->head = node;
+    cache->count++;
+    if (cache->count > pool->cache_limit) {
+        flush_cache(pool, cache, cache->count - pool->cache_limit / 2);
+    }
+}
+
+#else /* CHAT_POOL_DISABLE */
+
+/* ========== RESERVA DIRECTA CON MALLOC ========== */
+
+/**
+ * @brief Reserva un objeto con malloc() (pools desactivados)
+ */
+void *pool_alloc(chat_pool_t *pool)
+{
+    register_pool(pool);
+
+    void *object = malloc(pool->object_size);
+    if (object) {
+        count_alloc(pool);
+    }
+    return object;
+}
+
+/**
+ * @brief Libera un objeto con free() (pools desactivados)
+ */
+void pool_free(chat_pool_t *pool, void *object)
+{
+    if (!object) return;
+
+    __atomic_sub_fetch(&pool->in_use, 1, __ATOMIC_RELAXED);
+    free(object);
+}
+
+#endif /* CHAT_POOL_DISABLE */
+
+/**
+ * @brief Reserva un objeto del pool inicializado a cero
+ */
+void *pool_calloc(chat_pool_t *pool)
+{
+    void *object = pool_alloc(pool);
+    if (object) {
+        memset(object, 0, pool->object_size);
+    }
+    return object;
+}
+
+/* ========== ESTADÍSTICAS ========== */
+
+/**
+ * @brief Obtiene las estadísticas de los pools registrados
+ */
+int pool_stats_all(pool_stats_t *stats, int max)
+{
+    int count = __atomic_load_n(&pool_registry_count, __ATOMIC_ACQUIRE);
+    if (count > max) count = max;
+
+    for (int i = 0; i < count; i++) {
+        chat_pool_t *pool = pool_registry[i];
+        size_t objects = pool->slab_objects > 0 ? pool->slab_objects : 1;
+
+        pthread_mutex_lock(&pool->lock);
+        size_t slabs = pool->slab_count;
+        pthread_mutex_unlock(&pool->lock);
+
+        stats[i].name = pool->name;
+        stats[i].object_size = pool->object_size;
+        stats[i].in_use = __atomic_load_n(&pool->in_use, __ATOMIC_RELAXED);
+        stats[i].high_water = __atomic_load_n(&pool->high_water, __ATOMIC_RELAXED);
+        stats[i].capacity = slabs * objects;
+        stats[i].slab_bytes = slabs * (POOL_SLAB_HEADER + object_stride(pool) * objects);
+    }
+
+    return count;
+}
+
+/**
+ * @brief Registra en el log el uso y la marca máxima de cada pool
+ */
+void pool_log_summary(void)
+{
+    pool_stats_t stats[POOL_MAX_POOLS];
+    int count = pool_stats_all(stats, POOL_MAX_POOLS);
+
+    for (int i = 0; i < count; i++) {
+        LOG_INFO("Pool %s: %zu objetos de %zu bytes en uso, máximo %zu, %zu bytes en slabs",
+                 stats[i].name, stats[i].in_use, stats[i].object_size,
+                 stats[i].high_water, stats[i].slab_bytes);
+    }
+}
@@ -0,0 +1,249 @@
+/**
+ * @file chat_room.c
+ * @brief Implementación de las salas de chat
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Igual que la tabla de clientes, el hash de salas y los arrays de
+ * miembros crecen duplicando su tamaño y las bajas intercambian con el
+ * último elemento, así que entrar y salir de una sala es O(1) amortizado.
+ */
+
+#include "../include/chat_room.h"
+
+/* ========== FUNCIONES AUXILIARES ========== */
+
+/**
+ * @brief Reparte las cadenas del hash de salas en el doble de cubetas
+ * @return SUCCESS o ERROR_MEMORY
+ */
+static int grow_room_buckets(room_table_t *table)
+{
+    size_t bucket_count = table->bucket_count * 2;
+    chat_room_t **buckets = calloc(bucket_count, sizeof(*buckets));
+    if (!buckets) {
+        return ERROR_MEMORY;
+    }
+
+    for (size_t i = 0; i < table->bucket_count; i++) {
+        chat_room_t *room = table->buckets[i];
+        while (room) {
+            chat_room_t *next = room->hash_next;
+            size_t slot = room->name_hash & (bucket_count - 1);
+            room->hash_next = buckets[slot];
+            buckets[slot] = room;
+            room = next;
+        }
+    }
+
+    free(table->buckets);
+    table->buckets = buckets;
+    table->bucket_count = bucket_count;
+    return SUCCESS;
+}
+
+/**
+ * @brief Crea una sala vacía y la inserta en el hash
+ * @return Sala nueva o NULL si no hay memoria
+ */
+static chat_room_t *create_room(room_table_t *table, const char *name)
+{
+    /* Mantener una carga media de como mucho una sala por cubeta */
+    if ((size_t)table->count >= table->bucket_count &&
+        grow_room_buckets(table) != SUCCESS) {
+        return NULL;
+    }
+
+    chat_room_t *room = calloc(1, sizeof(chat_room_t));
+    if (!room) {
+        return NULL;
+    }
+
+    strncpy(room->name, name, ROOM_NAME_SIZE - 1);
+    room->name[ROOM_NAME_SIZE - 1] = '\0';
+    room->name_hash = hash_identifier(room->name);
+
+    size_t slot = room->name_hash & (table->bucket_count - 1);
+    room->hash_next = table->buckets[slot];
+    table->buckets[slot] = room;
+    table->count++;
+
+    return room;
+}
+
+/**
+ * @brief Quita una sala del hash y la libera
+ */
+static void destroy_room(room_table_t *table, chat_room_t *room)
+{
+    chat_room_t **link = &table->buckets[room->name_hash & (table->bucket_count - 1)];
+    while (*link && *link != room) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = room->hash_next;
+        table->count--;
+    }
+
+    free(room->members);
+    free(room);
+}
+
+/**
+ * @brief Asegura espacio para un miembro más
+ * @return SUCCESS o ERROR_MEMORY
+ */
+static int reserve_member(chat_room_t *room)
+{
+    if (room->member_count < room->member_capacity) {
+        return SUCCESS;
+    }
+
+    int capacity = room->member_capacity ? room->member_capacity * 2 : ROOM_MEMBERS_INITIAL;
+    client_info_t **members = realloc(room->members, (size_t)capacity * sizeof(*members));
+    if (!members) {
+        return ERROR_MEMORY;
+    }
+
+    room->members = members;
+    room->member_capacity = capacity;
+    return SUCCESS;
+}
+
+/* ========== OPERACIONES DE LAS SALAS ========== */
+
+/**
+ * @brief Crea una tabla con la sala por defecto
+ */
+room_table_t *room_table_create(void)
+{
+    room_table_t *table = calloc(1, sizeof(room_table_t));
+    if (!table) {
+        return NULL;
+    }
+
+    table->bucket_count = ROOM_TABLE_INITIAL;
+    table->buckets = calloc(table->bucket_count, sizeof(*table->buckets));
+    if (!table->buckets) {
+        free(table);
+        return NULL;
+    }
+
+    table->lobby = create_room(table, ROOM_DEFAULT_NAME);
+    if (!table->lobby) {
+        room_table_destroy(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+/**
+ * @brief Libera la tabla y todas sus salas (no libera los clientes)
+ */
+void room_table_destroy(room_table_t *table)
+{
+    if (!table) return;
+
+    for (size_t i = 0; i < table->bucket_count; i++) {
+        chat_room_t *room = table->buckets[i];
+        while (room) {
+            chat_room_t *next = room->hash_next;
+            for (int m = 0; m < room->member_count; m++) {
+                room->members[m]->room = NULL;
+                room->members[m]->room_index = -1;
+            }
+            free(room->members);
+            free(room);
+            room = next;
+        }
+    }
+
+    free(table->buckets);
+    free(table);
+}
+
+/**
+ * @brief Busca una sala por nombre
+ */
+chat_room_t *room_table_find(const room_table_t *table, const char *name)
+{
+    if (!table || !name) return NULL;
+
+    unsigned int hash = hash_identifier(name);
+    chat_room_t *room = table->buckets[hash & (table->bucket_count - 1)];
+
+    while (room) {
+        if (room->name_hash == hash && strcmp(room->name, name) == 0) {
+            return room;
+        }
+        room = room->hash_next;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Mueve un cliente a una sala, creándola si no existe
+ *
+ * La sala destino y su espacio se preparan antes de sacar al cliente de
+ * la actual, de modo que un fallo no lo deja sin sala.
+ */
+int room_table_join(room_table_t *table, client_info_t *client, const char *name)
+{
+    if (!table || !client || !name) return ERROR_MEMORY;
+
+    chat_room_t *room = room_table_find(table, name);
+    if (room && room == client->room) {
+        return SUCCESS;
+    }
+
+    int created = 0;
+    if (!room) {
+        room = create_room(table, name);
+        if (!room) {
+            return ERROR_MEMORY;
+        }
+        created = 1;
+    }
+
+    if (reserve_member(room) != SUCCESS) {
+        if (created) {
+            destroy_room(table, room);
+        }
+        return ERROR_MEMORY;
+    }
+
+    room_table_leave(table, client);
+
+    client->room = room;
+    client->room_index = room->member_count;
+    room->members[room->member_count++] = client;
+    room->presence_version++;
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Saca a un cliente de su sala en O(1)
+ */
+void room_table_leave(room_table_t *table, client_info_t *client)
+{
+    if (!table || !client || !client->room) return;
+
+    chat_room_t *room = client->room;
+
+    /* Array denso: el último ocupa el hueco */
+    int last = room->member_count - 1;
+    room->members[client->room_index] = room->members[last];
+    room->members[client->room_index]->room_index = client->room_index;
+    room->member_count = last;
+    room->presence_version++;
+
+    client->room = NULL;
+    client->room_index = -1;
+
+    if (room->member_count == 0 && room != table->lobby) {
+        destroy_room(table, room);
+    }
+}
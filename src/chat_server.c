@@ -4,20 +4,49 @@
  * @author Sistema de Chat Socket
  * @date 2025
  * 
- * Implementa un servidor TCP que maneja múltiples clientes concurrentes
- * usando threads, con funcionalidad de broadcast y notificaciones.
+ * Implementa un servidor TCP que maneja múltiples clientes concurrentes,
+ * con funcionalidad de broadcast y notificaciones. El modelo de
+ * concurrencia lo decide el motor de E/S elegido (ver chat_engine.h).
  */
 
-#include "../include/chat_server.h"
+#include "../include/chat_engine.h"
+#include "../include/chat_client_table.h"
+#include "../include/chat_room.h"
+#include "../include/chat_history.h"
+#include "../include/chat_metrics.h"
+#include "../include/chat_timer.h"
+#include "../include/chat_compress.h"
+#include "../include/chat_admission.h"
+#include "../include/chat_trace.h"
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
 
 /* Variable global para el contexto del servidor (para signal handler) */
 static server_context_t *g_server_ctx = NULL;
 
+/* Última señal de cierre recibida (la registra main al salir del motor) */
+static volatile sig_atomic_t g_shutdown_signal = 0;
+
+/* Estado por conexión y argumentos de los threads de cliente */
+static chat_pool_t client_pool = POOL_INITIALIZER("clientes",
+    sizeof(client_info_t), 64, POOL_CACHE_OBJECTS / 4);
+static chat_pool_t thread_args_pool = POOL_INITIALIZER("args_thread",
+    sizeof(client_thread_args_t), 64, POOL_CACHE_OBJECTS / 4);
+
+/* Threads de cliente vivos del motor threads (ver stop_client_threads) */
+static pthread_mutex_t client_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t client_threads_done = PTHREAD_COND_INITIALIZER;
+static client_thread_args_t *client_threads = NULL;
+
 /**
  * @brief Inicializa el contexto del servidor
  * 
  * Configura todas las estructuras de datos necesarias para el servidor,
- * incluyendo la inicialización de mutexes y arrays de clientes.
+ * incluyendo la inicialización de mutexes y la tabla de clientes.
  */
 int init_server_context(server_context_t *ctx)
 {
@@ -32,13 +61,20 @@ int init_server_context(server_context_t *ctx)
         return ERROR_THREAD;
     }
     
-    /* Inicializar array de clientes */
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        ctx->clients[i].socket_fd = -1;
-        ctx->clients[i].active = 0;
+    /* Inicializar tabla de clientes y salas */
+    ctx->clients = client_table_create();
+    ctx->rooms = room_table_create();
+    if (!ctx->clients || !ctx->rooms) {
+        LOG_ERROR("Error asignando memoria para la tabla de clientes");
+        client_table_destroy(ctx->clients);
+        room_table_destroy(ctx->rooms);
+        ctx->clients = NULL;
+        ctx->rooms = NULL;
+        pthread_mutex_destroy(&ctx->clients_mutex);
+        return ERROR_MEMORY;
     }
     
-    ctx->client_count = 0;
+    ctx->max_clients = MAX_CLIENTS;
     ctx->server_socket = -1;
     ctx->running = 1;
     
@@ -65,24 +101,36 @@ void cleanup_server_context(server_context_t *ctx)
     SAFE_CLOSE(ctx->server_socket);
     
     /* Desconectar todos los clientes agresivamente */
-    LOG_INFO("Desconectando todos los clientes...");
+    LOG_INFO("%s", ctx->handing_off ? "Soltando los clientes traspasados..." :
+                                      "Desconectando todos los clientes...");
     pthread_mutex_lock(&ctx->clients_mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (ctx->clients[i].active) {
-            LOG_INFO("Desconectando cliente '%s'", ctx->clients[i].username);
-            
-            /* Cerrar socket inmediatamente para forzar desconexión */
-            shutdown(ctx->clients[i].socket_fd, SHUT_RDWR);
-            SAFE_CLOSE(ctx->clients[i].socket_fd);
-            ctx->clients[i].active = 0;
-            
-            /* Cancelar thread del cliente si es posible */
-            if (ctx->clients[i].thread_id != 0) {
-                pthread_cancel(ctx->clients[i].thread_id);
-            }
+    while (ctx->clients && ctx->clients->count > 0) {
+        client_info_t *client = ctx->clients->active[ctx->clients->count - 1];
+        if (!ctx->handing_off) {
+            LOG_INFO("Desconectando cliente '%s'", client->username);
+        }
+        client_table_remove(ctx->clients, client);
+        room_table_leave(ctx->rooms, client);
+        
+        /* Cerrar socket inmediatamente para forzar desconexión; si se
+         * traspasó, la conexión sigue abierta en la versión nueva y
+         * shutdown() la cortaría también allí */
+        if (!ctx->handing_off) {
+            shutdown(client->socket_fd, SHUT_RDWR);
         }
+        outbound_queue_close(client->outbound);
+        outbound_queue_release(client->outbound);
+        SAFE_CLOSE(client->socket_fd);
+        client->active = 0;
+        
+        /* Los threads de cliente ya terminaron (ver stop_client_threads) */
+        free(client->handoff_input);
+        pool_free(&client_pool, client);
     }
-    ctx->client_count = 0;
+    client_table_destroy(ctx->clients);
+    ctx->clients = NULL;
+    room_table_destroy(ctx->rooms);
+    ctx->rooms = NULL;
     pthread_mutex_unlock(&ctx->clients_mutex);
     
     /* Destruir mutex */
@@ -91,18 +139,181 @@ void cleanup_server_context(server_context_t *ctx)
     LOG_INFO("Limpieza del servidor completada");
 }
 
+/* Opciones de los sockets de escucha (ver server_set_listen_options) */
+static int listen_backlog = LISTEN_BACKLOG;
+static int listen_defer_accept = 0;
+
+/* Sockets de escucha abiertos y heredados, para el reinicio en caliente */
+typedef struct {
+    int fd;                                 /* Socket de escucha */
+    int port;                               /* Puerto en el que escucha */
+} listener_entry_t;
+
+static pthread_mutex_t listeners_lock = PTHREAD_MUTEX_INITIALIZER;
+static listener_entry_t listeners[HANDOFF_MAX_LISTENERS];
+static int listener_count = 0;
+static int inherited_listeners[HANDOFF_MAX_LISTENERS];
+static int inherited_count = 0;
+
+/**
+ * @brief Fija las opciones de los sockets de escucha que se creen después
+ */
+void server_set_listen_options(int backlog, int defer_accept)
+{
+    listen_backlog = backlog;
+    listen_defer_accept = defer_accept;
+    
+    /* El kernel recorta el backlog a somaxconn sin avisar */
+    FILE *file = fopen("/proc/sys/net/core/somaxconn", "r");
+    int somaxconn;
+    if (file) {
+        if (fscanf(file, "%d", &somaxconn) == 1 && somaxconn < backlog) {
+            LOG_INFO("Backlog %d limitado por net.core.somaxconn a %d", backlog, somaxconn);
+        }
+        fclose(file);
+    }
+}
+
+/**
+ * @brief Puerto local de un socket o -1
+ */
+static int socket_local_port(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    
+    if (getsockname(fd, (struct sockaddr*)&addr, &addr_len) < 0 || addr.sin_family != AF_INET) {
+        return -1;
+    }
+    return ntohs(addr.sin_port);
+}
+
+/**
+ * @brief Apunta un socket de escucha para server_dup_listeners()
+ */
+static void register_listener(int fd, int port)
+{
+    pthread_mutex_lock(&listeners_lock);
+    if (listener_count < HANDOFF_MAX_LISTENERS) {
+        listeners[listener_count].fd = fd;
+        listeners[listener_count].port = port;
+        listener_count++;
+    }
+    pthread_mutex_unlock(&listeners_lock);
+}
+
+/**
+ * @brief Toma un socket heredado que escuche en el puerto o -1
+ */
+static int take_inherited_listener(int port)
+{
+    int fd = -1;
+    
+    pthread_mutex_lock(&listeners_lock);
+    for (int i = 0; i < inherited_count; i++) {
+        if (socket_local_port(inherited_listeners[i]) == port) {
+            fd = inherited_listeners[i];
+            inherited_listeners[i] = inherited_listeners[--inherited_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&listeners_lock);
+    
+    return fd;
+}
+
+/**
+ * @brief Entrega a create_server_socket() sockets de escucha ya abiertos
+ */
+void server_inherit_listeners(const int *fds, int count)
+{
+    pthread_mutex_lock(&listeners_lock);
+    for (int i = 0; i < count; i++) {
+        if (inherited_count < HANDOFF_MAX_LISTENERS) {
+            inherited_listeners[inherited_count++] = fds[i];
+        } else {
+            close(fds[i]);
+        }
+    }
+    pthread_mutex_unlock(&listeners_lock);
+}
+
+/**
+ * @brief Cierra los sockets heredados que no usó ningún motor
+ * 
+ * Con SO_REUSEPORT el kernel seguiría repartiéndoles conexiones que
+ * nadie aceptaría.
+ */
+void server_close_inherited_listeners(void)
+{
+    pthread_mutex_lock(&listeners_lock);
+    if (inherited_count > 0) {
+        LOG_INFO("Cerrando %d sockets de escucha heredados sin usar", inherited_count);
+    }
+    while (inherited_count > 0) {
+        close(inherited_listeners[--inherited_count]);
+    }
+    pthread_mutex_unlock(&listeners_lock);
+}
+
+/**
+ * @brief Duplica los sockets de escucha abiertos en un puerto
+ * 
+ * Comprueba cada duplicado: el número de un socket ya cerrado puede
+ * pertenecer ahora a otro descriptor.
+ */
+int server_dup_listeners(int port, int *fds, int max)
+{
+    int count = 0;
+    
+    pthread_mutex_lock(&listeners_lock);
+    for (int i = 0; i < listener_count && count < max; i++) {
+        if (listeners[i].port != port) continue;
+        
+        int fd = fcntl(listeners[i].fd, F_DUPFD_CLOEXEC, 0);
+        int accepting = 0;
+        socklen_t accepting_len = sizeof(accepting);
+        if (fd < 0) continue;
+        if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &accepting_len) < 0 ||
+            !accepting || socket_local_port(fd) != port) {
+            close(fd);
+            continue;
+        }
+        fds[count++] = fd;
+    }
+    pthread_mutex_unlock(&listeners_lock);
+    
+    return count;
+}
+
 /**
  * @brief Crea y configura el socket del servidor
  * 
  * Establece el socket en modo servidor, configura opciones de socket
- * y realiza bind al puerto especificado.
+ * y realiza bind al puerto especificado. Si la versión anterior dejó un
+ * socket escuchando en el puerto, se reutiliza en lugar de crear otro.
  */
-int create_server_socket(int port)
+int create_server_socket(int port, int reuse_port)
 {
     int server_fd;
     struct sockaddr_in server_addr;
     int opt = 1;
     
+    /* Las conexiones encoladas en el socket heredado no se pierden */
+    server_fd = take_inherited_listener(port);
+    if (server_fd >= 0) {
+        if (listen(server_fd, listen_backlog) < 0) {
+            LOG_ERROR("Error ajustando el socket heredado: %s", strerror(errno));
+        }
+        if (listen_defer_accept > 0) {
+            setsockopt(server_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                       &listen_defer_accept, sizeof(listen_defer_accept));
+        }
+        register_listener(server_fd, port);
+        LOG_INFO("Socket del servidor heredado de la versión anterior en puerto %d", port);
+        return server_fd;
+    }
+    
     /* Crear socket */
     server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
@@ -117,6 +328,14 @@ int create_server_socket(int port)
         return ERROR_SOCKET;
     }
     
+    /* Compartir el puerto entre varios sockets de escucha (un shard por socket) */
+    if (reuse_port &&
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        LOG_ERROR("Error al configurar SO_REUSEPORT: %s", strerror(errno));
+        SAFE_CLOSE(server_fd);
+        return ERROR_SOCKET;
+    }
+    
     /* Configurar dirección del servidor */
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
@@ -130,185 +349,373 @@ int create_server_socket(int port)
         return ERROR_BIND;
     }
     
+    /* No despertar al servidor por conexiones que aún no enviaron nada */
+    if (listen_defer_accept > 0 &&
+        setsockopt(server_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                   &listen_defer_accept, sizeof(listen_defer_accept)) < 0) {
+        LOG_ERROR("Error al configurar TCP_DEFER_ACCEPT: %s", strerror(errno));
+    }
+    
     /* Configurar socket para escuchar */
-    if (listen(server_fd, LISTEN_BACKLOG) < 0) {
+    if (listen(server_fd, listen_backlog) < 0) {
         LOG_ERROR("Error al configurar socket en modo listen: %s", strerror(errno));
         SAFE_CLOSE(server_fd);
         return ERROR_LISTEN;
     }
     
+    register_listener(server_fd, port);
     LOG_INFO("Socket del servidor creado y configurado en puerto %d", port);
     return server_fd;
 }
 
 /**
- * @brief Agrega un cliente a la lista de clientes conectados
+ * @brief Genera el token con el que un cliente puede reanudar su sesión
  * 
- * Busca un slot libre en el array de clientes y agrega la información
- * del nuevo cliente de forma thread-safe.
+ * Sin entropía el token queda vacío y la sesión no puede reclamarse.
  */
-int add_client(server_context_t *ctx, int client_socket, 
-               struct sockaddr_in client_addr, const char *username)
+static void generate_session_token(char *token)
 {
-    if (!ctx || !username) return -1;
+    unsigned char bytes[(SESSION_TOKEN_SIZE - 1) / 2];
     
-    pthread_mutex_lock(&ctx->clients_mutex);
-    
-    /* Verificar límite de clientes */
-    if (ctx->client_count >= MAX_CLIENTS) {
-        pthread_mutex_unlock(&ctx->clients_mutex);
-        LOG_ERROR("Límite máximo de clientes alcanzado (%d)", MAX_CLIENTS);
-        return -1;
+    token[0] = '\0';
+    if (getrandom(bytes, sizeof(bytes), GRND_NONBLOCK) != (ssize_t)sizeof(bytes)) {
+        LOG_ERROR("Sin entropía para el token de sesión: %s", strerror(errno));
+        return;
     }
     
-    /* Buscar slot libre */
-    int client_index = -1;
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (!ctx->clients[i].active) {
-            client_index = i;
-            break;
-        }
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        snprintf(token + 2 * i, 3, "%02x", bytes[i]);
+    }
+}
+
+/**
+ * @brief Compara dos tokens de sesión en tiempo constante
+ */
+static int session_token_matches(const char *expected, const char *presented)
+{
+    if (expected[0] == '\0' || strlen(presented) != SESSION_TOKEN_SIZE - 1) {
+        return 0;
     }
     
-    if (client_index == -1) {
-        pthread_mutex_unlock(&ctx->clients_mutex);
-        LOG_ERROR("No se encontró slot libre para nuevo cliente");
-        return -1;
+    unsigned char diff = 0;
+    for (int i = 0; i < SESSION_TOKEN_SIZE - 1; i++) {
+        diff |= (unsigned char)(expected[i] ^ presented[i]);
+    }
+    return diff == 0;
+}
+
+static void publish_presence(server_context_t *ctx, const client_info_t *member_of,
+                             const char *room_name, char op, unsigned long long version,
+                             const char *username);
+static int allow_client_message(server_context_t *ctx, client_info_t *client);
+
+/**
+ * @brief Agrega un cliente a la lista de clientes conectados
+ * 
+ * Reserva el cliente y su cola fuera del lock; bajo clients_mutex solo se
+ * comprueban el límite y el nombre duplicado y se inserta en la tabla.
+ * El historial de la sala se copia y se encola con greet sin soltar el
+ * lock, así que ningún mensaje llega a la vez por el historial y por el
+ * fan-out, ni un broadcast se adelanta al saludo.
+ * 
+ * Al reanudar, el nombre puede seguir ocupado por la conexión anterior si
+ * el servidor aún no detectó su caída. Con el token correcto se cierra
+ * con shutdown() (su dueño la retira como cualquier desconexión) y el
+ * cliente reintenta; el socket sigue abierto mientras esté en la tabla.
+ */
+int add_client(server_context_t *ctx, int client_socket, 
+               struct sockaddr_in client_addr, const char *username,
+               session_resume_t *resume,
+               client_greet_func_t greet, void *greet_arg)
+{
+    if (!ctx || !username) return ERROR_MEMORY;
+    
+    client_info_t *client = pool_calloc(&client_pool);
+    outbound_queue_t *outbound = outbound_queue_create(client_socket, WIRE_FORMAT_LEGACY,
+                                                       ctx->outbound_limits);
+    if (!client || !outbound) {
+        LOG_ERROR("Error asignando memoria para cliente '%s'", username);
+        outbound_queue_release(outbound);
+        pool_free(&client_pool, client);
+        return ERROR_MEMORY;
     }
     
     /* Configurar información del cliente */
-    client_info_t *client = &ctx->clients[client_index];
     client->socket_fd = client_socket;
     client->address = client_addr;
     client->connect_time = time(NULL);
     client->active = 1;
     client->disconnect_notified = 0;
+    client->outbound = outbound;
+    client->active_index = -1;
+    client->room_index = -1;
+    client->last_activity_ms = timer_now_ms();
     strncpy(client->username, username, USERNAME_SIZE - 1);
     client->username[USERNAME_SIZE - 1] = '\0';
+    generate_session_token(client->session);
+    
+    /* Todo cliente nuevo entra en la sala por defecto; el que reanuda, en la suya */
+    const char *room_name = resume ? resume->room : ROOM_DEFAULT_NAME;
     
-    ctx->client_count++;
+    pthread_mutex_lock(&ctx->clients_mutex);
+    
+    int result;
+    client_info_t *previous = NULL;
+    if (ctx->clients->count >= ctx->max_clients) {
+        result = ERROR_FULL;
+    } else if ((previous = client_table_find_name(ctx->clients, client->username)) != NULL) {
+        result = ERROR_DUPLICATE;
+        if (resume && session_token_matches(previous->session, resume->session)) {
+            shutdown(previous->socket_fd, SHUT_RDWR);
+            result = ERROR_RETRY;
+        }
+    } else {
+        result = client_table_insert(ctx->clients, client);
+        if (result == SUCCESS &&
+            (result = room_table_join(ctx->rooms, client, room_name)) != SUCCESS) {
+            client_table_remove(ctx->clients, client);
+        }
+        if (result == SUCCESS) {
+            client->presence_version = client->room->presence_version;
+        }
+        if (result == SUCCESS && greet) {
+            shared_frame_t *history[HISTORY_MAX_DEPTH];
+            int history_count = resume ?
+                history_snapshot_since(ctx->history, room_name, resume->sequence,
+                                       history, &resume->missed, &client->room_sequence) :
+                history_snapshot(ctx->history, room_name, history, &client->room_sequence);
+            greet(client, history, history_count, greet_arg);
+        }
+    }
+    int client_count = ctx->clients->count;
     
     pthread_mutex_unlock(&ctx->clients_mutex);
     
-    LOG_INFO("Cliente '%s' agregado (total: %d/%d)", username, ctx->client_count, MAX_CLIENTS);
-    return client_index;
+    if (result != SUCCESS) {
+        if (result == ERROR_FULL) {
+            LOG_ERROR("Límite máximo de clientes alcanzado (%d)", ctx->max_clients);
+        } else if (result == ERROR_DUPLICATE) {
+            LOG_ERROR("Nombre de usuario '%s' ya está en uso", username);
+        } else if (result == ERROR_RETRY) {
+            LOG_INFO("Conexión anterior de '%s' cerrada para reanudar su sesión", username);
+        } else {
+            LOG_ERROR("Error registrando cliente '%s' en la tabla", username);
+        }
+        outbound_queue_release(outbound);
+        pool_free(&client_pool, client);
+        return result;
+    }
+    
+    LOG_INFO("Cliente '%s' agregado (total: %d/%d)", username, client_count, ctx->max_clients);
+    return SUCCESS;
 }
 
 /**
- * @brief Remueve un cliente de la lista de clientes conectados
+ * @brief Registra un cliente heredado de la versión anterior
  * 
- * Busca el cliente por socket y lo marca como inactivo de forma thread-safe.
+ * No se comprueba el límite de clientes: la conexión ya estaba abierta y
+ * cortarla es justo lo que el traspaso evita.
  */
-int remove_client(server_context_t *ctx, int client_socket)
+int server_adopt_client(server_context_t *ctx, int client_socket,
+                        const handoff_client_t *state,
+                        const char *output, const char *input)
 {
-    if (!ctx) return -1;
+    if (!ctx || !state) return ERROR_MEMORY;
     
-    /* Si el servidor se está cerrando, no intentar remover */
-    if (!ctx->running) {
-        return 0; /* Silenciosamente ignorar durante el cierre */
+    if (state->wire_format < 0 || state->wire_format >= WIRE_FORMAT_COUNT ||
+        !validate_username(state->username) || !validate_room_name(state->room)) {
+        LOG_ERROR("Estado heredado inválido para el socket %d", client_socket);
+        return ERROR_SOCKET;
     }
     
-    pthread_mutex_lock(&ctx->clients_mutex);
+    client_info_t *client = pool_calloc(&client_pool);
+    outbound_queue_t *outbound = outbound_queue_create(client_socket,
+                                                       (wire_format_t)state->wire_format,
+                                                       ctx->outbound_limits);
+    char *pending_input = state->input_length > 0 ? malloc(state->input_length) : NULL;
+    if (!client || !outbound || (state->input_length > 0 && !pending_input)) {
+        LOG_ERROR("Error asignando memoria para cliente heredado '%s'", state->username);
+        free(pending_input);
+        outbound_queue_release(outbound);
+        pool_free(&client_pool, client);
+        return ERROR_MEMORY;
+    }
     
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (ctx->clients[i].active && ctx->clients[i].socket_fd == client_socket) {
-            /* Solo enviar notificación si no se ha enviado ya */
-            if (!ctx->clients[i].disconnect_notified) {
-                /* Notificar a otros clientes sobre la desconexión */
-                char notification_text[MESSAGE_SIZE];
-                snprintf(notification_text, sizeof(notification_text), 
-                         "[Usuario %s se desconectó]", ctx->clients[i].username);
-                
-                chat_message_t disconnect_notification;
-                init_message(&disconnect_notification, MSG_NOTIFICATION, 
-                           "Sistema", notification_text);
-                
-                /* Marcar que ya se envió la notificación */
-                ctx->clients[i].disconnect_notified = 1;
-                
-                /* Enviar notificación a todos los otros clientes */
-                pthread_mutex_unlock(&ctx->clients_mutex);
-                int sent = broadcast_message(ctx, &disconnect_notification, client_socket);
-                LOG_INFO("Cliente '%s' (socket %d) se desconectó. Notificación enviada a %d clientes", 
-                        ctx->clients[i].username, client_socket, sent);
-                pthread_mutex_lock(&ctx->clients_mutex);
-            }
-            
-            /* Marcar cliente como inactivo */
-            ctx->clients[i].active = 0;
-            SAFE_CLOSE(ctx->clients[i].socket_fd);
-            ctx->client_count--;
-            
-            pthread_mutex_unlock(&ctx->clients_mutex);
-            LOG_INFO("Cliente removido (total: %d/%d)", ctx->client_count, MAX_CLIENTS);
-            return 0;
-        }
+    client->socket_fd = client_socket;
+    client->address = state->address;
+    client->connect_time = (time_t)state->connect_time;
+    client->active = 1;
+    client->outbound = outbound;
+    client->active_index = -1;
+    client->room_index = -1;
+    client->last_activity_ms = state->last_activity_ms;
+    client->keepalive_sent_ms = state->keepalive_sent_ms;
+    strncpy(client->username, state->username, USERNAME_SIZE - 1);
+    client->username[USERNAME_SIZE - 1] = '\0';
+    memcpy(client->session, state->session, SESSION_TOKEN_SIZE - 1);
+    outbound_queue_set_sequenced(outbound, state->sequenced != 0);
+    client->presence = state->presence != 0;
+    if (pending_input) {
+        memcpy(pending_input, input, state->input_length);
+        client->handoff_input = pending_input;
+        client->handoff_input_length = state->input_length;
     }
     
+    pthread_mutex_lock(&ctx->clients_mutex);
+    int result = client_table_insert(ctx->clients, client);
+    if (result == SUCCESS &&
+        (result = room_table_join(ctx->rooms, client, state->room)) != SUCCESS) {
+        client_table_remove(ctx->clients, client);
+    }
     pthread_mutex_unlock(&ctx->clients_mutex);
-    LOG_ERROR("Cliente con socket %d no encontrado para remover", client_socket);
-    return -1;
+    
+    if (result != SUCCESS) {
+        LOG_ERROR("Error registrando cliente heredado '%s'", state->username);
+        free(pending_input);
+        outbound_queue_release(outbound);
+        pool_free(&client_pool, client);
+        return result;
+    }
+    
+    /* Lo que la versión anterior no llegó a escribir va antes que nada */
+    if (outbound_queue_restore(outbound, output, state->output_length) < 0) {
+        LOG_ERROR("Error restaurando la cola de salida de '%s'", client->username);
+    }
+    
+    metrics_add(METRIC_HANDOFF_CLIENTS, 1);
+    LOG_DEBUG("Cliente '%s' heredado en la sala '%s' (%u bytes por enviar, %u por procesar)",
+             client->username, state->room, state->output_length, state->input_length);
+    return SUCCESS;
 }
 
 /**
- * @brief Encuentra un cliente por su socket
- * 
- * Busca en la lista de clientes el que corresponde al socket dado.
+ * @brief Guarda en el cliente los bytes recibidos sin procesar
  */
-client_info_t *find_client(server_context_t *ctx, int client_socket)
+void server_stash_client_input(client_info_t *client, const frame_buffer_t *rx)
 {
-    if (!ctx) return NULL;
+    size_t pending = frame_buffer_pending(rx);
+    if (!client || pending == 0) return;
     
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (ctx->clients[i].active && ctx->clients[i].socket_fd == client_socket) {
-            return &ctx->clients[i];
-        }
-    }
+    free(client->handoff_input);
+    client->handoff_input = malloc(pending);
+    client->handoff_input_length = client->handoff_input ?
+                                   frame_buffer_peek(rx, client->handoff_input, pending) : 0;
+}
+
+/**
+ * @brief Devuelve al buffer de recepción los bytes heredados de un cliente
+ */
+int server_restore_client_input(client_info_t *client, frame_buffer_t *rx)
+{
+    if (!client || !client->handoff_input) return 0;
     
-    return NULL;
+    int result = frame_buffer_append(rx, client->handoff_input, client->handoff_input_length);
+    free(client->handoff_input);
+    client->handoff_input = NULL;
+    client->handoff_input_length = 0;
+    
+    return result;
 }
 
 /**
- * @brief Envía un mensaje a todos los clientes conectados (broadcast)
- * 
- * Itera sobre todos los clientes activos y envía el mensaje,
- * opcionalmente excluyendo un socket específico.
+ * @brief Registra las métricas de la cola de un cliente que tuvo congestión
  */
-int broadcast_message(server_context_t *ctx, const chat_message_t *msg, int exclude_socket)
+static void log_outbound_stats(client_info_t *client)
 {
-    if (!ctx || !msg) return 0;
+    outbound_stats_t stats;
+    outbound_queue_stats(client->outbound, &stats);
     
-    int sent_count = 0;
-    char buffer[BUFFER_SIZE];
-    ssize_t msg_size;
+    if (stats.overflows > 0) {
+        LOG_INFO("Cola de '%s': pico %zu bytes, %lu desbordes, %lu descartados, %lu agrupados",
+                client->username, stats.peak_bytes, stats.overflows,
+                stats.dropped_frames, stats.coalesced_frames);
+    }
+}
+
+/**
+ * @brief Remueve un cliente de la lista de clientes conectados
+ * 
+ * Busca el cliente por socket en O(1), lo quita de la tabla de forma
+ * thread-safe y libera su información.
+ */
+int remove_client(server_context_t *ctx, int client_socket)
+{
+    if (!ctx) return -1;
     
-    /* Serializar mensaje */
-    msg_size = serialize_message(msg, buffer, sizeof(buffer));
-    if (msg_size < 0) {
-        LOG_ERROR("Error al serializar mensaje para broadcast");
-        return 0;
+    /* Si el servidor se está cerrando, no intentar remover */
+    if (!ctx->running) {
+        return 0; /* Silenciosamente ignorar durante el cierre */
     }
     
     pthread_mutex_lock(&ctx->clients_mutex);
     
-    /* Enviar a todos los clientes activos */
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (ctx->clients[i].active && ctx->clients[i].socket_fd != exclude_socket) {
-            ssize_t sent = send(ctx->clients[i].socket_fd, buffer, msg_size, MSG_NOSIGNAL);
-            if (sent > 0) {
-                sent_count++;
-            } else {
-                LOG_ERROR("Error enviando mensaje a cliente '%s': %s", 
-                         ctx->clients[i].username, strerror(errno));
-                /* Marcar cliente para desconexión */
-                ctx->clients[i].active = 0;
-            }
-        }
+    client_info_t *client = client_table_find_fd(ctx->clients, client_socket);
+    if (!client) {
+        pthread_mutex_unlock(&ctx->clients_mutex);
+        LOG_ERROR("Cliente con socket %d no encontrado para remover", client_socket);
+        return -1;
+    }
+    
+    /* Solo enviar notificación si no se ha enviado ya; el cliente sigue
+     * en su sala, así que la sala no puede liberarse mientras tanto */
+    if (!client->disconnect_notified) {
+        /* Marcar que ya se envió la notificación */
+        client->disconnect_notified = 1;
+        
+        /* Notificar a los otros miembros de su sala */
+        pthread_mutex_unlock(&ctx->clients_mutex);
+        notify_user_disconnected(ctx, client);
+        pthread_mutex_lock(&ctx->clients_mutex);
+    }
+    
+    log_outbound_stats(client);
+    CHAT_TRACE3(disconnect, client_socket, client->username, (long long)client->connect_time);
+    client_table_remove(ctx->clients, client);
+    char room_name[ROOM_NAME_SIZE] = "";
+    if (client->room) {
+        memcpy(room_name, client->room->name, ROOM_NAME_SIZE);
+    }
+    room_table_leave(ctx->rooms, client);
+    int client_count = ctx->clients->count;
+    
+    /* Si la sala sigue existiendo, sus miembros reciben el cambio */
+    const chat_room_t *left = room_name[0] ? room_table_find(ctx->rooms, room_name) : NULL;
+    int notify_room = left != NULL;
+    unsigned long long presence_version = left ? left->presence_version : 0;
+    
+    pthread_mutex_unlock(&ctx->clients_mutex);
+    
+    if (notify_room) {
+        publish_presence(ctx, NULL, room_name, '-', presence_version, client->username);
     }
     
+    /* Fuera de la tabla ningún broadcast nuevo la ve; los que aún tengan
+     * su cola dejarán de escribir antes de cerrar el socket */
+    client->active = 0;
+    outbound_queue_close(client->outbound);
+    outbound_queue_release(client->outbound);
+    SAFE_CLOSE(client->socket_fd);
+    free(client->handoff_input);
+    pool_free(&client_pool, client);
+    
+    LOG_INFO("Cliente removido (total: %d/%d)", client_count, ctx->max_clients);
+    return 0;
+}
+
+/**
+ * @brief Encuentra un cliente por su socket
+ * 
+ * Consulta el índice por socket de la tabla de clientes.
+ */
+client_info_t *find_client(server_context_t *ctx, int client_socket)
+{
+    if (!ctx) return NULL;
+    
+    pthread_mutex_lock(&ctx->clients_mutex);
+    client_info_t *client = client_table_find_fd(ctx->clients, client_socket);
     pthread_mutex_unlock(&ctx->clients_mutex);
     
-    return sent_count;
+    return client;
 }
 
 /**
@@ -316,19 +723,19 @@ int broadcast_message(server_context_t *ctx, const chat_message_t *msg, int excl
  * 
  * Serializa y envía un mensaje a un socket de cliente particular.
  */
-int send_message_to_client(int client_socket, const chat_message_t *msg)
+int send_message_to_client(int client_socket, wire_format_t format, const chat_message_t *msg)
 {
     if (client_socket < 0 || !msg) return -1;
     
     char buffer[BUFFER_SIZE];
-    ssize_t msg_size = serialize_message(msg, buffer, sizeof(buffer));
+    ssize_t msg_size = serialize_message_as(msg, format, buffer, sizeof(buffer));
     
     if (msg_size < 0) {
         LOG_ERROR("Error al serializar mensaje");
         return -1;
     }
     
-    ssize_t sent = send(client_socket, buffer, msg_size, MSG_NOSIGNAL);
+    ssize_t sent = send_all(client_socket, buffer, msg_size);
     if (sent != msg_size) {
         LOG_ERROR("Error enviando mensaje: %s", strerror(errno));
         return -1;
@@ -338,80 +745,525 @@ int send_message_to_client(int client_socket, const chat_message_t *msg)
 }
 
 /**
- * @brief Thread principal para manejar un cliente individual
+ * @brief Encola un mensaje para un cliente registrado
  * 
- * Función que ejecuta cada thread de cliente, manejando la recepción
- * de mensajes y el procesamiento de los mismos.
+ * Pasa por la cola de salida para no intercalarse con broadcasts que
+ * estén a medio escribir en el mismo socket.
  */
-void *handle_client_thread(void *args)
+int queue_message_to_client(client_info_t *client, const chat_message_t *msg)
 {
-    client_thread_args_t *client_args = (client_thread_args_t*)args;
-    server_context_t *ctx = client_args->server_ctx;
-    int client_socket = client_args->client_socket;
+    if (!client || !client->outbound || !msg) return -1;
     
-    char buffer[BUFFER_SIZE];
-    chat_message_t msg;
-    client_info_t *client = NULL;
+    shared_frame_t *frame = shared_frame_create(msg);
+    if (!frame) {
+        return -1;
+    }
     
-    LOG_INFO("Thread iniciado para cliente en socket %d", client_socket);
+    int result = outbound_queue_push(client->outbound, frame);
+    shared_frame_release(frame);
     
-    /* Esperar mensaje inicial de conexión con nombre de usuario */
-    ssize_t received = recv(client_socket, buffer, sizeof(buffer), 0);
-    if (received <= 0) {
-        LOG_ERROR("Error recibiendo mensaje inicial del cliente");
-        goto cleanup;
-    }
+    return result;
+}
+
+/**
+ * @brief Encola un mensaje seguido del historial de una sala en una escritura
+ * 
+ * Suelta las referencias de los frames del historial.
+ */
+static int queue_message_with_history(client_info_t *client, const chat_message_t *msg,
+                                      shared_frame_t **history, int history_count)
+{
+    shared_frame_t *batch[HISTORY_MAX_DEPTH + 1];
     
-    /* Deserializar mensaje inicial */
-    if (deserialize_message(buffer, received, &msg) < 0 || msg.type != MSG_CONNECT) {
-        LOG_ERROR("Mensaje inicial inválido del cliente");
-        goto cleanup;
+    batch[0] = shared_frame_create(msg);
+    int count = batch[0] ? 1 : 0;
+    for (int i = 0; i < history_count; i++) {
+        batch[count++] = history[i];
     }
     
-    /* Validar nombre de usuario */
-    if (!validate_username(msg.username)) {
-        LOG_ERROR("Nombre de usuario inválido: '%s'", msg.username);
-        chat_message_t error_msg;
-        init_message(&error_msg, MSG_ERROR, "Sistema", "Nombre de usuario inválido");
-        send_message_to_client(client_socket, &error_msg);
-        goto cleanup;
-    }
+    int result = count > 0 ? outbound_queue_push_batch(client->outbound, batch, count) : -1;
     
-    /* Agregar cliente a la lista */
-    int client_index = add_client(ctx, client_socket, client_args->client_addr, msg.username);
-    if (client_index < 0) {
-        LOG_ERROR("Error agregando cliente '%s'", msg.username);
-        chat_message_t error_msg;
-        init_message(&error_msg, MSG_ERROR, "Sistema", "Servidor lleno. Intente más tarde.");
-        send_message_to_client(client_socket, &error_msg);
-        goto cleanup;
+    for (int i = 0; i < count; i++) {
+        shared_frame_release(batch[i]);
     }
+    return result;
+}
+
+/**
+ * @brief Envía a una sala un cambio de su lista de usuarios
+ * 
+ * Solo lo reciben los miembros que negociaron la presencia; no cruza el
+ * clúster, porque cada nodo numera sus propias versiones.
+ * 
+ * @param member_of Cliente cuya sala recibe el cambio (excluido él), o NULL
+ * @param room_name Sala buscada por nombre si member_of es NULL
+ * @param op '+' si entró, '-' si salió
+ * @param version Versión de la sala tras el cambio
+ */
+static void publish_presence(server_context_t *ctx, const client_info_t *member_of,
+                             const char *room_name, char op, unsigned long long version,
+                             const char *username)
+{
+    char content[MESSAGE_SIZE];
+    snprintf(content, sizeof(content), "%c%llu %s %s", op, version, room_name, username);
     
-    /* Obtener referencia al cliente */
-    client = find_client(ctx, client_socket);
-    if (!client) {
-        LOG_ERROR("Error encontrando cliente recién agregado");
-        goto cleanup;
-    }
+    chat_message_t presence_msg;
+    init_message(&presence_msg, MSG_PRESENCE, "Sistema", content);
+    fan_out_messages(ctx, member_of, member_of ? NULL : room_name, &presence_msg, 1,
+                     member_of ? member_of->socket_fd : -1);
+}
+
+/**
+ * @brief Envía a un cliente la lista completa de usuarios de su sala
+ * 
+ * Bajo clients_mutex solo se copian los nombres y la versión; los trozos
+ * se serializan después y se encolan en un solo lote, de modo que ningún
+ * cambio se intercala entre ellos. Activa además la presencia del
+ * cliente, para que reciba los cambios posteriores.
+ */
+static void send_presence_snapshot(server_context_t *ctx, client_info_t *client)
+{
+    char (*names)[USERNAME_SIZE] = NULL;
+    char room_name[ROOM_NAME_SIZE] = "";
+    unsigned long long version = 0;
+    int count = 0;
     
-    /* Guardar thread ID */
-    client->thread_id = pthread_self();
+    pthread_mutex_lock(&ctx->clients_mutex);
+    client->presence = 1;
+    const chat_room_t *room = client->room;
+    if (room && room->member_count > 0) {
+        names = malloc((size_t)room->member_count * sizeof(*names));
+        if (names) {
+            count = room->member_count;
+            for (int i = 0; i < count; i++) {
+                memcpy(names[i], room->members[i]->username, USERNAME_SIZE);
+            }
+            memcpy(room_name, room->name, ROOM_NAME_SIZE);
+            version = room->presence_version;
+        }
+    }
+    pthread_mutex_unlock(&ctx->clients_mutex);
+    
+    if (!names) {
+        if (room) LOG_ERROR("Sin memoria para la lista de usuarios de '%s'", client->username);
+        return;
+    }
+    
+    /* Cada trozo lleva al menos un nombre: como mucho uno por miembro */
+    shared_frame_t **frames = malloc((size_t)count * sizeof(*frames));
+    int frame_count = 0;
+    for (int i = 0; frames && i < count; ) {
+        char content[MESSAGE_SIZE];
+        int length = snprintf(content, sizeof(content), "%c%llu %s",
+                              frame_count == 0 ? '=' : '&', version, room_name);
+        while (i < count) {
+            size_t name_length = strlen(names[i]);
+            if ((size_t)length + 1 + name_length >= sizeof(content)) break;
+            content[length++] = ' ';
+            memcpy(content + length, names[i], name_length + 1);
+            length += (int)name_length;
+            i++;
+        }
+        
+        chat_message_t presence_msg;
+        init_message(&presence_msg, MSG_PRESENCE, "Sistema", content);
+        shared_frame_t *frame = shared_frame_create(&presence_msg);
+        if (!frame) break;
+        frames[frame_count++] = frame;
+    }
+    
+    if (frame_count > 0) {
+        outbound_queue_push_batch(client->outbound, frames, frame_count);
+        metrics_add(METRIC_PRESENCE_SNAPSHOTS, 1);
+    }
+    for (int i = 0; i < frame_count; i++) {
+        shared_frame_release(frames[i]);
+    }
+    free(frames);
+    free(names);
+}
+
+/**
+ * @brief Lee la petición de reanudar una sesión de un MSG_CONNECT
+ * @return 1 si el cliente presenta una sesión válida, 0 si no
+ */
+static int parse_session_resume(const chat_message_t *msg, session_resume_t *resume)
+{
+    char sequence[24];
+    char *end;
+    
+    memset(resume, 0, sizeof(*resume));
+    if (!message_get_field(msg, "session", resume->session, sizeof(resume->session)) ||
+        !message_get_field(msg, "room", resume->room, sizeof(resume->room)) ||
+        !message_get_field(msg, "seq", sequence, sizeof(sequence)) ||
+        !validate_room_name(resume->room)) {
+        return 0;
+    }
+    
+    errno = 0;
+    resume->sequence = strtoull(sequence, &end, 10);
+    return errno == 0 && end != sequence && *end == '\0';
+}
+
+/**
+ * @brief Lo negociado en un MSG_CONNECT, para el saludo del cliente
+ */
+typedef struct {
+    wire_format_t format;                   /* Formato de red aceptado */
+    int resumable;                          /* Acepta la reanudación de sesiones */
+    int presence;                           /* Acepta la presencia */
+    const session_resume_t *resume;         /* Sesión que se reanuda o NULL */
+} handshake_greeting_t;
+
+/**
+ * @brief Encola el acuse del formato, la bienvenida y el historial
+ * 
+ * Se llama desde add_client() con clients_mutex tomado, antes de que el
+ * fan-out vea al cliente: el acuse viaja en legacy para que el cliente lo
+ * entienda antes de cambiar de formato, y el resto ya en el negociado.
+ */
+static void greet_new_client(client_info_t *client, shared_frame_t **history,
+                             int history_count, void *arg)
+{
+    const handshake_greeting_t *greeting = (const handshake_greeting_t*)arg;
+    const session_resume_t *resume = greeting->resume;
+    
+    /* Confirmar el formato compacto (y la compresión y la reanudación, si
+     * se aceptaron) */
+    if (greeting->format != WIRE_FORMAT_LEGACY) {
+        char capabilities[128];
+        int written = snprintf(capabilities, sizeof(capabilities), "%s",
+                               greeting->format == WIRE_FORMAT_DEFLATE ?
+                               WIRE_CAPABILITY " " WIRE_DEFLATE_CAPABILITY : WIRE_CAPABILITY);
+        if (greeting->resumable && client->session[0]) {
+            snprintf(capabilities + written, sizeof(capabilities) - (size_t)written,
+                     " " WIRE_RESUME_CAPABILITY " session=%s", client->session);
+            outbound_queue_set_sequenced(client->outbound, 1);
+        }
+        if (greeting->presence) {
+            snprintf(capabilities + strlen(capabilities), sizeof(capabilities) - strlen(capabilities),
+                     " " WIRE_PRESENCE_CAPABILITY);
+        }
+        /* Los lotes se aceptan siempre: frame_buffer_next() los abre */
+        snprintf(capabilities + strlen(capabilities), sizeof(capabilities) - strlen(capabilities),
+                 " " WIRE_BATCH_CAPABILITY);
+        
+        chat_message_t wire_ack;
+        init_message(&wire_ack, MSG_CONNECT, "Sistema", capabilities);
+        queue_message_to_client(client, &wire_ack);
+        outbound_queue_set_format(client->outbound, greeting->format);
+    }
     
-    /* Notificar conexión exitosa al cliente */
+    /* Notificar conexión exitosa al cliente, con el historial de su sala
+     * en la misma escritura: al reanudar, solo lo que se perdió */
     chat_message_t welcome_msg;
-    init_message(&welcome_msg, MSG_NOTIFICATION, "Sistema", 
-                 "Conectado al chat. ¡Bienvenido!");
-    send_message_to_client(client_socket, &welcome_msg);
+    if (resume) {
+        char text[MESSAGE_SIZE];
+        int written = snprintf(text, sizeof(text), "Sesión reanudada en la sala '%s': %d mensajes nuevos",
+                               resume->room, history_count);
+        if (resume->missed > 0) {
+            snprintf(text + written, sizeof(text) - (size_t)written,
+                     " (%llu ya no están en el historial)", resume->missed);
+        }
+        init_message(&welcome_msg, MSG_NOTIFICATION, "Sistema", text);
+        metrics_add(METRIC_SESSION_RESUMES, 1);
+        metrics_add(METRIC_RESUME_REPLAYED, (unsigned long long)history_count);
+        LOG_INFO("Cliente '%s' reanuda su sesión en '%s' desde el mensaje %llu (%d reenviados)",
+                 client->username, resume->room, resume->sequence, history_count);
+    } else {
+        init_message(&welcome_msg, MSG_NOTIFICATION, "Sistema", 
+                     "Conectado al chat. ¡Bienvenido!");
+    }
+    queue_message_with_history(client, &welcome_msg, history, history_count);
+}
+
+/**
+ * @brief Completa el handshake de un cliente a partir de su MSG_CONNECT
+ * 
+ * Contiene la lógica común a todos los motores una vez recibido el
+ * mensaje inicial: validación, registro, bienvenida y notificación.
+ */
+client_info_t *complete_client_handshake(server_context_t *ctx, int client_socket,
+                                         struct sockaddr_in client_addr,
+                                         const chat_message_t *msg)
+{
+    if (!ctx || !msg) return NULL;
+    
+    if (msg->type != MSG_CONNECT) {
+        LOG_ERROR("Mensaje inicial inválido del cliente");
+        return NULL;
+    }
+    
+    /* Los clientes antiguos no anuncian el formato compacto */
+    wire_format_t format = message_offers_compact_wire(msg) ? 
+                           WIRE_FORMAT_COMPACT : WIRE_FORMAT_LEGACY;
+    if (format == WIRE_FORMAT_COMPACT && ctx->compression && message_offers_deflate(msg)) {
+        format = WIRE_FORMAT_DEFLATE;
+    }
+    
+    /* Los números de secuencia solo viajan en el envoltorio de los frames compactos */
+    int resumable = format != WIRE_FORMAT_LEGACY && message_offers_resume(msg);
+    int presence = format != WIRE_FORMAT_LEGACY && message_offers_presence(msg);
+    session_resume_t resume;
+    session_resume_t *resuming = resumable && parse_session_resume(msg, &resume) ? &resume : NULL;
+    
+    /* Validar nombre de usuario */
+    if (!validate_username(msg->username)) {
+        LOG_ERROR("Nombre de usuario inválido: '%s'", msg->username);
+        chat_message_t error_msg;
+        init_message(&error_msg, MSG_ERROR, "Sistema", "Nombre de usuario inválido");
+        send_message_to_client(client_socket, format, &error_msg);
+        return NULL;
+    }
+    
+    /* Agregar cliente a la lista; el saludo se encola antes de publicarlo */
+    handshake_greeting_t greeting = { format, resumable, presence, resuming };
+    int result = add_client(ctx, client_socket, client_addr, msg->username, resuming,
+                            greet_new_client, &greeting);
+    if (result != SUCCESS) {
+        LOG_ERROR("Error agregando cliente '%s'", msg->username);
+        chat_message_t error_msg;
+        init_message(&error_msg, MSG_ERROR, "Sistema", result == ERROR_DUPLICATE ?
+                     "Nombre de usuario en uso. Elija otro." : result == ERROR_RETRY ?
+                     "Cerrando la conexión anterior de la sesión. Reintente." :
+                     "Servidor lleno. Intente más tarde.");
+        send_message_to_client(client_socket, format, &error_msg);
+        return NULL;
+    }
+    
+    /* Obtener referencia al cliente */
+    client_info_t *client = find_client(ctx, client_socket);
+    if (!client) {
+        LOG_ERROR("Error encontrando cliente recién agregado");
+        return NULL;
+    }
+    CHAT_TRACE4(handshake, client_socket, client->username, (int)format, resuming != NULL);
+    
+    /* La lista de usuarios de su sala, antes de que lleguen cambios */
+    if (presence) {
+        send_presence_snapshot(ctx, client);
+    }
+    
+    /* Notificar a los otros miembros de su sala */
+    notify_user_connected(ctx, client);
+    
+    return client;
+}
+
+/**
+ * @brief Avanza el handshake TLS de una conexión recién aceptada
+ */
+tls_step_t server_tls_step(tls_session_t **session, int client_socket)
+{
+    tls_step_t step = tls_session_step(*session);
+    
+    if (step == TLS_STEP_WANT_READ || step == TLS_STEP_WANT_WRITE) {
+        return step;
+    }
+    
+    if (step == TLS_STEP_DONE) {
+        int resumed = tls_session_resumed(*session);
+        metrics_add(METRIC_TLS_HANDSHAKES, 1);
+        if (resumed) {
+            metrics_add(METRIC_TLS_RESUMED, 1);
+        }
+        LOG_DEBUG("Handshake TLS completado en socket %d (%s)", client_socket,
+                 resumed ? "sesión reanudada" : "sesión nueva");
+    } else {
+        metrics_add(METRIC_TLS_FAILURES, 1);
+        LOG_ERROR("Handshake TLS fallido en socket %d", client_socket);
+    }
+    
+    tls_session_free(*session);
+    *session = NULL;
+    return step;
+}
+
+/**
+ * @brief Handshake TLS de un thread de cliente dentro del plazo de conexión
+ * @param wake_fd eventfd del thread: despierta la espera al detener el servidor
+ * @return 0 con kTLS instalado, -1 si la conexión debe cerrarse
+ */
+static int thread_tls_handshake(server_context_t *ctx, int client_socket, int wake_fd,
+                                long long deadline)
+{
+    tls_session_t *session = tls_session_start(ctx->tls, client_socket, NULL);
+    tls_step_t step;
+    
+    while ((step = server_tls_step(&session, client_socket)) == TLS_STEP_WANT_READ ||
+           step == TLS_STEP_WANT_WRITE) {
+        long long now = timer_now_ms();
+        if (!ctx->running || now >= deadline) {
+            LOG_INFO("Conexión en socket %d sin handshake TLS tras %lld ms, cerrando",
+                    client_socket, ctx->timeout_ms);
+            metrics_add(METRIC_TLS_FAILURES, 1);
+            tls_session_free(session);
+            return -1;
+        }
+        
+        struct pollfd fds[2];
+        fds[0].fd = client_socket;
+        fds[0].events = step == TLS_STEP_WANT_READ ? POLLIN : POLLOUT;
+        fds[1].fd = wake_fd;
+        fds[1].events = POLLIN;
+        fds[0].revents = fds[1].revents = 0;
+        if (poll(fds, 2, (int)(deadline - now)) < 0 && errno != EINTR) {
+            LOG_ERROR("Error en poll para socket %d: %s", client_socket, strerror(errno));
+            tls_session_free(session);
+            return -1;
+        }
+    }
+    
+    return step == TLS_STEP_DONE ? 0 : -1;
+}
+
+/**
+ * @brief Saca un thread de la lista de threads vivos y libera sus argumentos
+ * 
+ * Es lo último que hace cada thread de cliente: a partir de aquí
+ * stop_client_threads() ya no lo espera.
+ */
+static void finish_client_thread(client_thread_args_t *client_args)
+{
+    int wake_fd = client_args->wake_fd;
+    
+    pthread_mutex_lock(&client_threads_lock);
+    if (client_args->prev) {
+        client_args->prev->next = client_args->next;
+    } else {
+        client_threads = client_args->next;
+    }
+    if (client_args->next) {
+        client_args->next->prev = client_args->prev;
+    }
+    if (!client_threads) {
+        pthread_cond_broadcast(&client_threads_done);
+    }
+    pthread_mutex_unlock(&client_threads_lock);
+    
+    SAFE_CLOSE(wake_fd);
+    pool_free(&thread_args_pool, client_args);
+}
+
+/**
+ * @brief Thread principal para manejar un cliente individual
+ * 
+ * Función que ejecuta cada thread de cliente, manejando la recepción
+ * de mensajes y el procesamiento de los mismos. El thread también termina
+ * las escrituras que su cola de salida no pudo completar sin bloquear:
+ * espera con poll() a que el socket sea escribible cuando la cola lo
+ * señala a través de un eventfd propio. El mismo eventfd lo despierta
+ * cuando el servidor se detiene.
+ */
+void *handle_client_thread(void *args)
+{
+    client_thread_args_t *client_args = (client_thread_args_t*)args;
+    server_context_t *ctx = client_args->server_ctx;
+    int client_socket = client_args->client_socket;
+    int wake_fd = client_args->wake_fd;
+    
+    frame_buffer_t rx;
+    client_info_t *client = client_args->client;
+    long long handshake_deadline = timer_now_ms() + ctx->timeout_ms;
+    
+    LOG_INFO("Thread iniciado para cliente en socket %d", client_socket);
+    
+    /* Con TLS, el handshake consume el mismo plazo que el MSG_CONNECT; un
+     * cliente heredado ya lo hizo con la versión anterior */
+    if (!client && ctx->tls &&
+        thread_tls_handshake(ctx, client_socket, wake_fd, handshake_deadline) < 0) {
+        SAFE_CLOSE(client_socket);
+        finish_client_thread(client_args);
+        return NULL;
+    }
+    
+    if (frame_buffer_init(&rx, FRAME_BUFFER_SIZE) != SUCCESS) {
+        LOG_ERROR("Error asignando buffer de recepción para socket %d", client_socket);
+        if (client) {
+            handle_client_disconnect(ctx, client);
+        } else {
+            SAFE_CLOSE(client_socket);
+        }
+        finish_client_thread(client_args);
+        return NULL;
+    }
     
-    /* Notificar a otros clientes sobre la nueva conexión */
-    notify_user_connected(ctx, msg.username, client_socket);
+    if (client) {
+        /* Cliente heredado: continúa el frame que la versión anterior
+         * recibió a medias */
+        client->thread_id = pthread_self();
+        outbound_queue_set_wake_fd(client->outbound, wake_fd);
+        if (server_restore_client_input(client, &rx) < 0) {
+            LOG_ERROR("Datos heredados de '%s' no caben en el buffer", client->username);
+        }
+    }
     
-    /* Bucle principal de manejo de mensajes */
-    while (ctx->running && client->active) {
-        received = recv(client_socket, buffer, sizeof(buffer), 0);
+    /* Bucle principal: el primer frame completo debe ser el MSG_CONNECT */
+    while (ctx->running && (!client || client->active)) {
+        /* Cada thread espera solo hasta su propio vencimiento: no hace
+         * falta una rueda compartida ni un thread de temporizadores */
+        long long now = timer_now_ms();
+        int timeout_ms = -1;
+        if (!client) {
+            if (now >= handshake_deadline) {
+                LOG_INFO("Conexión en socket %d sin handshake tras %lld ms, cerrando",
+                        client_socket, ctx->timeout_ms);
+                break;
+            }
+            timeout_ms = (int)(handshake_deadline - now);
+        } else {
+            long long next_check;
+            if (check_client_liveness(ctx, client, now, &next_check) < 0) {
+                break;
+            }
+            if (next_check > 0) {
+                timeout_ms = next_check > now ? (int)(next_check - now) : 0;
+            }
+        }
+        
+        struct pollfd fds[2];
+        fds[0].fd = client_socket;
+        fds[0].events = POLLIN;
+        if (client && outbound_queue_pending(client->outbound)) {
+            fds[0].events |= POLLOUT;
+        }
+        fds[1].fd = wake_fd;
+        fds[1].events = POLLIN;
+        fds[0].revents = fds[1].revents = 0;
+        
+        if (poll(fds, 2, timeout_ms) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Error en poll para socket %d: %s", client_socket, strerror(errno));
+            break;
+        }
+        
+        if (fds[1].revents & POLLIN) {
+            /* La cola quedó esperando (el siguiente poll incluye POLLOUT)
+             * o el servidor se detiene */
+            uint64_t pending;
+            if (read(wake_fd, &pending, sizeof(pending)) < 0 && errno != EAGAIN) {
+                LOG_ERROR("Error leyendo eventfd del socket %d: %s", client_socket, strerror(errno));
+            }
+        }
+        
+        if ((fds[0].revents & POLLOUT) && outbound_queue_flush(client->outbound) < 0) {
+            break;
+        }
+        
+        if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+        
+        ssize_t received = frame_buffer_read(&rx, client_socket);
         
         if (received <= 0) {
-            if (received == 0) {
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                /* Socket heredado de un motor no bloqueante */
+                continue;
+            }
+            if (!client) {
+                LOG_ERROR("Error recibiendo mensaje inicial del cliente");
+            } else if (received == 0) {
                 LOG_INFO("Cliente '%s' cerró la conexión", client->username);
             } else {
                 LOG_ERROR("Error recibiendo datos del cliente '%s': %s", 
@@ -419,33 +1271,311 @@ void *handle_client_thread(void *args)
             }
             break;
         }
+        metrics_add(METRIC_BYTES_IN, (unsigned long long)received);
+        CHAT_TRACE2(recv, client_socket, received);
         
-        /* Procesar mensaje recibido */
-        if (deserialize_message(buffer, received, &msg) == 0) {
-            if (process_client_message(ctx, client, &msg) < 0) {
-                LOG_ERROR("Error procesando mensaje del cliente '%s'", client->username);
-                break;
-            }
-        } else {
-            LOG_ERROR("Error deserializando mensaje del cliente '%s'", client->username);
+        /* Procesar todos los frames completos recibidos */
+        int status;
+        while ((status = process_client_frames(ctx, &rx, client_socket,
+                                               client_args->client_addr, &client)) == 1) {
+            /* Guardar thread ID y recibir los avisos de su cola */
+            client->thread_id = pthread_self();
+            outbound_queue_set_wake_fd(client->outbound, wake_fd);
+        }
+        if (status < 0) {
+            break;
         }
     }
     
-cleanup:
     /* Manejar desconexión */
     if (client) {
-        handle_client_disconnect(ctx, client);
+        /* El eventfd se cierra con el thread: la cola deja de usarlo antes */
+        if (client->outbound) {
+            outbound_queue_set_wake_fd(client->outbound, -1);
+        }
+        if (ctx->handing_off) {
+            /* La conexión pasa a la versión nueva con lo que quedó sin procesar */
+            server_stash_client_input(client, &rx);
+        } else {
+            handle_client_disconnect(ctx, client);
+        }
     } else {
         SAFE_CLOSE(client_socket);
     }
     
-    /* Liberar argumentos del thread */
-    free(client_args);
-    
+    frame_buffer_free(&rx);
     LOG_INFO("Thread de cliente finalizado");
+    finish_client_thread(client_args);
     return NULL;
 }
 
+/**
+ * @brief Reparte los mensajes de chat acumulados de un cliente
+ */
+static void flush_chat_batch(server_context_t *ctx, client_info_t *client,
+                             chat_message_t *batch, int *count)
+{
+    if (*count == 0) return;
+    
+    int sent = broadcast_batch_to_room(ctx, client, batch, *count);
+    if (*count == 1) {
+        LOG_INFO("Mensaje de '%s' enviado a %d clientes de la sala '%s'",
+                client->username, sent, client->room ? client->room->name : "");
+    } else {
+        LOG_INFO("%d mensajes de '%s' enviados juntos a %d clientes de la sala '%s'",
+                *count, client->username, sent, client->room ? client->room->name : "");
+    }
+    *count = 0;
+}
+
+/**
+ * @brief Procesa los frames completos acumulados de un cliente
+ * 
+ * Mientras el cliente no esté registrado, el primer frame se trata como
+ * handshake. Después, cada frame se entrega a process_client_message(),
+ * salvo los mensajes de chat seguidos (sueltos o de un lote), que se
+ * acumulan y se reparten juntos con broadcast_batch_to_room(): un solo
+ * recorrido de la sala y una sola escritura por miembro. Cualquier otro
+ * mensaje reparte antes lo acumulado, así que el orden se conserva.
+ */
+int process_client_frames(server_context_t *ctx, frame_buffer_t *rx, int client_socket,
+                          struct sockaddr_in client_addr, client_info_t **client)
+{
+    if (!ctx || !rx || !client) return -1;
+    
+    chat_message_t msg;
+    chat_message_t batch[BROADCAST_BATCH_MAX];
+    int batched = 0;
+    
+    if (*client) {
+        __atomic_store_n(&(*client)->last_activity_ms, timer_now_ms(), __ATOMIC_RELAXED);
+    }
+    
+    for (;;) {
+        size_t pending = frame_buffer_pending(rx);
+        int status = frame_buffer_next(rx, &msg);
+        
+        if (status == FRAME_INCOMPLETE) {
+            flush_chat_batch(ctx, *client, batch, &batched);
+            return 0;
+        }
+        if (status == FRAME_CORRUPT) {
+            flush_chat_batch(ctx, *client, batch, &batched);
+            LOG_ERROR("Flujo de datos inválido del cliente en socket %d", client_socket);
+            return -1;
+        }
+        
+        metrics_add(METRIC_MESSAGES_IN, 1);
+        
+        if (!*client) {
+            if (status != FRAME_READY) {
+                LOG_ERROR("Mensaje inicial inválido del cliente");
+                return -1;
+            }
+            /* Registrar cliente y notificar al resto */
+            *client = complete_client_handshake(ctx, client_socket, client_addr, &msg);
+            return *client ? 1 : -1;
+        }
+        
+        if (status == FRAME_INVALID) {
+            LOG_ERROR("Error deserializando mensaje del cliente '%s'", (*client)->username);
+            continue;
+        }
+        CHAT_TRACE4(message, client_socket, (*client)->username, (int)msg.type,
+                    pending - frame_buffer_pending(rx));
+        
+        if (msg.type == MSG_CHAT) {
+            if (allow_client_message(ctx, *client)) {
+                init_message(&batch[batched++], MSG_CHAT, (*client)->username, msg.content);
+                if (batched == BROADCAST_BATCH_MAX) {
+                    flush_chat_batch(ctx, *client, batch, &batched);
+                }
+            }
+            continue;
+        }
+        
+        flush_chat_batch(ctx, *client, batch, &batched);
+        if (process_client_message(ctx, *client, &msg) < 0 || !(*client)->active) {
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief Mueve a un cliente a otra sala y avisa a ambas
+ * 
+ * La sala anterior recibe el aviso mientras el cliente aún es miembro,
+ * porque puede liberarse en cuanto se quede vacía. El cliente recibe un
+ * MSG_JOIN con el nombre de su nueva sala seguido de su historial, ambos
+ * encolados en la misma sección crítica que la entrada: ningún mensaje de
+ * la nueva sala se les adelanta. Si recibe números de secuencia, el
+ * MSG_JOIN añade "seq=N", el último del historial copiado.
+ */
+static void change_client_room(server_context_t *ctx, client_info_t *client, const char *room_name)
+{
+    chat_message_t reply;
+    char text[MESSAGE_SIZE];
+    
+    if (!validate_room_name(room_name)) {
+        init_message(&reply, MSG_ERROR, "Sistema", "Nombre de sala inválido");
+        queue_message_to_client(client, &reply);
+        return;
+    }
+    
+    if (client->room && strcmp(client->room->name, room_name) == 0) {
+        snprintf(text, sizeof(text), "Ya estás en la sala '%s'", room_name);
+        init_message(&reply, MSG_NOTIFICATION, "Sistema", text);
+        queue_message_to_client(client, &reply);
+        return;
+    }
+    
+    snprintf(text, sizeof(text), "[Usuario %s salió de la sala]", client->username);
+    init_message(&reply, MSG_NOTIFICATION, "Sistema", text);
+    broadcast_to_room(ctx, client, &reply, client->socket_fd);
+    
+    shared_frame_t *history[HISTORY_MAX_DEPTH];
+    int history_count = 0;
+    
+    /* El historial se copia y se encola en la misma sección crítica que la entrada */
+    char old_room[ROOM_NAME_SIZE] = "";
+    const chat_room_t *left = NULL;
+    int notify_old_room = 0;
+    unsigned long long left_version = 0;
+    pthread_mutex_lock(&ctx->clients_mutex);
+    if (client->room) {
+        memcpy(old_room, client->room->name, ROOM_NAME_SIZE);
+    }
+    int result = room_table_join(ctx->rooms, client, room_name);
+    int member_count = client->room ? client->room->member_count : 0;
+    if (result == SUCCESS) {
+        history_count = history_snapshot(ctx->history, room_name, history, &client->room_sequence);
+        client->presence_version = client->room->presence_version;
+        left = old_room[0] ? room_table_find(ctx->rooms, old_room) : NULL;
+        notify_old_room = left != NULL;
+        left_version = left ? left->presence_version : 0;
+        
+        if (client->outbound->sequenced) {
+            snprintf(text, sizeof(text), "%s seq=%llu", room_name, client->room_sequence);
+        } else {
+            snprintf(text, sizeof(text), "%s", room_name);
+        }
+        init_message(&reply, MSG_JOIN, "Sistema", text);
+        queue_message_with_history(client, &reply, history, history_count);
+    }
+    pthread_mutex_unlock(&ctx->clients_mutex);
+    
+    if (result == SUCCESS && ctx->room_hook) {
+        ctx->room_hook(ctx, client);
+    }
+    
+    if (result != SUCCESS) {
+        LOG_ERROR("Error moviendo a '%s' a la sala '%s'", client->username, room_name);
+        init_message(&reply, MSG_ERROR, "Sistema", "No se pudo entrar en la sala");
+        queue_message_to_client(client, &reply);
+        return;
+    }
+    
+    LOG_INFO("Cliente '%s' entró en la sala '%s' (%d miembros)",
+            client->username, room_name, member_count);
+    
+    snprintf(text, sizeof(text), "[Usuario %s entró en la sala]", client->username);
+    init_message(&reply, MSG_NOTIFICATION, "Sistema", text);
+    broadcast_to_room(ctx, client, &reply, client->socket_fd);
+    
+    if (notify_old_room) {
+        publish_presence(ctx, NULL, old_room, '-', left_version, client->username);
+    }
+    publish_presence(ctx, client, room_name, '+', client->presence_version, client->username);
+    
+    if (client->presence) {
+        send_presence_snapshot(ctx, client);
+    }
+}
+
+/**
+ * @brief Revisa la actividad de un cliente y envía un keepalive si toca
+ * 
+ * Cualquier dato recibido después del sondeo demuestra que la conexión
+ * vive; el sondeo solo se da por contestado al llegar su MSG_KEEPALIVE,
+ * de modo que esa respuesta nunca se contesta a su vez.
+ */
+int check_client_liveness(server_context_t *ctx, client_info_t *client,
+                          long long now_ms, long long *next_check_ms)
+{
+    *next_check_ms = 0;
+    if (!ctx || !client || ctx->keepalive_ms <= 0) return 0;
+    
+    long long last_activity = __atomic_load_n(&client->last_activity_ms, __ATOMIC_RELAXED);
+    long long probe_sent = __atomic_load_n(&client->keepalive_sent_ms, __ATOMIC_ACQUIRE);
+    
+    if (probe_sent != 0 && last_activity < probe_sent) {
+        if (now_ms - probe_sent >= ctx->timeout_ms) {
+            LOG_INFO("Cliente '%s' no respondió al keepalive en %lld ms, desconectando",
+                    client->username, ctx->timeout_ms);
+            return -1;
+        }
+        *next_check_ms = probe_sent + ctx->timeout_ms;
+        return 0;
+    }
+    
+    if (now_ms - last_activity < ctx->keepalive_ms) {
+        *next_check_ms = last_activity + ctx->keepalive_ms;
+        return 0;
+    }
+    
+    /* Inactivo: sondear y esperar la respuesta */
+    LOG_DEBUG("Cliente '%s' inactivo durante %lld ms, enviando keepalive",
+             client->username, now_ms - last_activity);
+    __atomic_store_n(&client->keepalive_sent_ms, now_ms, __ATOMIC_RELEASE);
+    
+    chat_message_t probe;
+    init_message(&probe, MSG_KEEPALIVE, "Sistema", "");
+    queue_message_to_client(client, &probe);
+    
+    *next_check_ms = now_ms + ctx->timeout_ms;
+    return 0;
+}
+
+/**
+ * @brief Aplica los límites de envío a un mensaje que provoca fan-out
+ * 
+ * Se comprueba antes de serializar o recorrer ninguna sala: un cliente
+ * que envía en bucle solo gasta el coste de recibir sus frames. Primero
+ * su propia cubeta, sin lock (solo la toca quien procesa sus mensajes);
+ * después la de su IP. Los descartes se avisan con MSG_ERROR como mucho
+ * una vez cada RATE_LIMIT_NOTICE_MS, no uno por mensaje descartado.
+ * 
+ * @return 1 si el mensaje puede procesarse, 0 si se descarta
+ */
+static int allow_client_message(server_context_t *ctx, client_info_t *client)
+{
+    if (ctx->message_rate <= 0 && !ctx->message_limiter) return 1;
+    
+    long long now_ms = timer_now_ms();
+    int allowed = 1;
+    if (ctx->message_rate > 0 &&
+        !token_bucket_take(&client->send_bucket, ctx->message_rate, ctx->message_burst, now_ms)) {
+        metrics_add(METRIC_RATE_LIMITED_CLIENT, 1);
+        allowed = 0;
+    } else if (!admission_allow(ctx->message_limiter, &client->address, now_ms)) {
+        metrics_add(METRIC_RATE_LIMITED_IP, 1);
+        allowed = 0;
+    }
+    
+    if (allowed) return 1;
+    
+    if (client->send_warned_ms == 0 || now_ms - client->send_warned_ms >= RATE_LIMIT_NOTICE_MS) {
+        client->send_warned_ms = now_ms;
+        LOG_INFO("Cliente '%s' supera el límite de mensajes; se descartan los que excedan",
+                client->username);
+        chat_message_t error_msg;
+        init_message(&error_msg, MSG_ERROR, "Sistema",
+                     "Demasiados mensajes: se descartan hasta que baje el ritmo.");
+        queue_message_to_client(client, &error_msg);
+    }
+    return 0;
+}
+
 /**
  * @brief Procesa un mensaje recibido de un cliente
  * 
@@ -457,17 +1587,78 @@ int process_client_message(server_context_t *ctx, client_info_t *client,
 {
     if (!ctx || !client || !msg) return -1;
     
+    /* Lo que provoca fan-out pasa antes por los límites de envío */
+    if ((msg->type == MSG_CHAT || msg->type == MSG_PRIVATE || msg->type == MSG_PRESENCE ||
+         msg->type == MSG_JOIN || msg->type == MSG_LEAVE) &&
+        !allow_client_message(ctx, client)) {
+        return 0;
+    }
+    
     switch (msg->type) {
         case MSG_CHAT:
-            /* Broadcast del mensaje de chat a todos los clientes */
+            /* Fan-out del mensaje de chat a los miembros de su sala */
             {
                 chat_message_t broadcast_msg;
                 init_message(&broadcast_msg, MSG_CHAT, client->username, msg->content);
-                int sent = broadcast_message(ctx, &broadcast_msg, -1);
-                LOG_INFO("Mensaje de '%s' enviado a %d clientes", client->username, sent);
+                int sent = broadcast_to_room(ctx, client, &broadcast_msg, -1);
+                LOG_INFO("Mensaje de '%s' enviado a %d clientes de la sala '%s'",
+                        client->username, sent, client->room ? client->room->name : "");
+            }
+            break;
+            
+        case MSG_PRIVATE:
+            /* Entrega directa al destinatario nombrado al inicio del contenido */
+            {
+                char recipient[USERNAME_SIZE];
+                const char *text = msg->content;
+                size_t length = strnlen(text, sizeof(msg->content));
+                length = length < sizeof(msg->content) ? strcspn(text, " ") : 0;
+                
+                /* Sin destinatario válido el remitente recibe el mismo tipo de aviso */
+                chat_message_t error_msg;
+                char error_text[MESSAGE_SIZE];
+                if (length == 0 || length >= sizeof(recipient) || text[length] != ' ') {
+                    LOG_DEBUG("Mensaje privado de '%s' sin destinatario válido", client->username);
+                    snprintf(error_text, sizeof(error_text),
+                             "Mensaje privado inválido: use 'USUARIO texto' (usuario de hasta %d caracteres)",
+                             USERNAME_SIZE - 1);
+                    init_message(&error_msg, MSG_ERROR, "Sistema", error_text);
+                    queue_message_to_client(client, &error_msg);
+                    break;
+                }
+                memcpy(recipient, text, length);
+                recipient[length] = '\0';
+                
+                int result = send_private_message(ctx, client, recipient, text + length + 1);
+                if (result == SUCCESS) {
+                    LOG_DEBUG("Mensaje privado de '%s' entregado a '%s'", client->username, recipient);
+                } else {
+                    snprintf(error_text, sizeof(error_text), result == ERROR_NOT_FOUND ?
+                             "El usuario '%s' no está conectado" :
+                             "No se pudo entregar el mensaje a '%s'", recipient);
+                    init_message(&error_msg, MSG_ERROR, "Sistema", error_text);
+                    queue_message_to_client(client, &error_msg);
+                }
+            }
+            break;
+            
+        case MSG_PRESENCE:
+            /* El cliente perdió algún cambio: lista completa otra vez */
+            if (client->presence) {
+                send_presence_snapshot(ctx, client);
             }
             break;
             
+        case MSG_JOIN:
+            /* Cambiar a la sala indicada en el contenido */
+            change_client_room(ctx, client, msg->content);
+            break;
+            
+        case MSG_LEAVE:
+            /* Volver a la sala por defecto */
+            change_client_room(ctx, client, ROOM_DEFAULT_NAME);
+            break;
+            
         case MSG_DISCONNECT:
             /* El cliente solicita desconectarse */
             LOG_INFO("Cliente '%s' (socket %d) solicita desconexión", client->username, client->socket_fd);
@@ -475,32 +1666,23 @@ int process_client_message(server_context_t *ctx, client_info_t *client,
             /* Marcar que ya se procesó la desconexión */
             client->disconnect_notified = 1;
             
-            /* Notificar a otros clientes sobre la desconexión */
-            {
-                chat_message_t disconnect_notification;
-                char notification_text[MESSAGE_SIZE];
-                
-                snprintf(notification_text, sizeof(notification_text), 
-                         "[Usuario %s se desconectó]", client->username);
-                
-                init_message(&disconnect_notification, MSG_NOTIFICATION, 
-                           "Sistema", notification_text);
-                
-                /* Enviar notificación a todos los otros clientes */
-                int sent = broadcast_message(ctx, &disconnect_notification, client->socket_fd);
-                LOG_INFO("Notificación de desconexión de '%s' enviada a %d clientes", 
-                        client->username, sent);
-            }
+            /* Notificar a los otros miembros de su sala */
+            notify_user_disconnected(ctx, client);
             
             client->active = 0;
             return -1;
             
         case MSG_KEEPALIVE:
-            /* Responder al keepalive */
+            /* La respuesta a un sondeo propio no se contesta: se evita el eco */
+            if (__atomic_exchange_n(&client->keepalive_sent_ms, 0, __ATOMIC_ACQ_REL) != 0) {
+                break;
+            }
+            
+            /* Responder al keepalive del cliente */
             {
                 chat_message_t keepalive_response;
                 init_message(&keepalive_response, MSG_KEEPALIVE, "Sistema", "");
-                send_message_to_client(client->socket_fd, &keepalive_response);
+                queue_message_to_client(client, &keepalive_response);
             }
             break;
             
@@ -523,75 +1705,70 @@ void handle_client_disconnect(server_context_t *ctx, client_info_t *client)
 {
     if (!ctx || !client) return;
     
-    char username[USERNAME_SIZE];
-    strncpy(username, client->username, USERNAME_SIZE - 1);
-    username[USERNAME_SIZE - 1] = '\0';
-    
-    /* Remover cliente de la lista */
+    /* Remover cliente de la lista; la notificación a su sala se envía
+     * antes de sacarlo de ella */
     remove_client(ctx, client->socket_fd);
-    
-    /* Notificar desconexión a otros clientes */
-    notify_user_disconnected(ctx, username);
 }
 
 /**
  * @brief Envía notificación de conexión de usuario
  * 
- * Crea y envía una notificación a todos los clientes sobre
- * la conexión de un nuevo usuario.
+ * Crea y envía una notificación a los otros miembros de la sala
+ * del usuario recién conectado, y el cambio de su lista de usuarios a
+ * los que negociaron la presencia.
  */
-void notify_user_connected(server_context_t *ctx, const char *username, int exclude_socket)
+void notify_user_connected(server_context_t *ctx, const client_info_t *client)
 {
-    if (!ctx || !username) return;
+    if (!ctx || !client) return;
     
     char notification[MESSAGE_SIZE];
-    snprintf(notification, sizeof(notification), "[Usuario %s se conectó]", username);
+    snprintf(notification, sizeof(notification), "[Usuario %s se conectó]", client->username);
     
     chat_message_t notify_msg;
     init_message(&notify_msg, MSG_NOTIFICATION, "Sistema", notification);
     
-    int sent = broadcast_message(ctx, &notify_msg, exclude_socket);
-    LOG_INFO("Notificación de conexión de '%s' enviada a %d clientes", username, sent);
+    int sent = broadcast_to_room(ctx, client, &notify_msg, client->socket_fd);
+    LOG_INFO("Notificación de conexión de '%s' enviada a %d clientes", client->username, sent);
+    
+    if (client->room) {
+        publish_presence(ctx, client, client->room->name, '+', client->presence_version,
+                         client->username);
+    }
 }
 
 /**
  * @brief Envía notificación de desconexión de usuario
  * 
- * Crea y envía una notificación a todos los clientes sobre
- * la desconexión de un usuario.
+ * Crea y envía una notificación a los otros miembros de la sala
+ * del usuario que se desconecta; se llama antes de sacarlo de ella.
  */
-void notify_user_disconnected(server_context_t *ctx, const char *username)
+void notify_user_disconnected(server_context_t *ctx, const client_info_t *client)
 {
-    if (!ctx || !username) return;
+    if (!ctx || !client) return;
     
     char notification[MESSAGE_SIZE];
-    snprintf(notification, sizeof(notification), "[Usuario %s se desconectó]", username);
+    snprintf(notification, sizeof(notification), "[Usuario %s se desconectó]", client->username);
     
     chat_message_t notify_msg;
     init_message(&notify_msg, MSG_NOTIFICATION, "Sistema", notification);
     
-    int sent = broadcast_message(ctx, &notify_msg, -1);
-    LOG_INFO("Notificación de desconexión de '%s' enviada a %d clientes", username, sent);
+    int sent = broadcast_to_room(ctx, client, &notify_msg, client->socket_fd);
+    LOG_INFO("Notificación de desconexión de '%s' enviada a %d clientes", client->username, sent);
 }
 
 /**
  * @brief Manejador de señales para cierre graceful del servidor
  * 
- * Maneja señales SIGINT y SIGTERM para realizar cierre ordenado.
+ * Maneja señales SIGINT y SIGTERM para realizar cierre ordenado. Solo
+ * escribe variables sig_atomic_t: el logger no es async-signal-safe. Los
+ * motores esperan con timeout y salen al ver ctx->running a 0.
  */
 void signal_handler(int sig)
 {
-    LOG_INFO("Señal %d recibida, iniciando cierre del servidor...", sig);
+    g_shutdown_signal = sig;
     
     if (g_server_ctx) {
         g_server_ctx->running = 0;
-        
-        /* Forzar salida de accept() cerrando el socket del servidor */
-        if (g_server_ctx->server_socket >= 0) {
-            LOG_INFO("Cerrando socket del servidor para forzar salida...");
-            close(g_server_ctx->server_socket);
-            g_server_ctx->server_socket = -1;
-        }
     }
 }
 
@@ -622,108 +1799,545 @@ void print_server_stats(const server_context_t *ctx)
     
     printf("\n=== ESTADÍSTICAS DEL SERVIDOR ===\n");
     printf("Estado: %s\n", ctx->running ? "Ejecutándose" : "Detenido");
-    printf("Clientes conectados: %d/%d\n", ctx->client_count, MAX_CLIENTS);
+    printf("Clientes conectados: %d/%d\n", ctx->clients->count, ctx->max_clients);
     
-    if (ctx->client_count > 0) {
+    if (ctx->clients->count > 0) {
         printf("\nClientes activos:\n");
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (ctx->clients[i].active) {
-                char time_str[32];
-                format_timestamp(ctx->clients[i].connect_time, time_str, sizeof(time_str));
-                printf("  - %s (conectado desde %s)\n", 
-                       ctx->clients[i].username, time_str);
-            }
+        for (int i = 0; i < ctx->clients->count; i++) {
+            client_info_t *client = ctx->clients->active[i];
+            char time_str[32];
+            outbound_stats_t stats;
+            format_timestamp(client->connect_time, time_str, sizeof(time_str));
+            outbound_queue_stats(client->outbound, &stats);
+            printf("  - %s (conectado desde %s)\n", client->username, time_str);
+            printf("    cola de salida: %zu frames, %zu bytes (pico %zu)%s, "
+                   "descartados %lu, agrupados %lu\n",
+                   stats.queued_frames, stats.queued_bytes, stats.peak_bytes,
+                   stats.congested ? " congestionada" : "",
+                   stats.dropped_frames, stats.coalesced_frames);
         }
     }
     printf("===============================\n\n");
 }
 
+/**
+ * @brief Decide si se admite una conexión recién aceptada
+ */
+int server_admit_connection(server_context_t *ctx, int client_socket,
+                            const struct sockaddr_in *client_addr)
+{
+    if (admission_allow(ctx->admission, client_addr, timer_now_ms())) {
+        CHAT_TRACE3(accept, client_socket, client_addr->sin_addr.s_addr, client_addr->sin_port);
+        return 0;
+    }
+    
+    /* Sin log por conexión: en una tormenta inundaría el log */
+    metrics_add(METRIC_ACCEPT_REJECTED, 1);
+    close(client_socket);
+    return -1;
+}
+
+/**
+ * @brief Crea el thread detached que atiende a un cliente
+ * @param client Cliente heredado ya registrado o NULL para una conexión nueva
+ */
+static void start_client_thread(server_context_t *ctx, int client_socket,
+                                struct sockaddr_in client_addr, client_info_t *client)
+{
+    if (!client) {
+        metrics_add(METRIC_CONNECTIONS, 1);
+        LOG_INFO("Nueva conexión desde %s:%d", 
+                inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+    }
+    
+    /* Crear argumentos para el thread del cliente */
+    client_thread_args_t *client_args = pool_alloc(&thread_args_pool);
+    int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!client_args || wake_fd < 0) {
+        LOG_ERROR("Error preparando el thread del socket %d: %s", client_socket, strerror(errno));
+        pool_free(&thread_args_pool, client_args);
+        SAFE_CLOSE(wake_fd);
+        if (client) {
+            remove_client(ctx, client_socket);
+        } else {
+            SAFE_CLOSE(client_socket);
+        }
+        return;
+    }
+    
+    client_args->client_socket = client_socket;
+    client_args->client_addr = client_addr;
+    client_args->server_ctx = ctx;
+    client_args->client = client;
+    client_args->wake_fd = wake_fd;
+    
+    /* Apuntarlo antes de crearlo: stop_client_threads() debe esperarlo */
+    pthread_mutex_lock(&client_threads_lock);
+    client_args->prev = NULL;
+    client_args->next = client_threads;
+    if (client_threads) {
+        client_threads->prev = client_args;
+    }
+    client_threads = client_args;
+    pthread_mutex_unlock(&client_threads_lock);
+    
+    /* Crear thread para manejar el cliente */
+    pthread_t client_thread;
+    if (pthread_create(&client_thread, NULL, handle_client_thread, client_args) != 0) {
+        LOG_ERROR("Error creando thread para cliente: %s", strerror(errno));
+        finish_client_thread(client_args);
+        if (client) {
+            remove_client(ctx, client_socket);
+        } else {
+            SAFE_CLOSE(client_socket);
+        }
+        return;
+    }
+    
+    /* Detach del thread para limpieza automática */
+    pthread_detach(client_thread);
+}
+
+/**
+ * @brief Lanza un thread por cada cliente heredado de la versión anterior
+ */
+static void adopt_client_threads(server_context_t *ctx)
+{
+    pthread_mutex_lock(&ctx->clients_mutex);
+    int count = ctx->clients->count;
+    client_info_t **adopted = count > 0 ? malloc((size_t)count * sizeof(client_info_t*)) : NULL;
+    if (adopted) {
+        memcpy(adopted, ctx->clients->active, (size_t)count * sizeof(client_info_t*));
+    }
+    pthread_mutex_unlock(&ctx->clients_mutex);
+    
+    if (count > 0 && !adopted) {
+        LOG_ERROR("Error asignando memoria para adoptar %d clientes", count);
+        return;
+    }
+    
+    /* Cada thread puede desconectar a su cliente en cuanto arranca: se
+     * recorre la copia, no la tabla */
+    for (int i = 0; i < count; i++) {
+        start_client_thread(ctx, adopted[i]->socket_fd, adopted[i]->address, adopted[i]);
+    }
+    free(adopted);
+}
+
+/**
+ * @brief Despierta a todos los threads de cliente y espera a que terminen
+ * 
+ * Sin esta espera, un thread que aún procesa un mensaje usaría el
+ * contexto mientras cleanup_server_context() lo libera.
+ */
+static void stop_client_threads(void)
+{
+    pthread_mutex_lock(&client_threads_lock);
+    for (client_thread_args_t *args = client_threads; args; args = args->next) {
+        uint64_t one = 1;
+        if (write(args->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_ERROR("Error despertando al thread del socket %d: %s",
+                     args->client_socket, strerror(errno));
+        }
+    }
+    while (client_threads) {
+        pthread_cond_wait(&client_threads_done, &client_threads_lock);
+    }
+    pthread_mutex_unlock(&client_threads_lock);
+}
+
+/**
+ * @brief Motor clásico: un thread por cliente con recv() bloqueante
+ * 
+ * El thread principal espera el socket de escucha (no bloqueante) con
+ * poll() y en cada despertar acepta todas las conexiones pendientes hasta
+ * EAGAIN; cada cliente admitido recibe un thread detached que ejecuta
+ * handle_client_thread(). Al detenerse espera a que terminen todos.
+ */
+int run_threaded_engine(server_context_t *ctx, const server_config_t *config)
+{
+    /* Crear socket del servidor */
+    ctx->server_socket = create_server_socket(config->port, 0);
+    server_close_inherited_listeners();
+    if (ctx->server_socket < 0) {
+        return ctx->server_socket;
+    }
+    
+    if (fcntl(ctx->server_socket, F_SETFL,
+              fcntl(ctx->server_socket, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        LOG_ERROR("Error configurando socket de escucha no bloqueante: %s", strerror(errno));
+        return ERROR_SOCKET;
+    }
+    
+    adopt_client_threads(ctx);
+    
+    LOG_INFO("Servidor iniciado correctamente. Esperando conexiones...");
+    print_server_stats(ctx);
+    
+    /* Bucle principal del servidor; la espera está acotada porque un
+     * traspaso detiene el servidor sin cerrar el socket de escucha */
+    while (ctx->running) {
+        int listen_fd = ctx->server_socket;
+        if (listen_fd < 0) break;
+        
+        struct pollfd pfd = { listen_fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, EPOLL_WAIT_TIMEOUT_MS);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Error en poll del socket de escucha: %s", strerror(errno));
+            break;
+        }
+        if (ready == 0 || !ctx->running) {
+            continue;
+        }
+        
+        /* Vaciar la cola de conexiones pendientes */
+        for (;;) {
+            struct sockaddr_in client_addr;
+            socklen_t client_addr_len = sizeof(client_addr);
+            int client_socket = accept4(listen_fd, (struct sockaddr*)&client_addr,
+                                        &client_addr_len, SOCK_CLOEXEC);
+            
+            if (client_socket < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK && ctx->running) {
+                    LOG_ERROR("Error en accept: %s", strerror(errno));
+                    metrics_add(METRIC_ACCEPT_ERRORS, 1);
+                    /* Sin descriptores la conexión sigue pendiente: no girar en vacío */
+                    if (errno == EMFILE || errno == ENFILE) {
+                        usleep(ACCEPT_BACKOFF_MS * 1000);
+                    }
+                }
+                break;
+            }
+            
+            if (server_admit_connection(ctx, client_socket, &client_addr) == 0) {
+                start_client_thread(ctx, client_socket, client_addr, NULL);
+            }
+        }
+    }
+    
+    if (!ctx->running) {
+        LOG_INFO("Cierre solicitado, terminando bucle principal");
+    }
+    
+    stop_client_threads();
+    return SUCCESS;
+}
+
+/* Tabla de motores de E/S disponibles; el primero es el motor por defecto */
+static const server_engine_t server_engines[] = {
+    { "threads", "Un thread por cliente con recv() bloqueante", run_threaded_engine },
+    { "epoll",   "Event loops epoll edge-triggered con sockets no bloqueantes", run_epoll_engine },
+    { "reactor", "Un reactor por CPU con SO_REUSEPORT y clientes repartidos", run_reactor_engine },
+    { "uring",   "Event loops io_uring con accept/recv multishot y envíos agrupados", run_uring_engine },
+};
+
+#define SERVER_ENGINE_COUNT (sizeof(server_engines) / sizeof(server_engines[0]))
+
+/**
+ * @brief Busca un motor de E/S por nombre
+ */
+const server_engine_t *find_server_engine(const char *name)
+{
+    if (!name) return NULL;
+    
+    for (size_t i = 0; i < SERVER_ENGINE_COUNT; i++) {
+        if (strcmp(server_engines[i].name, name) == 0) {
+            return &server_engines[i];
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * @brief Muestra los motores disponibles
+ */
+void print_server_engines(FILE *stream)
+{
+    fprintf(stream, "Motores disponibles:\n");
+    for (size_t i = 0; i < SERVER_ENGINE_COUNT; i++) {
+        fprintf(stream, "  %-8s - %s%s\n", server_engines[i].name,
+                server_engines[i].description, i == 0 ? " (por defecto)" : "");
+    }
+}
+
+/**
+ * @brief Calcula el número de event loops a usar
+ * 
+ * Sin valor explícito se usa un loop por CPU en línea.
+ */
+int resolve_event_loop_count(int requested, int max_loops)
+{
+    int count = requested;
+    
+    if (count <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cpus > 0 ? (int)cpus : 1;
+    }
+    
+    if (count > max_loops) {
+        count = max_loops;
+    }
+    
+    return count;
+}
+
 /**
  * @brief Función principal del servidor
  * 
- * Implementa el bucle principal del servidor, aceptando conexiones
- * y creando threads para manejar cada cliente.
+ * Inicializa el contexto y delega la atención de clientes en el motor
+ * de E/S configurado hasta que el servidor recibe la orden de cierre.
  */
-int run_server(int port)
+int run_server(const server_config_t *config)
 {
     server_context_t server_ctx;
-    int client_socket;
-    struct sockaddr_in client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
     
-    LOG_INFO("Iniciando servidor de chat en puerto %d", port);
+    const server_engine_t *engine = find_server_engine(config->engine_name);
+    if (!engine) {
+        LOG_ERROR("Motor de E/S desconocido: '%s'", config->engine_name);
+        return ERROR_SOCKET;
+    }
+    
+    LOG_INFO("Iniciando servidor de chat en puerto %d (motor: %s)", 
+            config->port, engine->name);
     
     /* Inicializar contexto del servidor */
     if (init_server_context(&server_ctx) != SUCCESS) {
         LOG_ERROR("Error inicializando contexto del servidor");
         return ERROR_MEMORY;
     }
+    server_ctx.outbound_limits = &config->outbound;
+    server_ctx.max_clients = config->max_clients;
+    server_ctx.keepalive_ms = (long long)config->keepalive_interval * 1000;
+    server_ctx.timeout_ms = (long long)config->connection_timeout * 1000;
+    LOG_INFO("Keepalive tras %d s de inactividad, timeout de %d s",
+            config->keepalive_interval, config->connection_timeout);
+    
+    server_ctx.compression = config->compression;
+    wire_set_deflate_threshold((size_t)config->compress_min);
+    if (config->compression) {
+        LOG_INFO("Compresión deflate para frames de %d bytes o más", config->compress_min);
+    }
+    
+    server_set_listen_options(config->listen_backlog, config->defer_accept);
+    LOG_INFO("Cola de conexiones pendientes: %d%s", config->listen_backlog,
+            config->defer_accept > 0 ? ", TCP_DEFER_ACCEPT activado" : "");
+    
+    /* Reinicio en caliente: la versión anterior entrega sus sockets y sus
+     * clientes después de volcar el historial que se carga a continuación */
+    if (config->upgrade_socket) {
+        handoff_receive(&server_ctx, config->upgrade_socket);
+    }
+    
+    /* Recuperar el historial antes de aceptar clientes */
+    if (config->history_depth > 0) {
+        server_ctx.history = history_create(config->history_depth, config->history_dir);
+        if (!server_ctx.history) {
+            LOG_ERROR("Error inicializando el historial de salas");
+            cleanup_server_context(&server_ctx);
+            return ERROR_MEMORY;
+        }
+        LOG_INFO("Historial: %d mensajes por sala (%s)", config->history_depth,
+                config->history_dir ? config->history_dir : "solo memoria");
+    }
+    LOG_INFO("Colas de salida: marca alta %zu bytes, marca baja %zu bytes, política %s",
+            config->outbound.high_watermark, config->outbound.low_watermark,
+            overflow_policy_name(config->outbound.policy));
+    
+    /* TLS solo con kTLS: sin él los sockets no pueden usarse en claro */
+    if (config->tls_cert) {
+        if (!tls_kernel_supported()) {
+            LOG_ERROR("El kernel no admite kTLS (¿falta el módulo tls?), no se puede servir TLS");
+            cleanup_server_context(&server_ctx);
+            history_destroy(server_ctx.history);
+            return ERROR_SOCKET;
+        }
+        server_ctx.tls = tls_server_create(config->tls_cert, config->tls_key);
+        if (!server_ctx.tls) {
+            LOG_ERROR("Error inicializando TLS con %s", config->tls_cert);
+            cleanup_server_context(&server_ctx);
+            history_destroy(server_ctx.history);
+            return ERROR_SOCKET;
+        }
+        LOG_INFO("TLS 1.2 con kTLS activado (certificado %s)", config->tls_cert);
+    }
+    
+    /* Limitar el ritmo de admisión antes de aceptar la primera conexión */
+    if (config->accept_rate > 0 || config->accept_global > 0) {
+        server_ctx.admission = admission_create(config->accept_rate, config->accept_burst,
+                                                config->accept_global);
+        if (!server_ctx.admission) {
+            LOG_ERROR("Error creando el limitador de admisión");
+            cleanup_server_context(&server_ctx);
+            history_destroy(server_ctx.history);
+            tls_context_destroy(server_ctx.tls);
+            return ERROR_MEMORY;
+        }
+        LOG_INFO("Admisión limitada: %d conexiones/s por IP (ráfaga %d), %d conexiones/s en total",
+                config->accept_rate, config->accept_burst, config->accept_global);
+    }
+    
+    /* Límites de envío de mensajes por cliente y por IP */
+    server_ctx.message_rate = config->message_rate;
+    server_ctx.message_burst = config->message_burst;
+    if (config->message_ip_rate > 0) {
+        server_ctx.message_limiter = admission_create(config->message_ip_rate,
+                                                      config->message_burst, 0);
+        if (!server_ctx.message_limiter) {
+            LOG_ERROR("Error creando el limitador de mensajes por IP");
+            cleanup_server_context(&server_ctx);
+            history_destroy(server_ctx.history);
+            tls_context_destroy(server_ctx.tls);
+            admission_destroy(server_ctx.admission);
+            return ERROR_MEMORY;
+        }
+    }
+    if (config->message_rate > 0 || config->message_ip_rate > 0) {
+        LOG_INFO("Mensajes limitados: %d/s por cliente y %d/s por IP (ráfaga %d, 0 = sin límite)",
+                config->message_rate, config->message_ip_rate, config->message_burst);
+    }
     
     /* Configurar manejadores de señales */
     setup_signal_handlers(&server_ctx);
     
-    /* Crear socket del servidor */
-    server_ctx.server_socket = create_server_socket(port);
-    if (server_ctx.server_socket < 0) {
-        cleanup_server_context(&server_ctx);
-        return server_ctx.server_socket;
+    /* Los threads de red no deben esperar por stdout */
+    if (log_start_async() != 0) {
+        LOG_ERROR("No se pudo arrancar el logger asíncrono, se usará salida síncrona");
     }
     
-    LOG_INFO("Servidor iniciado correctamente. Esperando conexiones...");
-    print_server_stats(&server_ctx);
-    
-    /* Bucle principal del servidor */
-    while (server_ctx.running) {
-        /* Aceptar nueva conexión */
-        client_socket = accept(server_ctx.server_socket, 
-                              (struct sockaddr*)&client_addr, &client_addr_len);
-        
-        if (client_socket < 0) {
-            if (errno == EINTR) {
-                /* Interrupción por señal, continuar */
-                continue;
-            }
-            if (!server_ctx.running) {
-                /* El servidor se está cerrando, salir silenciosamente */
-                LOG_INFO("Socket del servidor cerrado, terminando bucle principal");
-                break;
-            }
-            LOG_ERROR("Error en accept: %s", strerror(errno));
-            break;
+    /* Agrupar escrituras antes de que las colas empiecen a recibir frames */
+    if (config->flush_window_us > 0) {
+        if (outbound_flusher_start((unsigned int)config->flush_window_us) == 0) {
+            LOG_INFO("Escrituras agrupadas en ventanas de %d us", config->flush_window_us);
+        } else {
+            LOG_ERROR("No se pudo arrancar el agrupador de escrituras, se enviará al encolar");
         }
-        
-        LOG_INFO("Nueva conexión desde %s:%d", 
-                inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-        
-        /* Crear argumentos para el thread del cliente */
-        client_thread_args_t *client_args = malloc(sizeof(client_thread_args_t));
-        if (!client_args) {
-            LOG_ERROR("Error asignando memoria para argumentos de thread");
-            SAFE_CLOSE(client_socket);
-            continue;
+    }
+    
+    if (history_start(server_ctx.history) != SUCCESS) {
+        LOG_ERROR("No se pudo arrancar el escritor del historial, no se persistirán mensajes nuevos");
+    }
+    
+    if (config->metrics_port > 0 &&
+        metrics_server_start(&server_ctx, config->metrics_address, config->metrics_port) != SUCCESS) {
+        LOG_ERROR("No se pudo abrir el puerto de métricas %s:%d",
+                  config->metrics_address, config->metrics_port);
+    }
+    
+    /* Enlaces con los otros nodos: sin ellos el nodo atiende solo a sus clientes */
+    if (config->cluster_port > 0) {
+        cluster_options_t cluster_options;
+        cluster_options.address = config->cluster_address;
+        cluster_options.port = config->cluster_port;
+        cluster_options.secret_file = config->cluster_secret_file;
+        cluster_options.ca_file = config->cluster_ca;
+        cluster_options.peers = config->cluster_peers;
+        cluster_options.peer_count = config->cluster_peer_count;
+        server_ctx.cluster = cluster_create(&server_ctx, &cluster_options);
+        if (!server_ctx.cluster) {
+            LOG_ERROR("No se pudo arrancar el clúster en %s:%d, el nodo funcionará aislado",
+                     config->cluster_address, config->cluster_port);
         }
-        
-        client_args->client_socket = client_socket;
-        client_args->client_addr = client_addr;
-        client_args->server_ctx = &server_ctx;
-        
-        /* Crear thread para manejar el cliente */
-        pthread_t client_thread;
-        if (pthread_create(&client_thread, NULL, handle_client_thread, client_args) != 0) {
-            LOG_ERROR("Error creando thread para cliente: %s", strerror(errno));
-            free(client_args);
-            SAFE_CLOSE(client_socket);
-            continue;
+    }
+    
+    /* La versión que sustituya a esta se conectará aquí */
+    handoff_t *handoff = NULL;
+    if (config->upgrade_socket) {
+        handoff = handoff_listen(&server_ctx, config->upgrade_socket, config->port);
+        if (!handoff) {
+            LOG_ERROR("No se pudo escuchar en %s, no habrá reinicio en caliente",
+                     config->upgrade_socket);
         }
-        
-        /* Detach del thread para limpieza automática */
-        pthread_detach(client_thread);
     }
     
+    /* Atender clientes hasta la orden de cierre */
+    int result = engine->run(&server_ctx, config);
+    
+    if (g_shutdown_signal) {
+        LOG_INFO("Señal %d recibida, iniciando cierre del servidor...", (int)g_shutdown_signal);
+    }
     LOG_INFO("Cerrando servidor...");
-    cleanup_server_context(&server_ctx);
+    cluster_destroy(server_ctx.cluster);
+    server_ctx.cluster = NULL;
+    outbound_flusher_stop();
+    metrics_server_stop();
+    
+    /* Sus puertos y el historial en disco deben quedar libres antes de
+     * que la versión nueva reciba el estado y arranque */
+    if (server_ctx.handing_off) {
+        history_destroy(server_ctx.history);
+        server_ctx.history = NULL;
+        handoff_send(handoff, &server_ctx);
+    }
+    handoff_destroy(handoff);
     
-    return SUCCESS;
+    metrics_log_summary();
+    cleanup_server_context(&server_ctx);
+    history_destroy(server_ctx.history);
+    tls_context_destroy(server_ctx.tls);
+    admission_destroy(server_ctx.admission);
+    admission_destroy(server_ctx.message_limiter);
+    pool_log_summary();
+    log_stop_async();
+    
+    return result;
+}
+
+/**
+ * @brief Muestra el uso del programa servidor
+ */
+static void print_server_usage(const char *program)
+{
+    fprintf(stderr, "Uso: %s [puerto] [--engine=NOMBRE] [--loops=N] [--max-clients=N] "
+            "[--overflow=POLÍTICA] [--queue-kb=N] [--flush-window=US] [--log-level=NIVEL] "
+            "[--metrics-port=N] [--metrics-addr=IP] [--history=N] [--history-dir=DIR] "
+            "[--keepalive=S] [--timeout=S] [--tls-cert=FILE --tls-key=FILE] "
+            "[--compress=deflate|off] [--compress-min=BYTES] [--backlog=N] [--defer-accept=S] "
+            "[--accept-rate=N] [--accept-burst=N] [--accept-global=N] "
+            "[--msg-rate=N] [--msg-ip-rate=N] [--msg-burst=N] "
+            "[--cluster-port=N --cluster-secret-file=FILE] [--cluster-addr=IP] [--cluster-ca=FILE] "
+            "[--peer=HOST:PORT ...] [--upgrade-socket=PATH]\n", program);
+    print_server_engines(stderr);
+    fprintf(stderr, "Políticas de desborde de la cola de salida (marca alta: --queue-kb):\n");
+    fprintf(stderr, "  drop       - Descarta notificaciones antiguas y, si no basta, el mensaje nuevo (por defecto)\n");
+    fprintf(stderr, "  coalesce   - Sustituye lo pendiente por un aviso de mensajes omitidos\n");
+    fprintf(stderr, "  disconnect - Desconecta al cliente lento\n");
+    fprintf(stderr, "Agrupación de escrituras: --flush-window=US combina en un único envío lo que cada "
+            "cliente recibe en US microsegundos (1-%d, por defecto 0 = enviar al encolar)\n",
+            OUTBOUND_FLUSH_WINDOW_MAX_US);
+    fprintf(stderr, "Niveles de log: debug, info (por defecto), error, off\n");
+    fprintf(stderr, "Métricas Prometheus en http://IP:N/metrics con --metrics-port=N (desactivadas por defecto); "
+            "--metrics-addr=IP elige la interfaz (por defecto %s, solo local)\n", METRICS_DEFAULT_ADDRESS);
+    fprintf(stderr, "Historial: --history=N mensajes por sala (0-%d, por defecto %d); "
+            "--history-dir=DIR lo persiste entre reinicios\n", HISTORY_MAX_DEPTH, HISTORY_DEFAULT_DEPTH);
+    fprintf(stderr, "Keepalive: sondeo tras --keepalive=S segundos sin datos (por defecto %d, 0 = nunca); "
+            "se cierra la conexión si no responde o no completa el handshake en --timeout=S "
+            "(por defecto %d)\n", KEEPALIVE_INTERVAL, CONNECTION_TIMEOUT);
+    fprintf(stderr, "TLS: --tls-cert y --tls-key (PEM) cifran las conexiones con TLS 1.2; "
+            "requiere kTLS en el kernel (modprobe tls)\n");
+    fprintf(stderr, "Compresión: --compress=deflate (por defecto) comprime con deflate los frames de "
+            "--compress-min=BYTES o más (por defecto %d) para los clientes que lo negocian; "
+            "--compress=off la desactiva\n", WIRE_DEFLATE_MIN_SIZE);
+    fprintf(stderr, "Admisión: --backlog=N conexiones pendientes (por defecto %d); --defer-accept=S "
+            "no despierta al servidor hasta que el cliente envía datos; --accept-rate=N conexiones/s "
+            "por IP con ráfaga --accept-burst=N (por defecto %d) y --accept-global=N en total "
+            "(0 = sin límite, por defecto)\n", LISTEN_BACKLOG, ADMISSION_DEFAULT_BURST);
+    fprintf(stderr, "Límite de envío: --msg-rate=N mensajes/s por cliente y --msg-ip-rate=N por IP "
+            "(0 = sin límite, por defecto), con ráfaga --msg-burst=N (por defecto %d); los mensajes "
+            "que exceden se descartan y el remitente recibe un aviso\n", ADMISSION_MESSAGE_BURST);
+    fprintf(stderr, "Clúster: --cluster-port=N recibe los enlaces de los otros nodos en "
+            "--cluster-addr=IP (por defecto %s, solo local) y cada --peer=HOST:PORT (hasta %d) "
+            "indica el puerto de clúster de otro nodo; los mensajes de las salas se reenvían a "
+            "todos los pares. Los nodos se autentican con el secreto de --cluster-secret-file=FILE "
+            "(%d-%d bytes, el mismo en todos); con TLS los enlaces también se cifran y el "
+            "certificado de los pares se verifica con --cluster-ca=FILE (por defecto las CAs "
+            "del sistema)\n", CLUSTER_DEFAULT_ADDRESS, CLUSTER_MAX_PEERS,
+            CLUSTER_SECRET_MIN, CLUSTER_SECRET_MAX);
+    fprintf(stderr, "Reinicio en caliente: --upgrade-socket=PATH; un proceso nuevo arrancado con "
+            "el mismo PATH hereda los sockets y los clientes del actual sin desconectarlos "
+            "(no disponible con el motor uring)\n");
 }
 
 /**
@@ -733,20 +2347,294 @@ int run_server(int port)
  */
 int main(int argc, char *argv[])
 {
-    int port = DEFAULT_PORT;
+    server_config_t config;
+    config.port = DEFAULT_PORT;
+    config.engine_name = DEFAULT_ENGINE;
+    config.event_loops = 0;
+    config.max_clients = MAX_CLIENTS;
+    config.metrics_port = 0;
+    config.metrics_address = METRICS_DEFAULT_ADDRESS;
+    config.history_depth = HISTORY_DEFAULT_DEPTH;
+    config.history_dir = NULL;
+    config.keepalive_interval = KEEPALIVE_INTERVAL;
+    config.connection_timeout = CONNECTION_TIMEOUT;
+    outbound_limits_init(&config.outbound);
+    config.flush_window_us = 0;
+    config.tls_cert = NULL;
+    config.tls_key = NULL;
+    config.compression = 1;
+    config.compress_min = WIRE_DEFLATE_MIN_SIZE;
+    config.listen_backlog = LISTEN_BACKLOG;
+    config.defer_accept = 0;
+    config.accept_rate = 0;
+    config.accept_burst = ADMISSION_DEFAULT_BURST;
+    config.accept_global = 0;
+    config.message_rate = 0;
+    config.message_ip_rate = 0;
+    config.message_burst = ADMISSION_MESSAGE_BURST;
+    config.cluster_port = 0;
+    config.cluster_address = CLUSTER_DEFAULT_ADDRESS;
+    config.cluster_secret_file = NULL;
+    config.cluster_ca = NULL;
+    config.cluster_peer_count = 0;
+    config.upgrade_socket = NULL;
     
     /* Procesar argumentos de línea de comandos */
-    if (argc > 1) {
-        port = atoi(argv[1]);
-        if (port <= 0 || port > 65535) {
-            fprintf(stderr, "Puerto inválido: %s\n", argv[1]);
-            fprintf(stderr, "Uso: %s [puerto]\n", argv[0]);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--engine=", 9) == 0) {
+            config.engine_name = argv[i] + 9;
+            if (!find_server_engine(config.engine_name)) {
+                fprintf(stderr, "Motor inválido: %s\n", config.engine_name);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--loops=", 8) == 0) {
+            config.event_loops = atoi(argv[i] + 8);
+            if (config.event_loops <= 0) {
+                fprintf(stderr, "Número de loops inválido: %s\n", argv[i] + 8);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--max-clients=", 14) == 0) {
+            config.max_clients = atoi(argv[i] + 14);
+            if (config.max_clients <= 0) {
+                fprintf(stderr, "Límite de clientes inválido: %s\n", argv[i] + 14);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--overflow=", 11) == 0) {
+            if (parse_overflow_policy(argv[i] + 11, &config.outbound.policy) < 0) {
+                fprintf(stderr, "Política de desborde inválida: %s\n", argv[i] + 11);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--queue-kb=", 11) == 0) {
+            int queue_kb = atoi(argv[i] + 11);
+            if (queue_kb <= 0) {
+                fprintf(stderr, "Tamaño de cola inválido: %s\n", argv[i] + 11);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            outbound_limits_set_high(&config.outbound, (size_t)queue_kb * 1024);
+        } else if (strncmp(argv[i], "--flush-window=", 15) == 0) {
+            config.flush_window_us = atoi(argv[i] + 15);
+            if (config.flush_window_us < 0 || config.flush_window_us > OUTBOUND_FLUSH_WINDOW_MAX_US ||
+                (config.flush_window_us == 0 && strcmp(argv[i] + 15, "0") != 0)) {
+                fprintf(stderr, "Ventana de agrupación inválida: %s\n", argv[i] + 15);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--log-level=", 12) == 0) {
+            log_level_t level;
+            if (parse_log_level(argv[i] + 12, &level) < 0) {
+                fprintf(stderr, "Nivel de log inválido: %s\n", argv[i] + 12);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            log_set_level(level);
+        } else if (strncmp(argv[i], "--metrics-port=", 15) == 0) {
+            config.metrics_port = atoi(argv[i] + 15);
+            if (config.metrics_port <= 0 || config.metrics_port > 65535) {
+                fprintf(stderr, "Puerto de métricas inválido: %s\n", argv[i] + 15);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--metrics-addr=", 15) == 0) {
+            struct in_addr metrics_in_addr;
+            config.metrics_address = argv[i] + 15;
+            if (inet_pton(AF_INET, config.metrics_address, &metrics_in_addr) != 1) {
+                fprintf(stderr, "Dirección de métricas inválida: %s\n", config.metrics_address);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--history=", 10) == 0) {
+            config.history_depth = atoi(argv[i] + 10);
+            if (config.history_depth < 0 || config.history_depth > HISTORY_MAX_DEPTH ||
+                (config.history_depth == 0 && strcmp(argv[i] + 10, "0") != 0)) {
+                fprintf(stderr, "Profundidad de historial inválida: %s\n", argv[i] + 10);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--history-dir=", 14) == 0) {
+            config.history_dir = argv[i] + 14;
+            if (config.history_dir[0] == '\0') {
+                fprintf(stderr, "Directorio de historial vacío\n");
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--keepalive=", 12) == 0) {
+            config.keepalive_interval = atoi(argv[i] + 12);
+            if (config.keepalive_interval < 0 ||
+                (config.keepalive_interval == 0 && strcmp(argv[i] + 12, "0") != 0)) {
+                fprintf(stderr, "Intervalo de keepalive inválido: %s\n", argv[i] + 12);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--timeout=", 10) == 0) {
+            config.connection_timeout = atoi(argv[i] + 10);
+            if (config.connection_timeout <= 0) {
+                fprintf(stderr, "Timeout de conexión inválido: %s\n", argv[i] + 10);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--tls-cert=", 11) == 0) {
+            config.tls_cert = argv[i] + 11;
+        } else if (strncmp(argv[i], "--tls-key=", 10) == 0) {
+            config.tls_key = argv[i] + 10;
+        } else if (strcmp(argv[i], "--compress=deflate") == 0) {
+            config.compression = 1;
+        } else if (strcmp(argv[i], "--compress=off") == 0) {
+            config.compression = 0;
+        } else if (strncmp(argv[i], "--backlog=", 10) == 0) {
+            config.listen_backlog = atoi(argv[i] + 10);
+            if (config.listen_backlog <= 0) {
+                fprintf(stderr, "Backlog inválido: %s\n", argv[i] + 10);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--defer-accept=", 15) == 0) {
+            config.defer_accept = atoi(argv[i] + 15);
+            if (config.defer_accept < 0 ||
+                (config.defer_accept == 0 && strcmp(argv[i] + 15, "0") != 0)) {
+                fprintf(stderr, "Espera de TCP_DEFER_ACCEPT inválida: %s\n", argv[i] + 15);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--accept-rate=", 14) == 0) {
+            config.accept_rate = atoi(argv[i] + 14);
+            if (config.accept_rate < 0 ||
+                (config.accept_rate == 0 && strcmp(argv[i] + 14, "0") != 0)) {
+                fprintf(stderr, "Tasa de admisión por IP inválida: %s\n", argv[i] + 14);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--accept-burst=", 15) == 0) {
+            config.accept_burst = atoi(argv[i] + 15);
+            if (config.accept_burst <= 0) {
+                fprintf(stderr, "Ráfaga de admisión inválida: %s\n", argv[i] + 15);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--accept-global=", 16) == 0) {
+            config.accept_global = atoi(argv[i] + 16);
+            if (config.accept_global < 0 ||
+                (config.accept_global == 0 && strcmp(argv[i] + 16, "0") != 0)) {
+                fprintf(stderr, "Tasa de admisión global inválida: %s\n", argv[i] + 16);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--msg-rate=", 11) == 0) {
+            config.message_rate = atoi(argv[i] + 11);
+            if (config.message_rate < 0 ||
+                (config.message_rate == 0 && strcmp(argv[i] + 11, "0") != 0)) {
+                fprintf(stderr, "Límite de mensajes por cliente inválido: %s\n", argv[i] + 11);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--msg-ip-rate=", 14) == 0) {
+            config.message_ip_rate = atoi(argv[i] + 14);
+            if (config.message_ip_rate < 0 ||
+                (config.message_ip_rate == 0 && strcmp(argv[i] + 14, "0") != 0)) {
+                fprintf(stderr, "Límite de mensajes por IP inválido: %s\n", argv[i] + 14);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--msg-burst=", 12) == 0) {
+            config.message_burst = atoi(argv[i] + 12);
+            if (config.message_burst <= 0) {
+                fprintf(stderr, "Ráfaga de mensajes inválida: %s\n", argv[i] + 12);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--cluster-port=", 15) == 0) {
+            config.cluster_port = atoi(argv[i] + 15);
+            if (config.cluster_port <= 0 || config.cluster_port > 65535) {
+                fprintf(stderr, "Puerto de clúster inválido: %s\n", argv[i] + 15);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--cluster-addr=", 15) == 0) {
+            struct in_addr cluster_in_addr;
+            config.cluster_address = argv[i] + 15;
+            if (inet_pton(AF_INET, config.cluster_address, &cluster_in_addr) != 1) {
+                fprintf(stderr, "Dirección de clúster inválida: %s\n", config.cluster_address);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--cluster-secret-file=", 22) == 0) {
+            config.cluster_secret_file = argv[i] + 22;
+        } else if (strncmp(argv[i], "--cluster-ca=", 13) == 0) {
+            config.cluster_ca = argv[i] + 13;
+        } else if (strncmp(argv[i], "--peer=", 7) == 0) {
+            if (cluster_parse_peer(argv[i] + 7) < 0) {
+                fprintf(stderr, "Par inválido (se espera HOST:PORT): %s\n", argv[i] + 7);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            if (config.cluster_peer_count == CLUSTER_MAX_PEERS) {
+                fprintf(stderr, "Demasiados pares (máximo %d)\n", CLUSTER_MAX_PEERS);
+                return EXIT_FAILURE;
+            }
+            config.cluster_peers[config.cluster_peer_count++] = argv[i] + 7;
+        } else if (strncmp(argv[i], "--upgrade-socket=", 17) == 0) {
+            config.upgrade_socket = argv[i] + 17;
+            if (config.upgrade_socket[0] == '\0') {
+                fprintf(stderr, "Ruta del socket de reinicio vacía\n");
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--compress=", 11) == 0) {
+            fprintf(stderr, "Compresión inválida: %s\n", argv[i] + 11);
+            print_server_usage(argv[0]);
             return EXIT_FAILURE;
+        } else if (strncmp(argv[i], "--compress-min=", 15) == 0) {
+            config.compress_min = atoi(argv[i] + 15);
+            if (config.compress_min < 0 || config.compress_min > WIRE_MAX_FRAME_SIZE ||
+                (config.compress_min == 0 && strcmp(argv[i] + 15, "0") != 0)) {
+                fprintf(stderr, "Umbral de compresión inválido: %s\n", argv[i] + 15);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            config.port = atoi(argv[i]);
+            if (config.port <= 0 || config.port > 65535) {
+                fprintf(stderr, "Puerto inválido: %s\n", argv[i]);
+                print_server_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
         }
     }
     
+    if ((config.tls_cert == NULL) != (config.tls_key == NULL) ||
+        (config.tls_cert && (config.tls_cert[0] == '\0' || config.tls_key[0] == '\0'))) {
+        fprintf(stderr, "--tls-cert y --tls-key deben indicarse juntos\n");
+        print_server_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    if (config.cluster_peer_count > 0 && config.cluster_port == 0) {
+        fprintf(stderr, "--peer requiere --cluster-port para recibir los mensajes de los pares\n");
+        print_server_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    /* El puerto de clúster inyecta mensajes en las salas: nunca sin autenticar */
+    if (config.cluster_port > 0 &&
+        (!config.cluster_secret_file || config.cluster_secret_file[0] == '\0')) {
+        fprintf(stderr, "--cluster-port requiere --cluster-secret-file con el secreto de los nodos\n");
+        print_server_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    /* El motor uring no sabe ceder sus conexiones con operaciones en curso */
+    if (config.upgrade_socket && strcmp(config.engine_name, "uring") == 0) {
+        fprintf(stderr, "--upgrade-socket no está disponible con el motor uring\n");
+        print_server_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    
     /* Ejecutar servidor */
-    int result = run_server(port);
+    int result = run_server(&config);
     
     if (result == SUCCESS) {
         LOG_INFO("Servidor terminado correctamente");
@@ -0,0 +1,245 @@
+/**
+ * @file chat_timer.c
+ * @brief Implementación de la rueda de temporizadores jerárquica
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * Un temporizador con vencimiento E en el nivel l está en la ranura
+ * (E >> 6l) & 63. Cuando el tick actual es múltiplo de 64^l, la ranura
+ * del frente del nivel l se reparte de nuevo y sus temporizadores caen a
+ * niveles inferiores; los niveles se recorren de arriba abajo para que un
+ * temporizador pueda bajar varios niveles en el mismo tick.
+ */
+
+#include "../include/chat_timer.h"
+
+#define TIMER_SLOT_MASK     (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_MAX_TICKS     (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+/* ========== LISTAS DE RANURA ========== */
+
+/**
+ * @brief Deja una lista circular vacía
+ */
+static void list_init(wheel_timer_t *head)
+{
+    head->prev = head->next = head;
+}
+
+/**
+ * @brief Añade un temporizador al final de una lista
+ */
+static void list_append(wheel_timer_t *head, wheel_timer_t *timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+/**
+ * @brief Saca un temporizador de su lista
+ */
+static void list_unlink(wheel_timer_t *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+}
+
+/**
+ * @brief Mueve todos los elementos de una lista a otra vacía
+ */
+static void list_splice(wheel_timer_t *from, wheel_timer_t *to)
+{
+    if (from->next == from) {
+        list_init(to);
+        return;
+    }
+
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    list_init(from);
+}
+
+/* ========== COLOCACIÓN ========== */
+
+/**
+ * @brief Coloca un temporizador en el nivel más bajo que abarca su vencimiento
+ */
+static void place_timer(timer_wheel_t *wheel, wheel_timer_t *timer)
+{
+    unsigned long long delta = timer->expires - wheel->now;
+
+    if (delta >= TIMER_MAX_TICKS) {
+        timer->expires = wheel->now + TIMER_MAX_TICKS - 1;
+        delta = TIMER_MAX_TICKS - 1;
+    }
+
+    int level = 0;
+    while (delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    size_t slot = (timer->expires >> (TIMER_WHEEL_BITS * level)) & TIMER_SLOT_MASK;
+    list_append(&wheel->slots[level][slot], timer);
+}
+
+/**
+ * @brief Reparte la ranura del frente de un nivel en los niveles inferiores
+ */
+static void cascade_level(timer_wheel_t *wheel, int level)
+{
+    size_t slot = (wheel->now >> (TIMER_WHEEL_BITS * level)) & TIMER_SLOT_MASK;
+    wheel_timer_t pending;
+    list_splice(&wheel->slots[level][slot], &pending);
+
+    while (pending.next != &pending) {
+        wheel_timer_t *timer = pending.next;
+        list_unlink(timer);
+        place_timer(wheel, timer);
+    }
+}
+
+/* ========== OPERACIONES DE LA RUEDA ========== */
+
+/**
+ * @brief Milisegundos de un reloj monótono
+ */
+long long timer_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Inicializa una rueda vacía
+ */
+void timer_wheel_init(timer_wheel_t *wheel, long long now_ms)
+{
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            list_init(&wheel->slots[level][slot]);
+        }
+    }
+
+    wheel->now = (unsigned long long)(now_ms / TIMER_TICK_MS);
+    wheel->count = 0;
+}
+
+/**
+ * @brief Inicializa un temporizador desarmado
+ */
+void timer_init(wheel_timer_t *timer, timer_callback_t callback, void *data)
+{
+    timer->prev = timer->next = NULL;
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->data = data;
+}
+
+/**
+ * @brief Indica si un temporizador está armado
+ */
+int timer_pending(const wheel_timer_t *timer)
+{
+    return timer->next != NULL;
+}
+
+/**
+ * @brief Arma (o rearma) un temporizador en O(1)
+ */
+void timer_wheel_arm(timer_wheel_t *wheel, wheel_timer_t *timer, long long expires_ms)
+{
+    if (timer_pending(timer)) {
+        list_unlink(timer);
+    } else {
+        wheel->count++;
+    }
+
+    /* Redondear hacia arriba: un temporizador nunca vence antes de tiempo */
+    long long ticks = expires_ms > 0 ? (expires_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS : 0;
+    timer->expires = (unsigned long long)ticks > wheel->now ?
+                     (unsigned long long)ticks : wheel->now + 1;
+    place_timer(wheel, timer);
+}
+
+/**
+ * @brief Cancela un temporizador en O(1)
+ */
+void timer_wheel_cancel(timer_wheel_t *wheel, wheel_timer_t *timer)
+{
+    if (!timer_pending(timer)) return;
+
+    list_unlink(timer);
+    wheel->count--;
+}
+
+/**
+ * @brief Avanza la rueda hasta now_ms y ejecuta los temporizadores vencidos
+ *
+ * Los vencidos de cada tick se apartan antes de ejecutarlos, de modo que
+ * una acción puede rearmar su temporizador o cancelar otro pendiente.
+ */
+int timer_wheel_advance(timer_wheel_t *wheel, long long now_ms)
+{
+    unsigned long long target = (unsigned long long)(now_ms / TIMER_TICK_MS);
+    int fired = 0;
+
+    while (wheel->now < target) {
+        if (wheel->count == 0) {
+            /* Rueda vacía: no hay nada que repartir ni ejecutar */
+            wheel->now = target;
+            break;
+        }
+
+        wheel->now++;
+
+        for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((wheel->now & ((1ULL << (TIMER_WHEEL_BITS * level)) - 1)) == 0) {
+                cascade_level(wheel, level);
+            }
+        }
+
+        wheel_timer_t expired;
+        list_splice(&wheel->slots[0][wheel->now & TIMER_SLOT_MASK], &expired);
+
+        while (expired.next != &expired) {
+            wheel_timer_t *timer = expired.next;
+            list_unlink(timer);
+            wheel->count--;
+            fired++;
+            timer->callback(timer->data);
+        }
+    }
+
+    return fired;
+}
+
+/**
+ * @brief Espera máxima antes de que haya que volver a avanzar la rueda
+ */
+int timer_wheel_timeout_ms(const timer_wheel_t *wheel, long long now_ms, int max_ms)
+{
+    if (wheel->count == 0) {
+        return max_ms;
+    }
+
+    /* Lo que llegue antes: la próxima ranura ocupada del nivel 0 o la
+     * próxima bajada de nivel */
+    unsigned long long next = ((wheel->now >> TIMER_WHEEL_BITS) + 1) << TIMER_WHEEL_BITS;
+    for (unsigned long long tick = wheel->now + 1; tick < next; tick++) {
+        const wheel_timer_t *slot = &wheel->slots[0][tick & TIMER_SLOT_MASK];
+        if (slot->next != slot) {
+            next = tick;
+            break;
+        }
+    }
+
+    long long wait_ms = (long long)next * TIMER_TICK_MS - now_ms;
+    if (wait_ms < 0) return 0;
+    return wait_ms < max_ms ? (int)wait_ms : max_ms;
+}
@@ -0,0 +1,460 @@
+/**
+ * @file chat_tls.c
+ * @brief Implementación del transporte TLS con kTLS
+ * @author Sistema de Chat Socket
+ * @date 2025
+ *
+ * OpenSSL instala kTLS por sí mismo (SSL_OP_ENABLE_KTLS) al cambiar las
+ * claves de cada sentido; aquí solo se comprueba que lo consiguió en los
+ * dos antes de soltar el objeto SSL. Si el kernel o el cifrado negociado
+ * no lo permiten la conexión se rechaza: un socket sin kTLS no puede
+ * usarse con los caminos de envío y recepción del resto del programa.
+ */
+
+#include "../include/chat_tls.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <netinet/tcp.h>
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+/**
+ * @brief Instante monotónico actual en milisegundos
+ */
+static long long monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Comprueba que el kernel admite kTLS (ULP "tls")
+ *
+ * El ULP solo se puede instalar en un socket conectado: se prueba con una
+ * conexión por loopback que no llega a aceptarse.
+ */
+int tls_kernel_supported(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int supported = 0;
+
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int probe = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (listener >= 0 && probe >= 0 &&
+        bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+        listen(listener, 1) == 0 &&
+        getsockname(listener, (struct sockaddr*)&addr, &addr_len) == 0 &&
+        connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        supported = setsockopt(probe, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0;
+    }
+
+    SAFE_CLOSE(probe);
+    SAFE_CLOSE(listener);
+    return supported;
+}
+
+#ifndef CHAT_NO_TLS
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+#include <openssl/hmac.h>
+
+/* Cifrados AEAD que el kernel sabe instalar */
+#define TLS_CIPHERS "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:" \
+                    "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:" \
+                    "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305"
+
+#define TLS_SESSION_ID_CONTEXT "chat"
+
+/**
+ * @brief Configuración TLS compartida
+ */
+struct tls_context {
+    SSL_CTX *ssl_ctx;
+    int server;                             /* Contexto de servidor */
+    int verify;                             /* El cliente verifica el certificado */
+    pthread_mutex_t session_lock;           /* Protege last_session */
+    SSL_SESSION *last_session;              /* Sesión a reanudar (cliente) */
+};
+
+/**
+ * @brief Handshake en curso
+ */
+struct tls_session {
+    tls_context_t *ctx;
+    SSL *ssl;
+    int fd;
+    int saved_flags;                        /* Flags del socket antes del handshake */
+    int resumed;                            /* Sesión reanudada */
+};
+
+/**
+ * @brief Registra el primer error de la cola de OpenSSL
+ */
+static void log_ssl_error(const char *what)
+{
+    char reason[256];
+    unsigned long error = ERR_get_error();
+
+    if (error != 0) {
+        ERR_error_string_n(error, reason, sizeof(reason));
+    } else {
+        snprintf(reason, sizeof(reason), "%s", errno ? strerror(errno) : "conexión cerrada");
+    }
+    LOG_ERROR("%s: %s", what, reason);
+    ERR_clear_error();
+}
+
+/**
+ * @brief Crea un SSL_CTX con las opciones comunes de ambos extremos
+ */
+static tls_context_t *create_context(const SSL_METHOD *method, int server)
+{
+    tls_context_t *ctx = calloc(1, sizeof(tls_context_t));
+    if (!ctx) {
+        LOG_ERROR("Error asignando memoria para el contexto TLS");
+        return NULL;
+    }
+
+    ctx->ssl_ctx = SSL_CTX_new(method);
+    if (!ctx->ssl_ctx) {
+        log_ssl_error("Error creando el contexto TLS");
+        free(ctx);
+        return NULL;
+    }
+    ctx->server = server;
+    pthread_mutex_init(&ctx->session_lock, NULL);
+
+    SSL_CTX_set_min_proto_version(ctx->ssl_ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(ctx->ssl_ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx->ssl_ctx, SSL_OP_NO_RENEGOTIATION | SSL_OP_NO_COMPRESSION);
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options(ctx->ssl_ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+    if (SSL_CTX_set_cipher_list(ctx->ssl_ctx, TLS_CIPHERS) != 1) {
+        log_ssl_error("Error configurando los cifrados TLS");
+        tls_context_destroy(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+/**
+ * @brief Crea el contexto del servidor
+ */
+tls_context_t *tls_server_create(const char *cert_file, const char *key_file)
+{
+    if (!cert_file || !key_file) return NULL;
+
+    tls_context_t *ctx = create_context(TLS_server_method(), 1);
+    if (!ctx) return NULL;
+
+    if (SSL_CTX_use_certificate_chain_file(ctx->ssl_ctx, cert_file) != 1) {
+        log_ssl_error("Error cargando el certificado TLS");
+        tls_context_destroy(ctx);
+        return NULL;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx->ssl_ctx, key_file, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx->ssl_ctx) != 1) {
+        log_ssl_error("Error cargando la clave privada TLS");
+        tls_context_destroy(ctx);
+        return NULL;
+    }
+
+    /* Reanudación: tickets sin estado y, para clientes sin tickets, caché */
+    SSL_CTX_set_session_cache_mode(ctx->ssl_ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx->ssl_ctx, TLS_SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx->ssl_ctx, TLS_SESSION_TIMEOUT);
+    SSL_CTX_set_session_id_context(ctx->ssl_ctx, (const unsigned char*)TLS_SESSION_ID_CONTEXT,
+                                   sizeof(TLS_SESSION_ID_CONTEXT) - 1);
+
+    return ctx;
+}
+
+/**
+ * @brief Crea el contexto de un cliente
+ */
+tls_context_t *tls_client_create(const char *ca_file, int verify)
+{
+    tls_context_t *ctx = create_context(TLS_client_method(), 0);
+    if (!ctx) return NULL;
+
+    ctx->verify = verify;
+    if (verify) {
+        int loaded = ca_file ? SSL_CTX_load_verify_locations(ctx->ssl_ctx, ca_file, NULL)
+                             : SSL_CTX_set_default_verify_paths(ctx->ssl_ctx);
+        if (loaded != 1) {
+            log_ssl_error("Error cargando las CAs de confianza");
+            tls_context_destroy(ctx);
+            return NULL;
+        }
+        SSL_CTX_set_verify(ctx->ssl_ctx, SSL_VERIFY_PEER, NULL);
+    }
+
+    /* Las sesiones se guardan a mano en last_session */
+    SSL_CTX_set_session_cache_mode(ctx->ssl_ctx, SSL_SESS_CACHE_OFF);
+    return ctx;
+}
+
+/**
+ * @brief Libera un contexto
+ */
+void tls_context_destroy(tls_context_t *ctx)
+{
+    if (!ctx) return;
+
+    SSL_SESSION_free(ctx->last_session);
+    SSL_CTX_free(ctx->ssl_ctx);
+    pthread_mutex_destroy(&ctx->session_lock);
+    free(ctx);
+}
+
+/**
+ * @brief Empieza un handshake sobre un socket conectado
+ */
+tls_session_t *tls_session_start(tls_context_t *ctx, int fd, const char *peer_ip)
+{
+    if (!ctx || fd < 0) return NULL;
+
+    tls_session_t *session = calloc(1, sizeof(tls_session_t));
+    if (!session) return NULL;
+
+    session->ctx = ctx;
+    session->fd = fd;
+    session->ssl = SSL_new(ctx->ssl_ctx);
+    if (!session->ssl || SSL_set_fd(session->ssl, fd) != 1) {
+        log_ssl_error("Error creando la sesión TLS");
+        SSL_free(session->ssl);
+        free(session);
+        return NULL;
+    }
+
+    if (ctx->server) {
+        SSL_set_accept_state(session->ssl);
+    } else {
+        SSL_set_connect_state(session->ssl);
+        if (ctx->verify && peer_ip) {
+            X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(session->ssl), peer_ip);
+        }
+
+        pthread_mutex_lock(&ctx->session_lock);
+        if (ctx->last_session) {
+            SSL_set_session(session->ssl, ctx->last_session);
+        }
+        pthread_mutex_unlock(&ctx->session_lock);
+    }
+
+    session->saved_flags = fcntl(fd, F_GETFL, 0);
+    if (session->saved_flags >= 0 && !(session->saved_flags & O_NONBLOCK)) {
+        fcntl(fd, F_SETFL, session->saved_flags | O_NONBLOCK);
+    }
+
+    return session;
+}
+
+/**
+ * @brief Comprueba kTLS y deja el socket listo para texto claro
+ */
+static tls_step_t finish_handshake(tls_session_t *session)
+{
+    SSL *ssl = session->ssl;
+
+    if (!BIO_get_ktls_send(SSL_get_wbio(ssl)) || !BIO_get_ktls_recv(SSL_get_rbio(ssl))) {
+        LOG_ERROR("No se pudo instalar kTLS en el socket %d (cifrado %s)",
+                 session->fd, SSL_get_cipher_name(ssl));
+        return TLS_STEP_FAILED;
+    }
+
+    session->resumed = SSL_session_reused(ssl) == 1;
+
+    if (!session->ctx->server && !session->resumed) {
+        /* Guardar la sesión nueva para las siguientes conexiones */
+        SSL_SESSION *fresh = SSL_get1_session(ssl);
+        pthread_mutex_lock(&session->ctx->session_lock);
+        SSL_SESSION *old = session->ctx->last_session;
+        session->ctx->last_session = fresh;
+        pthread_mutex_unlock(&session->ctx->session_lock);
+        SSL_SESSION_free(old);
+    }
+
+    if (session->saved_flags >= 0) {
+        fcntl(session->fd, F_SETFL, session->saved_flags);
+    }
+    return TLS_STEP_DONE;
+}
+
+/**
+ * @brief Avanza el handshake sin bloquear
+ */
+tls_step_t tls_session_step(tls_session_t *session)
+{
+    if (!session) return TLS_STEP_FAILED;
+
+    ERR_clear_error();
+    errno = 0;
+    int result = SSL_do_handshake(session->ssl);
+    if (result == 1) {
+        return finish_handshake(session);
+    }
+
+    switch (SSL_get_error(session->ssl, result)) {
+        case SSL_ERROR_WANT_READ:
+            return TLS_STEP_WANT_READ;
+        case SSL_ERROR_WANT_WRITE:
+            return TLS_STEP_WANT_WRITE;
+        default:
+            log_ssl_error("Error en el handshake TLS");
+            return TLS_STEP_FAILED;
+    }
+}
+
+/**
+ * @brief Indica si el handshake terminado reanudó una sesión anterior
+ */
+int tls_session_resumed(const tls_session_t *session)
+{
+    return session ? session->resumed : 0;
+}
+
+/**
+ * @brief Libera una sesión
+ *
+ * Con kTLS instalado el socket sigue cifrando sin el objeto SSL; no se
+ * envía close_notify para no escribir fuera del flujo de la aplicación.
+ */
+void tls_session_free(tls_session_t *session)
+{
+    if (!session) return;
+
+    SSL_free(session->ssl);
+    free(session);
+}
+
+/**
+ * @brief Calcula HMAC-SHA256
+ */
+int tls_hmac_sha256(const void *key, size_t key_length, const void *data, size_t data_length,
+                    unsigned char mac[TLS_HMAC_SIZE])
+{
+    unsigned int mac_length = 0;
+
+    if (!HMAC(EVP_sha256(), key, (int)key_length, data, data_length, mac, &mac_length) ||
+        mac_length != TLS_HMAC_SIZE) {
+        log_ssl_error("Error calculando HMAC-SHA256");
+        return -1;
+    }
+    return 0;
+}
+
+#else /* CHAT_NO_TLS */
+
+/* ========== SIN SOPORTE TLS ========== */
+
+tls_context_t *tls_server_create(const char *cert_file, const char *key_file)
+{
+    (void)cert_file;
+    (void)key_file;
+    LOG_ERROR("Compilado sin soporte TLS (NO_TLS=1)");
+    return NULL;
+}
+
+tls_context_t *tls_client_create(const char *ca_file, int verify)
+{
+    (void)ca_file;
+    (void)verify;
+    LOG_ERROR("Compilado sin soporte TLS (NO_TLS=1)");
+    return NULL;
+}
+
+void tls_context_destroy(tls_context_t *ctx)
+{
+    (void)ctx;
+}
+
+tls_session_t *tls_session_start(tls_context_t *ctx, int fd, const char *peer_ip)
+{
+    (void)ctx;
+    (void)fd;
+    (void)peer_ip;
+    return NULL;
+}
+
+tls_step_t tls_session_step(tls_session_t *session)
+{
+    (void)session;
+    return TLS_STEP_FAILED;
+}
+
+int tls_session_resumed(const tls_session_t *session)
+{
+    (void)session;
+    return 0;
+}
+
+void tls_session_free(tls_session_t *session)
+{
+    (void)session;
+}
+
+int tls_hmac_sha256(const void *key, size_t key_length, const void *data, size_t data_length,
+                    unsigned char mac[TLS_HMAC_SIZE])
+{
+    (void)key;
+    (void)key_length;
+    (void)data;
+    (void)data_length;
+    (void)mac;
+    LOG_ERROR("Compilado sin soporte TLS (NO_TLS=1): no hay HMAC-SHA256");
+    return -1;
+}
+
+#endif /* CHAT_NO_TLS */
+
+/**
+ * @brief Handshake completo esperando con poll()
+ */
+int tls_handshake(tls_context_t *ctx, int fd, const char *peer_ip, int timeout_ms, int *resumed)
+{
+    tls_session_t *session = tls_session_start(ctx, fd, peer_ip);
+    if (!session) return -1;
+
+    long long deadline = monotonic_ms() + timeout_ms;
+    tls_step_t step;
+
+    while ((step = tls_session_step(session)) == TLS_STEP_WANT_READ ||
+           step == TLS_STEP_WANT_WRITE) {
+        long long remaining = deadline - monotonic_ms();
+        if (remaining <= 0) {
+            LOG_ERROR("Timeout en el handshake TLS del socket %d", fd);
+            step = TLS_STEP_FAILED;
+            break;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = step == TLS_STEP_WANT_READ ? POLLIN : POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, (int)remaining) < 0 && errno != EINTR) {
+            step = TLS_STEP_FAILED;
+            break;
+        }
+    }
+
+    if (resumed) {
+        *resumed = tls_session_resumed(session);
+    }
+    tls_session_free(session);
+    return step == TLS_STEP_DONE ? 0 : -1;
+}